@@ -83,10 +83,12 @@ extern const char *backend_host;
 extern int backend_port;
 extern int liveweb_port;
 extern int restful_port;
+extern int restful_nthr;
 extern bool skip_skip;
 extern bool init_iploc;
 extern bool want_kbcursor;
 extern bool no_web_touch;
+extern bool incr_map;
 extern const char *init_locip;
 extern int gimbal_trace_level;
 extern time_t usr_datetime;
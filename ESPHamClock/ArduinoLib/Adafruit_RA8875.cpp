@@ -9,8 +9,9 @@
  *   draws to an X11 window.
  *   uses one supporting thread to manage the X11 display connection and input.
  *
- * Both systems use a memory array named fb_canvas as a pixel-by-pixel rendering surface. This is
- * periodically copied to fb_stage on change. _USE_FB0 uses a third copy fb_cursor in which to draw cursor.
+ * Both systems use a memory array named fb_canvas as a pixel-by-pixel rendering surface. The drawing
+ * methods mark each damage cell they change so only those regions are periodically copied to fb_stage
+ * and on to the display. _USE_FB0 uses a third copy fb_cursor in which to draw cursor.
  * FB_X0 and FB_Y0 are the upper left coords on the hardware of drawing area FB_YRES x FB_XRES.
  *
  * Earth map pixels area mmap'd from local day and night files.
@@ -40,6 +41,17 @@
 
 #include "Adafruit_RA8875.h"
 
+#if defined(_USE_X11)
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 
 #ifdef _USE_FB0
 
@@ -146,6 +158,28 @@ Adafruit_RA8875::Adafruit_RA8875(uint8_t CS, uint8_t RST)
         // insure earth map pointers are NULL until set
         DEARTH_BIG = NULL;
         NEARTH_BIG = NULL;
+        earth_tiled = false;
+        dearth_tiled = nearth_tiled = NULL;
+
+        // no display stats yet
+        ds_pixbytes = ds_wirebytes = 0;
+        ds_pix_bps = ds_wire_bps = 0;
+        gettimeofday (&ds_tv0, NULL);
+
+        // everything needs drawing at first
+        memset (dmg_cell, 1, sizeof(dmg_cell));
+        memset (dmg_gen, 0, sizeof(dmg_gen));
+        stage_gen = 0;
+        dmg_nrects = 0;
+
+        // no map layers until asked
+        memset (ml, 0, sizeof(ml));
+        ml_draw = MAPL_NONE;
+
+        // no drawing signatures until asked
+        ds_col = ds_row = NULL;
+        ds_sig = NULL;
+        ds_ncols = ds_ncells = 0;
 
         // not ready until proven
         ready = false;
@@ -154,11 +188,58 @@ Adafruit_RA8875::Adafruit_RA8875(uint8_t CS, uint8_t RST)
         screen_w = screen_h = 0;
 }
 
+/* set the big earth maps, each row-major RGB565, or NULL.
+ * N.B. caller must insure plotEarth() is not running
+ */
 void Adafruit_RA8875::setEarthPix (char *day_pixels, char *night_pixels)
 {
         DEARTH_BIG = (uint16_t(*)[EARTH_BIG_H][EARTH_BIG_W]) day_pixels;
         NEARTH_BIG = (uint16_t(*)[EARTH_BIG_H][EARTH_BIG_W]) night_pixels;
+        buildEarthTiles();
+}
 
+/* set whether plotEarth() uses tiled copies of the earth maps. these keep the pixels near each map
+ * location close in memory too, so projections that sample widely separated map rows for each screen
+ * row touch far fewer cache lines and pages.
+ * N.B. caller must insure plotEarth() is not running
+ */
+void Adafruit_RA8875::setEarthTiled (bool on)
+{
+        earth_tiled = on;
+        buildEarthTiles();
+}
+
+/* (re)build or discard the tiled copies of the earth maps according to earth_tiled.
+ * earth_tiled is turned off if there is not enough memory.
+ */
+void Adafruit_RA8875::buildEarthTiles()
+{
+        free (dearth_tiled);
+        free (nearth_tiled);
+        dearth_tiled = nearth_tiled = NULL;
+        if (!earth_tiled || !DEARTH_BIG || !NEARTH_BIG)
+            return;
+
+        dearth_tiled = (uint16_t *) calloc (EARTH_TILED_N, sizeof(uint16_t));
+        nearth_tiled = (uint16_t *) calloc (EARTH_TILED_N, sizeof(uint16_t));
+        if (!dearth_tiled || !nearth_tiled) {
+            printf ("No memory for tiled earth maps\n");
+            free (dearth_tiled);
+            free (nearth_tiled);
+            dearth_tiled = nearth_tiled = NULL;
+            earth_tiled = false;
+            return;
+        }
+
+        // copy one row of each tile at a time
+        for (int ey = 0; ey < EARTH_BIG_H; ey++) {
+            for (int ex = 0; ex < EARTH_BIG_W; ex += EARTH_TILE) {
+                int n = EARTH_BIG_W - ex < EARTH_TILE ? EARTH_BIG_W - ex : EARTH_TILE;
+                int ti = earthTileIndex (ex, ey);
+                memcpy (&dearth_tiled[ti], &(*DEARTH_BIG)[ey][ex], n*sizeof(uint16_t));
+                memcpy (&nearth_tiled[ti], &(*NEARTH_BIG)[ey][ex], n*sizeof(uint16_t));
+            }
+        }
 }
 
 #if defined(_USE_X11)
@@ -172,6 +253,69 @@ static int myXIOErrorHandler (Display *dpy)
     (void) dpy;
     pthread_exit(NULL);
 }
+
+/* error handler used only while attaching MIT-SHM, which fails if the server is not on this host.
+ */
+static volatile bool shm_failed;
+static int shmErrorHandler (Display *dpy, XErrorEvent *ep)
+{
+    (void) dpy;
+    (void) ep;
+    shm_failed = true;
+    return (0);
+}
+
+/* try to create an XImage for fb_stage in memory shared with the X server so drawCanvas() need not
+ * send the pixels through the connection. return image, with its data as fb_stage, else NULL.
+ */
+XImage *Adafruit_RA8875::createShmImage()
+{
+        XImage *shm_img = XShmCreateImage (display, visual, visdepth, ZPixmap, NULL, &shm_info,
+                                                FB_XRES, FB_YRES);
+        if (!shm_img)
+            return (NULL);
+        if (shm_img->bytes_per_line != FB_XRES*BYTESPFBPIX) {
+            printf ("MIT-SHM row is %d bytes, not %d\n", shm_img->bytes_per_line, FB_XRES*BYTESPFBPIX);
+            XDestroyImage (shm_img);
+            return (NULL);
+        }
+
+        shm_info.shmid = shmget (IPC_PRIVATE, fb_nbytes, IPC_CREAT | 0600);
+        if (shm_info.shmid < 0) {
+            printf ("MIT-SHM shmget(%d): %s\n", fb_nbytes, strerror(errno));
+            XDestroyImage (shm_img);
+            return (NULL);
+        }
+        shm_info.shmaddr = shm_img->data = (char *) shmat (shm_info.shmid, NULL, 0);
+        if (shm_info.shmaddr == (char *)-1) {
+            printf ("MIT-SHM shmat: %s\n", strerror(errno));
+            shmctl (shm_info.shmid, IPC_RMID, NULL);
+            shm_img->data = NULL;
+            XDestroyImage (shm_img);
+            return (NULL);
+        }
+        shm_info.readOnly = True;
+
+        // attach, errors are reported asynchronously so sync to collect them
+        shm_failed = false;
+        XErrorHandler prev_handler = XSetErrorHandler (shmErrorHandler);
+        XShmAttach (display, &shm_info);
+        XSync (display, False);
+        XSetErrorHandler (prev_handler);
+
+        // segment is destroyed as soon as both we and the server detach, even if we crash
+        shmctl (shm_info.shmid, IPC_RMID, NULL);
+
+        if (shm_failed) {
+            printf ("MIT-SHM attach failed\n");
+            shmdt (shm_info.shmaddr);
+            shm_img->data = NULL;
+            XDestroyImage (shm_img);
+            return (NULL);
+        }
+
+        return (shm_img);
+}
 #endif // _USE_X11
 
 bool Adafruit_RA8875::begin (int not_used)
@@ -226,6 +370,10 @@ bool Adafruit_RA8875::begin (int not_used)
             printf ("fb_lock: %s\n", strerror(errno));
             exit(1);
         }
+        if (pthread_cond_init (&stage_cv, NULL)) {
+            printf ("stage_cv: %s\n", strerror(errno));
+            exit(1);
+        }
 
         // start with default font
         current_font = &Courier_Prime_Sans6pt7b;
@@ -304,18 +452,28 @@ bool Adafruit_RA8875::begin (int not_used)
 	}
 	memset (fb_canvas, 0, fb_nbytes);       // black
 
-	// get memory for the staging area used to find dirty pixels
-	fb_stage = (fbpix_t *) malloc (fb_nbytes);
-	if (!fb_stage) {
-	    printf ("Can not malloc(%d) for stage\n", fb_nbytes);
-	    exit(1);
-	}
+	// create XImage using staging area, in memory shared with the server if possible
+        img = NULL;
+        use_shm = false;
+        if (XShmQueryExtension (display)) {
+            img = createShmImage();
+            if (img) {
+                fb_stage = (fbpix_t *) img->data;
+                use_shm = true;
+            }
+        }
+        printf ("X11 display updates %s MIT-SHM\n", use_shm ? "using" : "without");
+        if (!img) {
+            fb_stage = (fbpix_t *) malloc (fb_nbytes);
+            if (!fb_stage) {
+                printf ("Can not malloc(%d) for stage\n", fb_nbytes);
+                exit(1);
+            }
+            img = XCreateImage(display, visual, visdepth, ZPixmap, 0, (char*)fb_stage, FB_XRES, FB_YRES,
+                    BITSPFBPIX, 0);
+        }
 	memset (fb_stage, 1, fb_nbytes);        // unlikely color
 
-	// create XImage using staging area
-	img = XCreateImage(display, visual, visdepth, ZPixmap, 0, (char*)fb_stage, FB_XRES, FB_YRES,
-                BITSPFBPIX, 0);
-
 	// create window with initial size, user might resize later
 	XSetWindowAttributes wa;
 	wa.bit_gravity = StaticGravity;
@@ -382,6 +540,10 @@ bool Adafruit_RA8875::begin (int not_used)
 	    printf ("fb_lock: %s\n", strerror(errno));
 	    exit(1);
 	}
+	if (pthread_cond_init (&stage_cv, NULL)) {
+	    printf ("stage_cv: %s\n", strerror(errno));
+	    exit(1);
+	}
 
 	// start with default font
 	current_font = &Courier_Prime_Sans6pt7b;
@@ -505,6 +667,10 @@ bool Adafruit_RA8875::begin (int not_used)
 	    close(fb_fd);
 	    exit(1);
 	}
+	if (pthread_cond_init (&stage_cv, NULL)) {
+	    printf ("stage_cv: %s\n", strerror(errno));
+	    exit(1);
+	}
 
 	// start with default font
 	current_font = &Courier_Prime_Sans6pt7b;
@@ -695,23 +861,232 @@ uint16_t Adafruit_RA8875::readData(void)
 	}
 }
 
-/* return pixels as packed RGB bytes
+#if defined(__SSE2__)
+
+/* store 4 pixels, each 32 bits with bytes R G B 0, as 12 packed RGB bytes at rgb24.
+ * N.B. 16 bytes are written so there must be room for 4 more after those 12
  */
-bool Adafruit_RA8875::getRawPix(uint8_t *rgb24, int npix)
+static inline void storeRGB24x4 (__m128i rgb0, uint8_t *rgb24)
 {
-        if (npix != FB_XRES * FB_YRES) {
-            printf ("getRawPix: %d != %d\n", npix, FB_XRES * FB_YRES);
-            return (false);
+        // pack each pair into the low 6 bytes of its 64 bit half, then join the halves
+        const __m128i lo3 = _mm_set1_epi64x (0x0000000000FFFFFFLL);
+        const __m128i lo6 = _mm_set_epi64x (0, 0x0000FFFFFFFFFFFFLL);
+        __m128i pairs = _mm_or_si128 (_mm_and_si128 (rgb0, lo3), _mm_slli_epi64 (_mm_srli_epi64 (rgb0, 32), 24));
+        __m128i all = _mm_or_si128 (_mm_and_si128 (pairs, lo6), _mm_slli_si128 (_mm_srli_si128 (pairs, 8), 6));
+        _mm_storeu_si128 ((__m128i *)rgb24, all);
+}
+
+#endif
+
+/* convert n fb pixels to packed RGB bytes, 8 or more at a time if we have SIMD.
+ */
+void Adafruit_RA8875::fbPixToRGB24 (const fbpix_t *pix, int n, uint8_t *rgb24)
+{
+        int i = 0;
+
+#if defined(_16BIT_FB)
+
+  #if defined(__SSE2__)
+
+        // leave at least 2 for scalar so the 4 bytes past the last store are still ours
+        const __m128i m8 = _mm_set1_epi16 (0xF8);
+        const __m128i m6 = _mm_set1_epi16 (0xFC);
+        for (; i + 10 <= n; i += 8, rgb24 += 24) {
+            __m128i p = _mm_loadu_si128 ((const __m128i *)(pix + i));
+            __m128i r = _mm_and_si128 (_mm_srli_epi16 (p, 8), m8);
+            __m128i g = _mm_and_si128 (_mm_srli_epi16 (p, 3), m6);
+            __m128i b = _mm_and_si128 (_mm_slli_epi16 (p, 3), m8);
+            __m128i rg = _mm_or_si128 (r, _mm_slli_epi16 (g, 8));
+            storeRGB24x4 (_mm_unpacklo_epi16 (rg, b), rgb24);
+            storeRGB24x4 (_mm_unpackhi_epi16 (rg, b), rgb24 + 12);
+        }
+
+  #elif defined(__ARM_NEON)
+
+        const uint8x8_t m8 = vdup_n_u8 (0xF8);
+        const uint8x8_t m6 = vdup_n_u8 (0xFC);
+        for (; i + 8 <= n; i += 8, rgb24 += 24) {
+            uint16x8_t p = vld1q_u16 (pix + i);
+            uint8x8x3_t rgb;
+            rgb.val[0] = vand_u8 (vshrn_n_u16 (p, 8), m8);
+            rgb.val[1] = vand_u8 (vshrn_n_u16 (p, 3), m6);
+            rgb.val[2] = vshl_n_u8 (vmovn_u16 (p), 3);
+            vst3_u8 (rgb24, rgb);
+        }
+
+  #endif
+
+#else // 32 bit fb
+
+  #if defined(__SSE2__)
+
+        // swap R and B within each pixel.
+        // leave at least 2 for scalar so the 4 bytes past the last store are still ours
+        const __m128i mg = _mm_set1_epi32 (0x0000FF00);
+        const __m128i m8 = _mm_set1_epi32 (0x000000FF);
+        for (; i + 10 <= n; i += 8, rgb24 += 24) {
+            for (int j = 0; j < 8; j += 4) {
+                __m128i p = _mm_loadu_si128 ((const __m128i *)(pix + i + j));
+                __m128i rgb0 = _mm_or_si128 (_mm_and_si128 (p, mg),
+                                _mm_or_si128 (_mm_and_si128 (_mm_srli_epi32 (p, 16), m8),
+                                              _mm_slli_epi32 (_mm_and_si128 (p, m8), 16)));
+                storeRGB24x4 (rgb0, rgb24 + 3*j);
+            }
         }
-        for (int i = 0; i < npix; i++) {
-            uint32_t p32 = FBPIXTORGB32(fb_stage[i]);
+
+  #elif defined(__ARM_NEON)
+
+        // little endian pixels are B G R A in memory
+        for (; i + 16 <= n; i += 16, rgb24 += 48) {
+            uint8x16x4_t bgra = vld4q_u8 ((const uint8_t *)(pix + i));
+            uint8x16x3_t rgb;
+            rgb.val[0] = bgra.val[2];
+            rgb.val[1] = bgra.val[1];
+            rgb.val[2] = bgra.val[0];
+            vst3q_u8 (rgb24, rgb);
+        }
+
+  #endif
+
+#endif // _16BIT_FB
+
+        // scalar for all the rest
+        for (; i < n; i++) {
+            uint32_t p32 = FBPIXTORGB32(pix[i]);
             *rgb24++ = p32 >> 16;
             *rgb24++ = p32 >> 8;
             *rgb24++ = p32;
         }
+}
+
+/* convert n fb pixels to RGB565, 8 or more at a time if we have SIMD.
+ */
+void Adafruit_RA8875::fbPixToRGB565 (const fbpix_t *pix, int n, uint16_t *rgb565)
+{
+#if defined(_16BIT_FB)
+
+        memcpy (rgb565, pix, n * sizeof(uint16_t));
+
+#else // 32 bit fb
+
+        int i = 0;
+
+  #if defined(__SSE2__)
+
+        // SSE2 can only pack 32 to 16 bits with signed saturation so offset to fit then restore
+        const __m128i mr = _mm_set1_epi32 (0xF800);
+        const __m128i mg = _mm_set1_epi32 (0x07E0);
+        const __m128i mb = _mm_set1_epi32 (0x001F);
+        const __m128i off32 = _mm_set1_epi32 (0x8000);
+        const __m128i off16 = _mm_set1_epi16 ((short)0x8000);
+        for (; i + 8 <= n; i += 8) {
+            __m128i c[2];
+            for (int j = 0; j < 2; j++) {
+                __m128i p = _mm_loadu_si128 ((const __m128i *)(pix + i + 4*j));
+                c[j] = _mm_sub_epi32 (_mm_or_si128 (_mm_and_si128 (_mm_srli_epi32 (p, 8), mr),
+                                      _mm_or_si128 (_mm_and_si128 (_mm_srli_epi32 (p, 5), mg),
+                                                    _mm_and_si128 (_mm_srli_epi32 (p, 3), mb))), off32);
+            }
+            _mm_storeu_si128 ((__m128i *)(rgb565 + i), _mm_xor_si128 (_mm_packs_epi32 (c[0], c[1]), off16));
+        }
+
+  #elif defined(__ARM_NEON)
+
+        // little endian pixels are B G R A in memory
+        const uint8x8_t m8 = vdup_n_u8 (0xF8);
+        const uint8x8_t m6 = vdup_n_u8 (0xFC);
+        for (; i + 16 <= n; i += 16) {
+            uint8x16x4_t bgra = vld4q_u8 ((const uint8_t *)(pix + i));
+            uint16x8_t lo = vorrq_u16 (vorrq_u16 (vshll_n_u8 (vand_u8 (vget_low_u8 (bgra.val[2]), m8), 8),
+                                                  vshll_n_u8 (vand_u8 (vget_low_u8 (bgra.val[1]), m6), 3)),
+                                       vmovl_u8 (vshr_n_u8 (vget_low_u8 (bgra.val[0]), 3)));
+            uint16x8_t hi = vorrq_u16 (vorrq_u16 (vshll_n_u8 (vand_u8 (vget_high_u8 (bgra.val[2]), m8), 8),
+                                                  vshll_n_u8 (vand_u8 (vget_high_u8 (bgra.val[1]), m6), 3)),
+                                       vmovl_u8 (vshr_n_u8 (vget_high_u8 (bgra.val[0]), 3)));
+            vst1q_u16 (rgb565 + i, lo);
+            vst1q_u16 (rgb565 + i + 8, hi);
+        }
+
+  #endif
+
+        // scalar for all the rest
+        for (; i < n; i++)
+            rgb565[i] = FBPIXTORGB16(pix[i]);
+
+#endif // _16BIT_FB
+}
+
+/* return whether the given fb region is entirely within the frame buffer, else say why not.
+ */
+static bool fbRegionOk (int x, int y, int w, int h)
+{
+        if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > FB_XRES || y + h > FB_YRES) {
+            printf ("getRegion: %d x %d + %d + %d is not within %d x %d\n", w, h, x, y, FB_XRES, FB_YRES);
+            return (false);
+        }
+        return (true);
+}
+
+/* copy the given fb region of what is being displayed to pix, w*h native pixels packed row by row.
+ * return false if region is not entirely within the frame buffer.
+ */
+bool Adafruit_RA8875::getRegionPix (int x, int y, int w, int h, fbpix_t *pix)
+{
+        if (!fbRegionOk (x, y, w, h))
+            return (false);
+
+	pthread_mutex_lock (&fb_lock);
+            if (x == 0 && w == FB_XRES)
+                memcpy (pix, &fb_stage[y*FB_XRES], w*h*BYTESPFBPIX);
+            else
+                for (int r = 0; r < h; r++)
+                    memcpy (pix + r*w, &fb_stage[(y+r)*FB_XRES + x], w*BYTESPFBPIX);
+	pthread_mutex_unlock (&fb_lock);
+
+        return (true);
+}
+
+/* same as getRegionPix but converted to packed RGB bytes.
+ */
+bool Adafruit_RA8875::getRegionRGB24 (int x, int y, int w, int h, uint8_t *rgb24)
+{
+        if (!fbRegionOk (x, y, w, h))
+            return (false);
+
+	pthread_mutex_lock (&fb_lock);
+            for (int r = 0; r < h; r++)
+                fbPixToRGB24 (&fb_stage[(y+r)*FB_XRES + x], w, rgb24 + 3*r*w);
+	pthread_mutex_unlock (&fb_lock);
+
+        return (true);
+}
+
+/* same as getRegionPix but converted to RGB565.
+ */
+bool Adafruit_RA8875::getRegionRGB565 (int x, int y, int w, int h, uint16_t *rgb565)
+{
+        if (!fbRegionOk (x, y, w, h))
+            return (false);
+
+	pthread_mutex_lock (&fb_lock);
+            for (int r = 0; r < h; r++)
+                fbPixToRGB565 (&fb_stage[(y+r)*FB_XRES + x], w, rgb565 + r*w);
+	pthread_mutex_unlock (&fb_lock);
+
         return (true);
 }
 
+/* return all pixels as packed RGB bytes
+ */
+bool Adafruit_RA8875::getRawPix(uint8_t *rgb24, int npix)
+{
+        if (npix != FB_XRES * FB_YRES) {
+            printf ("getRawPix: %d != %d\n", npix, FB_XRES * FB_YRES);
+            return (false);
+        }
+        return (getRegionRGB24 (0, 0, FB_XRES, FB_YRES, rgb24));
+}
+
 void Adafruit_RA8875::setFont (const GFXfont *f)
 {
 	if (f)
@@ -907,6 +1282,8 @@ void Adafruit_RA8875::setMouse (int x, int y)
             gettimeofday (&mouse_tv, NULL);
 
         pthread_mutex_unlock(&mouse_lock);
+
+        wakeLoop();
 }
 
 
@@ -1520,70 +1897,290 @@ void Adafruit_RA8875::plotfb (int16_t x, int16_t y, fbpix_t color)
         int index = y*FB_XRES + x;
         if (index < 0 || index >= FB_XRES*FB_YRES)
             printf ("no! %d %d\n", x, y);
-        else
+        else {
+            // within the map layer box either draw on the current layer or the canvas now owns this pixel
+            unsigned lx = x - ml_x, ly = y - ml_y;  // rely on unsigned wrap to catch < ml_x,y
+            if (ml[MAPL_BASE].pix && lx < (unsigned)ml_w && ly < (unsigned)ml_h) {
+                int li = ly*ml_w + lx;
+                if (ml_draw != MAPL_NONE && (ml[ml_draw].pix || newLayerPix (ml[ml_draw]))) {
+                    MapLayerInfo &l = ml[ml_draw];
+                    if (color == LAYER_CLEAR)
+                        color ^= 1;
+                    l.pix[li] = color;
+                    if (x < l.x0) l.x0 = x;
+                    if (x > l.x1) l.x1 = x;
+                    if (y < l.y0) l.y0 = y;
+                    if (y > l.y1) l.y1 = y;
+                    l.sig += ((uint32_t)index * 2654435761U) ^ (uint32_t)color;
+                    l.dirty = true;
+                    return;
+                }
+                ml[MAPL_BASE].pix[li] = LAYER_CLEAR;
+            }
+
             fb_canvas[index] = color;
+            dmg_cell[(index/FB_XRES)/DMG_CELL][(index%FB_XRES)/DMG_CELL] = 1;
+            if (ds_sig && x >= 0 && x < FB_XRES) {
+                int col = ds_col[x], row = ds_row[y];
+                if (col >= 0 && row >= 0)
+                    ds_sig[row*ds_ncols + col] += ((uint32_t)index * 2654435761U) ^ (uint32_t)color;
+            }
+        }
+}
+
+#if !defined(_16BIT_FB) && !defined(B_AND_W)
+
+/* RGB1632() of each of 4 RGB565 pixels held in 32 bit lanes
+ */
+#if defined(__SSE2__)
+static inline __m128i rgb1632x4 (__m128i p)
+{
+        return (_mm_or_si128 (_mm_slli_epi32 (_mm_and_si128 (p, _mm_set1_epi32 (0xF800)), 8),
+                _mm_or_si128 (_mm_slli_epi32 (_mm_and_si128 (p, _mm_set1_epi32 (0x07E0)), 5),
+                              _mm_slli_epi32 (_mm_and_si128 (p, _mm_set1_epi32 (0x001F)), 3))));
+}
+#elif defined(__ARM_NEON)
+static inline uint32x4_t rgb1632x4 (uint32x4_t p)
+{
+        return (vorrq_u32 (vshlq_n_u32 (vandq_u32 (p, vdupq_n_u32 (0xF800)), 8),
+                vorrq_u32 (vshlq_n_u32 (vandq_u32 (p, vdupq_n_u32 (0x07E0)), 5),
+                           vshlq_n_u32 (vandq_u32 (p, vdupq_n_u32 (0x001F)), 3))));
+}
+#endif
+
+#endif // !_16BIT_FB && !B_AND_W
+
+/* blend n RGB565 day and night pixels to fb pixels in out. fract is the day weight of each, 0 .. 256.
+ * done in fixed point on the RGB565 components directly, 8 at a time if we have SIMD including the
+ * conversion to fb pixels.
+ */
+static void blendEarthPix (const uint16_t *day, const uint16_t *night, const uint16_t *fract,
+fbpix_t *out, int n)
+{
+        int i = 0;
+
+#if defined(__SSE2__)
+
+        const __m128i m6 = _mm_set1_epi16 (0x3F);
+        const __m128i m5 = _mm_set1_epi16 (0x1F);
+        const __m128i one = _mm_set1_epi16 (256);
+        for (; i + 8 <= n; i += 8) {
+            __m128i d = _mm_loadu_si128 ((const __m128i *)(day + i));
+            __m128i m = _mm_loadu_si128 ((const __m128i *)(night + i));
+            __m128i fd = _mm_loadu_si128 ((const __m128i *)(fract + i));
+            __m128i fn = _mm_sub_epi16 (one, fd);
+
+            // each product fits in 16 bits because components are at most 6 bits and weights 9 bits
+            __m128i r = _mm_srli_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (_mm_srli_epi16 (d, 11), fd),
+                                                       _mm_mullo_epi16 (_mm_srli_epi16 (m, 11), fn)), 8);
+            __m128i g = _mm_srli_epi16 (_mm_add_epi16 (
+                                _mm_mullo_epi16 (_mm_and_si128 (_mm_srli_epi16 (d, 5), m6), fd),
+                                _mm_mullo_epi16 (_mm_and_si128 (_mm_srli_epi16 (m, 5), m6), fn)), 8);
+            __m128i b = _mm_srli_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (_mm_and_si128 (d, m5), fd),
+                                                       _mm_mullo_epi16 (_mm_and_si128 (m, m5), fn)), 8);
+            __m128i c16 = _mm_or_si128 (_mm_slli_epi16 (r, 11), _mm_or_si128 (_mm_slli_epi16 (g, 5), b));
+
+        #if defined(_16BIT_FB)
+            _mm_storeu_si128 ((__m128i *)(out + i), c16);
+        #elif !defined(B_AND_W)
+            const __m128i zero = _mm_setzero_si128 ();
+            _mm_storeu_si128 ((__m128i *)(out + i), rgb1632x4 (_mm_unpacklo_epi16 (c16, zero)));
+            _mm_storeu_si128 ((__m128i *)(out + i + 4), rgb1632x4 (_mm_unpackhi_epi16 (c16, zero)));
+        #else
+            uint16_t t16[8];
+            _mm_storeu_si128 ((__m128i *)t16, c16);
+            for (int j = 0; j < 8; j++)
+                out[i+j] = RGB16TOFBPIX(t16[j]);
+        #endif
+        }
+
+#elif defined(__ARM_NEON)
+
+        const uint16x8_t m6 = vdupq_n_u16 (0x3F);
+        const uint16x8_t m5 = vdupq_n_u16 (0x1F);
+        const uint16x8_t one = vdupq_n_u16 (256);
+        for (; i + 8 <= n; i += 8) {
+            uint16x8_t d = vld1q_u16 (day + i);
+            uint16x8_t m = vld1q_u16 (night + i);
+            uint16x8_t fd = vld1q_u16 (fract + i);
+            uint16x8_t fn = vsubq_u16 (one, fd);
+
+            // each product fits in 16 bits because components are at most 6 bits and weights 9 bits
+            uint16x8_t r = vshrq_n_u16 (vmlaq_u16 (vmulq_u16 (vshrq_n_u16 (d, 11), fd),
+                                                   vshrq_n_u16 (m, 11), fn), 8);
+            uint16x8_t g = vshrq_n_u16 (vmlaq_u16 (vmulq_u16 (vandq_u16 (vshrq_n_u16 (d, 5), m6), fd),
+                                                   vandq_u16 (vshrq_n_u16 (m, 5), m6), fn), 8);
+            uint16x8_t b = vshrq_n_u16 (vmlaq_u16 (vmulq_u16 (vandq_u16 (d, m5), fd),
+                                                   vandq_u16 (m, m5), fn), 8);
+            uint16x8_t c16 = vorrq_u16 (vshlq_n_u16 (r, 11), vorrq_u16 (vshlq_n_u16 (g, 5), b));
+
+        #if defined(_16BIT_FB)
+            vst1q_u16 (out + i, c16);
+        #elif !defined(B_AND_W)
+            vst1q_u32 (out + i, rgb1632x4 (vmovl_u16 (vget_low_u16 (c16))));
+            vst1q_u32 (out + i + 4, rgb1632x4 (vmovl_u16 (vget_high_u16 (c16))));
+        #else
+            uint16_t t16[8];
+            vst1q_u16 (t16, c16);
+            for (int j = 0; j < 8; j++)
+                out[i+j] = RGB16TOFBPIX(t16[j]);
+        #endif
+        }
+
+#endif
+
+        // scalar for all the rest
+        for (; i < n; i++) {
+            uint16_t d = day[i], m = night[i];
+            uint16_t fd = fract[i], fn = 256 - fd;
+            uint16_t r = (((d >> 11)        * fd) + ((m >> 11)        * fn)) >> 8;
+            uint16_t g = ((((d >> 5) & 0x3F) * fd) + (((m >> 5) & 0x3F) * fn)) >> 8;
+            uint16_t b = (((d & 0x1F)        * fd) + ((m & 0x1F)        * fn)) >> 8;
+            out[i] = RGB16TOFBPIX((r << 11) | (g << 5) | b);
+        }
 }
 
 /* plot hi res earth lat0,lng0 at app's screen location x0,y0.
  * we interpolate this to SCALESZxSCALESZ, knowing dlat and dlng going one full step right and down.
- * frac_day is 1 for all DEARTH, 0 for all NEARTH else blend
+ * fract_day is 1 for all DEARTH, 0 for all NEARTH else blend; it too is interpolated to each subpixel
+ * using dfractr and dfractd, the change going one full step right and down.
  */
 void Adafruit_RA8875::plotEarth (uint16_t x0, uint16_t y0, float lat0, float lng0,
-float dlatr, float dlngr, float dlatd, float dlngd, float fract_day)
+float dlatr, float dlngr, float dlatd, float dlngd, float fract_day, float dfractr, float dfractd)
+{
+        EarthPt pt;
+        pt.lat0 = lat0;
+        pt.lng0 = lng0;
+        pt.dlatr = dlatr;
+        pt.dlngr = dlngr;
+        pt.dlatd = dlatd;
+        pt.dlngd = dlngd;
+        pt.fract_day = fract_day;
+        pt.dfractr = dfractr;
+        pt.dfractd = dfractd;
+        plotEarthRow (x0, y0, &pt, 1);
+}
+
+/* plot the n hi res earth points in pts at app's screen locations x0,y0 across to the right, each just as
+ * plotEarth() would. each full res row of the run is blended in one pass so long runs use SIMD throughout.
+ */
+void Adafruit_RA8875::plotEarthRow (uint16_t x0, uint16_t y0, const EarthPt *pts, int n)
 {
         // beware of no map files
         if (!DEARTH_BIG || !NEARTH_BIG)
             return;
 
-        // beware lng wrap across date line
-        if (dlngr < -180) dlngr += 360;
-        if (dlngd < -180) dlngd += 360;
-        if (dlngr >  180) dlngr -= 360;
-        if (dlngd >  180) dlngd -= 360;
+        // long runs are done in passes of at most PE_MAXW app pixels
+        #define PE_MAXS (FB_XRES/APP_WIDTH)                     // max SCALESZ
+        #define PE_MAXW 128                                     // max app pixels per pass
+        #define PE_MAXN (PE_MAXW*PE_MAXS*PE_MAXS)               // max fb pixels per pass
+        for (int n_done = 0, m; n_done < n; n_done += m) {
+            m = n - n_done < PE_MAXW ? n - n_done : PE_MAXW;
+            const int w = m * SCALESZ;                          // fb pixels in each row of this pass
+            const int fx0 = (x0 + n_done) * SCALESZ;            // fb coords of upper left
+            const int fy0 = y0 * SCALESZ;
+
+            // find map pixel index and fixed point day fraction at each subpixel, row by row
+            bool tiled = dearth_tiled != NULL;
+            const uint16_t *day_pix = tiled ? dearth_tiled : &(*DEARTH_BIG)[0][0];
+            const uint16_t *night_pix = tiled ? nearth_tiled : &(*NEARTH_BIG)[0][0];
+            int pix_i[PE_MAXN];
+            uint16_t fract[PE_MAXN];
+            uint16_t min_f[PE_MAXS], max_f[PE_MAXS];
+            for (int r = 0; r < SCALESZ; r++) {
+                min_f[r] = 256;
+                max_f[r] = 0;
+            }
+            for (int j = 0; j < m; j++) {
+                const EarthPt &p = pts[n_done + j];
+
+                // beware lng wrap across date line
+                float dlngr = p.dlngr, dlngd = p.dlngd;
+                if (dlngr < -180) dlngr += 360;
+                if (dlngd < -180) dlngd += 360;
+                if (dlngr >  180) dlngr -= 360;
+                if (dlngd >  180) dlngd -= 360;
+
+                // scale app step size to our step size
+                float dlatr = p.dlatr/SCALESZ;
+                float dlatd = p.dlatd/SCALESZ;
+                float dfractr = p.dfractr/SCALESZ;
+                float dfractd = p.dfractd/SCALESZ;
+                dlngr /= SCALESZ;
+                dlngd /= SCALESZ;
+
+                for (int r = 0; r < SCALESZ; r++) {
+                    int k = r*w + j*SCALESZ;
+                    for (int c = 0; c < SCALESZ; c++, k++) {
+                        float lat = p.lat0 + dlatr*c + dlatd*r;
+                        float lng = p.lng0 + dlngr*c + dlngd*r;
+                        int ex = (int)((lng+180)*EARTH_BIG_W/360 + EARTH_BIG_W + 0.5F);
+                        int ey = (int)((90-lat)*EARTH_BIG_H/180 + EARTH_BIG_H + 0.5F);
+                        ex = (ex + EARTH_BIG_W) % EARTH_BIG_W;
+                        ey = (ey + EARTH_BIG_H) % EARTH_BIG_H;
+                        pix_i[k] = tiled ? earthTileIndex (ex, ey) : ey*EARTH_BIG_W + ex;
+                        float f = p.fract_day + dfractr*c + dfractd*r;
+                        uint16_t f16 = f <= 0 ? 0 : (f >= 1 ? 256 : (uint16_t)(256*f + 0.5F));
+                        if (f16 < min_f[r])
+                            min_f[r] = f16;
+                        if (f16 > max_f[r])
+                            max_f[r] = f16;
+                        fract[k] = f16;
+                    }
+                }
+            }
+
+            // render each row, blending all of it in one call if any twilight
+            fbpix_t block[PE_MAXN];
+            for (int r = 0; r < SCALESZ; r++) {
+                const int *ip = &pix_i[r*w];
+                fbpix_t *bp = &block[r*w];
+                if (min_f[r] == 256) {
+                    for (int i = 0; i < w; i++)
+                        bp[i] = RGB16TOFBPIX(day_pix[ip[i]]);
+                } else if (max_f[r] == 0) {
+                    for (int i = 0; i < w; i++)
+                        bp[i] = RGB16TOFBPIX(night_pix[ip[i]]);
+                } else {
+                    uint16_t day[PE_MAXW*PE_MAXS], night[PE_MAXW*PE_MAXS];
+                    for (int i = 0; i < w; i++) {
+                        day[i] = day_pix[ip[i]];
+                        night[i] = night_pix[ip[i]];
+                    }
+                    blendEarthPix (day, night, &fract[r*w], bp, w);
+                }
+            }
+
+            // copy to canvas, or to base layer then canvas with any layers on top.
+            // N.B. map workers call us while the main thread draws too, so only the above is done unlocked
+            pthread_mutex_lock (&fb_lock);
 
-        // scale app step size to our step size
-        dlatr /= SCALESZ;
-        dlngr /= SCALESZ;
-        dlatd /= SCALESZ;
-        dlngd /= SCALESZ;
+                fbpix_t *bp = block;
+                unsigned lx = fx0 - ml_x, ly = fy0 - ml_y;
+                if (!ml[MAPL_BASE].pix || lx + w > (unsigned)ml_w || ly + SCALESZ > (unsigned)ml_h) {
+                    for (int r = 0; r < SCALESZ; r++, bp += w)
+                        memcpy (&fb_canvas[(fy0+r)*FB_XRES + fx0], bp, w*sizeof(fbpix_t));
+                } else {
+                    for (int r = 0; r < SCALESZ; r++) {
+                        fbpix_t *canvas_p = &fb_canvas[(fy0+r)*FB_XRES + fx0];
+                        int li = (ly+r)*ml_w + lx;
+                        for (int c = 0; c < w; c++, li++) {
+                            fbpix_t color = *bp++;
+                            if (color == LAYER_CLEAR)
+                                color ^= 1;
+                            ml[MAPL_BASE].pix[li] = color;
+                            canvas_p[c] = topLayerPix (li);
+                        }
+                    }
+                }
 
-        // ditto starting loc
-	x0 *= SCALESZ;
-	y0 *= SCALESZ;
+                // rows are always within one row of damage cells
+                for (int c = fx0/DMG_CELL; c <= (fx0+w-1)/DMG_CELL; c++)
+                    dmg_cell[fy0/DMG_CELL][c] = 1;
+                fb_dirty = true;
 
-	for (int r = 0; r < SCALESZ; r++) {
-	    fbpix_t *frow = &fb_canvas[(y0+r)*FB_XRES + x0];
-	    for (int c = 0; c < SCALESZ; c++) {
-                float lat = lat0 + dlatr*c + dlatd*r;
-                float lng = lng0 + dlngr*c + dlngd*r;
-                int ex = (int)((lng+180)*EARTH_BIG_W/360 + EARTH_BIG_W + 0.5F);
-                int ey = (int)((90-lat)*EARTH_BIG_H/180 + EARTH_BIG_H + 0.5F);
-                ex = (ex + EARTH_BIG_W) % EARTH_BIG_W;
-                ey = (ey + EARTH_BIG_H) % EARTH_BIG_H;
-		uint16_t c16; 
-		if (fract_day == 0) {
-		    c16 = (*NEARTH_BIG)[ey][ex];
-		} else if (fract_day == 1) {
-		    c16 = (*DEARTH_BIG)[ey][ex];
-		} else {
-		    // blend from day to night
-		    uint16_t day_pix = (*DEARTH_BIG)[ey][ex];
-		    uint16_t night_pix = (*NEARTH_BIG)[ey][ex];
-		    uint8_t day_r = RGB565_R(day_pix);
-		    uint8_t day_g = RGB565_G(day_pix);
-		    uint8_t day_b = RGB565_B(day_pix);
-		    uint8_t night_r = RGB565_R(night_pix);
-		    uint8_t night_g = RGB565_G(night_pix);
-		    uint8_t night_b = RGB565_B(night_pix);
-		    float fract_night = 1 - fract_day;
-		    uint8_t twi_r = (fract_day*day_r + fract_night*night_r);
-		    uint8_t twi_g = (fract_day*day_g + fract_night*night_g);
-		    uint8_t twi_b = (fract_day*day_b + fract_night*night_b);
-		    c16 = RGB565 (twi_r, twi_g, twi_b);
-		}
-		*frow++ = RGB16TOFBPIX(c16);
-	    }
-	}
+            pthread_mutex_unlock (&fb_lock);
+        }
 }
 
 void Adafruit_RA8875::plotChar (char ch)
@@ -1623,6 +2220,443 @@ void Adafruit_RA8875::setPR (uint16_t x, uint16_t y, uint16_t w, uint16_t h)
         }
 }
 
+/* mark all damage cells touching the given inclusive fb box as changed.
+ * N.B. we assume caller holds fb_lock
+ */
+void Adafruit_RA8875::damageBox (int x0, int y0, int x1, int y1)
+{
+        if (x0 < 0) x0 = 0;
+        if (y0 < 0) y0 = 0;
+        if (x1 >= FB_XRES) x1 = FB_XRES-1;
+        if (y1 >= FB_YRES) y1 = FB_YRES-1;
+        for (int r = y0/DMG_CELL; r <= y1/DMG_CELL; r++)
+            for (int c = x0/DMG_CELL; c <= x1/DMG_CELL; c++)
+                dmg_cell[r][c] = 1;
+}
+
+/* mark the entire canvas as changed
+ */
+void Adafruit_RA8875::damageAll()
+{
+	pthread_mutex_lock (&fb_lock);
+            memset (dmg_cell, 1, sizeof(dmg_cell));
+            fb_dirty = true;
+	pthread_mutex_unlock (&fb_lock);
+}
+
+/* add r to dmg_rects, extending the previous one if r is just below it with the same width,
+ * else merging it with whichever grows the least if already full.
+ */
+void Adafruit_RA8875::addDmgRect (const DmgRect &r)
+{
+        if (dmg_nrects > 0) {
+            DmgRect &p = dmg_rects[dmg_nrects-1];
+            if (p.x == r.x && p.w == r.w && p.y + p.h == r.y) {
+                p.h += r.h;
+                return;
+            }
+        }
+
+        if (dmg_nrects < DMG_MAXRECTS) {
+            dmg_rects[dmg_nrects++] = r;
+            return;
+        }
+
+        int best_i = 0;
+        long best_grow = 0;
+        for (int i = 0; i < dmg_nrects; i++) {
+            DmgRect &p = dmg_rects[i];
+            int x0 = p.x < r.x ? p.x : r.x;
+            int y0 = p.y < r.y ? p.y : r.y;
+            int x1 = p.x + p.w > r.x + r.w ? p.x + p.w : r.x + r.w;
+            int y1 = p.y + p.h > r.y + r.h ? p.y + p.h : r.y + r.h;
+            long grow = (long)(x1-x0)*(y1-y0) - (long)p.w*p.h;
+            if (i == 0 || grow < best_grow) {
+                best_i = i;
+                best_grow = grow;
+            }
+        }
+        DmgRect &p = dmg_rects[best_i];
+        int x1 = p.x + p.w > r.x + r.w ? p.x + p.w : r.x + r.w;
+        int y1 = p.y + p.h > r.y + r.h ? p.y + p.h : r.y + r.h;
+        if (r.x < p.x) p.x = r.x;
+        if (r.y < p.y) p.y = r.y;
+        p.w = x1 - p.x;
+        p.h = y1 - p.y;
+}
+
+/* gather the changed cells into dmg_rects and mark them all unchanged, plus the protected region if
+ * pr_draw. each row of cells contributes one rectangle spanning its changed cells.
+ * N.B. we assume caller holds fb_lock
+ */
+void Adafruit_RA8875::collectDamage()
+{
+        dmg_nrects = 0;
+
+        for (int r = 0; r < DMG_NROWS; r++) {
+            int c0 = -1, c1 = -1;
+            for (int c = 0; c < DMG_NCOLS; c++) {
+                if (__atomic_exchange_n (&dmg_cell[r][c], 0, __ATOMIC_ACQUIRE)) {
+                    if (c0 < 0)
+                        c0 = c;
+                    c1 = c;
+                }
+            }
+            if (c0 >= 0) {
+                DmgRect dr;
+                dr.x = c0*DMG_CELL;
+                dr.y = r*DMG_CELL;
+                dr.w = (c1-c0+1)*DMG_CELL;
+                dr.h = DMG_CELL;
+                if (dr.x + dr.w > FB_XRES)
+                    dr.w = FB_XRES - dr.x;
+                if (dr.y + dr.h > FB_YRES)
+                    dr.h = FB_YRES - dr.y;
+                addDmgRect (dr);
+            }
+        }
+
+        if (pr_draw && pr_w > 0 && pr_h > 0) {
+            DmgRect dr = {pr_x, pr_y, pr_w, pr_h};
+            addDmgRect (dr);
+        }
+
+        if (dmg_nrects > 0) {
+            stage_gen++;
+            pthread_cond_broadcast (&stage_cv);
+        }
+}
+
+/* copy r from fb_canvas to fb_stage, except the protected region unless pr_draw.
+ * N.B. we assume caller holds fb_lock
+ */
+void Adafruit_RA8875::stageRect (const DmgRect &r)
+{
+        // portion of protected region within r to skip, if any
+        int skip_x0 = r.x + r.w, skip_x1 = r.x + r.w, skip_y0 = r.y + r.h, skip_y1 = r.y + r.h;
+        if (!pr_draw && pr_w > 0 && pr_h > 0 && pr_x < r.x + r.w && pr_x + pr_w > r.x
+                                             && pr_y < r.y + r.h && pr_y + pr_h > r.y) {
+            skip_x0 = pr_x > r.x ? pr_x : r.x;
+            skip_x1 = pr_x + pr_w < r.x + r.w ? pr_x + pr_w : r.x + r.w;
+            skip_y0 = pr_y;
+            skip_y1 = pr_y + pr_h;
+        }
+
+        for (int y = r.y; y < r.y + r.h; y++) {
+            fbpix_t *stage_p = &fb_stage[y*FB_XRES];
+            fbpix_t *canvas_p = &fb_canvas[y*FB_XRES];
+            if (y < skip_y0 || y >= skip_y1) {
+                memcpy (stage_p + r.x, canvas_p + r.x, r.w*BYTESPFBPIX);
+            } else {
+                memcpy (stage_p + r.x, canvas_p + r.x, (skip_x0 - r.x)*BYTESPFBPIX);
+                memcpy (stage_p + skip_x1, canvas_p + skip_x1, (r.x + r.w - skip_x1)*BYTESPFBPIX);
+            }
+        }
+
+        for (int cr = r.y/DMG_CELL; cr <= (r.y + r.h - 1)/DMG_CELL; cr++)
+            for (int cc = r.x/DMG_CELL; cc <= (r.x + r.w - 1)/DMG_CELL; cc++)
+                dmg_gen[cr][cc] = stage_gen;
+}
+
+/* add to the display data counts, updating the rates every few seconds.
+ * pix_bytes are those presented to the display, wire_bytes those sent through a server connection.
+ */
+void Adafruit_RA8875::countDisplayBytes (long pix_bytes, long wire_bytes)
+{
+	pthread_mutex_lock (&fb_lock);
+
+            ds_pixbytes += pix_bytes;
+            ds_wirebytes += wire_bytes;
+
+            struct timeval tv;
+            gettimeofday (&tv, NULL);
+            float dt = (tv.tv_sec - ds_tv0.tv_sec) + (tv.tv_usec - ds_tv0.tv_usec)*1e-6F;
+            if (dt >= 5) {
+                ds_pix_bps = ds_pixbytes/dt;
+                ds_wire_bps = ds_wirebytes/dt;
+                ds_pixbytes = ds_wirebytes = 0;
+                ds_tv0 = tv;
+            }
+
+	pthread_mutex_unlock (&fb_lock);
+}
+
+/* return how the display is updated and the recent rates of bytes presented to it and sent through
+ * the display server connection, if any.
+ */
+const char *Adafruit_RA8875::getDisplayStats (float *pix_bps, float *wire_bps)
+{
+	pthread_mutex_lock (&fb_lock);
+            *pix_bps = ds_pix_bps;
+            *wire_bps = ds_wire_bps;
+	pthread_mutex_unlock (&fb_lock);
+
+#if defined(_USE_X11)
+        return (use_shm ? "X11 MIT-SHM" : "X11 XPutImage");
+#elif defined(_USE_FB0)
+        return ("fb0");
+#else
+        return ("web");
+#endif
+}
+
+/* return the current stage generation, for use with stageChangedSince().
+ */
+uint32_t Adafruit_RA8875::getStageGen()
+{
+	pthread_mutex_lock (&fb_lock);
+            uint32_t gen = stage_gen;
+	pthread_mutex_unlock (&fb_lock);
+        return (gen);
+}
+
+/* wait up to to_ms for fb_stage to change since getStageGen() returned gen.
+ * return the stage generation then current, which equals gen if nothing changed in time.
+ */
+uint32_t Adafruit_RA8875::waitStageGen (uint32_t gen, int to_ms)
+{
+        struct timespec ts;
+        clock_gettime (CLOCK_REALTIME, &ts);
+        ts.tv_sec += to_ms/1000;
+        ts.tv_nsec += (to_ms%1000)*1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec += 1;
+            ts.tv_nsec -= 1000000000L;
+        }
+
+	pthread_mutex_lock (&fb_lock);
+            while (stage_gen == gen && pthread_cond_timedwait (&stage_cv, &fb_lock, &ts) == 0)
+                continue;
+            uint32_t now_gen = stage_gen;
+	pthread_mutex_unlock (&fb_lock);
+
+        return (now_gen);
+}
+
+/* return whether any of the given fb box of fb_stage might have changed since getStageGen() returned gen.
+ */
+bool Adafruit_RA8875::stageChangedSince (uint32_t gen, int x, int y, int w, int h)
+{
+        bool changed = false;
+
+        if (x < 0) { w += x; x = 0; }
+        if (y < 0) { h += y; y = 0; }
+        if (x + w > FB_XRES) w = FB_XRES - x;
+        if (y + h > FB_YRES) h = FB_YRES - y;
+
+	pthread_mutex_lock (&fb_lock);
+            for (int cr = y/DMG_CELL; !changed && h > 0 && cr <= (y + h - 1)/DMG_CELL; cr++)
+                for (int cc = x/DMG_CELL; !changed && w > 0 && cc <= (x + w - 1)/DMG_CELL; cc++)
+                    if (dmg_gen[cr][cc] > gen)
+                        changed = true;
+	pthread_mutex_unlock (&fb_lock);
+
+        return (changed);
+}
+
+/* allocate the map base layer to cover the given box of the canvas, in app coords, initially empty.
+ * the other layers get their memory the first time anything is drawn in them.
+ * once set, plotEarth() draws in MAPL_BASE and the drawing primitives draw in the layer set with
+ * drawToLayer(). compositeLayers() then shows the top non-empty layer pixel of each changed layer.
+ * drawing directly on the canvas within the box takes that pixel away from the layers until plotEarth()
+ * draws there again, so things other than the map may still be drawn as usual.
+ * return whether the layers are ready, else everything is drawn directly on the canvas as before.
+ */
+bool Adafruit_RA8875::setMapLayerBox (uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+        bool ok = true;
+
+	pthread_mutex_lock (&fb_lock);
+
+            ml_x = x*SCALESZ;
+            ml_y = y*SCALESZ;
+            ml_w = w*SCALESZ;
+            ml_h = h*SCALESZ;
+            if (ml_x + ml_w > FB_XRES || ml_y + ml_h > FB_YRES)
+                ok = false;
+
+            for (int l = 0; l < MAPL_N; l++) {
+                MapLayerInfo &li = ml[l];
+                free (li.pix);
+                li.pix = NULL;
+                if (ok && l == MAPL_BASE && !newLayerPix (li))
+                    ok = false;
+                li.x0 = li.cx0 = ml_x + ml_w;
+                li.y0 = li.cy0 = ml_y + ml_h;
+                li.x1 = li.cx1 = ml_x - 1;
+                li.y1 = li.cy1 = ml_y - 1;
+                li.sig = li.csig = 0;
+                li.dirty = false;
+            }
+            ml_draw = MAPL_NONE;
+
+	pthread_mutex_unlock (&fb_lock);
+
+        return (ok);
+}
+
+/* malloc the pixels of the given layer to fill the layer box, all LAYER_CLEAR.
+ * return whether ok.
+ * N.B. we assume caller holds fb_lock.
+ */
+bool Adafruit_RA8875::newLayerPix (MapLayerInfo &li)
+{
+        int n_pix = ml_w * ml_h;
+        li.pix = (fbpix_t *) malloc (n_pix * sizeof(fbpix_t));
+        if (!li.pix) {
+            static bool reported;                   // just once, plotfb() keeps trying
+            if (!reported) {
+                printf ("No memory for %d x %d map layer\n", ml_w, ml_h);
+                reported = true;
+            }
+            return (false);
+        }
+        for (int i = 0; i < n_pix; i++)
+            li.pix[i] = LAYER_CLEAR;
+        return (true);
+}
+
+/* direct subsequent drawing within the map layer box to the given layer, or the canvas if MAPL_NONE.
+ * N.B. only plotEarth() draws in MAPL_BASE
+ */
+void Adafruit_RA8875::drawToLayer (MapLayer l)
+{
+	pthread_mutex_lock (&fb_lock);
+            ml_draw = ml[MAPL_BASE].pix && l != MAPL_BASE && l < MAPL_N ? l : MAPL_NONE;
+	pthread_mutex_unlock (&fb_lock);
+}
+
+/* erase everything drawn in the given layer. shows on the canvas with the next compositeLayers().
+ */
+void Adafruit_RA8875::clearLayer (MapLayer l)
+{
+        if (l == MAPL_BASE || l >= MAPL_N)
+            return;
+
+	pthread_mutex_lock (&fb_lock);
+            MapLayerInfo &li = ml[l];
+            if (li.pix && li.x0 <= li.x1) {
+                int n = li.x1 - li.x0 + 1;
+                for (int y = li.y0; y <= li.y1; y++) {
+                    fbpix_t *lp = &li.pix[(y-ml_y)*ml_w + li.x0-ml_x];
+                    for (int i = 0; i < n; i++)
+                        lp[i] = LAYER_CLEAR;
+                }
+                li.dirty = true;
+            }
+
+            // the signature only describes what lies within the box so they always restart together
+            li.x0 = ml_x + ml_w;
+            li.y0 = ml_y + ml_h;
+            li.x1 = ml_x - 1;
+            li.y1 = ml_y - 1;
+            li.sig = 0;
+	pthread_mutex_unlock (&fb_lock);
+}
+
+/* copy the top layer pixels within the given inclusive fb box to the canvas, except those it now owns.
+ * N.B. we assume caller holds fb_lock and box is within the layers.
+ */
+void Adafruit_RA8875::compositeBox (int x0, int y0, int x1, int y1)
+{
+        for (int y = y0; y <= y1; y++) {
+            fbpix_t *canvas_p = &fb_canvas[y*FB_XRES];
+            int li = (y-ml_y)*ml_w + x0-ml_x;
+            for (int x = x0; x <= x1; x++, li++) {
+                fbpix_t p = topLayerPix (li);
+                if (p != LAYER_CLEAR)
+                    canvas_p[x] = p;
+            }
+        }
+        damageBox (x0, y0, x1, y1);
+}
+
+/* show each layer that changed since last time on the canvas.
+ * a layer that was cleared then drawn exactly the same as before is not considered a change.
+ */
+void Adafruit_RA8875::compositeLayers()
+{
+	pthread_mutex_lock (&fb_lock);
+
+            for (int l = 0; ml[MAPL_BASE].pix && l < MAPL_N; l++) {
+                MapLayerInfo &li = ml[l];
+                if (!li.dirty)
+                    continue;
+                li.dirty = false;
+                if (li.sig == li.csig && li.x0 == li.cx0 && li.y0 == li.cy0 && li.x1 == li.cx1
+                                            && li.y1 == li.cy1)
+                    continue;
+
+                // composite everywhere the layer is now or was before
+                int x0 = li.x0 < li.cx0 ? li.x0 : li.cx0;
+                int y0 = li.y0 < li.cy0 ? li.y0 : li.cy0;
+                int x1 = li.x1 > li.cx1 ? li.x1 : li.cx1;
+                int y1 = li.y1 > li.cy1 ? li.y1 : li.cy1;
+                if (x0 <= x1 && y0 <= y1) {
+                    compositeBox (x0, y0, x1, y1);
+                    fb_dirty = true;
+                }
+
+                li.cx0 = li.x0;
+                li.cy0 = li.y0;
+                li.cx1 = li.x1;
+                li.cy1 = li.y1;
+                li.csig = li.sig;
+            }
+
+	pthread_mutex_unlock (&fb_lock);
+}
+
+/* start keeping a signature of all drawing within each cell of the given grid, in app coords.
+ * getDrawSigs() then shows which cells were drawn differently than last time.
+ * N.B. plotEarth() and drawing on map layers are not included, only drawing directly on the canvas.
+ */
+void Adafruit_RA8875::setDrawSigGrid (uint16_t x, uint16_t y, uint16_t cell_w, uint16_t cell_h,
+int n_cols, int n_rows)
+{
+	pthread_mutex_lock (&fb_lock);
+
+            // get memory first time
+            if (!ds_col) {
+                ds_col = (int16_t *) malloc (FB_XRES * sizeof(int16_t));
+                ds_row = (int16_t *) malloc (FB_YRES * sizeof(int16_t));
+            }
+            free (ds_sig);
+            ds_sig = (uint32_t *) calloc (n_cols * n_rows, sizeof(uint32_t));
+            if (!ds_col || !ds_row || !ds_sig) {
+                printf ("No memory for %d x %d draw signatures\n", n_cols, n_rows);
+                free (ds_sig);
+                ds_sig = NULL;
+            } else {
+                // tables of cell column and row for each fb x and y, -1 if not in grid
+                for (int fx = 0; fx < FB_XRES; fx++) {
+                    int c = fx/SCALESZ - x;
+                    ds_col[fx] = c >= 0 && c < cell_w*n_cols ? c/cell_w : -1;
+                }
+                for (int fy = 0; fy < FB_YRES; fy++) {
+                    int r = fy/SCALESZ - y;
+                    ds_row[fy] = r >= 0 && r < cell_h*n_rows ? r/cell_h : -1;
+                }
+                ds_ncols = n_cols;
+                ds_ncells = n_cols * n_rows;
+            }
+
+	pthread_mutex_unlock (&fb_lock);
+}
+
+/* copy the signatures of up to n_sigs grid cells to sigs[] then restart them all.
+ * cells are numbered across then down. cells beyond those in the grid are set to 0.
+ */
+void Adafruit_RA8875::getDrawSigs (uint32_t *sigs, int n_sigs)
+{
+	pthread_mutex_lock (&fb_lock);
+            for (int i = 0; i < n_sigs; i++)
+                sigs[i] = ds_sig && i < ds_ncells ? ds_sig[i] : 0;
+            if (ds_sig)
+                memset (ds_sig, 0, ds_ncells * sizeof(uint32_t));
+	pthread_mutex_unlock (&fb_lock);
+}
+
 /* draw the protected region synchronously
  */
 void Adafruit_RA8875::drawPR(void)
@@ -1668,6 +2702,8 @@ void Adafruit_RA8875::putChar (char c)
         if (++kb_qtail == KB_N)
             kb_qtail = 0;
     pthread_mutex_unlock (&kb_lock);
+
+    wakeLoop();
 }
 
 
@@ -1697,68 +2733,34 @@ void *Adafruit_RA8875::fbThreadHelper(void *me)
 // _USE_X11
 void Adafruit_RA8875::drawCanvas()
 {
-        // send one block containing the rectangular bounding box of the changed pixels. smaller
-        // transations would send fewer pixels but each transaction is expensive.. found no happy medium.
-
-        bool any_change = false;
-
-        // bounding box
-        int bb_x0 = 0, bb_y0 = 0, bb_x1 = 0, bb_y1 = 0;
-
-        for (int y = 0; y < FB_YRES; y++) {
-
-            // we assume protected region is at lower right
-            int max_x = pr_draw || pr_w == 0 || y < pr_y ? FB_XRES : pr_x;
-
-            // handy start of this row
-            fbpix_t *stage_p = &fb_stage[y*FB_XRES];
-            fbpix_t *canvas_p = &fb_canvas[y*FB_XRES];
-
-            for (int x = 0; x < FB_XRES; x++) {
-
-                int max_y = pr_draw || pr_h == 0 || x < pr_x ? FB_YRES : pr_y;
-                if (x >= max_x && y >= max_y)
-                    continue;
-
-                if (stage_p[x] != canvas_p[x]) {
-
-                    // update pixel
-                    stage_p[x] = canvas_p[x];
-
-                    // update bounding box
-                    if (!any_change) {
-                        bb_x0 = bb_x1 = x;
-                        bb_y0 = bb_y1 = y;
-                    }
-                    if (x < bb_x0)
-                        bb_x0 = x;
-                    if (x > bb_x1)
-                        bb_x1 = x;
-                    if (y > bb_y1)
-                        bb_y1 = y;
-                    // y can't get any smaller
-
-                    // found something to do
-                    any_change = true;
-                }
-            }
-        }
+        // stage and send each rectangle of damage. many tiny transactions would send fewer pixels but each
+        // is expensive so collectDamage() limits them to DMG_MAXRECTS.
 
-        if (any_change) {
+        collectDamage();
+        if (dmg_nrects == 0)
+            return;
 
-            // update bounding box (inclusive of both edges)
-            int nx = bb_x1-bb_x0+1;
-            int ny = bb_y1-bb_y0+1;
-            XPutImage(display, pixmap, black_gc, img, bb_x0, bb_y0, bb_x0, bb_y0, nx, ny);
-            XCopyArea(display, pixmap, win, black_gc, bb_x0, bb_y0, nx, ny, FB_X0+bb_x0, FB_Y0+bb_y0);
+        // N.B. with MIT-SHM the server reads fb_stage directly so it must not change until after XSync
+        long n_bytes = 0;
+        for (int i = 0; i < dmg_nrects; i++) {
+            DmgRect &r = dmg_rects[i];
+            stageRect (r);
+            if (use_shm)
+                XShmPutImage(display, pixmap, black_gc, img, r.x, r.y, r.x, r.y, r.w, r.h, False);
+            else
+                XPutImage(display, pixmap, black_gc, img, r.x, r.y, r.x, r.y, r.w, r.h);
+            XCopyArea(display, pixmap, win, black_gc, r.x, r.y, r.w, r.h, FB_X0+r.x, FB_Y0+r.y);
+            n_bytes += (long)r.w * r.h * BYTESPFBPIX;
 
             // struct timeval tv;
             // gettimeofday(&tv, NULL);
-            // printf ("XCopyArea %ld.%06ld [%6d, %6d] %6d x %6d = %6d\n", tv.tv_sec, tv.tv_usec, bb_x0, bb_y0, nx, ny, nx*ny);
-
-            // let server catch up before next loop
-            XSync (display, false);
+            // printf ("XCopyArea %ld.%06ld [%6d, %6d] %6d x %6d = %6d\n", tv.tv_sec, tv.tv_usec, r.x, r.y, r.w, r.h, r.w*r.h);
         }
+
+        // let server catch up before next loop
+        XSync (display, false);
+
+        countDisplayBytes (n_bytes, use_shm ? 0 : n_bytes);
 }
 
 // _USE_X11
@@ -1878,6 +2880,7 @@ void Adafruit_RA8875::encodeKeyEvent (XKeyEvent *event)
             if (++kb_qtail == KB_N)
                 kb_qtail = 0;
             pthread_mutex_unlock (&kb_lock);
+            wakeLoop();
             // printf ("encode key= 0x%x %c\n", c, c);
         }
 }
@@ -2053,6 +3056,7 @@ void Adafruit_RA8875::fbThread ()
 
                     // record time of mouse situation change for cursor fade
                     gettimeofday (&mouse_tv, NULL);
+                    wakeLoop();
 
 		    break;
 
@@ -2067,6 +3071,7 @@ void Adafruit_RA8875::fbThread ()
 
                     // record time of mouse situation change for cursor fade
                     gettimeofday (&mouse_tv, NULL);
+                    wakeLoop();
 
 		    break;
 
@@ -2091,6 +3096,7 @@ void Adafruit_RA8875::fbThread ()
 
                     // record time of mouse situation change for cursor fade
                     gettimeofday (&mouse_tv, NULL);
+                    wakeLoop();
 
 		    break;
 
@@ -2105,8 +3111,8 @@ void Adafruit_RA8875::fbThread ()
 		    XFillRectangle (display, win, black_gc, 0, FB_Y0, FB_X0, FB_YRES);
 		    XFillRectangle (display, win, black_gc, FB_X0 + FB_XRES, FB_Y0, FB_X0+1, FB_YRES);
 		    XFillRectangle (display, win, black_gc, 0, FB_Y0 + FB_YRES, fb_si.xres, FB_Y0+1);
-                    // invalidate staging area to get a full refresh
-                    memset (fb_stage, ~0, fb_nbytes);
+                    // get a full refresh
+                    damageAll();
 		    break;
 
                 case ClientMessage:
@@ -2247,24 +3253,13 @@ void Adafruit_RA8875::fbThread ()
 // _WEB_ONLY
 void Adafruit_RA8875::drawCanvas()
 {
-        for (int y = 0; y < FB_YRES; y++) {
-
-            // we assume protected region is at lower right
-            int max_x = pr_draw || pr_w == 0 || y < pr_y ? FB_XRES : pr_x;
-
-            // handy start of this row
-            fbpix_t *stage_p = &fb_stage[y*FB_XRES];
-            fbpix_t *canvas_p = &fb_canvas[y*FB_XRES];
-
-            for (int x = 0; x < FB_XRES; x++) {
-
-                int max_y = pr_draw || pr_h == 0 || x < pr_x ? FB_YRES : pr_y;
-                if (x >= max_x && y >= max_y)
-                    continue;
-
-                stage_p[x] = canvas_p[x];
-            }
+        long n_bytes = 0;
+        collectDamage();
+        for (int i = 0; i < dmg_nrects; i++) {
+            stageRect (dmg_rects[i]);
+            n_bytes += (long)dmg_rects[i].w * dmg_rects[i].h * BYTESPFBPIX;
         }
+        countDisplayBytes (n_bytes, 0);
 }
 
 // _WEB_ONLY
@@ -2531,6 +3526,9 @@ void Adafruit_RA8875::mouseThread (void)
 
 		pthread_mutex_unlock (&mouse_lock);
 
+                if (fb_dirty)
+                    wakeLoop();
+
             } else {
 
                 // close and rety later if disappeared
@@ -2638,6 +3636,7 @@ void Adafruit_RA8875::kbThread ()
                         kb_qtail = 0;
 		    fb_dirty = true;
 		pthread_mutex_unlock (&kb_lock);
+                wakeLoop();
 	    } else {
                 if (nr < 0)
                     printf ("KB: %s\n", strerror(errno));
@@ -2678,28 +3677,10 @@ void Adafruit_RA8875::setCursorIfVis (uint16_t row, uint16_t col, fbpix_t color)
 // _USE_FB0
 void Adafruit_RA8875::drawCanvas()
 {
-        // put only the unproteced region unless pr_draw is set
-        if (pr_draw) {
-            // draw everything
-            memcpy (fb_stage, fb_canvas, fb_nbytes);
-        } else {
-            // draw only around the protected area
-            uint16_t bw = FB_XRES*BYTESPFBPIX;                                  // bytes wide
-            uint16_t pr_r = pr_x + pr_w;                                        // right of PR
-            uint16_t pr_b = pr_y + pr_h;                                        // bottom of PR
-            fbpix_t *s_row = fb_stage;                                          // next stage row
-            fbpix_t *c_row = fb_canvas;                                         // next canvas row
-            for (uint16_t y = 0; y < FB_YRES; y++, c_row += FB_XRES, s_row += FB_XRES) {
-                if (y < pr_y) {
-                    memcpy (s_row, c_row, bw);                                  // above
-                } else if (y < pr_b) {
-                    memcpy (s_row, c_row, pr_x*BYTESPFBPIX);                    // left
-                    memcpy (s_row+pr_r, c_row+pr_r, (FB_XRES-pr_r)*BYTESPFBPIX);// right
-                } else {
-                    memcpy (s_row, c_row, bw);                                  // below
-                }
-            }
-        }
+        // stage only what changed, stageRect() skips the protected region unless pr_draw is set
+        collectDamage();
+        for (int i = 0; i < dmg_nrects; i++)
+            stageRect (dmg_rects[i]);
 }
 
 /* thread that runs forever to update display buffer whenever fb_canvas changes
@@ -2710,19 +3691,26 @@ void Adafruit_RA8875::fbThread ()
         // init cursor timeout off soon
         gettimeofday (&mouse_tv, NULL);
 
+        // full copy until know cursor has faded
+        bool cursor_was_on = true;
+
         // update screen periodically
 	for (;;) {
 
             // all set
             ready = true;
 
-	    // get stable copy of canvas into staging area
+	    // get stable copy of canvas into staging area, note what changed
+            DmgRect rects[DMG_MAXRECTS];
+            int n_rects = 0;
 	    pthread_mutex_lock (&fb_lock);
 		bool is_new = fb_dirty || pr_draw;
 		if (is_new) {
                     drawCanvas();
 		    fb_dirty = false;
                     pr_draw = false;
+                    n_rects = dmg_nrects;
+                    memcpy (rects, dmg_rects, n_rects * sizeof(DmgRect));
 		}
 	    pthread_mutex_unlock (&fb_lock);
 
@@ -2730,9 +3718,23 @@ void Adafruit_RA8875::fbThread ()
             struct timeval tv;
             gettimeofday (&tv, NULL);
             mouse_idle = (tv.tv_sec - mouse_tv.tv_sec)*1000 + (tv.tv_usec - mouse_tv.tv_usec)/1000;
+            bool cursor_on = mouse_idle < MOUSE_FADE;
+
+            // without a cursor now or before just copy the changed regions straight to the hardware
+            if (!cursor_on && !cursor_was_on) {
+                long n_bytes = 0;
+                for (int i = 0; i < n_rects; i++) {
+                    DmgRect &r = rects[i];
+                    for (int y = r.y; y < r.y + r.h; y++)
+                        memcpy (fb_fb + (FB_Y0+y)*fb_si.xres + FB_X0 + r.x, fb_stage + y*FB_XRES + r.x,
+                                                        r.w*BYTESPFBPIX);
+                    n_bytes += (long)r.w * r.h * BYTESPFBPIX;
+                }
+                countDisplayBytes (n_bytes, 0);
+            }
 
-            // copy fb_stage to hardware display if new or mouse moved
-            if (is_new || mouse_idle < MOUSE_FADE) {
+            // else copy all of fb_stage to hardware display if new or mouse moved
+            else if (is_new || cursor_on || cursor_was_on) {
 
                 // copy to cursor layer
                 memcpy (fb_cursor, fb_stage, fb_nbytes);
@@ -2779,7 +3781,10 @@ void Adafruit_RA8875::fbThread ()
 
                 // black bottom border
                 memset (fb_fb+(FB_Y0+FB_YRES)*fb_si.xres, 0, FB_Y0*fb_rowbytes);
+
+                countDisplayBytes (fb_nbytes, 0);
             }
+            cursor_was_on = cursor_on;
 
 	    // no need to go crazy
             usleep (20000);
@@ -15,6 +15,7 @@
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
 
 #endif // _USE_X11
 
@@ -96,6 +97,30 @@ typedef uint32_t fbpix_t;
 // basic background refresh interval, usecs
 #define REFRESH_US      50000
 
+// one app pixel of earth for plotEarthRow(), gradients are the change going one full step right and down
+typedef struct {
+    float lat0, lng0;                   // location, degrees
+    float dlatr, dlngr, dlatd, dlngd;   // location gradients, degrees
+    float fract_day, dfractr, dfractd;  // 1 for all day, 0 for all night, and its gradients
+} EarthPt;
+
+// map layers, bottom to top, composited into the canvas within the box given to setMapLayerBox()
+typedef enum {
+    MAPL_BASE,                          // earth pixels, only drawn by plotEarth()
+    MAPL_GRID,                          // map grid lines
+    MAPL_PATHS,                         // satellite, DX and spot paths
+    MAPL_SYMBOLS,                       // markers, spots and labels
+    MAPL_N,
+    MAPL_NONE = MAPL_N                  // draw directly on the canvas
+} MapLayer;
+
+// layer pixel value meaning nothing is drawn there, drawing this color is nudged to a neighbor
+#if defined(_16BIT_FB)
+#define LAYER_CLEAR     ((fbpix_t)0x0001)
+#else
+#define LAYER_CLEAR     ((fbpix_t)0xFF000000)
+#endif
+
 class Adafruit_RA8875 {
 
     public:
@@ -187,13 +212,24 @@ class Adafruit_RA8875 {
 	void fillCircleRaw(int16_t x0, int16_t y0, int16_t r, uint16_t color16);
 	void drawCircleRaw(int16_t x0, int16_t y0, int16_t r, uint16_t color16);
 
-	// special method to draw hi res earth pixel
+	// special methods to draw hi res earth pixels
 	void plotEarth (uint16_t x0, uint16_t y0, float lat0, float lng0,
-            float dlatr, float dlngr, float dlatd, float dlngd, float fract_day);
+            float dlatr, float dlngr, float dlatd, float dlngd, float fract_day, float dfractr, float dfractd);
+        void plotEarthRow (uint16_t x0, uint16_t y0, const EarthPt *pts, int n);
 
         // methods to implement a protected rectangle drawn only with drawPR()
         void setPR (uint16_t x, uint16_t y, uint16_t w, uint16_t h);
         void drawPR(void);
+
+        // methods to draw in layers composited within a box of the canvas
+        bool setMapLayerBox (uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+        void drawToLayer (MapLayer l);
+        void clearLayer (MapLayer l);
+        void compositeLayers (void);
+
+        // methods to learn which cells of a grid have been drawn differently since last asked
+        void setDrawSigGrid (uint16_t x, uint16_t y, uint16_t cell_w, uint16_t cell_h, int n_cols, int n_rows);
+        void getDrawSigs (uint32_t *sigs, int n_sigs);
         uint16_t pr_x, pr_y, pr_w, pr_h;
         volatile bool pr_draw;
 	void drawCanvas(void);
@@ -212,6 +248,10 @@ class Adafruit_RA8875 {
 
         void setEarthPix (char *day_pixels, char *night_pixels);
 
+        // choose whether plotEarth() samples a tiled copy of the earth maps or the row-major originals
+        void setEarthTiled (bool on);
+        bool getEarthTiled (void) { return (earth_tiled); }
+
         // used to engage/disengage X11 fullscreen
         void X11OptionsEngageNow (bool fullscreen);
 
@@ -224,6 +264,21 @@ class Adafruit_RA8875 {
         // very fast pixel access
         bool getRawPix(uint8_t *rgb24, int bytes);
 
+        // copy a region of what is being displayed, fb coords, native or converted
+        bool getRegionPix (int x, int y, int w, int h, fbpix_t *pix);
+        bool getRegionRGB24 (int x, int y, int w, int h, uint8_t *rgb24);
+        bool getRegionRGB565 (int x, int y, int w, int h, uint16_t *rgb565);
+        static void fbPixToRGB24 (const fbpix_t *pix, int n, uint8_t *rgb24);
+        static void fbPixToRGB565 (const fbpix_t *pix, int n, uint16_t *rgb565);
+
+        // used to report how the display is updated and its recent data rates, bytes/sec
+        const char *getDisplayStats (float *pix_bps, float *wire_bps);
+
+        // used to learn which portions of getRawPix() changed, coords are fb
+        uint32_t getStageGen (void);
+        uint32_t waitStageGen (uint32_t gen, int to_ms);
+        bool stageChangedSince (uint32_t gen, int x, int y, int w, int h);
+
     protected:
 
 	// 0: normal 2: 180 degs
@@ -267,6 +322,17 @@ class Adafruit_RA8875 {
 
 #endif
 
+        // tiled earth layout: EARTH_TILE x EARTH_TILE blocks, each contiguous, rows of blocks across
+        #define EARTH_TILE      8                                       // tile side, power of 2
+        #define EARTH_TILE_SH   3                                       // log2(EARTH_TILE)
+        #define EARTH_TILES_W   ((EARTH_BIG_W+EARTH_TILE-1)/EARTH_TILE) // n tiles across
+        #define EARTH_TILES_H   ((EARTH_BIG_H+EARTH_TILE-1)/EARTH_TILE) // n tiles down
+        #define EARTH_TILED_N   (EARTH_TILES_W*EARTH_TILES_H*EARTH_TILE*EARTH_TILE) // n pixels
+        static inline int earthTileIndex (int ex, int ey) {
+            return ((((ey >> EARTH_TILE_SH)*EARTH_TILES_W + (ex >> EARTH_TILE_SH)) << (2*EARTH_TILE_SH))
+                        | ((ey & (EARTH_TILE-1)) << EARTH_TILE_SH) | (ex & (EARTH_TILE-1)));
+        }
+
 #ifdef _USE_X11
 
 	Display *display;
@@ -276,6 +342,9 @@ class Adafruit_RA8875 {
 	GC black_gc;
 	XImage *img;
 	Pixmap pixmap;
+        bool use_shm;                   // set if img is in MIT-SHM shared memory
+        XShmSegmentInfo shm_info;       // img shared memory segment if use_shm
+        XImage *createShmImage(void);
         Atom wmDeleteMessage;
 
         // used by X11OptionsEngageNow
@@ -342,6 +411,32 @@ class Adafruit_RA8875 {
 	fbpix_t *fb_canvas;             // main drawing image buffer
 	fbpix_t *fb_stage;              // temp image during staging to fb hw
 	int fb_nbytes;                  // bytes in each in-memory image buffer
+
+        // canvas damage is tracked in square cells, drawCanvas() only stages the rectangles they form
+        #define DMG_CELL        (8*(FB_XRES/APP_WIDTH))                 // cell size, fb pixels
+        #define DMG_NCOLS       ((FB_XRES+DMG_CELL-1)/DMG_CELL)         // n cells across
+        #define DMG_NROWS       ((FB_YRES+DMG_CELL-1)/DMG_CELL)         // n cells down
+        #define DMG_MAXRECTS    16                                      // max rectangles per frame
+        typedef struct {
+            int x, y, w, h;
+        } DmgRect;
+        uint8_t dmg_cell[DMG_NROWS][DMG_NCOLS]; // set when cell has changed since last staged
+        uint32_t dmg_gen[DMG_NROWS][DMG_NCOLS]; // stage_gen when cell was last staged
+        uint32_t stage_gen;             // incremented each time drawCanvas() stages anything
+        pthread_cond_t stage_cv;        // broadcast each time stage_gen changes, uses fb_lock
+        DmgRect dmg_rects[DMG_MAXRECTS];// rectangles staged by latest drawCanvas()
+        int dmg_nrects;                 // n dmg_rects in use
+        void damageBox (int x0, int y0, int x1, int y1);
+        void damageAll (void);
+        void addDmgRect (const DmgRect &r);
+        void collectDamage (void);
+        void stageRect (const DmgRect &r);
+
+        // display data rate stats, pixels staged and sent to the display server if any
+        long ds_pixbytes, ds_wirebytes;         // bytes so far this period
+        float ds_pix_bps, ds_wire_bps;          // rates as of end of previous period
+        struct timeval ds_tv0;                  // start of this period
+        void countDisplayBytes (long pix_bytes, long wire_bytes);
 	void plotChar (char c);
 	fbpix_t text_color;
 	uint16_t cursor_x, cursor_y;
@@ -365,10 +460,40 @@ class Adafruit_RA8875 {
         void drawThickLine (int16_t aXStart, int16_t aYStart, int16_t aXEnd, int16_t aYEnd,
                         int16_t aThickness, uint8_t aThicknessMode, fbpix_t aColor);
 
+        // map layers, all coords are fb
+        typedef struct {
+            fbpix_t *pix;               // ml_w x ml_h pixels, LAYER_CLEAR where nothing is drawn, NULL until used
+            int x0, y0, x1, y1;         // bounding box of all drawing since last clear, x0 > x1 if none
+            int cx0, cy0, cx1, cy1;     // bounding box as of last composite
+            uint32_t sig, csig;         // signature of all drawing since last clear and as of last composite
+            bool dirty;                 // set when changed since last composite
+        } MapLayerInfo;
+        MapLayerInfo ml[MAPL_N];        // layers, bottom to top
+        int ml_x, ml_y, ml_w, ml_h;     // layer box on the canvas
+        MapLayer ml_draw;               // layer now receiving the drawing primitives
+        fbpix_t topLayerPix (int i) {   // composite pixel at layer index i, LAYER_CLEAR if none
+            for (int l = MAPL_N; --l >= 0; )
+                if (ml[l].pix && ml[l].pix[i] != LAYER_CLEAR)
+                    return (ml[l].pix[i]);
+            return (LAYER_CLEAR);
+        }
+        bool newLayerPix (MapLayerInfo &li);
+        void compositeBox (int x0, int y0, int x1, int y1);
+
+        // drawing signature of each setDrawSigGrid() cell
+        int16_t *ds_col, *ds_row;       // cell column and row of each fb x and y, -1 if not in grid
+        uint32_t *ds_sig;               // running signature of each cell, across then down
+        int ds_ncols, ds_ncells;
+
 	// big earth mmap'd maps
         uint16_t (*DEARTH_BIG)[EARTH_BIG_H][EARTH_BIG_W];
         uint16_t (*NEARTH_BIG)[EARTH_BIG_H][EARTH_BIG_W];
 
+        // malloced tiled copies of the big earth maps if earth_tiled, else NULL
+        bool earth_tiled;
+        uint16_t *dearth_tiled, *nearth_tiled;
+        void buildEarthTiles (void);
+
         // swap two pairs of x and y
         void swap2 (int16_t &x0, int16_t &y0, int16_t &x1, int16_t &y1) {
             int16_t tx = x0; x0 = x1; x1 = tx;
@@ -11,13 +11,43 @@
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <sys/resource.h>
+#include <pthread.h>
 
 #include "Arduino.h"
+#include "WiFiClient.h"
+
+#if defined(_IS_LINUX)
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#endif
 
 // max cpu usage, throttle with -t
 #define DEF_CPU_USAGE 0.8F
 static float max_cpu_usage = DEF_CPU_USAGE;
 
+// optional event driven loop() with -n, else throttle
+#define EV_MAXIDLE_MS   100                     // longest to go without calling loop(), millis
+#define EV_MAXEV        16                      // max events collected per epoll_wait(2)
+#define LS_PERIOD       10000000                // loop stats sample period, usecs
+static bool loop_events;                        // set to run loop() only when something is due
+static int ev_epfd = -1;                        // epoll set, if loop_events
+static int ev_timerfd = -1;                     // timer for next deadline
+static int ev_wakefd = -1;                      // eventfd other threads poke to run loop() again
+static uint32_t ev_due_ms;                      // earliest deadline from wakeLoopBy(), if ev_due_set
+static bool ev_due_set;                         // whether ev_due_ms is set since loop() last started
+static pthread_t main_tid;                      // thread that runs setup() and loop()
+
+// loop stats for get_sys.txt, all guarded by ls_lock
+static pthread_mutex_t ls_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct timeval ls_wake_tv;               // time of oldest wakeLoop() not yet seen by loop()
+static bool ls_wake_pending;                    // whether ls_wake_tv is set
+static unsigned ls_nlat;                        // n wake latencies measured
+static double ls_sumlat_us;                     // their total
+static int ls_maxlat_us;                        // largest
+static float ls_cpu, ls_rate;                   // cpu fraction and loop() rate over last full period
+static unsigned ls_ntimer, ls_nwake, ls_ninput; // n epoll_wait(2) returns for each reason
+
 char **our_argv;                // our argv for restarting
 std::string our_dir;            // our storage directory, including trailing /
 
@@ -291,17 +321,23 @@ static void usage (const char *errfmt, ...)
         fprintf (stderr, " -g   : init DE using geolocation with current public IP; requires -k\n");
         fprintf (stderr, " -h   : print this help summary then exit\n");
         fprintf (stderr, " -i i : init DE using geolocation with IP i; requires -k\n");
+        fprintf (stderr, " -j n : serve RESTful commands concurrently with n worker threads; default 0 serves one at a time\n");
         fprintf (stderr, " -k   : start immediately in normal mode, ie, don't offer Setup or wait for Skips\n");
         fprintf (stderr, " -l l : set Mercator or Mollweide center longitude to l degrees, +E; requires -k\n");
         fprintf (stderr, " -m   : enable demo mode\n");
+        fprintf (stderr, " -n   : run loop only when input, a timer or the clock is due instead of throttling with -t; linux only\n");
         fprintf (stderr, " -o   : write diagnostic log to stdout instead of in %s\n",defaultAppDir().c_str());
         fprintf (stderr, " -p f : require passwords in file f formatted as lines of \"category password\"\n");
         fprintf (stderr, "        categories: changeUTC exit newde newdx reboot restart setup shutdown unlock upgrade\n");
+        fprintf (stderr, " -r d : record each network request and its response in directory d for later replay with -z\n");
         fprintf (stderr, " -s d : start time as if UTC now is d formatted as YYYY-MM-DDTHH:MM:SS\n");
         fprintf (stderr, " -t p : throttle max cpu to p percent; default is %.0f\n", DEF_CPU_USAGE*100);
+        fprintf (stderr, " -u   : update map incrementally, only repainting pixels whose day/night shading changed\n");
         fprintf (stderr, " -v   : show version info then exit\n");
         fprintf (stderr, " -w p : set live web server port to p or -1 to disable; default %d\n",LIVEWEB_PORT);
         fprintf (stderr, " -y   : activate keyboard cursor control arrows/hjkl/Return -- beware stuck keys!\n");
+        fprintf (stderr, " -z r : replay network responses recorded with -r instead of using the network;\n");
+        fprintf (stderr, "        r is dir[,ms[,KBps]] to add ms latency and limit bandwidth to KBps KB/s\n");
 
         exit(1);
 }
@@ -315,6 +351,9 @@ static void crackArgs (int ac, char *av[])
         bool fs_set = false;
         const char *new_appdir = NULL;
         bool cl_set = false;
+        const char *record_dir = NULL;
+        char *replay_dir = NULL;
+        int replay_ms = 0, replay_kBps = 0;
 
          while (--ac && **++av == '-') {
             char *s = *av;
@@ -385,6 +424,14 @@ static void crackArgs (int ac, char *av[])
                     init_locip = *++av;
                     ac--;
                     break;
+                case 'j':
+                    if (ac < 2)
+                        usage ("missing number of threads for -j");
+                    restful_nthr = atoi(*++av);
+                    if (restful_nthr < 0 || restful_nthr > 16)
+                        usage ("-j threads must be 0 .. 16");
+                    ac--;
+                    break;
                 case 'k':
                     skip_skip = true;
                     break;
@@ -398,6 +445,9 @@ static void crackArgs (int ac, char *av[])
                 case 'm':
                     setDemoMode(true);
                     break;
+                case 'n':
+                    loop_events = true;
+                    break;
                 case 'o':
                     diag_to_file = false;
                     break;
@@ -408,6 +458,12 @@ static void crackArgs (int ac, char *av[])
                     pw_file = *++av;
                     ac--;
                     break;
+                case 'r':
+                    if (ac < 2)
+                        usage ("missing directory path for -r");
+                    record_dir = *++av;
+                    ac--;
+                    break;
                 case 's':
                     if (ac < 2)
                         usage ("missing date/time for -s");
@@ -422,6 +478,9 @@ static void crackArgs (int ac, char *av[])
                         usage ("-t percentage must be 10 .. 100");
                     ac--;
                     break;
+                case 'u':
+                    incr_map = true;
+                    break;
                 case 'v':
                     showVersion();
                     exit(0);
@@ -440,6 +499,20 @@ static void crackArgs (int ac, char *av[])
                 case 'y':
                     want_kbcursor = true;
                     break;
+                case 'z': {
+                        if (ac < 2)
+                            usage ("missing directory path for -z");
+                        replay_dir = strdup(*++av);         // copy so we don't modify av[]
+                        char *comma = strchr (replay_dir, ',');
+                        if (comma) {
+                            *comma = '\0';
+                            if (sscanf (comma+1, "%d,%d", &replay_ms, &replay_kBps) < 1
+                                                || replay_ms < 0 || replay_kBps < 0)
+                                usage ("-z requires dir[,ms[,KBps]] with ms and KBps >= 0");
+                        }
+                        ac--;
+                    }
+                    break;
                 default:
                     usage ("unknown option: %c", *s);
                 }
@@ -459,6 +532,8 @@ static void crackArgs (int ac, char *av[])
             usage ("-l requires -k");
         if (liveweb_port == restful_port && liveweb_port > 0 && restful_port > 0)
             usage ("Live web and RESTful ports may not be equal: %d %d", liveweb_port, restful_port);
+        if (record_dir && replay_dir)
+            usage ("can not use both -r and -z");
 
 
         // prepare our working directory in our_dir
@@ -468,11 +543,259 @@ static void crackArgs (int ac, char *av[])
         if (diag_to_file)
             makeDiagFile();
 
+        // record or replay network traffic if requested
+        if (record_dir && !WiFiClient::setRecordDir (record_dir))
+            usage ("can not record in %s", record_dir);
+        if (replay_dir && !WiFiClient::setReplayDir (replay_dir, replay_ms, replay_kBps))
+            usage ("can not replay from %s", replay_dir);
+
         // set desired screen option if set
         if (fs_set)
             setX11FullScreen (full_screen);
 }
 
+/* other threads call this to have the main thread call loop() again as soon as possible.
+ * also records the time so the wait can be reported by getLoopStats().
+ */
+void wakeLoop()
+{
+        pthread_mutex_lock (&ls_lock);
+            if (!ls_wake_pending) {
+                gettimeofday (&ls_wake_tv, NULL);
+                ls_wake_pending = true;
+            }
+        pthread_mutex_unlock (&ls_lock);
+
+    #if defined(_IS_LINUX)
+        if (ev_wakefd >= 0) {
+            uint64_t one = 1;
+            (void) !write (ev_wakefd, &one, sizeof(one));
+        }
+    #endif
+}
+
+/* arrange for loop() to be called when fd becomes readable, or no longer if !on.
+ * edge triggered so loop() need not drain fd to avoid spinning.
+ * N.B. closing fd removes it automatically.
+ */
+void wakeLoopOnInput (int fd, bool on)
+{
+    #if defined(_IS_LINUX)
+        if (ev_epfd < 0 || fd < 0)
+            return;
+
+        if (on) {
+            struct epoll_event ev;
+            memset (&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN | EPOLLET;
+            ev.data.fd = fd;
+            if (epoll_ctl (ev_epfd, EPOLL_CTL_ADD, fd, &ev) < 0
+                            && (errno != EEXIST || epoll_ctl (ev_epfd, EPOLL_CTL_MOD, fd, &ev) < 0))
+                printf ("epoll add fd %d: %s\n", fd, strerror(errno));
+        } else {
+            (void) epoll_ctl (ev_epfd, EPOLL_CTL_DEL, fd, NULL);
+        }
+    #else
+        (void) fd;
+        (void) on;
+    #endif
+}
+
+/* return whether we are called from the thread that runs setup() and loop().
+ */
+bool onMainThread()
+{
+        return (pthread_equal (pthread_self(), main_tid));
+}
+
+/* arrange for loop() to be called again no later than when millis() reaches ms.
+ * only the earliest since loop() last started is kept.
+ * N.B. only the main thread sets a deadline, calls from others are ignored; they use wakeLoop() instead.
+ */
+void wakeLoopBy (uint32_t ms)
+{
+        if (!loop_events || !onMainThread())
+            return;
+        if (!ev_due_set || (int32_t)(ms - ev_due_ms) < 0) {
+            ev_due_ms = ms;
+            ev_due_set = true;
+        }
+}
+
+/* pass back a line of main loop stats for get_sys.txt.
+ * wake latency is from wakeLoop() until loop() next starts, which is how long touches, keys and
+ * commands handed over by RESTful worker threads wait.
+ * return whether there is anything to report.
+ */
+bool getLoopStats (char line[], size_t line_len)
+{
+        pthread_mutex_lock (&ls_lock);
+            int l = snprintf (line, line_len, "%s %.0f/s cpu %.1f%% wake %.2f ms avg %.2f max",
+                    loop_events ? "events" : "throttle", ls_rate, 100*ls_cpu,
+                    ls_nlat ? ls_sumlat_us/ls_nlat/1000.0 : 0.0, ls_maxlat_us/1000.0);
+            if (loop_events)
+                snprintf (line+l, line_len-l, " by timer %u wake %u input %u", ls_ntimer, ls_nwake, ls_ninput);
+        pthread_mutex_unlock (&ls_lock);
+        return (true);
+}
+
+/* called by main() just before each call to loop() to update loop stats.
+ */
+static void noteLoopStart()
+{
+        #define TVUSEC(tv0,tv1) (((tv1).tv_sec-(tv0).tv_sec)*1000000 + ((tv1).tv_usec-(tv0).tv_usec))
+
+        static struct timeval tv0;              // start of current sample period
+        static struct rusage ru0;               // usage at tv0
+        static unsigned n_loops;                // loop() calls during current period
+
+        struct timeval tv1;
+        gettimeofday (&tv1, NULL);
+
+        pthread_mutex_lock (&ls_lock);
+
+            // latency of any pending wake
+            if (ls_wake_pending) {
+                int lat_us = TVUSEC (ls_wake_tv, tv1);
+                ls_sumlat_us += lat_us;
+                if (lat_us > ls_maxlat_us)
+                    ls_maxlat_us = lat_us;
+                ls_nlat++;
+                ls_wake_pending = false;
+            }
+
+            // update cpu and rate at the end of each sample period
+            n_loops++;
+            int et_us = TVUSEC (tv0, tv1);
+            if (tv0.tv_sec == 0 || et_us >= LS_PERIOD) {
+                struct rusage ru1;
+                getrusage (RUSAGE_SELF, &ru1);
+                if (tv0.tv_sec != 0) {
+                    int cpu_us = TVUSEC (ru0.ru_utime, ru1.ru_utime) + TVUSEC (ru0.ru_stime, ru1.ru_stime);
+                    ls_cpu = (float)cpu_us/et_us;
+                    ls_rate = 1e6F*n_loops/et_us;
+                }
+                tv0 = tv1;
+                ru0 = ru1;
+                n_loops = 0;
+            }
+
+        pthread_mutex_unlock (&ls_lock);
+}
+
+/* prepare the epoll set, its timer and wake event for loop_events.
+ * return whether ready, else caller should fall back to throttling.
+ */
+static bool initLoopEvents()
+{
+    #if defined(_IS_LINUX)
+        ev_epfd = epoll_create1 (EPOLL_CLOEXEC);
+        ev_timerfd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        ev_wakefd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (ev_epfd < 0 || ev_timerfd < 0 || ev_wakefd < 0) {
+            printf ("loop events: %s\n", strerror(errno));
+            goto bad;
+        }
+
+        // timer and wake are level triggered, we read them each time
+        struct epoll_event ev;
+        memset (&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = ev_timerfd;
+        if (epoll_ctl (ev_epfd, EPOLL_CTL_ADD, ev_timerfd, &ev) < 0) {
+            printf ("epoll add timer: %s\n", strerror(errno));
+            goto bad;
+        }
+        ev.data.fd = ev_wakefd;
+        if (epoll_ctl (ev_epfd, EPOLL_CTL_ADD, ev_wakefd, &ev) < 0) {
+            printf ("epoll add wake: %s\n", strerror(errno));
+            goto bad;
+        }
+
+        return (true);
+
+      bad:
+        if (ev_epfd >= 0)
+            close (ev_epfd);
+        if (ev_timerfd >= 0)
+            close (ev_timerfd);
+        if (ev_wakefd >= 0)
+            close (ev_wakefd);
+        ev_epfd = ev_timerfd = ev_wakefd = -1;
+        return (false);
+    #else
+        printf ("loop events require linux\n");
+        return (false);
+    #endif
+}
+
+/* block until something wants loop() to run: input on any fd from wakeLoopOnInput(), a wakeLoop() from
+ * another thread, the deadline from wakeLoopBy(), the next second on the clock or EV_MAXIDLE_MS.
+ */
+static void waitLoopEvents()
+{
+    #if defined(_IS_LINUX)
+        // find ms until earliest deadline
+        uint32_t now = millis();
+        int wait_ms = EV_MAXIDLE_MS;
+        if (ev_due_set) {
+            int due_ms = (int32_t)(ev_due_ms - now);
+            if (due_ms < wait_ms)
+                wait_ms = due_ms;
+        }
+        struct timeval tv;
+        gettimeofday (&tv, NULL);
+        int sec_ms = 1000 - tv.tv_usec/1000;
+        if (sec_ms < wait_ms)
+            wait_ms = sec_ms;
+        ev_due_set = false;
+
+        // already due
+        if (wait_ms <= 0) {
+            pthread_mutex_lock (&ls_lock);
+                ls_ntimer++;
+            pthread_mutex_unlock (&ls_lock);
+            return;
+        }
+
+        // arm timer, one shot
+        struct itimerspec its;
+        memset (&its, 0, sizeof(its));
+        its.it_value.tv_sec = wait_ms / 1000;
+        its.it_value.tv_nsec = (wait_ms % 1000) * 1000000L;
+        if (timerfd_settime (ev_timerfd, 0, &its, NULL) < 0) {
+            printf ("timerfd_settime: %s\n", strerror(errno));
+            usleep (wait_ms*1000);
+            return;
+        }
+
+        // wait for anything
+        struct epoll_event evs[EV_MAXEV];
+        int n = epoll_wait (ev_epfd, evs, EV_MAXEV, -1);
+        if (n < 0) {
+            if (errno != EINTR)
+                printf ("epoll_wait: %s\n", strerror(errno));
+            return;
+        }
+
+        // note why, consume timer and wake counts
+        pthread_mutex_lock (&ls_lock);
+            for (int i = 0; i < n; i++) {
+                uint64_t count;
+                int fd = evs[i].data.fd;
+                if (fd == ev_timerfd) {
+                    (void) !read (ev_timerfd, &count, sizeof(count));
+                    ls_ntimer++;
+                } else if (fd == ev_wakefd) {
+                    (void) !read (ev_wakefd, &count, sizeof(count));
+                    ls_nwake++;
+                } else
+                    ls_ninput++;
+            }
+        pthread_mutex_unlock (&ls_lock);
+    #endif // _IS_LINUX
+}
+
 /* Every normal C program requires a main().
  * This is provided as magic in the Arduino IDE so here we must do it ourselves.
  */
@@ -481,6 +804,9 @@ int main (int ac, char *av[])
 	// save our args for identical restart or remote update
 	our_argv = av;
 
+        // remember who we are
+        main_tid = pthread_self();
+
         // always want stdout synchronous 
         setbuf (stdout, NULL);
 
@@ -503,6 +829,12 @@ int main (int ac, char *av[])
         // log os release, if available
         logOS();
 
+        // prepare events before setup() so it can register fds, else fall back to throttling
+        if (loop_events && !initLoopEvents()) {
+            printf ("loop events unavailable, throttling instead\n");
+            loop_events = false;
+        }
+
 	// call Arduino setup one time
         printf ("Calling Arduino setup()\n");
 	setup();
@@ -513,13 +845,19 @@ int main (int ac, char *av[])
         const int sleep_dt = 10;        // sleep adjustment, usecs
         const int max_sleep = 50000;    // max sleep each loop, usecs
 
-        #define TVUSEC(tv0,tv1) (((tv1).tv_sec-(tv0).tv_sec)*1000000 + ((tv1).tv_usec-(tv0).tv_usec))
-
 	// call Arduino loop forever
-        // this loop by itself would run 100% CPU so try to be a better citizen and throttle back
-        printf ("Starting Arduino loop()\n");
+        // this loop by itself would run 100% CPU so either wait for events or throttle back
+        printf ("Starting Arduino loop() %s\n", loop_events ? "on events" : "throttled");
 	for (;;) {
 
+            noteLoopStart();
+
+            if (loop_events) {
+                loop();
+                waitLoopEvents();
+                continue;
+            }
+
             // get time and usage before calling loop()
             struct rusage ru0;
             getrusage (RUSAGE_SELF, &ru0);
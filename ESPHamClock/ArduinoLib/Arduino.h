@@ -61,6 +61,13 @@ extern char our_make[];
 extern std::string our_dir;
 
 extern void capturePasswords (const char *fn);
+extern bool onMainThread (void);
+
+// optional event driven loop(), see main()
+extern void wakeLoop (void);
+extern void wakeLoopOnInput (int fd, bool on);
+extern void wakeLoopBy (uint32_t ms);
+extern bool getLoopStats (char line[], size_t line_len);
 
 #include "ESP.h"
 #include "Serial.h"
@@ -1,6 +1,16 @@
 /* implement EEPROM class using a local file.
- * format is %08X %02X\n for each address/byte pair.
- * updates of existing address are performed in place.
+ *
+ * contents are kept in a binary file: an EEHeader then the data bytes. it is loaded with a MAP_PRIVATE mmap,
+ * which is just a cheap way to read it: the mapping is copy-on-write so write() only ever changes our
+ * memory, never the file. the file is only changed by save(), which always writes all of it, header and
+ * all data, to a temp name then renames that over the original. the data are small so this costs little
+ * more than writing just the changed bytes, and unlike updating the file in place a crash at any moment
+ * leaves either the old or the new file intact. commit() just notes a save is wanted if anything changed;
+ * a thread then saves after EE_COALESCE_MS so a burst of commits costs one write. flush() saves now.
+ *
+ * the original text format, %08X %02X\n for each address/byte pair, is imported if there is no valid
+ * binary file yet. that file is also where we hold the lock preventing multiple instances, as before,
+ * and exportText() rewrites it on demand for anyone who wants to read it.
  */
 
 #include <string>
@@ -10,8 +20,13 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <libgen.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/time.h>
 
 #include "Arduino.h"
 #include "EEPROM.h"
@@ -20,15 +35,51 @@ class EEPROM EEPROM;
 
 static bool verbose;
 
+#define EE_MAGIC        "HCEEPRM1"              // identifies binary file format, 8 chars
+#define EE_COALESCE_MS  1000                    // delay after first commit() before saving, millis
+
+// binary file header, data follows
+typedef struct {
+        char magic[8];                          // EE_MAGIC, not terminated
+        uint32_t n;                             // n data bytes following
+        uint32_t sum;                           // eeSum() of data
+} EEHeader;
+
+/* return FNV-1a hash of the given bytes, used to check file integrity
+ */
+static uint32_t eeSum (const uint8_t *p, size_t n)
+{
+        uint32_t h = 2166136261U;
+        while (n-- > 0) {
+            h ^= *p++;
+            h *= 16777619U;
+        }
+        return (h);
+}
+
 EEPROM::EEPROM()
 {
         fp = NULL;
         filename = NULL;
+        txt_filename = NULL;
+        map = NULL;
+        map_len = 0;
+        data_array = NULL;
+        n_data_array = 0;
+        pthread_mutex_init (&lock, NULL);
+        pthread_cond_init (&commit_cv, NULL);
+        pthread_mutex_init (&save_lock, NULL);
+        dirty = false;
+        commit_pending = false;
+        flusher_ok = false;
+        n_writes = n_changed = n_commits = n_saves = 0;
 }
 
+/* return name of the binary file
+ */
 const char *EEPROM::getFilename(void)
 {
-        // establish file name
+        // establish file names
 	if (!filename) {
 
             // new file name
@@ -39,39 +90,119 @@ const char *EEPROM::getFilename(void)
 	    snprintf (oldfn, sizeof(oldfn), "%s/.rpihamclock_eeprom", getenv("HOME"));
             rename (oldfn, newfn.c_str());
 
-	    filename = strdup (newfn.c_str());
+	    txt_filename = strdup (newfn.c_str());
+	    filename = strdup ((newfn + ".bin").c_str());
 	}
 
         return (filename);
 }
 
+/* load data_array from the binary file if it exists and looks good.
+ * use it directly as a private mapping if it is the same size, else copy what fits into fresh memory.
+ * return whether successful, else data_array is still all zeros.
+ */
+bool EEPROM::loadBinary()
+{
+        int fd = open (filename, O_RDONLY);
+        if (fd < 0) {
+            if (errno != ENOENT)
+                printf ("EEPROM %s: %s\n", filename, strerror(errno));
+            return (false);
+        }
+
+        bool ok = false;
+        struct stat st;
+        EEHeader hdr;
+        if (fstat (fd, &st) < 0 || (size_t)st.st_size < sizeof(hdr)) {
+            printf ("EEPROM %s: too short\n", filename);
+        } else {
+            size_t f_len = st.st_size;
+            uint8_t *f_map = (uint8_t *) mmap (NULL, f_len, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (f_map == MAP_FAILED) {
+                printf ("EEPROM %s: mmap %s\n", filename, strerror(errno));
+            } else {
+                memcpy (&hdr, f_map, sizeof(hdr));
+                uint8_t *f_data = f_map + sizeof(hdr);
+                if (memcmp (hdr.magic, EE_MAGIC, sizeof(hdr.magic)) != 0 || hdr.n != f_len - sizeof(hdr)
+                                        || hdr.sum != eeSum (f_data, hdr.n)) {
+                    printf ("EEPROM %s: corrupt\n", filename);
+                    munmap (f_map, f_len);
+                } else if (hdr.n == n_data_array) {
+                    // use as is
+                    free (data_array);
+                    data_array = f_data;
+                    map = f_map;
+                    map_len = f_len;
+                    ok = true;
+                } else {
+                    // size changed, keep what still fits
+                    memcpy (data_array, f_data, hdr.n < n_data_array ? hdr.n : n_data_array);
+                    munmap (f_map, f_len);
+                    dirty = true;
+                    ok = true;
+                }
+            }
+        }
+
+        close (fd);
+        return (ok);
+}
+
+/* init data_array from the text file .. support old version of random memory locations
+ */
+void EEPROM::importText()
+{
+	char line[64];
+	unsigned int a, b;
+        int n = 0;
+        rewind (fp);
+	while (fgets (line, sizeof(line), fp)) {
+	    if (sscanf (line, "%x %x", &a, &b) == 2 && a < n_data_array) {
+                data_array[a] = b;
+                n++;
+            }
+        }
+
+        // save in new format right away
+        if (n > 0) {
+            printf ("EEPROM %s: imported %d bytes\n", txt_filename, n);
+            dirty = true;
+            if (!save())
+                printf ("EEPROM %s: import save failed\n", filename);
+        }
+}
+
 void EEPROM::begin (int s)
 {
-        // establish filename
+        // establish filenames
         filename = getFilename();
 
         // start over if called again
+        (void) flush();
         if (fp) {
             fclose(fp);
             fp = NULL;
         }
-        if (data_array) {
+        if (map) {
+            munmap (map, map_len);
+            map = NULL;
+        } else if (data_array) {
             free (data_array);
-            data_array = NULL;
         }
+        data_array = NULL;
 
-        // open RW, create if new owned by real user
-	fp = fopen (filename, "r+");
+        // open text file RW, create if new owned by real user
+	fp = fopen (txt_filename, "r+");
         if (fp) {
             if (verbose)
-                printf ("EEPROM %s: open ok\n", filename);
+                printf ("EEPROM %s: open ok\n", txt_filename);
         } else {
-            fp = fopen (filename, "w+");
+            fp = fopen (txt_filename, "w+");
             if (fp) {
                 if (verbose)
-                    printf ("EEPROM %s: create ok\n", filename);
+                    printf ("EEPROM %s: create ok\n", txt_filename);
             } else {
-                fprintf (stderr, "%s: %s\n", filename, strerror(errno));
+                fprintf (stderr, "%s: %s\n", txt_filename, strerror(errno));
                 exit(1);
             }
         }
@@ -87,41 +218,326 @@ void EEPROM::begin (int s)
         // malloc memory, init as zeros
         n_data_array = s;
         data_array = (uint8_t *) calloc (n_data_array, sizeof(uint8_t));
+        dirty = false;
 
-        // init data_array from file .. support old version of random memory locations
-	char line[64];
-	unsigned int a, b;
-	while (fp && fgets (line, sizeof(line), fp)) {
-	    if (sscanf (line, "%x %x", &a, &b) == 2 && a < n_data_array)
-                data_array[a] = b;
-        }
+        // fill from binary file else text
+        if (!loadBinary())
+            importText();
 }
 
+/* start saving data_array, soon.
+ * N.B. returns before it is written, use flush() to wait.
+ */
 bool EEPROM::commit(void)
 {
-        // (over)write entire data_array array
-        fseek (fp, 0L, SEEK_SET);
-        for (unsigned a = 0; a < n_data_array; a++)
-            fprintf (fp, "%08X %02X\n", a, data_array[a]);
-        fflush (fp);
+        pthread_mutex_lock (&lock);
+
+            n_commits++;
+
+            // start the flusher first time
+            if (!flusher_ok) {
+                pthread_t tid;
+                int e = pthread_create (&tid, NULL, flusherThread, this);
+                if (e == 0)
+                    flusher_ok = true;
+                else
+                    printf ("EEPROM flusher thread: %s\n", strerror(e));
+            }
+
+            // nothing to do unless something changed
+            bool now = false;
+            if (dirty) {
+                if (flusher_ok) {
+                    commit_pending = true;
+                    pthread_cond_signal (&commit_cv);
+                } else
+                    now = true;
+            }
+
+        pthread_mutex_unlock (&lock);
+
+        // save here if no flusher
+        return (now ? save() : true);
+}
+
+/* save any changes now.
+ * return whether io ok.
+ */
+bool EEPROM::flush(void)
+{
+        return (data_array ? save() : true);
+}
+
+/* write a snapshot of all of data_array to a temp file and rename it over filename, if anything changed.
+ * return whether io ok.
+ */
+bool EEPROM::save()
+{
+        pthread_mutex_lock (&save_lock);
+
+        // snapshot and mark clean
+        pthread_mutex_lock (&lock);
+            bool any = dirty;
+            size_t n = n_data_array;
+            uint8_t *copy = any ? (uint8_t *) malloc (sizeof(EEHeader) + n) : NULL;
+            if (copy)
+                memcpy (copy + sizeof(EEHeader), data_array, n);
+            dirty = false;
+            commit_pending = false;
+        pthread_mutex_unlock (&lock);
+
+        if (!any) {
+            pthread_mutex_unlock (&save_lock);
+            return (true);
+        }
+
+        bool ok = false;
+        std::string tmp_fn = std::string(filename) + ".tmp";
+        const char *tmp = tmp_fn.c_str();
+        int fd = -1;
+
+        if (!copy) {
+            printf ("EEPROM: no memory to save %d bytes\n", (int)n);
+            goto out;
+        }
+
+        // fill header
+        EEHeader hdr;
+        memcpy (hdr.magic, EE_MAGIC, sizeof(hdr.magic));
+        hdr.n = n;
+        hdr.sum = eeSum (copy + sizeof(hdr), n);
+        memcpy (copy, &hdr, sizeof(hdr));
+
+        // write and sync temp file then rename over the real one
+        fd = open (tmp, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+        if (fd < 0) {
+            printf ("EEPROM %s: %s\n", tmp, strerror(errno));
+            goto out;
+        }
+        (void) !fchown (fd, getuid(), getgid());
+        if (::write (fd, copy, sizeof(hdr) + n) != (ssize_t)(sizeof(hdr) + n) || fsync (fd) < 0) {
+            printf ("EEPROM %s: write %s\n", tmp, strerror(errno));
+            goto out;
+        }
+        if (close (fd) < 0) {
+            fd = -1;
+            printf ("EEPROM %s: close %s\n", tmp, strerror(errno));
+            goto out;
+        }
+        fd = -1;
+        if (rename (tmp, filename) < 0) {
+            printf ("EEPROM %s: %s\n", filename, strerror(errno));
+            goto out;
+        }
+
+        // sync directory so the rename itself survives a crash
+        {
+            std::string dir = filename;
+            int dfd = open (dirname ((char *)dir.c_str()), O_RDONLY);
+            if (dfd >= 0) {
+                (void) fsync (dfd);
+                close (dfd);
+            }
+        }
+
+        ok = true;
+        if (verbose)
+            printf ("EEPROM %s: saved %d bytes\n", filename, (int)n);
+
+    out:
+
+        if (fd >= 0)
+            close (fd);
+        if (!ok)
+            unlink (tmp);
+        free (copy);
+
+        // record, try again next commit if failed
+        pthread_mutex_lock (&lock);
+            if (ok)
+                n_saves++;
+            else
+                dirty = true;
+        pthread_mutex_unlock (&lock);
+
+        pthread_mutex_unlock (&save_lock);
+        return (ok);
+}
+
+/* thread that saves EE_COALESCE_MS after each commit() with changes, so any more that come along in the
+ * mean time are included too.
+ */
+void *EEPROM::flusherThread (void *me)
+{
+        class EEPROM *ee = (class EEPROM *) me;
+        pthread_detach (pthread_self());
+
+        for (;;) {
+            pthread_mutex_lock (&ee->lock);
+                while (!ee->commit_pending)
+                    pthread_cond_wait (&ee->commit_cv, &ee->lock);
+            pthread_mutex_unlock (&ee->lock);
+
+            usleep (EE_COALESCE_MS*1000);
+            (void) ee->save();
+        }
+
+        return (NULL);          // lint
+}
+
+/* (re)write the text file with the current contents and return its name.
+ */
+const char *EEPROM::exportText(void)
+{
+        if (fp && data_array) {
+            pthread_mutex_lock (&lock);
+                if (ftruncate (fileno(fp), 0) < 0)
+                    printf ("EEPROM %s: %s\n", txt_filename, strerror(errno));
+                rewind (fp);
+                for (unsigned a = 0; a < n_data_array; a++)
+                    fprintf (fp, "%08X %02X\n", a, data_array[a]);
+                fflush (fp);
+            pthread_mutex_unlock (&lock);
+        }
+        return (txt_filename ? txt_filename : getFilename());
+}
 
-        // return whether io ok
-        return (!feof(fp) && !ferror(fp));
+/* pass back a line of stats for get_sys.txt
+ */
+void EEPROM::getStats (char line[], size_t line_len)
+{
+        pthread_mutex_lock (&lock);
+            snprintf (line, line_len, "writes %u changed %u commits %u saves %u%s", n_writes, n_changed,
+                                n_commits, n_saves, dirty ? " pending" : "");
+        pthread_mutex_unlock (&lock);
 }
 
 void EEPROM::write (uint32_t address, uint8_t byte)
 {
-        // set array if available and address is in bounds
-        if (data_array && address < n_data_array)
-            data_array[address] = byte;
+        // set array if available and address is in bounds, note whether anything really changed
+        if (data_array && address < n_data_array) {
+            pthread_mutex_lock (&lock);
+                n_writes++;
+                if (data_array[address] != byte) {
+                    data_array[address] = byte;
+                    dirty = true;
+                    n_changed++;
+                }
+            pthread_mutex_unlock (&lock);
+        }
 }
 
 uint8_t EEPROM::read (uint32_t address)
 {
-        // use array if available and address is in bounds
-        if (data_array && address < n_data_array)
-            return (data_array[address]);
+        // use array if available and address is in bounds, else 0.
+        // N.B. lock like write() so other threads see whole updates
+        uint8_t byte = 0;
+        if (data_array && address < n_data_array) {
+            pthread_mutex_lock (&lock);
+                byte = data_array[address];
+            pthread_mutex_unlock (&lock);
+        }
+        return (byte);
+}
+
+#if defined(_UNIT_TEST)
+
+/* benchmark NV style writes: a cookie and 4 bytes then commit(), against rewriting the whole text file
+ * as every commit() used to. then check the binary file reloads and a text file imports.
+ * g++ -Wall -O2 -D_UNIT_TEST -IArduinoLib -o eeprom-test ArduinoLib/EEPROM.cpp -lpthread && ./eeprom-test
+ */
+
+#define BM_SIZE         1000                    // about what HamClock uses
+#define BM_NWRITES      20000                   // n NV writes to time
+
+std::string our_dir;
+
+static double usSince (const struct timeval &tv0)
+{
+        struct timeval tv1;
+        gettimeofday (&tv1, NULL);
+        return ((tv1.tv_sec - tv0.tv_sec)*1e6 + (tv1.tv_usec - tv0.tv_usec));
+}
+
+int main (int ac, char *av[])
+{
+        char dir[] = "/tmp/eeprom-testXXXXXX";
+        if (!mkdtemp (dir)) {
+            perror ("mkdtemp");
+            return (1);
+        }
+        our_dir = std::string(dir) + "/";
+
+        // former commit(): rewrite entire text file each time
+        FILE *tfp = fopen ((our_dir + "old").c_str(), "w+");
+        uint8_t old[BM_SIZE];
+        memset (old, 0, sizeof(old));
+        struct timeval tv0;
+        gettimeofday (&tv0, NULL);
+        for (int i = 0; i < BM_NWRITES; i++) {
+            int a = (i*37) % (BM_SIZE-5);
+            old[a] = 0x5A;
+            for (int j = 1; j < 5; j++)
+                old[a+j] = i >> (8*(j-1));
+            fseek (tfp, 0L, SEEK_SET);
+            for (unsigned k = 0; k < BM_SIZE; k++)
+                fprintf (tfp, "%08X %02X\n", k, old[k]);
+            fflush (tfp);
+        }
+        double us = usSince (tv0);
+        printf ("text rewrite   %10.0f NV writes/s\n", BM_NWRITES/us*1e6);
+
+        // new: same writes through EEPROM then flush
+        EEPROM.begin (BM_SIZE);
+        gettimeofday (&tv0, NULL);
+        for (int i = 0; i < BM_NWRITES; i++) {
+            int a = (i*37) % (BM_SIZE-5);
+            EEPROM.write (a, 0x5A);
+            for (int j = 1; j < 5; j++)
+                EEPROM.write (a+j, i >> (8*(j-1)));
+            EEPROM.commit();
+        }
+        bool ok = EEPROM.flush();
+        us = usSince (tv0);
+        char stats[100];
+        EEPROM.getStats (stats, sizeof(stats));
+        printf ("binary commit  %10.0f NV writes/s incl flush: %s\n", BM_NWRITES/us*1e6, stats);
+
+        // check contents survive a reload
+        EEPROM.begin (BM_SIZE);
+        for (int a = 0; a < BM_SIZE; a++) {
+            if (EEPROM.read(a) != old[a]) {
+                printf ("reload mismatch at %d: %02X %02X\n", a, EEPROM.read(a), old[a]);
+                ok = false;
+                break;
+            }
+        }
 
-        // not found
-        return (0);
+        // check text import when binary is missing
+        fseek (tfp, 0L, SEEK_SET);
+        FILE *efp = fopen (EEPROM.exportText(), "w");
+        for (unsigned k = 0; k < BM_SIZE; k++)
+            fprintf (efp, "%08X %02X\n", k, (k*7) & 0xff);
+        fclose (efp);
+        fclose (tfp);
+        unlink (EEPROM.getFilename());
+        EEPROM.begin (BM_SIZE);
+        for (int a = 0; a < BM_SIZE; a++) {
+            if (EEPROM.read(a) != ((a*7) & 0xff)) {
+                printf ("import mismatch at %d\n", a);
+                ok = false;
+                break;
+            }
+        }
+        if (access (EEPROM.getFilename(), R_OK) < 0) {
+            printf ("import did not save binary\n");
+            ok = false;
+        }
+
+        printf ("%s\n", ok ? "ok" : "FAILED");
+        std::string rm = std::string("rm -rf ") + dir;
+        (void) !system (rm.c_str());
+        return (ok ? 0 : 1);
 }
+
+#endif // _UNIT_TEST
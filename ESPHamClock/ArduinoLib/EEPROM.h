@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <pthread.h>
 
 /* EEPROM class that uses a local file
  */
@@ -19,13 +20,34 @@ class EEPROM
 
         // non-standard
         const char *getFilename(void);
+        const char *exportText(void);
+        bool flush(void);
+        void getStats (char line[], size_t line_len);
 
     private:
 
-	const char *filename;
-        FILE *fp;
-        uint8_t *data_array;
+	const char *filename;                   // binary store
+	const char *txt_filename;               // original text format, also holds our instance lock
+        FILE *fp;                               // open on txt_filename
+        uint8_t *map;                           // copy-on-write mmap of filename if matched size, else NULL
+        size_t map_len;                         // bytes in map
+        uint8_t *data_array;                    // in map after header, else malloced
         size_t n_data_array;
+
+        // coalesce commits, all guarded by lock
+        pthread_mutex_t lock;
+        pthread_cond_t commit_cv;               // signaled when commit_pending is set
+        pthread_mutex_t save_lock;              // serializes save()
+        bool dirty;                             // data_array changed since last save
+        bool commit_pending;                    // commit() called with dirty data not yet saved
+        bool flusher_ok;                        // whether flusherThread() is running
+        unsigned n_writes, n_changed;           // n write() calls, n that changed a byte
+        unsigned n_commits, n_saves;            // n commit() calls, n files actually written
+
+        bool save (void);
+        bool loadBinary (void);
+        void importText (void);
+        static void *flusherThread (void *me);
 };
 
 extern class EEPROM EEPROM;
@@ -6,6 +6,7 @@
 #include "Arduino.h"
 #include "ESP8266WiFi.h"
 #include "ESP.h"
+#include "EEPROM.h"
 
 class ESP ESP;
 
@@ -22,6 +23,9 @@ void ESP::restart(void)
             printf ("  argv[%d]: %s\n", i, our_argv[i]);
         printf ("see you there!\n\n");
 
+        // save any settings still waiting to be written
+        EEPROM.flush();
+
         // close all but basic fd
         for (int i = 3; i < 100; i++)
             (void) ::close(i);
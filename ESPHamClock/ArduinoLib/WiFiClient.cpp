@@ -2,6 +2,8 @@
  */
 
 #include <signal.h>
+#include <poll.h>
+#include <dirent.h>
 
 #include "IPAddress.h"
 #include "WiFiClient.h"
@@ -9,29 +11,681 @@
 // set for more verbose info
 static int _trace_client = 0;
 
+/* connections whose HTTP/1.1 response has been fully read are kept for reuse by the next connect() to
+ * the same host:port, and host addresses are remembered for a while, both shared by all instances.
+ * getaddrinfo() does not report the record TTL so we use a fixed one and forget early on connect failure.
+ */
+#define POOL_MAX        8               // max idle connections kept for reuse
+#define POOL_IDLE       15              // max seconds to keep an idle connection
+#define DNS_MAX         16              // max host addresses remembered
+#define DNS_TTL         300             // seconds to trust a remembered address
+#define SENT_MAX        8192            // max request bytes kept for a redial
+#define DRAIN_MAX       8               // max peek[] fills stop() will discard to finish a response
+
+typedef struct {
+    char host[64];
+    int port;
+    int fd;
+    time_t t_idle;                      // when parked
+    bool used;
+} PoolEntry;
+
+typedef struct {
+    char host[64];
+    struct sockaddr_in sa;
+    time_t t_expire;                    // 0 if unused
+} DNSEntry;
+
+static PoolEntry pool[POOL_MAX];
+static DNSEntry dns[DNS_MAX];
+static unsigned n_dials, n_reuses, n_redials, n_dns_hits, n_dns_misses;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;  // guards all of the above
+
+/* return whether an idle fd still looks open at the far end.
+ * anything to read while idle can only be EOF, an error or junk.
+ */
+static bool idleOk (int fd)
+{
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        return (poll (&pfd, 1, 0) == 0);
+}
+
+/* close pool entries that have been idle too long.
+ * N.B. caller must hold pool_lock
+ */
+static void poolExpire (time_t now)
+{
+        for (int i = 0; i < POOL_MAX; i++) {
+            PoolEntry &pe = pool[i];
+            if (pe.used && now - pe.t_idle > POOL_IDLE) {
+                if (_trace_client)
+                    printf ("WiFiCl: pooled fd %d idle too long\n", pe.fd);
+                close (pe.fd);
+                pe.used = false;
+            }
+        }
+}
+
+/* remove and return an idle connection to host:port from the pool, else -1
+ */
+static int poolGet (const char *host, int port)
+{
+        int fd = -1;
+
+        pthread_mutex_lock (&pool_lock);
+        poolExpire (time(NULL));
+        for (int i = 0; fd < 0 && i < POOL_MAX; i++) {
+            PoolEntry &pe = pool[i];
+            if (pe.used && pe.port == port && strcmp (pe.host, host) == 0) {
+                pe.used = false;
+                if (idleOk (pe.fd))
+                    fd = pe.fd;
+                else {
+                    if (_trace_client)
+                        printf ("WiFiCl: pooled fd %d closed by %s:%d\n", pe.fd, host, port);
+                    close (pe.fd);
+                }
+            }
+        }
+        if (fd >= 0)
+            n_reuses++;
+        pthread_mutex_unlock (&pool_lock);
+
+        return (fd);
+}
+
+/* add an idle connection to host:port to the pool, closing the oldest if full
+ */
+static void poolPut (const char *host, int port, int fd)
+{
+        pthread_mutex_lock (&pool_lock);
+
+        time_t now = time(NULL);
+        poolExpire (now);
+
+        PoolEntry *pe = NULL;
+        PoolEntry *oldest = &pool[0];
+        for (int i = 0; !pe && i < POOL_MAX; i++) {
+            if (!pool[i].used)
+                pe = &pool[i];
+            else if (pool[i].t_idle < oldest->t_idle)
+                oldest = &pool[i];
+        }
+        if (!pe) {
+            close (oldest->fd);
+            pe = oldest;
+        }
+
+        strcpy (pe->host, host);
+        pe->port = port;
+        pe->fd = fd;
+        pe->t_idle = now;
+        pe->used = true;
+
+        pthread_mutex_unlock (&pool_lock);
+}
+
+/* find the address of host, using a recent answer if possible, and set *cached accordingly.
+ * return whether found.
+ */
+static bool lookupHost (const char *host, struct sockaddr_in *sap, bool *cached)
+{
+        time_t now = time(NULL);
+        bool cacheable = strlen(host) < sizeof(dns[0].host);
+
+        // use a recent answer if we have one
+        pthread_mutex_lock (&pool_lock);
+        *cached = false;
+        for (int i = 0; cacheable && !*cached && i < DNS_MAX; i++) {
+            DNSEntry &de = dns[i];
+            if (de.t_expire > now && strcmp (de.host, host) == 0) {
+                *sap = de.sa;
+                *cached = true;
+            }
+        }
+        if (*cached)
+            n_dns_hits++;
+        else
+            n_dns_misses++;
+        pthread_mutex_unlock (&pool_lock);
+        if (*cached)
+            return (true);
+
+        /* ask the resolver.
+         * N.B. must call freeaddrinfo(aip) after successful call before returning
+         */
+        struct addrinfo hints, *aip;
+        memset (&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        int error = ::getaddrinfo (host, NULL, &hints, &aip);
+        if (error) {
+            printf ("WiFiCl: getaddrinfo(%s): %s\n", host, gai_strerror(error));
+            return (false);
+        }
+        memcpy (sap, aip->ai_addr, sizeof(*sap));
+        freeaddrinfo (aip);
+
+        // remember in place of the unused, expired or soonest to expire
+        if (cacheable) {
+            pthread_mutex_lock (&pool_lock);
+            DNSEntry *de = &dns[0];
+            for (int i = 1; i < DNS_MAX; i++)
+                if (dns[i].t_expire < de->t_expire)
+                    de = &dns[i];
+            strcpy (de->host, host);
+            de->sa = *sap;
+            de->t_expire = now + DNS_TTL;
+            pthread_mutex_unlock (&pool_lock);
+        }
+
+        return (true);
+}
+
+/* forget any remembered address for host
+ */
+static void forgetHost (const char *host)
+{
+        pthread_mutex_lock (&pool_lock);
+        for (int i = 0; i < DNS_MAX; i++)
+            if (strcmp (dns[i].host, host) == 0)
+                dns[i].t_expire = 0;
+        pthread_mutex_unlock (&pool_lock);
+}
+
+/* record and replay.
+ *
+ * when recording, each session -- one connect() to a host:port until the response is done -- is saved in
+ * the record dir as NNNNNN.cap: a magic line, a line with host port and whether the server then closed,
+ * the first line the client wrote, such as the HTTP request line, then all response bytes exactly as
+ * received. when replaying, dial() instead returns one end of a local socket pair whose other end is
+ * served by a thread that answers each request with the best matching capture after the given latency
+ * and at no more than the given bandwidth, so runs are repeatable without any network.
+ */
+#define CAP_MAGIC       "HCCAP1"        // first line of each capture file
+#define CAP_SUFFIX      ".cap"          // capture file name suffix
+#define REPLAY_WAIT     (2*POOL_IDLE*1000)      // ms replay waits for another request before closing
+
+typedef struct {
+    char *path;                         // malloced full file name
+    char host[64];
+    int port;
+    bool close;                         // server closed after this response
+    char *line;                         // malloced first line the client wrote
+    long body_off;                      // file offset of response bytes
+    int n_served;                       // times replayed
+} Capture;
+
+static char *record_dir;                // malloced dir to record into, else NULL
+static char *replay_dir;                // malloced dir to replay from, else NULL
+static Capture *captures;               // malloced replay captures in file name order
+static int n_captures;                  // n in captures[]
+static int replay_ms;                   // replay latency before each response and each new connection
+static int replay_kBps;                 // replay bandwidth limit, 0 for none
+static unsigned rec_seq;                // number of the last capture file in record_dir
+static unsigned n_recorded, n_replayed, n_unmatched;
+static pthread_mutex_t rr_lock = PTHREAD_MUTEX_INITIALIZER;    // guards all of the above
+
+/* scandir() filter for capture files
+ */
+static int isCapture (const struct dirent *dp)
+{
+        int nl = strlen (dp->d_name);
+        int sl = strlen (CAP_SUFFIX);
+        return (nl > sl && strcmp (dp->d_name + nl - sl, CAP_SUFFIX) == 0);
+}
+
+/* return microseconds since t0
+ */
+static long usSince (const struct timeval &t0)
+{
+        struct timeval t1;
+        gettimeofday (&t1, NULL);
+        return ((t1.tv_sec - t0.tv_sec)*1000000L + (t1.tv_usec - t0.tv_usec));
+}
+
+/* close all idle pooled connections
+ */
+static void poolFlush (void)
+{
+        pthread_mutex_lock (&pool_lock);
+        for (int i = 0; i < POOL_MAX; i++) {
+            if (pool[i].used) {
+                close (pool[i].fd);
+                pool[i].used = false;
+            }
+        }
+        pthread_mutex_unlock (&pool_lock);
+}
+
+/* save one session as the next capture file in record_dir
+ */
+static void saveCapture (const char *host, int port, bool closed, const char *line,
+                                        const uint8_t *rsp, size_t n_rsp)
+{
+        pthread_mutex_lock (&rr_lock);
+        char path[1024];
+        bool ok = record_dir != NULL;
+        if (ok) {
+            snprintf (path, sizeof(path), "%s/%06u%s", record_dir, ++rec_seq, CAP_SUFFIX);
+            n_recorded++;
+        }
+        pthread_mutex_unlock (&rr_lock);
+        if (!ok)
+            return;
+
+        FILE *fp = fopen (path, "w");
+        if (!fp) {
+            printf ("WiFiCl: %s: %s\n", path, strerror(errno));
+            return;
+        }
+        fprintf (fp, "%s\n%s %d %d\n%s\n", CAP_MAGIC, host, port, closed, line);
+        bool wrote = fwrite (rsp, 1, n_rsp, fp) == n_rsp;
+        if (fclose (fp) != 0 || !wrote)
+            printf ("WiFiCl: %s: %s\n", path, strerror(errno));
+}
+
+/* read the leading lines of the capture file at path into c. return whether ok.
+ */
+static bool loadCapture (const char *path, Capture &c)
+{
+        FILE *fp = fopen (path, "r");
+        if (!fp)
+            return (false);
+
+        char magic[20], hp[100], line[600];
+        int closed = 0;
+        bool ok = fgets (magic, sizeof(magic), fp) && fgets (hp, sizeof(hp), fp) && fgets (line, sizeof(line), fp);
+        if (ok) {
+            magic[strcspn (magic, "\n")] = '\0';
+            line[strcspn (line, "\n")] = '\0';
+            ok = strcmp (magic, CAP_MAGIC) == 0 && sscanf (hp, "%63s %d %d", c.host, &c.port, &closed) == 3;
+            c.body_off = ftell (fp);
+        }
+        fclose (fp);
+
+        if (ok) {
+            c.path = strdup (path);
+            c.line = strdup (line);
+            c.close = closed != 0;
+            c.n_served = 0;
+        }
+        return (ok);
+}
+
+/* return the length of the method and path at the front of a request line, ie, up to any query or version
+ */
+static int pathLen (const char *line)
+{
+        const char *sp = strchr (line, ' ');
+        if (!sp)
+            return (strlen (line));
+        return (sp + 1 - line + strcspn (sp + 1, "? "));
+}
+
+/* find the capture that best answers line sent to host:port, else NULL.
+ * an exact match is best, else one with the same method and path that shares the longest prefix.
+ * of equally good captures the first not yet served is used else the last, so a run of identical
+ * requests is answered in the order they were recorded.
+ * N.B. caller must hold rr_lock
+ */
+static Capture *findCapture (const char *host, int port, const char *line)
+{
+        int pl = pathLen (line);
+        int best_score = -1;
+        Capture *best_new = NULL, *best_last = NULL;
+
+        for (int i = 0; i < n_captures; i++) {
+            Capture &c = captures[i];
+            if (c.port != port || strcmp (c.host, host) != 0 || pathLen (c.line) != pl
+                                        || strncmp (c.line, line, pl) != 0)
+                continue;
+            int score = pl;
+            while (line[score] != '\0' && line[score] == c.line[score])
+                score++;
+            if (line[score] == '\0' && c.line[score] == '\0')
+                score++;                                // exact beats any prefix
+            if (score > best_score) {
+                best_score = score;
+                best_new = NULL;
+            }
+            if (score == best_score) {
+                if (!best_new && c.n_served == 0)
+                    best_new = &c;
+                best_last = &c;
+            }
+        }
+
+        return (best_new ? best_new : best_last);
+}
+
+/* send the response bytes in the capture file at path starting at body_off to fd after lat_ms
+ * and at no more than kBps, if > 0. return whether ok.
+ */
+static bool replaySend (int fd, const char *path, long body_off, int lat_ms, int kBps)
+{
+        FILE *fp = fopen (path, "r");
+        if (!fp || fseek (fp, body_off, SEEK_SET) < 0) {
+            printf ("WiFiCl: %s: %s\n", path, strerror(errno));
+            if (fp)
+                fclose (fp);
+            return (false);
+        }
+
+        if (lat_ms > 0)
+            usleep (lat_ms*1000L);
+
+        // send in slices of about 20 ms worth, each no sooner than the bandwidth allows
+        size_t slice = kBps > 0 ? kBps*1024L/50 : 65536;
+        if (slice < 256)
+            slice = 256;
+        if (slice > 65536)
+            slice = 65536;
+        uint8_t *buf = (uint8_t *) malloc (slice);
+        struct timeval t0;
+        gettimeofday (&t0, NULL);
+        double n_sent = 0;
+        bool ok = buf != NULL;
+        size_t nr;
+        while (ok && (nr = fread (buf, 1, slice, fp)) > 0) {
+            ok = send (fd, buf, nr, MSG_NOSIGNAL) == (ssize_t)nr;
+            n_sent += nr;
+            if (kBps > 0) {
+                long us_wait = (long)(1e6*n_sent/(kBps*1024.0)) - usSince (t0);
+                if (us_wait > 0)
+                    usleep (us_wait);
+            }
+        }
+
+        free (buf);
+        fclose (fp);
+        return (ok);
+}
+
+/* wait for the next request to arrive in req[] after the *n_req already there. return the length of
+ * its first line, plus the rest of its header if it is HTTP, or 0 if fd closed or nothing came in time.
+ * N.B. requests with bodies are not supported.
+ */
+static int replayRequest (int fd, char req[], int req_len, int *n_req)
+{
+        while (true) {
+            req[*n_req] = '\0';
+            const char *eol = strchr (req, '\n');
+            if (eol) {
+                bool http = memmem (req, eol - req, " HTTP/1.", 8) != NULL;
+                const char *eor = http ? strstr (req, "\r\n\r\n") : eol;
+                if (eor)
+                    return (eor - req + (http ? 4 : 1));
+            }
+
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int nr;
+            if (*n_req >= req_len-1 || poll (&pfd, 1, REPLAY_WAIT) <= 0
+                                || (nr = ::read (fd, req + *n_req, req_len-1 - *n_req)) <= 0)
+                return (0);
+            *n_req += nr;
+        }
+}
+
+typedef struct {
+    int fd;                             // our end of the socket pair
+    char host[64];
+    int port;
+} ReplayConn;
+
+/* thread that answers requests on one replay connection until the client closes or the capture did
+ */
+static void *replayThread (void *arg)
+{
+        pthread_detach (pthread_self());
+        ReplayConn rc = *(ReplayConn *)arg;
+        free (arg);
+
+        char req[8192];
+        int n_req = 0;
+        bool more = true;
+        int n_used;
+        while (more && (n_used = replayRequest (rc.fd, req, sizeof(req), &n_req)) > 0) {
+
+            // first line is the key
+            char line[512];
+            int ll = strcspn (req, "\r\n");
+            snprintf (line, sizeof(line), "%.*s", ll < (int)sizeof(line) ? ll : (int)sizeof(line)-1, req);
+            memmove (req, req + n_used, n_req - n_used);
+            n_req -= n_used;
+
+            // find best capture, copy what we need in case the captures are reloaded meanwhile
+            pthread_mutex_lock (&rr_lock);
+            Capture *cp = findCapture (rc.host, rc.port, line);
+            char *path = NULL;
+            long body_off = 0;
+            if (cp) {
+                path = strdup (cp->path);
+                body_off = cp->body_off;
+                more = !cp->close;
+                cp->n_served++;
+                n_replayed++;
+            } else
+                n_unmatched++;
+            int lat_ms = replay_ms;
+            int kBps = replay_kBps;
+            pthread_mutex_unlock (&rr_lock);
+
+            if (!path) {
+                printf ("WiFiCl: replay has nothing for %s:%d %s\n", rc.host, rc.port, line);
+                break;
+            }
+            if (_trace_client)
+                printf ("WiFiCl: replaying %s for %s:%d %s\n", path, rc.host, rc.port, line);
+            if (!replaySend (rc.fd, path, body_off, lat_ms, kBps))
+                more = false;
+            free (path);
+        }
+
+        close (rc.fd);
+        return (NULL);
+}
+
+/* start a replay connection to host:port, return our end or -1 if nothing was recorded for it.
+ */
+static int replayDial (const char *host, int port)
+{
+        pthread_mutex_lock (&rr_lock);
+        bool have = false;
+        for (int i = 0; !have && i < n_captures; i++)
+            have = captures[i].port == port && strcmp (captures[i].host, host) == 0;
+        int lat_ms = replay_ms;
+        pthread_mutex_unlock (&rr_lock);
+
+        if (!have || strlen (host) >= sizeof(ReplayConn().host)) {
+            printf ("WiFiCl: replay has nothing for %s:%d\n", host, port);
+            return (-1);
+        }
+
+        int sv[2];
+        if (socketpair (AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+            printf ("WiFiCl: socketpair(%s:%d): %s\n", host, port, strerror(errno));
+            return (-1);
+        }
+
+        ReplayConn *rc = (ReplayConn *) malloc (sizeof(ReplayConn));
+        rc->fd = sv[1];
+        strcpy (rc->host, host);
+        rc->port = port;
+        pthread_t tid;
+        int err = pthread_create (&tid, NULL, replayThread, rc);
+        if (err != 0) {
+            printf ("WiFiCl: replay thread(%s:%d): %s\n", host, port, strerror(err));
+            close (sv[0]);
+            close (sv[1]);
+            free (rc);
+            return (-1);
+        }
+
+        // stands in for the connect handshake
+        if (lat_ms > 0)
+            usleep (lat_ms*1000L);
+
+        return (sv[0]);
+}
+
 // default constructor
 WiFiClient::WiFiClient()
 {
         // init
 	socket = -1;
-	n_peek = 0;
-        next_peek = 0;
+        held = NULL;
+        n_held = held_size = 0;
+        holding = false;
+        sent = NULL;
+        hs_complete = false;
+        initState();
 }
 
 // constructor handed an open socket to use
 WiFiClient::WiFiClient(int fd)
 {
-        // init
-	socket = -1;
-	n_peek = 0;
-        next_peek = 0;
-
         if (fd >= 0 && _trace_client)
             printf ("WiFiCl: new WiFiClient inheriting fd %d\n", fd);
 
+        // init
 	socket = fd;
+        held = NULL;
+        n_held = held_size = 0;
+        holding = false;
+        sent = NULL;
+        hs_complete = false;
+        initState();
+}
+
+// destructor, closes or pools the socket as if by stop() and frees any buffers
+WiFiClient::~WiFiClient()
+{
+        stop();
+        free (held);
+}
+
+// move constructor, takes over from's socket and buffers and leaves it unconnected
+WiFiClient::WiFiClient (WiFiClient &&from)
+{
+        take (from);
+}
+
+// move assignment, first stops this client then takes over from's socket and buffers
+WiFiClient &WiFiClient::operator= (WiFiClient &&from)
+{
+        if (this != &from) {
+            stop();
+            free (held);
+            take (from);
+        }
+        return (*this);
+}
+
+/* copy all of from's state to us then reset from as if just constructed so it no longer owns anything.
+ * N.B. we must not own anything either
+ */
+void WiFiClient::take (WiFiClient &from)
+{
+        memcpy ((void *)this, (void *)&from, sizeof(*this));
+
+        from.socket = -1;
+        from.held = NULL;
+        from.n_held = from.held_size = 0;
+        from.holding = false;
+        from.hs_complete = false;
+        from.initState();
+}
+
+/* reset the state that lasts for one connection.
+ * N.B. sent and rec_rsp must already be NULL or freed
+ */
+void WiFiClient::initState()
+{
 	n_peek = 0;
         next_peek = 0;
+        pool_host[0] = '\0';
+        pool_port = 0;
+        reused = false;
+        n_rx = 0;
+        sent = NULL;
+        n_sent = 0;
+        hs = HS_OFF;
+        rec_line[0] = '\0';
+        n_rec_line = 0;
+        rec_rsp = NULL;
+        n_rec_rsp = rec_rsp_size = 0;
+        rec_parked = false;
+}
+
+/* save the session just ended as the next capture if recording, then reset for the next one.
+ * N.B. record_dir is only changed before any connections, so need not lock just to check it
+ */
+void WiFiClient::endSession()
+{
+        if (record_dir && pool_host[0] != '\0' && rec_line[0] != '\0' && n_rec_rsp > 0) {
+            // a 304 is only meaningful to the cache that asked for it so never replay one
+            bool is_304 = n_rec_rsp >= 12 && memcmp (rec_rsp, "HTTP/1.", 7) == 0
+                                        && memcmp (rec_rsp+8, " 304", 4) == 0;
+            if (!is_304)
+                saveCapture (pool_host, pool_port, !rec_parked, rec_line, rec_rsp, n_rec_rsp);
+        }
+
+        free (sent);
+        free (rec_rsp);
+        initState();
+}
+
+/* collect the first line of the n bytes in buf being written if recording
+ */
+void WiFiClient::recordWrite (const uint8_t *buf, int n)
+{
+        if (!record_dir || n_rec_line < 0)
+            return;
+
+        for (int i = 0; i < n; i++) {
+            if (buf[i] == '\n') {
+                n_rec_line = -1;
+                break;
+            }
+            if (buf[i] != '\r' && n_rec_line < (int)sizeof(rec_line)-1) {
+                rec_line[n_rec_line++] = buf[i];
+                rec_line[n_rec_line] = '\0';
+            }
+        }
+}
+
+/* append the n raw bytes in buf just received to rec_rsp if recording
+ */
+void WiFiClient::recordRead (const uint8_t *buf, int n)
+{
+        if (!record_dir || rec_line[0] == '\0')
+            return;
+
+        if (n_rec_rsp + n > rec_rsp_size) {
+            size_t new_size = 2*(n_rec_rsp + n);
+            uint8_t *new_rsp = (uint8_t *) realloc (rec_rsp, new_size);
+            if (!new_rsp) {
+                // forget this session
+                printf ("WiFiCl: no memory to record %ld bytes\n", (long)new_size);
+                free (rec_rsp);
+                rec_rsp = NULL;
+                n_rec_rsp = rec_rsp_size = 0;
+                rec_line[0] = '\0';
+                n_rec_line = -1;
+                return;
+            }
+            rec_rsp = new_rsp;
+            rec_rsp_size = new_size;
+        }
+        memcpy (rec_rsp + n_rec_rsp, buf, n);
+        n_rec_rsp += n;
 }
 
 // return whether this socket is active
@@ -105,54 +759,111 @@ int WiFiClient::tout (int to_ms, int fd)
 }
 
 
-bool WiFiClient::connect(const char *host, int port)
+/* open a new connection to host:port, return socket or -1
+ */
+int WiFiClient::dial (const char *host, int port)
 {
-        struct addrinfo hints, *aip;
-        char port_str[16];
-        int sockfd;
-
-        /* lookup host address.
-         * N.B. must call freeaddrinfo(aip) after successful call before returning
-         */
-        memset (&hints, 0, sizeof(hints));
-        hints.ai_family = AF_INET;
-        hints.ai_socktype = SOCK_STREAM;
-        snprintf (port_str, sizeof(port_str), "%d", port);
-        int error = ::getaddrinfo (host, port_str, &hints, &aip);
-        if (error) {
-            printf ("WiFiCl: getaddrinfo(%s:%d): %s\n", host, port, gai_strerror(error));
-            return (false);
+        // all connections are local while replaying
+        // N.B. replay_dir is only changed before any connections, so need not lock just to check it
+        if (replay_dir) {
+            int sockfd = replayDial (host, port);
+            if (sockfd >= 0) {
+                pthread_mutex_lock (&pool_lock);
+                n_dials++;
+                pthread_mutex_unlock (&pool_lock);
+            }
+            return (sockfd);
         }
 
-        /* create socket */
-        sockfd = ::socket (aip->ai_family, aip->ai_socktype, aip->ai_protocol);
-        if (sockfd < 0) {
-            freeaddrinfo (aip);
-            printf ("WiFiCl: socket(%s:%d): %s\n", host, port, strerror(errno));
-	    return (false);
-        }
+        for (int n_try = 0; n_try < 2; n_try++) {
+
+            // lookup host address
+            struct sockaddr_in sa;
+            bool cached;
+            if (!lookupHost (host, &sa, &cached))
+                return (-1);
+            sa.sin_port = htons (port);
 
-        /* connect */
-        if (connect_to (sockfd, aip->ai_addr, aip->ai_addrlen, 5000) < 0) {
+            // create socket
+            int sockfd = ::socket (AF_INET, SOCK_STREAM, 0);
+            if (sockfd < 0) {
+                printf ("WiFiCl: socket(%s:%d): %s\n", host, port, strerror(errno));
+                return (-1);
+            }
+
+            // connect
+            if (connect_to (sockfd, (struct sockaddr *)&sa, sizeof(sa), 5000) == 0) {
+
+                // handle write errors inline
+                signal (SIGPIPE, SIG_IGN);
+
+                if (_trace_client)
+                    printf ("WiFiCl: new %s:%d fd %d\n", host, port, sockfd);
+                pthread_mutex_lock (&pool_lock);
+                n_dials++;
+                pthread_mutex_unlock (&pool_lock);
+                return (sockfd);
+            }
             printf ("WiFiCl: connect(%s:%d): %s\n", host, port, strerror(errno));
-            freeaddrinfo (aip);
             close (sockfd);
-            return (false);
+
+            // a remembered address may have moved so try once more with a fresh lookup
+            if (!cached)
+                break;
+            forgetHost (host);
         }
 
-        /* handle write errors inline */
-        signal (SIGPIPE, SIG_IGN);
+        return (-1);
+}
 
-        /* ok */
-        if (_trace_client)
-            printf ("WiFiCl: new %s:%d fd %d\n", host, port, sockfd);
-        freeaddrinfo (aip);
+bool WiFiClient::connect(const char *host, int port)
+{
+        // reuse an idle connection to the same place if possible else make a new one
+        bool from_pool = false;
+        int sockfd = poolGet (host, port);
+        if (sockfd >= 0) {
+            if (_trace_client)
+                printf ("WiFiCl: reusing %s:%d fd %d\n", host, port, sockfd);
+            from_pool = true;
+        } else if ((sockfd = dial (host, port)) < 0)
+            return (false);
+
+        // ok
+        endSession();
 	socket = sockfd;
-	n_peek = 0;
-        next_peek = 0;
+        reused = from_pool;
+        if (strlen (host) < sizeof(pool_host)) {
+            strcpy (pool_host, host);
+            pool_port = port;
+        }
         return (true);
 }
 
+/* a reused connection was closed by the server before any reply, presumably because it had been idle too
+ * long, so open a new one and send the request again. return whether ok.
+ */
+bool WiFiClient::redial()
+{
+        if (_trace_client)
+            printf ("WiFiCl: fd %d closed by %s:%d, redialing\n", socket, pool_host, pool_port);
+        close (socket);
+
+        socket = dial (pool_host, pool_port);
+        reused = false;
+        bool ok = socket >= 0 && write (sent, n_sent) == n_sent;
+        free (sent);
+        sent = NULL;
+        n_sent = 0;
+
+        if (ok) {
+            pthread_mutex_lock (&pool_lock);
+            n_redials++;
+            pthread_mutex_unlock (&pool_lock);
+        }
+
+        return (ok);
+}
+
 bool WiFiClient::connect(IPAddress ip, int port)
 {
         char host[32];
@@ -170,15 +881,66 @@ void WiFiClient::setNoDelay(bool on)
 
 void WiFiClient::stop()
 {
+        // finish a persistent response if it has already arrived so the socket can be used again
+        if (socket >= 0 && hs != HS_OFF && hs_reuse) {
+            next_peek = n_peek;
+            for (int i = 0; i < DRAIN_MAX && readReady() && fillPeek(); i++)
+                next_peek = n_peek;
+        }
+
 	if (socket >= 0) {
             if (_trace_client)
                 printf ("WiFiCl: fd %d is now closed\n", socket);
 	    shutdown (socket, SHUT_RDWR);
 	    close (socket);
 	    socket = -1;
-	    n_peek = 0;
-            next_peek = 0;
 	}
+
+        endSession();
+}
+
+/* non-standard: hand back the socket for the caller to own and leave this client unconnected, or -1 if
+ * not connected. handy to pass a connection to another thread.
+ */
+int WiFiClient::detachFd()
+{
+        int fd = socket;
+        socket = -1;
+        endSession();
+        return (fd);
+}
+
+/* non-standard: stop any current connection then carry on with the given open fd, which need not be a
+ * socket, just as if it had been handed to the constructor.
+ */
+void WiFiClient::adoptFd (int fd)
+{
+        stop();
+        free (held);
+        held = NULL;
+        n_held = held_size = 0;
+        holding = false;
+        hs_complete = false;
+        socket = fd;
+}
+
+/* the response body is complete so keep the socket for the next connect() if allowed else close it.
+ * either way this client now acts as if the server closed the connection.
+ */
+void WiFiClient::park()
+{
+        hs_complete = true;
+        if (hs_reuse && pool_host[0] != '\0') {
+            if (_trace_client)
+                printf ("WiFiCl: fd %d is now idle\n", socket);
+            poolPut (pool_host, pool_port, socket);
+            socket = -1;
+            rec_parked = true;
+            endSession();
+        } else {
+            hs_reuse = false;
+            stop();
+        }
 }
 
 bool WiFiClient::connected()
@@ -186,15 +948,21 @@ bool WiFiClient::connected()
 	return (socket >= 0);
 }
 
-int WiFiClient::available()
+/* return whether socket has data that can be read without blocking.
+ * closes socket on error.
+ * N.B. only call when peek[] is empty
+ */
+bool WiFiClient::readReady()
 {
         // none if closed
         if (socket < 0)
-            return (0);
+            return (false);
 
-        // simple if unread bytes already available
-	if (next_peek < n_peek)
-	    return (1);
+        // act like EOF at the end of a framed body
+        if (hs == HS_DONE) {
+            park();
+            return (false);
+        }
 
         // don't block if nothing available
         struct timeval tv;
@@ -207,28 +975,74 @@ int WiFiClient::available()
         if (s < 0) {
             printf ("WiFiCl: fd %d select err: %s\n", socket, strerror(errno));
 	    stop();
-	    return (0);
+	    return (false);
 	}
-        if (s == 0)
-            return (0);
+        return (s > 0);
+}
 
-        // read more
-	int nr = ::read(socket, peek, sizeof(peek));
+/* read up to n bytes from the ready socket into buf then remove any HTTP framing in place.
+ * return count left for the caller, which may be 0 if all were framing, or -1 if socket is now closed.
+ */
+int WiFiClient::recvBytes (uint8_t *buf, size_t n)
+{
+	int nr = ::read (socket, buf, n);
 	if (nr > 0) {
             if (_trace_client > 1)
                 printf ("WiFiCl: read(%d) %d\n", socket, nr);
-	    n_peek = nr;
-            next_peek = 0;
+            n_rx += nr;
+            recordRead (buf, nr);
+            if (sent) {
+                // got a reply so no longer need the copy for redial()
+                free (sent);
+                sent = NULL;
+                n_sent = 0;
+            }
+            return (hs == HS_OFF ? nr : decodeHTTP (buf, nr));
+        }
+
+        if (nr == 0) {
+            if (_trace_client)
+                printf ("WiFiCl: read(%d) EOF\n", socket);
+        } else
+            printf ("WiFiCl: read(%d): %s\n", socket, strerror(errno));
+
+        // try again if a reused connection was closed before it saw our request, else give up
+        if (reused && n_rx == 0 && redial())
+            return (0);
+        hs_complete = nr == 0 && (hs == HS_OFF || hs == HS_TOEOF);
+        hs_reuse = false;
+        stop();
+        return (-1);
+}
+
+/* refill peek[] from socket, which is known to be ready.
+ * return false if socket is now closed, else true even if all that arrived was framing.
+ */
+bool WiFiClient::fillPeek()
+{
+        int nr = recvBytes (peek, sizeof(peek));
+        if (nr < 0)
+            return (false);
+        n_peek = nr;
+        next_peek = 0;
+
+        // nothing more will come if that was the end of a framed body
+        if (nr == 0 && hs == HS_DONE) {
+            park();
+            return (false);
+        }
+
+        return (true);
+}
+
+int WiFiClient::available()
+{
+        // simple if unread bytes already available
+	if (socket >= 0 && next_peek < n_peek)
 	    return (1);
-	} else {
-            if (nr == 0) {
-                if (_trace_client)
-                    printf ("WiFiCl: read(%d) EOF\n", socket);
-            } else
-                printf ("WiFiCl: read(%d): %s\n", socket, strerror(errno));
-	    stop();
-	    return (0);
-	}
+
+        // read more if ready
+        return (readReady() && fillPeek() && next_peek < n_peek);
 }
 
 int WiFiClient::read()
@@ -238,18 +1052,133 @@ int WiFiClient::read()
 	return (-1);
 }
 
+/* read up to n bytes into buf without blocking.
+ * return count, 0 if none are ready now or -1 if socket is closed.
+ * N.B. requests at least as large as peek[] bypass it and go straight from the socket into buf.
+ */
+int WiFiClient::read (uint8_t *buf, size_t n)
+{
+        // none if closed
+        if (socket < 0)
+            return (-1);
+
+        // drain read-ahead first
+        int n_buf = n_peek - next_peek;
+        if (n_buf > 0) {
+            if ((size_t)n_buf > n)
+                n_buf = n;
+            memcpy (buf, &peek[next_peek], n_buf);
+            next_peek += n_buf;
+            return (n_buf);
+        }
+
+        // nothing buffered so wait for more
+        if (!readReady())
+            return (socket < 0 ? -1 : 0);
+
+        // big enough to skip peek[]
+        if (n >= sizeof(peek))
+            return (recvBytes (buf, n));
+
+        // refill peek[] then copy what we can
+        if (!fillPeek())
+            return (-1);
+        return (read (buf, n));
+}
+
+/* copy buffered bytes into buf up to but not including term, reading more from the socket only if
+ * nothing is buffered. never blocks.
+ * at most n bytes are stored; any beyond that up to term are discarded so long lines are truncated.
+ * set *found if term was consumed, in which case the caller has a complete record.
+ * return count stored in buf, 0 if nothing ready or -1 if socket is closed.
+ */
+int WiFiClient::readUntil (char term, char *buf, int n, bool *found)
+{
+        *found = false;
+
+        // none if closed
+        if (socket < 0)
+            return (-1);
+
+        // insure something is buffered
+        if (next_peek >= n_peek) {
+            if (!readReady())
+                return (socket < 0 ? -1 : 0);
+            if (!fillPeek())
+                return (-1);
+        }
+
+        // find extent of this record within the buffer
+        const uint8_t *start = &peek[next_peek];
+        int n_buf = n_peek - next_peek;
+        const uint8_t *tp = (const uint8_t *) memchr (start, term, n_buf);
+        int n_rec = tp ? tp - start : n_buf;
+
+        // copy what fits, consume all of it plus term
+        int n_copy = n_rec < n ? n_rec : n;
+        if (n_copy > 0)
+            memcpy (buf, start, n_copy);
+        next_peek += n_rec;
+        if (tp) {
+            next_peek += 1;
+            *found = true;
+        }
+
+        return (n_copy);
+}
+
 int WiFiClient::write (const uint8_t *buf, int n)
 {
         // can't if closed
         if (socket < 0)
             return (0);
 
+        // just collect if holding
+        if (holding) {
+            if (n_held + n > held_size) {
+                held_size = 2*(n_held + n);
+                uint8_t *new_held = (uint8_t *) realloc (held, held_size);
+                if (!new_held) {
+                    printf ("WiFiCl: no memory to hold %d bytes\n", held_size);
+                    free (held);
+                    held = NULL;
+                    n_held = held_size = 0;
+                    holding = false;
+                    stop();
+                    return (0);
+                }
+                held = new_held;
+            }
+            memcpy (held+n_held, buf, n);
+            n_held += n;
+            return (n);
+        }
+
+        recordWrite (buf, n);
+
+        // keep a copy in case a reused connection turns out to be closed and must be redialed
+        if (reused && n_rx == 0) {
+            uint8_t *new_sent = n_sent + n <= SENT_MAX ? (uint8_t *) realloc (sent, n_sent + n) : NULL;
+            if (new_sent) {
+                sent = new_sent;
+                memcpy (sent+n_sent, buf, n);
+                n_sent += n;
+            } else {
+                free (sent);
+                sent = NULL;
+                n_sent = 0;
+                reused = false;
+            }
+        }
+
 	int nw;
 	for (int ntot = 0; ntot < n; ntot += nw) {
 	    nw = ::write (socket, buf+ntot, n-ntot);
 	    if (nw < 0) {
                 // select says it won't block but it still might be temporarily EAGAIN
                 if (errno != EAGAIN) {
+                    if (reused && n_rx == 0 && redial())
+                        return (n);     // redial() sent all of sent[] which includes buf
                     printf ("WiFiCl: write(%d): %s\n", socket, strerror(errno));
                     stop();             // avoid repeated failed attempts
                     return (0);
@@ -352,6 +1281,301 @@ void WiFiClient::println (uint32_t i)
 	write ((const uint8_t *) buf, n);
 }
 
+/* non-standard: collect all subsequent writes in memory instead of sending them.
+ * handy to learn the full length of a reply before sending any of it.
+ * N.B. caller must call releaseWrites() to stop.
+ */
+void WiFiClient::holdWrites()
+{
+        holding = true;
+        n_held = 0;
+}
+
+/* non-standard: stop holding writes and pass back what was collected since holdWrites(), if any.
+ * N.B. caller must free the returned memory, even if *np is 0.
+ */
+uint8_t *WiFiClient::releaseWrites (int *np)
+{
+        uint8_t *h = held;
+        *np = n_held;
+        held = NULL;
+        n_held = held_size = 0;
+        holding = false;
+        return (h);
+}
+
+/* non-standard: the request just sent asked for a persistent HTTP/1.1 connection, so frame the response
+ * body to act like EOF at its end then keep the socket for the next connect() to the same host:port.
+ * httpBodyComplete() then tells whether the body was read to its end, not cut short.
+ */
+void WiFiClient::httpKeepAlive()
+{
+        hs = HS_HEADER;
+        hs_n = -1;
+        hs_status = 0;
+        hs_chunked = false;
+        hs_reuse = true;
+        hs_complete = false;
+        hs_nline = 0;
+}
+
+/* collect c into hs_line[], return true when it completes a line, which is then in hs_line without CR LF.
+ */
+bool WiFiClient::hsLine (uint8_t c)
+{
+        if (c == '\n') {
+            hs_line[hs_nline] = '\0';
+            hs_nline = 0;
+            return (true);
+        }
+        if (c != '\r' && hs_nline < (int)sizeof(hs_line)-1)
+            hs_line[hs_nline++] = c;
+        return (false);
+}
+
+/* act on the response header line in hs_line[]
+ */
+void WiFiClient::hsHeaderLine()
+{
+        if (hs_status == 0) {
+
+            // status line: 1.0 closes unless it says otherwise
+            int minor;
+            if (sscanf (hs_line, "HTTP/1.%d %d", &minor, &hs_status) != 2) {
+                hs_status = -1;
+                hs = HS_TOEOF;
+                hs_reuse = false;
+            } else
+                hs_reuse = minor >= 1;
+
+        } else if (hs_line[0] == '\0') {
+
+            // blank line ends header, now decide how the body ends
+            if (hs_status == 204 || hs_status == 304)
+                hs = HS_DONE;
+            else if (hs_chunked)
+                hs = HS_CHUNKSIZE;
+            else if (hs_n >= 0)
+                hs = hs_n > 0 ? HS_LENGTH : HS_DONE;
+            else {
+                hs = HS_TOEOF;
+                hs_reuse = false;
+            }
+
+        } else if (strncasecmp (hs_line, "Content-Length:", 15) == 0) {
+            hs_n = atol (hs_line+15);
+        } else if (strncasecmp (hs_line, "Transfer-Encoding:", 18) == 0) {
+            hs_chunked = strcasestr (hs_line+18, "chunked") != NULL;
+        } else if (strncasecmp (hs_line, "Connection:", 11) == 0) {
+            if (strcasestr (hs_line+11, "close"))
+                hs_reuse = false;
+            else if (strcasestr (hs_line+11, "keep-alive"))
+                hs_reuse = true;
+        }
+}
+
+/* remove HTTP body framing in place from the n raw bytes in buf, return count left.
+ * header bytes pass through unchanged for the caller to parse as usual.
+ */
+int WiFiClient::decodeHTTP (uint8_t *buf, int n)
+{
+        int n_out = 0;
+        int i = 0;
+
+        while (i < n) {
+            switch (hs) {
+
+            case HS_HEADER:
+                buf[n_out++] = buf[i];
+                if (hsLine (buf[i++]))
+                    hsHeaderLine();
+                break;
+
+            case HS_LENGTH:     // fallthru
+            case HS_CHUNKDATA: {
+                    int n_run = n - i < hs_n ? n - i : (int)hs_n;
+                    memmove (buf + n_out, buf + i, n_run);
+                    n_out += n_run;
+                    i += n_run;
+                    hs_n -= n_run;
+                    if (hs_n == 0)
+                        hs = hs == HS_LENGTH ? HS_DONE : HS_CHUNKEND;
+                }
+                break;
+
+            case HS_CHUNKSIZE:
+                if (hsLine (buf[i++])) {
+                    char *end;
+                    hs_n = strtol (hs_line, &end, 16);
+                    if (end == hs_line || hs_n < 0) {
+                        // garbled so pass the rest unchanged and close at EOF
+                        if (_trace_client)
+                            printf ("WiFiCl: fd %d bad chunk size \"%s\"\n", socket, hs_line);
+                        hs = HS_TOEOF;
+                        hs_reuse = false;
+                    } else
+                        hs = hs_n > 0 ? HS_CHUNKDATA : HS_TRAILER;
+                }
+                break;
+
+            case HS_CHUNKEND:
+                if (hsLine (buf[i++]))
+                    hs = HS_CHUNKSIZE;
+                break;
+
+            case HS_TRAILER:
+                if (hsLine (buf[i++]) && hs_line[0] == '\0')
+                    hs = HS_DONE;
+                break;
+
+            case HS_DONE:
+                // more than the body is unexpected so don't trust this connection again
+                hs_reuse = false;
+                i = n;
+                break;
+
+            case HS_OFF:        // fallthru
+            case HS_TOEOF:
+                memmove (buf + n_out, buf + i, n - i);
+                n_out += n - i;
+                i = n;
+                break;
+            }
+        }
+
+        return (n_out);
+}
+
+/* non-standard: report connection pool and address cache activity since startup
+ */
+void WiFiClient::getPoolStats (char line[], size_t line_len)
+{
+        pthread_mutex_lock (&pool_lock);
+
+        int n_idle = 0;
+        for (int i = 0; i < POOL_MAX; i++)
+            if (pool[i].used)
+                n_idle++;
+
+        snprintf (line, line_len, "%u new %u reused %u redialed %d idle, DNS %u hit %u miss",
+                        n_dials, n_reuses, n_redials, n_idle, n_dns_hits, n_dns_misses);
+
+        pthread_mutex_unlock (&pool_lock);
+
+        // plus record or replay activity if either is on
+        pthread_mutex_lock (&rr_lock);
+        size_t ll = strlen (line);
+        if (record_dir && ll < line_len)
+            snprintf (line+ll, line_len-ll, ", recorded %u", n_recorded);
+        else if (replay_dir && ll < line_len)
+            snprintf (line+ll, line_len-ll, ", replayed %u unmatched %u", n_replayed, n_unmatched);
+        pthread_mutex_unlock (&rr_lock);
+}
+
+/* non-standard: save each session from now on as a capture file in dir, creating it if necessary,
+ * else stop recording if dir is NULL. numbering continues after any captures already there.
+ * return whether ok.
+ */
+bool WiFiClient::setRecordDir (const char *dir)
+{
+        unsigned last_seq = 0;
+        if (dir) {
+            if (mkdir (dir, 0755) < 0 && errno != EEXIST) {
+                printf ("WiFiCl: mkdir %s: %s\n", dir, strerror(errno));
+                return (false);
+            }
+            struct dirent **names;
+            int n = scandir (dir, &names, isCapture, alphasort);
+            if (n < 0) {
+                printf ("WiFiCl: %s: %s\n", dir, strerror(errno));
+                return (false);
+            }
+            for (int i = 0; i < n; i++) {
+                unsigned seq = strtoul (names[i]->d_name, NULL, 10);
+                if (seq > last_seq)
+                    last_seq = seq;
+                free (names[i]);
+            }
+            free (names);
+        }
+
+        pthread_mutex_lock (&rr_lock);
+        free (record_dir);
+        record_dir = dir ? strdup (dir) : NULL;
+        rec_seq = last_seq;
+        n_recorded = 0;
+        pthread_mutex_unlock (&rr_lock);
+
+        if (dir)
+            printf ("WiFiCl: recording in %s after capture %u\n", dir, last_seq);
+        return (true);
+}
+
+/* non-standard: from now on serve all connections from the capture files in dir with latency_ms before
+ * each connection and response and at no more than kBps KB/s if > 0, else go back to the network
+ * if dir is NULL. return whether ok.
+ */
+bool WiFiClient::setReplayDir (const char *dir, int latency_ms, int kBps)
+{
+        Capture *new_caps = NULL;
+        int n_new = 0;
+        if (dir) {
+            struct dirent **names;
+            int n = scandir (dir, &names, isCapture, alphasort);
+            if (n < 0) {
+                printf ("WiFiCl: %s: %s\n", dir, strerror(errno));
+                return (false);
+            }
+            for (int i = 0; i < n; i++) {
+                char path[1024];
+                snprintf (path, sizeof(path), "%s/%s", dir, names[i]->d_name);
+                free (names[i]);
+                Capture c;
+                if (!loadCapture (path, c)) {
+                    printf ("WiFiCl: %s: not a capture\n", path);
+                    continue;
+                }
+                Capture *more_caps = (Capture *) realloc (new_caps, (n_new+1)*sizeof(Capture));
+                if (!more_caps) {
+                    free (c.path);
+                    free (c.line);
+                    break;
+                }
+                new_caps = more_caps;
+                new_caps[n_new++] = c;
+            }
+            free (names);
+            if (n_new == 0) {
+                printf ("WiFiCl: no captures in %s\n", dir);
+                free (new_caps);
+                return (false);
+            }
+        }
+
+        pthread_mutex_lock (&rr_lock);
+        for (int i = 0; i < n_captures; i++) {
+            free (captures[i].path);
+            free (captures[i].line);
+        }
+        free (captures);
+        captures = new_caps;
+        n_captures = n_new;
+        free (replay_dir);
+        replay_dir = dir ? strdup (dir) : NULL;
+        replay_ms = latency_ms;
+        replay_kBps = kBps;
+        n_replayed = n_unmatched = 0;
+        pthread_mutex_unlock (&rr_lock);
+
+        // connections made so far are not part of the replay
+        poolFlush();
+
+        if (dir)
+            printf ("WiFiCl: replaying %d captures from %s, %d ms latency, %d KB/s\n", n_new, dir,
+                                        latency_ms, kBps);
+        return (true);
+}
+
 IPAddress WiFiClient::remoteIP()
 {
 	struct sockaddr_in sa;
@@ -365,3 +1589,412 @@ IPAddress WiFiClient::remoteIP()
         sscanf (s, "%d.%d.%d.%d", &oct0, &oct1, &oct2, &oct3);
 	return (IPAddress(oct0,oct1,oct2,oct3));
 }
+
+#if defined(_UNIT_TEST)
+
+#include <utility>
+
+/* benchmark reading a map file download from a local stand-in HTTP server one byte at a time,
+ * in bulk and as lines. then check persistent connections against a stand-in that counts them,
+ * answers with Content-Length and chunked bodies and drops a request now and then like a server
+ * whose keep-alive timer fired just as it arrived. check a client closes its socket when it goes out
+ * of scope and can be moved. finally record a few of its responses and check they replay without it,
+ * also with latency and bandwidth limits.
+ * g++ -Wall -O2 -D_UNIT_TEST -o wificlient-test ArduinoLib/WiFiClient.cpp -lpthread && ./wificlient-test
+ */
+
+// same size as a 1600x960 build map file
+#define BM_SIZE         (1320*660*2)
+#define BM_LINEL        80
+#define BM_NRUNS        5
+
+// serve BM_SIZE bytes of body to each connection on listen socket lfd until killed.
+// body is lines of BM_LINEL-1 chars each ending with \n so it suits all modes.
+static void benchServer (int lfd)
+{
+        static char body[BM_SIZE];
+        for (int i = 0; i < BM_SIZE; i++)
+            body[i] = (i % BM_LINEL) == BM_LINEL-1 ? '\n' : 'A' + (i % 26);
+
+        while (true) {
+            int fd = accept (lfd, NULL, NULL);
+            if (fd < 0)
+                exit(1);
+
+            // absorb request through blank line
+            char req[1024];
+            int nreq = 0, nr;
+            while (nreq < (int)sizeof(req)-1 && (nr = ::read (fd, req+nreq, sizeof(req)-1-nreq)) > 0) {
+                nreq += nr;
+                req[nreq] = '\0';
+                if (strstr (req, "\r\n\r\n"))
+                    break;
+            }
+
+            char hdr[100];
+            int nhdr = snprintf (hdr, sizeof(hdr), "HTTP/1.0 200 OK\r\nContent-Length: %d\r\n\r\n",
+                                                BM_SIZE);
+            if (::write (fd, hdr, nhdr) == nhdr && ::write (fd, body, BM_SIZE) != BM_SIZE)
+                printf ("short body\n");
+            close (fd);
+        }
+}
+
+// read client through the blank line after the header. return false if trouble.
+static bool skipHeader (WiFiClient &client)
+{
+        char line[BM_LINEL];
+        bool eol;
+        int nr;
+        do {
+            eol = false;
+            int ll = 0;
+            while (!eol && (nr = client.readUntil ('\n', line+ll, sizeof(line)-1-ll, &eol)) >= 0) {
+                if (nr == 0 && !eol)
+                    usleep (10);
+                ll += nr;
+            }
+            if (nr < 0)
+                return (false);
+            line[ll] = '\0';
+        } while (strcmp (line, "\r") != 0);
+
+        return (true);
+}
+
+// connect, send request and skip header. return false if trouble.
+static bool benchGET (WiFiClient &client, int port)
+{
+        if (!client.connect ("127.0.0.1", port))
+            return (false);
+        client.print ("GET /maps/map-D-1320x660-Countries.bmp HTTP/1.0\r\n\r\n");
+        return (skipHeader (client));
+}
+
+#define KA_BODY         20000           // body bytes per pool test response
+#define KA_NREQ         50              // requests per pool test run
+#define KA_MAXREQ       10              // responses per connection before dropping the next request
+
+static char ka_body[KA_BODY];
+static volatile int ka_n_accepts;
+
+// absorb one request through its blank line into req[]. return false if closed.
+static bool kaRequest (int fd, char req[], int req_len)
+{
+        int nreq = 0, nr;
+        req[0] = '\0';
+        while (nreq < req_len-1 && (nr = ::read (fd, req+nreq, req_len-1-nreq)) > 0) {
+            nreq += nr;
+            req[nreq] = '\0';
+            if (strstr (req, "\r\n\r\n"))
+                return (true);
+        }
+        return (false);
+}
+
+// write all n bytes of buf to fd. return whether ok.
+static bool kaWrite (int fd, const void *buf, int n)
+{
+        return (::write (fd, buf, n) == n);
+}
+
+// serve requests on one connection until the client closes, asks us to or sends one too many
+static void *kaConnection (void *arg)
+{
+        pthread_detach (pthread_self());
+        int fd = (int)(long)arg;
+
+        // like real servers don't let Nagle hold back the body behind the header
+        int on = 1;
+        setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        static const char ka_trailer[] = "0\r\nX-Trailer: 1\r\n\r\n";
+        char req[1024];
+        for (int n_req = 0; kaRequest (fd, req, sizeof(req)) && n_req < KA_MAXREQ; n_req++) {
+            bool ka = strstr (req, "keep-alive") != NULL;
+            char hdr[200];
+            if (strstr (req, "GET /chunk") && strstr (req, "HTTP/1.1")) {
+                // vary chunk sizes so framing lands all over the client's reads
+                int nhdr = snprintf (hdr, sizeof(hdr),
+                            "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n%s\r\n",
+                            ka ? "" : "Connection: close\r\n");
+                bool ok = kaWrite (fd, hdr, nhdr);
+                for (int i = 0, n_chunk; ok && i < KA_BODY; i += n_chunk) {
+                    n_chunk = 1 + (i*7919) % 3001;
+                    if (n_chunk > KA_BODY - i)
+                        n_chunk = KA_BODY - i;
+                    nhdr = snprintf (hdr, sizeof(hdr), "%x;ext=1\r\n", n_chunk);
+                    ok = kaWrite (fd, hdr, nhdr) && kaWrite (fd, ka_body+i, n_chunk)
+                                                 && kaWrite (fd, "\r\n", 2);
+                }
+                if (!ok || !kaWrite (fd, ka_trailer, strlen(ka_trailer)))
+                    break;
+            } else {
+                int nhdr = snprintf (hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n%s\r\n",
+                            KA_BODY, ka ? "" : "Connection: close\r\n");
+                if (!kaWrite (fd, hdr, nhdr) || !kaWrite (fd, ka_body, KA_BODY))
+                    break;
+            }
+            if (!ka)
+                break;
+        }
+
+        close (fd);
+        return (NULL);
+}
+
+// accept connections on listen socket lfd and count them
+static void *kaServer (void *arg)
+{
+        int lfd = (int)(long)arg;
+        while (true) {
+            int fd = accept (lfd, NULL, NULL);
+            if (fd < 0)
+                exit(1);
+            __sync_fetch_and_add (&ka_n_accepts, 1);
+            pthread_t tid;
+            pthread_create (&tid, NULL, kaConnection, (void*)(long)fd);
+        }
+        return (NULL);
+}
+
+// GET page from the pool test server and check the body. return whether ok.
+static bool kaGET (int port, const char *page, bool keep_alive)
+{
+        WiFiClient client;
+        if (!client.connect ("localhost", port))
+            return (false);
+
+        char req[200];
+        snprintf (req, sizeof(req), "GET %s HTTP/1.%d\r\nHost: localhost\r\nConnection: %s\r\n\r\n",
+                            page, keep_alive, keep_alive ? "keep-alive" : "close");
+        client.print (req);
+        if (keep_alive)
+            client.httpKeepAlive();
+        if (!skipHeader (client)) {
+            client.stop();
+            return (false);
+        }
+
+        // read body until EOF, which comes at the end of the body whether or not the connection closed
+        static char body[KA_BODY+1];
+        struct timeval tv0, tv1;
+        gettimeofday (&tv0, NULL);
+        int n_body = 0, nr;
+        while ((nr = client.read ((uint8_t *)body + n_body, sizeof(body) - n_body)) >= 0
+                                                                && n_body < (int)sizeof(body)) {
+            // wait a little when none are ready like waitTCPData() so a server thread can run on one cpu
+            if (nr == 0)
+                usleep (10);
+            n_body += nr;
+            gettimeofday (&tv1, NULL);
+            if (tv1.tv_sec - tv0.tv_sec > 5) {
+                printf ("%s: body never ended after %d bytes\n", page, n_body);
+                break;
+            }
+        }
+        client.stop();
+
+        if (n_body != KA_BODY || memcmp (body, ka_body, KA_BODY) != 0) {
+            printf ("%s: bad body, %d bytes\n", page, n_body);
+            return (false);
+        }
+        return (true);
+}
+
+// run KA_NREQ GETs alternating framing, which only 1.1 may chunk. return whether all ok and report connections and time used.
+static bool kaRun (int port, bool keep_alive)
+{
+        int n0 = ka_n_accepts;
+        struct timeval tv0, tv1;
+        gettimeofday (&tv0, NULL);
+
+        for (int i = 0; i < KA_NREQ; i++)
+            if (!kaGET (port, (i & 1) ? "/chunk" : "/length", keep_alive))
+                return (false);
+
+        gettimeofday (&tv1, NULL);
+        double dt = (tv1.tv_sec - tv0.tv_sec) + (tv1.tv_usec - tv0.tv_usec)/1e6;
+        char stats[200];
+        WiFiClient::getPoolStats (stats, sizeof(stats));
+        printf ("%-11s %3d requests %3d connections %7.1f us/request; pool: %s\n",
+                        keep_alive ? "keep-alive" : "close", KA_NREQ, ka_n_accepts - n0,
+                        1e6*dt/KA_NREQ, stats);
+        return (true);
+}
+
+int main (int ac, char *av[])
+{
+        // listen on any local port
+        int lfd = ::socket (AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in sa;
+        memset (&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+        sa.sin_port = 0;
+        socklen_t sal = sizeof(sa);
+        if (lfd < 0 || bind (lfd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen (lfd, 5) < 0
+                        || getsockname (lfd, (struct sockaddr *)&sa, &sal) < 0) {
+            printf ("listen: %s\n", strerror(errno));
+            return (1);
+        }
+        int port = ntohs (sa.sin_port);
+
+        // server is a child process
+        pid_t pid = fork();
+        if (pid == 0)
+            benchServer (lfd);
+        close (lfd);
+
+        static uint8_t buf[65536];
+        const char *modes[3] = {"read()", "read(buf,n)", "readUntil()"};
+        for (int mode = 0; mode < 3; mode++) {
+
+            double best_mbs = 0;
+            for (int run = 0; run < BM_NRUNS; run++) {
+
+                WiFiClient client;
+                if (!benchGET (client, port)) {
+                    printf ("%s: GET failed\n", modes[mode]);
+                    kill (pid, SIGTERM);
+                    return (1);
+                }
+
+                struct timeval tv0, tv1;
+                gettimeofday (&tv0, NULL);
+
+                // N.B. each mode busy-polls because none of them block
+                long n_body = 0;
+                while (n_body < BM_SIZE && client.connected()) {
+                    switch (mode) {
+                    case 0:
+                        if (client.available() && client.read() >= 0)
+                            n_body++;
+                        break;
+                    case 1: {
+                            int nr = client.read (buf, sizeof(buf));
+                            if (nr > 0)
+                                n_body += nr;
+                        }
+                        break;
+                    case 2: {
+                            bool eol;
+                            int nr = client.readUntil ('\n', (char *)buf, BM_LINEL, &eol);
+                            if (nr > 0)
+                                n_body += nr + eol;
+                        }
+                        break;
+                    }
+                }
+
+                gettimeofday (&tv1, NULL);
+                client.stop();
+
+                if (n_body != BM_SIZE) {
+                    printf ("%s: short body %ld\n", modes[mode], n_body);
+                    kill (pid, SIGTERM);
+                    return (1);
+                }
+                double dt = (tv1.tv_sec - tv0.tv_sec) + (tv1.tv_usec - tv0.tv_usec)/1e6;
+                double mbs = BM_SIZE/dt/1e6;
+                if (mbs > best_mbs)
+                    best_mbs = mbs;
+            }
+
+            printf ("%-12s %8.1f MB/s best of %d %d byte downloads\n", modes[mode], best_mbs,
+                                                BM_NRUNS, BM_SIZE);
+        }
+
+        kill (pid, SIGTERM);
+
+        // persistent connections
+        for (int i = 0; i < KA_BODY; i++)
+            ka_body[i] = (i % BM_LINEL) == BM_LINEL-1 ? '\n' : 'a' + (i % 26);
+        lfd = ::socket (AF_INET, SOCK_STREAM, 0);
+        sa.sin_port = 0;
+        sal = sizeof(sa);
+        if (lfd < 0 || bind (lfd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen (lfd, 5) < 0
+                        || getsockname (lfd, (struct sockaddr *)&sa, &sal) < 0) {
+            printf ("listen: %s\n", strerror(errno));
+            return (1);
+        }
+        port = ntohs (sa.sin_port);
+        pthread_t tid;
+        pthread_create (&tid, NULL, kaServer, (void*)(long)lfd);
+
+        if (!kaRun (port, false))
+            return (1);
+        int n0 = ka_n_accepts;
+        if (!kaRun (port, true))
+            return (1);
+
+        // first request makes a connection then each one after every KA_MAXREQ redials
+        int n_want = (KA_NREQ + KA_MAXREQ - 1)/KA_MAXREQ;
+        if (ka_n_accepts - n0 != n_want) {
+            printf ("keep-alive made %d connections but should be %d\n", ka_n_accepts - n0, n_want);
+            return (1);
+        }
+
+        // a client that goes out of scope without stop() still closes its socket and one that is moved
+        // hands its socket to the new client
+        int scope_fd;
+        {
+            WiFiClient client;
+            if (!client.connect ("localhost", port))
+                return (1);
+            scope_fd = client.fd();
+            WiFiClient moved (std::move (client));
+            if (client.fd() >= 0 || moved.fd() != scope_fd) {
+                printf ("move left fd %d and %d, expected -1 and %d\n", client.fd(), moved.fd(), scope_fd);
+                return (1);
+            }
+        }
+        if (fcntl (scope_fd, F_GETFD) >= 0) {
+            printf ("fd %d still open after its client went out of scope\n", scope_fd);
+            return (1);
+        }
+
+        // record each kind of request once
+        char rr_dir[] = "/tmp/wificlient-test-XXXXXX";
+        if (!mkdtemp (rr_dir) || !WiFiClient::setRecordDir (rr_dir))
+            return (1);
+        for (int i = 0; i < 4; i++)
+            if (!kaGET (port, (i & 1) ? "/chunk" : "/length", i >= 2))
+                return (1);
+        WiFiClient::setRecordDir (NULL);
+
+        // replay them many times, now never reaching the server
+        if (!WiFiClient::setReplayDir (rr_dir, 0, 0))
+            return (1);
+        n0 = ka_n_accepts;
+        if (!kaRun (port, false) || !kaRun (port, true) || !kaGET (port, "/length?v=2", true))
+            return (1);
+        if (ka_n_accepts != n0) {
+            printf ("replay made %d connections to the server\n", ka_n_accepts - n0);
+            return (1);
+        }
+
+        // one new connection and response with latency and limited bandwidth
+        const int rr_ms = 50, rr_kBps = 200;
+        if (!WiFiClient::setReplayDir (rr_dir, rr_ms, rr_kBps))
+            return (1);
+        struct timeval tv0;
+        gettimeofday (&tv0, NULL);
+        if (!kaGET (port, "/length", false))
+            return (1);
+        struct timeval tv1;
+        gettimeofday (&tv1, NULL);
+        double ms = (tv1.tv_sec - tv0.tv_sec)*1e3 + (tv1.tv_usec - tv0.tv_usec)/1e3;
+        double ms_want = 2*rr_ms + 1e3*KA_BODY/(rr_kBps*1024.0);
+        printf ("replay with %d ms %d KB/s took %.1f ms, expected %.1f\n", rr_ms, rr_kBps, ms, ms_want);
+        WiFiClient::setReplayDir (NULL, 0, 0);
+
+        char cmd[100];
+        snprintf (cmd, sizeof(cmd), "rm -rf %s", rr_dir);
+        if (system (cmd) != 0)
+            printf ("%s: can not remove\n", rr_dir);
+
+        return (ms < 0.95*ms_want || ms > ms_want + 100);
+}
+
+#endif // _UNIT_TEST
@@ -36,6 +36,14 @@ class WiFiClient {
 
 	WiFiClient();
 	WiFiClient(int fd);
+        ~WiFiClient();
+
+        // a client owns its socket and buffers so it may be moved but not copied
+        WiFiClient (const WiFiClient &) = delete;
+        WiFiClient &operator= (const WiFiClient &) = delete;
+        WiFiClient (WiFiClient &&from);
+        WiFiClient &operator= (WiFiClient &&from);
+
 	bool connect (const char *host, int port);
 	bool connect (IPAddress ip, int port);
 	void stop (void);
@@ -43,6 +51,8 @@ class WiFiClient {
         void setNoDelay(bool on);
 	bool connected();
 	int read();
+	int read (uint8_t *buf, size_t n);
+	int readUntil (char term, char *buf, int n, bool *found);
 	operator bool();
 	int write (const uint8_t *buf, int n);
 	void print (void);
@@ -60,16 +70,79 @@ class WiFiClient {
 	void flush(void){};
 	IPAddress remoteIP(void);
 
+        // non-standard
+        int fd (void) { return (socket); }
+        int detachFd (void);
+        void adoptFd (int fd);
+        void holdWrites (void);
+        uint8_t *releaseWrites (int *np);
+        void httpKeepAlive (void);
+        bool httpBodyComplete (void) { return (hs_complete); }
+        static void getPoolStats (char line[], size_t line_len);
+        static bool setRecordDir (const char *dir);
+        static bool setReplayDir (const char *dir, int latency_ms, int kBps);
+
     private:
 
+        // response framing state after httpKeepAlive()
+        typedef enum {
+            HS_OFF,                     // no framing, bytes pass unchanged until EOF
+            HS_HEADER,                  // in response header
+            HS_LENGTH,                  // in body of Content-Length
+            HS_CHUNKSIZE,               // in chunk size line
+            HS_CHUNKDATA,               // in chunk data
+            HS_CHUNKEND,                // in CRLF after chunk data
+            HS_TRAILER,                 // in trailer after last chunk
+            HS_TOEOF,                   // body ends at EOF
+            HS_DONE,                    // body complete
+        } HTTPState;
+
 	int socket;
   	uint8_t peek[4096];             // read-ahead buffer
   	int n_peek;                     // n useful values in peek[]
         int next_peek;                  // next peek[] index to use
+        uint8_t *held;                  // malloced writes collected while holding, if any
+        int n_held;                     // n bytes in held[]
+        int held_size;                  // n bytes malloced for held[]
+        bool holding;                   // whether write() collects in held[] instead of sending
 
+        char pool_host[64];             // as given to connect(), "" if too long to pool
+        int pool_port;                  // as given to connect()
+        bool reused;                    // socket came from the pool and may be redialed
+        long n_rx;                      // raw bytes received since connect()
+        uint8_t *sent;                  // malloced copy of writes to a reused socket before any reply
+        int n_sent;                     // n bytes in sent[]
+        HTTPState hs;                   // response framing state
+        long hs_n;                      // bytes left in body or chunk, -1 if no Content-Length
+        int hs_status;                  // response status code, 0 until status line is seen
+        bool hs_chunked;                // Transfer-Encoding: chunked
+        bool hs_reuse;                  // socket may be pooled when body is done
+        bool hs_complete;               // response body was read to its end
+        char hs_line[128];              // header or chunk line being collected, truncated if long
+        int hs_nline;                   // n chars in hs_line[]
+        char rec_line[512];             // first line written while recording, truncated if long
+        int n_rec_line;                 // n chars in rec_line[], -1 once the line is complete
+        uint8_t *rec_rsp;               // malloced raw bytes received while recording
+        size_t n_rec_rsp;               // n bytes in rec_rsp[]
+        size_t rec_rsp_size;            // n bytes malloced for rec_rsp[]
+        bool rec_parked;                // session ended with the socket pooled, not closed
 
         int connect_to (int sockfd, struct sockaddr *serv_addr, int addrlen, int to_ms);
         int tout (int to_ms, int fd);
+        bool readReady (void);
+        bool fillPeek (void);
+        void take (WiFiClient &from);
+        void initState (void);
+        void endSession (void);
+        void recordWrite (const uint8_t *buf, int n);
+        void recordRead (const uint8_t *buf, int n);
+        int dial (const char *host, int port);
+        bool redial (void);
+        void park (void);
+        int recvBytes (uint8_t *buf, size_t n);
+        int decodeHTTP (uint8_t *buf, int n);
+        bool hsLine (uint8_t c);
+        void hsHeaderLine (void);
 
 };
 
@@ -33,6 +33,9 @@ class WiFiUDP {
 	int read(uint8_t *buf, int n);
 	void stop();
 
+        // non-standard
+        int fd (void) { return (sockfd); }
+
     private:
 
 	struct sockaddr_in remoteip;
@@ -189,6 +189,9 @@ static void defaultState()
     satResetIO();
     disableMCPPoller (onair_poller);
     radioResetIO();
+
+    // save any settings still waiting to be written
+    EEPROM.flush();
 }
 
 
@@ -2517,11 +2520,14 @@ bool timesUp (uint32_t *prev, uint32_t atleast_dt)
 {
     uint32_t ms = millis();
     uint32_t dt = ms - *prev;   // works ok if millis rolls over
-    if (dt > atleast_dt) {
+    bool up = dt > atleast_dt;
+    if (up)
         *prev = ms;
-        return (true);
-    }
-    return (false);
+#if defined(_IS_UNIX)
+    // let an event driven main loop sleep until this is due again, ignored unless on the main thread
+    wakeLoopBy (*prev + atleast_dt + 1);
+#endif // _IS_UNIX
+    return (up);
 }
 
 
@@ -2550,8 +2556,9 @@ void postDiags (void)
             cl += s.st_size;
     }
 
-    // add eeprom file
-    if (stat (EEPROM.getFilename(), &s) == 0)
+    // add eeprom file, as text
+    const char *ee_fn = EEPROM.exportText();
+    if (stat (ee_fn, &s) == 0)
         cl += s.st_size;
 
     Serial.printf ("DP: %d %s\n", cl, fn);
@@ -2570,7 +2577,7 @@ void postDiags (void)
 
         // just concat each file including eeprom
         for (int i = 0; i <= N_DIAG_FILES; i++) {                       // 1 more for eeprom
-            std::string dp = i < N_DIAG_FILES ? our_dir + diag_files[i] : EEPROM.getFilename();
+            std::string dp = i < N_DIAG_FILES ? our_dir + diag_files[i] : ee_fn;
             FILE *fp = fopen (dp.c_str(), "r");
             if (fp) {
                 Serial.printf ("DP:   %s\n", dp.c_str());
@@ -649,6 +649,9 @@ extern void updateADIF (const SBox &box);
 extern bool checkADIFTouch (const SCoord &s, const SBox &box);
 extern void drawADIFSpotsOnMap (void);
 extern int readADIFWiFiClient (WiFiClient &client, long content_length, char ynot[], int n_ynot);
+extern int crackADIFWiFiClient (WiFiClient &client, long content_length, DXClusterSpot **spotsp,
+    uint8_t *crcp, char ynot[], int n_ynot);
+extern int setADIFSpots (DXClusterSpot *spots, int n_spots, uint8_t crc);
 extern bool getClosestADIFSpot (const LatLong &ll, DXClusterSpot *sp, LatLong *llp);
 extern void checkADIF(void);
 
@@ -894,6 +897,7 @@ extern bool updateDXCluster(const SBox &box);
 extern void closeDXCluster(void);
 extern bool checkDXClusterTouch (const SCoord &s, const SBox &box);
 extern bool getDXClusterSpots (DXClusterSpot **spp, uint8_t *nspotsp);
+extern bool copyDXClusterSpots (DXClusterSpot **spp, uint8_t *nspotsp);
 extern void drawDXClusterSpotsOnMap (void);
 extern void updateDXClusterSpotScreenLocations(void);
 extern bool isDXClusterConnected(void);
@@ -965,6 +969,12 @@ extern uint32_t max_wd_dt;
 extern uint8_t flash_crc_ok;
 
 extern void drawMoreEarth (void);
+#if defined(_IS_UNIX)
+extern void stopMapSweep (void);
+extern bool getMapSweepStats (int i, char line[], size_t line_len);
+#endif // _IS_UNIX
+extern void markMapPathsStale (void);
+extern void markMapSymbolsStale (void);
 extern void eraseDEMarker (void);
 extern void eraseDEAPMarker (void);
 extern void drawDEMarker (bool force);
@@ -1192,6 +1202,42 @@ extern float nearestKD3Dist2Miles(float d);
 
 
 
+/*********************************************************************************************
+ *
+ * ctyindex.cpp
+ *
+ */
+
+typedef struct {
+    char call[MAX_SPOTCALL_LEN];                // mostly prefixes, a few calls
+    float lat_d, lng_d;                         // +N +E degrees
+    int call_len;                               // handy strlen(call)
+    int prefix_i;                               // index of longest other entry that prefixes call, else -1
+} CtyLoc;
+
+extern int mkCtyIndex (CtyLoc *list, int n);
+extern const CtyLoc *findCtyLoc (const CtyLoc *list, int n, const char *call);
+
+
+
+
+
+/*********************************************************************************************
+ *
+ * httpcache.cpp
+ *
+ */
+
+extern bool httpCacheHCGET (WiFiClient &client, const char *hc_page_progmem);
+extern bool httpCacheStale (void);
+#if defined(_IS_UNIX)
+extern bool getHTTPCacheStats (char line[], size_t line_len);
+#endif
+
+
+
+
+
 /*********************************************************************************************
  *
  * liveweb-html.cpp
@@ -1212,6 +1258,7 @@ extern char live_html[];
 extern void initLiveWeb(bool verbose);
 extern bool liveweb_fs_ready;
 extern time_t last_live;
+extern bool getLiveWebStats (int i, char line[], size_t line_len);
 
 
 
@@ -1467,6 +1514,9 @@ extern SBox mapscale_b;                 // map scale box
 
 extern void initCoreMaps(void);
 extern bool installFreshMaps(void);
+#if defined(_IS_UNIX)
+extern bool getMapPrefetchStats (char line[], size_t line_len);
+#endif
 extern float propMap2MHz (PropMapBand band);
 extern int propMap2Band (PropMapBand band);
 extern bool getMapDayPixel (uint16_t row, uint16_t col, uint16_t *dayp);
@@ -2330,12 +2380,15 @@ extern void updateWiFi(void);
 extern bool checkBCTouch (const SCoord &s, const SBox &b);
 extern bool setPlotChoice (PlotPane new_pp, PlotChoice new_ch);
 extern bool getTCPChar (WiFiClient &client, char *cp);
+extern bool getFetchStats (int i, char line[], size_t line_len);
+extern size_t getTCPBytes (WiFiClient &client, uint8_t *buf, size_t n);
 extern time_t getNTPUTC(const char **server);
 extern void scheduleRSSNow(void);
 extern bool getTCPLine (WiFiClient &client, char line[], uint16_t line_len, uint16_t *ll);
 extern void sendUserAgent (WiFiClient &client);
 extern bool wifiOk(void);
 extern void httpGET (WiFiClient &client, const char *server, const char *page);
+extern void httpGET (WiFiClient &client, const char *server, const char *page, const char *xhdrs);
 extern void httpHCGET (WiFiClient &client, const char *server, const char *hc_page);
 extern void httpHCPGET (WiFiClient &client, const char *server, const char *hc_page_progmem);
 extern bool httpSkipHeader (WiFiClient &client);
@@ -580,6 +580,7 @@ static void resetADIFSpots(void)
     adif_ss.n_data = 0;
     adif_ss.top_vis = 0;
     prev_crc = 0;
+    markMapSymbolsStale();
 }
 
 /* draw complete ADIF pane in the given box
@@ -612,11 +613,11 @@ static void drawADIFPane (const SBox &box, const char *filename)
     drawAllVisADIFSpots (box);
 }
 
-/* add another spot to adif_spots[] unless older than oldest so far.
+/* add another spot to spots[], which has room for MAX_SPOTS, unless older than oldest so far.
  * maintain sorted order of oldest spot first.
- * only way we can fail is run out of memory.
+ * N.B. touches nothing else so may be used from any thread, DE fields are filled later by fillADIFDE().
  */
-static void addADIFSpot (const DXClusterSpot &spot)
+static void addADIFSpot (const DXClusterSpot &spot, DXClusterSpot *spots, int &n_spots)
 {
     #if defined(_TRACE)
         printf ("new spot: %s %s %s %s %g %g %s %g %ld\n", 
@@ -625,30 +626,33 @@ static void addADIFSpot (const DXClusterSpot &spot)
     #endif
 
     // if already full, just discard spot if older than oldest
-    if (adif_ss.n_data == MAX_SPOTS && spot.spotted < adif_spots[0].spotted)
+    if (n_spots == MAX_SPOTS && spot.spotted < spots[0].spotted)
         return;
 
     // assuming file probably has oldest entries first then each spot is probably newer than any so far,
     // so work back from the end to find the newest older entry
     int new_i;                                  // will be the index of the newest entry older than spot
-    for (new_i = adif_ss.n_data; --new_i >= 0 && spot.spotted < adif_spots[new_i].spotted; )
+    for (new_i = n_spots; --new_i >= 0 && spot.spotted < spots[new_i].spotted; )
         continue;
 
-    if (adif_ss.n_data == MAX_SPOTS) {
-        // adif_spots is already full: make room by shifting out the oldest up through new_i
-        memmove (adif_spots, &adif_spots[1], new_i * sizeof(DXClusterSpot));
+    if (n_spots == MAX_SPOTS) {
+        // spots is already full: make room by shifting out the oldest up through new_i
+        memmove (spots, &spots[1], new_i * sizeof(DXClusterSpot));
     } else {
         // make room by moving existing entries newer than new_i
-        memmove (&adif_spots[new_i+2], &adif_spots[new_i+1], (adif_ss.n_data-new_i-1)*sizeof(DXClusterSpot));
-        adif_ss.n_data += 1;                   // we've made room for spot
+        memmove (&spots[new_i+2], &spots[new_i+1], (n_spots-new_i-1)*sizeof(DXClusterSpot));
+        n_spots += 1;                           // we've made room for spot
         new_i += 1;                             // put it 1 past the older entry 
     }
 
     // place new spot at new_i
-    DXClusterSpot &new_spot = adif_spots[new_i];
-    new_spot = spot;
+    spots[new_i] = spot;
+}
 
-    // supply missing fields from DE
+/* supply any fields of the given spot that are missing from DE.
+ */
+static void fillADIFDE (DXClusterSpot &new_spot)
+{
     if (!new_spot.de_call[0])
         snprintf (new_spot.de_call, sizeof(new_spot.de_call), "%s", getCallsign());
     if (!new_spot.de_grid[0]) {
@@ -690,8 +694,10 @@ static int readADIFile (FILE *fp, char ynot[], int n_ynot)
             return (-1);
         }
         if (adif.ps == ADIFPS_FINISHED)
-            addADIFSpot (spot);
+            addADIFSpot (spot, adif_spots, adif_ss.n_data);
     }
+    for (int i = 0; i < adif_ss.n_data; i++)
+        fillADIFDE (adif_spots[i]);
 
     // gettimeofday (&t1, NULL);
     // printf ("file update %ld us\n", TVDELUS (t0, t1));
@@ -708,6 +714,7 @@ static int readADIFile (FILE *fp, char ynot[], int n_ynot)
 
     // shrink back to just what we need
     adif_spots = (DXClusterSpot *) realloc (adif_spots, adif_ss.n_data * sizeof(DXClusterSpot));
+    markMapSymbolsStale();
 
     // ok
     return (adif_ss.n_data);
@@ -715,20 +722,24 @@ static int readADIFile (FILE *fp, char ynot[], int n_ynot)
 
 
 
-/* replace adif_spots with those found in the given network connection.
- * return new count else -1 with short reason in ynot[] and adif_spots reset.
- * N.B. we set from_set_adif.
+/* crack the ADIF stream in the given network connection into a new malloced list of its newest MAX_SPOTS
+ * spots, in *spotsp, and its checksum, in *crcp, without touching adif_spots, so this may be called from
+ * any thread. the list is then installed with setADIFSpots().
+ * return count else -1 with short reason in ynot[], including running out of memory, and *spotsp NULL.
  * N.B. caller must close connection.
- * N.B. silently trucated to newest MAX_SPOTS
  * N.B. errors only reported for broken adif, not missing fields
  */
-int readADIFWiFiClient (WiFiClient &client, long content_length, char ynot[], int n_ynot)
+int crackADIFWiFiClient (WiFiClient &client, long content_length, DXClusterSpot **spotsp,
+        uint8_t *crcp, char ynot[], int n_ynot)
 {
-    // restart list at full capacity
-    adif_spots = (DXClusterSpot *) realloc (adif_spots, MAX_SPOTS * sizeof(DXClusterSpot));
-    if (!adif_spots)
-        fatalError (_FX("ADIF: no memory for new spots\n"));
-    adif_ss.n_data = 0;
+    // start list at full capacity
+    DXClusterSpot *spots = (DXClusterSpot *) malloc (MAX_SPOTS * sizeof(DXClusterSpot));
+    if (!spots) {
+        snprintf (ynot, n_ynot, _FX("no memory for %d spots"), MAX_SPOTS);
+        *spotsp = NULL;
+        return (-1);
+    }
+    int n_spots = 0;
 
     // struct timeval t0, t1;
     // gettimeofday (&t0, NULL);
@@ -740,33 +751,72 @@ int readADIFWiFiClient (WiFiClient &client, long content_length, char ynot[], in
     char c;
     for (long nr = 0; (!content_length || nr < content_length) && getTCPChar (client, &c); nr++) {
         if (!parseADIF(c, adif, spot, ynot, n_ynot)) {
-            resetADIFSpots();
+            free (spots);
+            *spotsp = NULL;
             return (-1);
         }
         if (adif.ps == ADIFPS_FINISHED)
-            addADIFSpot (spot);
+            addADIFSpot (spot, spots, n_spots);
     }
 
     // gettimeofday (&t1, NULL);
     // printf ("file update %ld us\n", TVDELUS (t0, t1));
 
+    *spotsp = spots;
+    *crcp = adif.crc;
+    return (n_spots);
+}
+
+/* replace adif_spots with the list found by crackADIFWiFiClient(), which we take over, or reset them if
+ * n_spots < 0.
+ * return new count else -1.
+ * N.B. we set from_set_adif.
+ */
+int setADIFSpots (DXClusterSpot *spots, int n_spots, uint8_t crc)
+{
+    if (n_spots < 0) {
+        free (spots);
+        resetADIFSpots();
+        return (-1);
+    }
+
+    // install, shrunk back to just what we need
+    free (adif_spots);
+    adif_spots = (DXClusterSpot *) realloc (spots, n_spots * sizeof(DXClusterSpot));
+    adif_ss.n_data = n_spots;
+    for (int i = 0; i < n_spots; i++)
+        fillADIFDE (adif_spots[i]);
+    markMapSymbolsStale();
+
     // note spots came from network
     from_set_adif = true;
 
     // scroll all the way down unless likely the same list
-    Serial.printf (_FX("ADIF: crc %d previous %d\n"), adif.crc, prev_crc);
-    if (adif.crc != prev_crc) {
+    Serial.printf (_FX("ADIF: crc %d previous %d\n"), crc, prev_crc);
+    if (crc != prev_crc) {
         adif_ss.scrollToNewest();
-        prev_crc = adif.crc;
+        prev_crc = crc;
     }
 
-    // shrink back to just what we need
-    adif_spots = (DXClusterSpot *) realloc (adif_spots, adif_ss.n_data * sizeof(DXClusterSpot));
-
     // ok
     return (adif_ss.n_data);
 }
 
+/* replace adif_spots with those found in the given network connection.
+ * return new count else -1 with short reason in ynot[] and adif_spots reset.
+ * N.B. we set from_set_adif.
+ * N.B. caller must close connection.
+ * N.B. silently trucated to newest MAX_SPOTS
+ * N.B. errors only reported for broken adif, not missing fields
+ */
+int readADIFWiFiClient (WiFiClient &client, long content_length, char ynot[], int n_ynot)
+{
+    DXClusterSpot *spots;
+    uint8_t crc = 0;
+    int n_spots = crackADIFWiFiClient (client, content_length, &spots, &crc, ynot, n_ynot);
+    return (setADIFSpots (spots, n_spots, crc));
+}
+
 
 /* called occasionally to show ADIF records.
  * if records were set via set_adif or no file name is available set name to "set_adif".
@@ -0,0 +1,248 @@
+/* longest prefix lookup of call signs in the cty location table.
+ *
+ * the table is sorted ala strcmp and each entry records the longest other entry that is a prefix of it.
+ * the longest entry that is a prefix of a given call must then be the entry at or just before where the
+ * call would sort or else one of that entry's chain of prefixes, so a lookup costs one binary search plus
+ * at most one comparison per character of the call.
+ *
+ * usage: fill a CtyLoc list, call mkCtyIndex() once then findCtyLoc() for each lookup; see unit test.
+ *
+ * to build and run a stand-alone main test and benchmark against the former linear scan:
+ *    g++ -Wall -O2 -D_UNIT_TEST -o x.ctyindex ctyindex.cpp && ./x.ctyindex cty_wt_mod-ll.txt spots.txt
+ * where spots.txt is a recorded cluster feed or any file with one call at the start of each line.
+ */
+
+
+/* use HamClock.h but if unit test then define here what we need from it
+ */
+
+#if defined (_UNIT_TEST)
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/time.h>
+
+#define MAX_SPOTCALL_LEN                12      // including \0
+
+typedef struct {
+    char call[MAX_SPOTCALL_LEN];                // mostly prefixes, a few calls
+    float lat_d, lng_d;                         // +N +E degrees
+    int call_len;                               // handy strlen(call)
+    int prefix_i;                               // index of longest other entry that prefixes call, else -1
+} CtyLoc;
+
+
+#else // !_UNIT_TEST
+
+#include "HamClock.h"
+
+#endif // !_UNIT_TEST
+
+
+
+/* qsort-style compare two CtyLoc by call
+ */
+static int qsCtyLoc (const void *p1, const void *p2)
+{
+    return (strcmp (((const CtyLoc *)p1)->call, ((const CtyLoc *)p2)->call));
+}
+
+/* sort list by call, discard duplicate calls and link each entry to its longest prefix.
+ * return new count.
+ */
+int mkCtyIndex (CtyLoc *list, int n)
+{
+    qsort (list, n, sizeof(CtyLoc), qsCtyLoc);
+
+    // chain of entries each a prefix of the next, longest last. one per length so can never overflow.
+    int chain[MAX_SPOTCALL_LEN];
+    int n_chain = 0;
+
+    int n_keep = 0;
+    for (int i = 0; i < n; i++) {
+
+        // keep just the first of any duplicates
+        CtyLoc &cl = list[i];
+        if (n_keep > 0 && strcmp (list[n_keep-1].call, cl.call) == 0)
+            continue;
+        cl.call_len = strlen (cl.call);
+        list[n_keep] = cl;
+
+        // sorted order means any prefix of this entry is already in the chain
+        while (n_chain > 0 && strncmp (list[chain[n_chain-1]].call, cl.call,
+                                                        list[chain[n_chain-1]].call_len) != 0)
+            n_chain--;
+        list[n_keep].prefix_i = n_chain > 0 ? chain[n_chain-1] : -1;
+        chain[n_chain++] = n_keep++;
+    }
+
+    return (n_keep);
+}
+
+/* return the longest entry in list that is a prefix of call, else NULL.
+ * N.B. list must have been prepared with mkCtyIndex()
+ */
+const CtyLoc *findCtyLoc (const CtyLoc *list, int n, const char *call)
+{
+    // find last entry that sorts at or before call
+    int lo = 0, hi = n - 1, i = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp (list[mid].call, call) <= 0) {
+            i = mid;
+            lo = mid + 1;
+        } else
+            hi = mid - 1;
+    }
+
+    // any prefix of call sorts between it and call so is this entry or one of its prefixes
+    while (i >= 0 && strncmp (list[i].call, call, list[i].call_len) != 0)
+        i = list[i].prefix_i;
+
+    return (i >= 0 ? &list[i] : NULL);
+}
+
+
+
+#if defined(_UNIT_TEST)
+
+/* return microseconds since t0
+ */
+static long usSince (const struct timeval &t0)
+{
+    struct timeval t1;
+    gettimeofday (&t1, NULL);
+    return ((t1.tv_sec - t0.tv_sec)*1000000L + (t1.tv_usec - t0.tv_usec));
+}
+
+/* the former lookup: linear scan of sorted list from the first entry with the same first character
+ */
+static const CtyLoc *linearCtyLoc (const CtyLoc *list, int n, const int radix[], const char *call)
+{
+    const CtyLoc *candidate = NULL;
+    int radix_index = call[0] - '0';
+    if (radix_index >= 0 && radix_index < 'Z' - '0' + 1) {
+        int len_match = 0;
+        for (int i = radix[radix_index]; i >= 0 && i < n; i++) {
+            const CtyLoc *cp = &list[i];
+            if (cp->call[0] != call[0])
+                break;
+            if (strncmp (cp->call, call, cp->call_len) == 0) {
+                int cc_len = strlen(cp->call);
+                if (cc_len > len_match) {
+                    len_match = cc_len;
+                    candidate = cp;
+                }
+            }
+        }
+    }
+    return (candidate);
+}
+
+int main (int ac, char *av[])
+{
+    if (ac != 3) {
+        fprintf (stderr, "Usage: %s cty_wt_mod-ll.txt spots.txt\n", av[0]);
+        return (1);
+    }
+
+    // read cty table
+    FILE *fp = fopen (av[1], "r");
+    if (!fp) {
+        perror (av[1]);
+        return (1);
+    }
+    CtyLoc *list = NULL;
+    int n_list = 0;
+    char line[200];
+    while (fgets (line, sizeof(line), fp)) {
+        CtyLoc cl;
+        if (line[0] == '#' || sscanf (line, "%11s %f %f", cl.call, &cl.lat_d, &cl.lng_d) != 3)
+            continue;
+        list = (CtyLoc *) realloc (list, (n_list+1)*sizeof(CtyLoc));
+        list[n_list++] = cl;
+    }
+    fclose (fp);
+
+    struct timeval t0;
+    gettimeofday (&t0, NULL);
+    int n_cty = mkCtyIndex (list, n_list);
+    printf ("%d cty entries, %d unique, index built in %ld us\n", n_list, n_cty, usSince(t0));
+
+    // radix for the linear reference
+    int radix['Z' - '0' + 1];
+    for (int i = 0; i < 'Z' - '0' + 1; i++)
+        radix[i] = -1;
+    for (int i = n_cty; --i >= 0; ) {
+        int ri = list[i].call[0] - '0';
+        if (ri >= 0 && ri < 'Z' - '0' + 1)
+            radix[ri] = i;
+    }
+
+    // collect calls: DE and DX from "DX de" cluster lines else first word of each line
+    fp = fopen (av[2], "r");
+    if (!fp) {
+        perror (av[2]);
+        return (1);
+    }
+    char (*calls)[MAX_SPOTCALL_LEN] = NULL;
+    int n_calls = 0;
+    while (fgets (line, sizeof(line), fp)) {
+        char c1[MAX_SPOTCALL_LEN], c2[MAX_SPOTCALL_LEN];
+        float kHz;
+        int n = 0;
+        if (sscanf (line, "DX de %11[^: ]: %f %11s", c1, &kHz, c2) == 3)
+            n = 2;
+        else if (sscanf (line, "%11s", c1) == 1)
+            n = 1;
+        for (int i = 0; i < n; i++) {
+            calls = (char (*)[MAX_SPOTCALL_LEN]) realloc (calls, (n_calls+1)*MAX_SPOTCALL_LEN);
+            char *cp = calls[n_calls++];
+            strcpy (cp, i == 0 ? c1 : c2);
+            for (; *cp; cp++)
+                *cp = toupper(*cp);
+        }
+    }
+    fclose (fp);
+    printf ("%d calls\n", n_calls);
+
+    // check both find the same entry
+    int n_bad = 0, n_found = 0;
+    for (int i = 0; i < n_calls; i++) {
+        const CtyLoc *a = findCtyLoc (list, n_cty, calls[i]);
+        const CtyLoc *b = linearCtyLoc (list, n_cty, radix, calls[i]);
+        if (a != b) {
+            printf ("%-12s index %-12s linear %s\n", calls[i], a ? a->call : "-", b ? b->call : "-");
+            n_bad++;
+        }
+        if (a)
+            n_found++;
+    }
+    printf ("%d found, %d disagree\n", n_found, n_bad);
+
+    // time each over enough repeats to be measurable
+    const int n_rep = 1 + 2000000/(n_calls+1);
+    volatile int sink = 0;
+    gettimeofday (&t0, NULL);
+    for (int r = 0; r < n_rep; r++)
+        for (int i = 0; i < n_calls; i++)
+            sink += findCtyLoc (list, n_cty, calls[i]) != NULL;
+    long us_index = usSince (t0);
+    gettimeofday (&t0, NULL);
+    for (int r = 0; r < n_rep; r++)
+        for (int i = 0; i < n_calls; i++)
+            sink += linearCtyLoc (list, n_cty, radix, calls[i]) != NULL;
+    long us_linear = usSince (t0);
+    double n_look = (double)n_rep*n_calls;
+    printf ("index  %8.3f us/lookup\n", us_index/n_look);
+    printf ("linear %8.3f us/lookup\n", us_linear/n_look);
+
+    free (list);
+    free (calls);
+    return (n_bad > 0);
+}
+
+#endif // _UNIT_TEST
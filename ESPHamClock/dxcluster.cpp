@@ -33,6 +33,9 @@ static uint32_t last_action;                    // time of most recent spot or u
 #define MAX_SPOTS       (DXMAX_VIS+nMoreScrollRows())
 static DXClusterSpot *dx_spots;                 // malloced list, oldest at [0]
 static ScrollState dxc_ss = {DXMAX_VIS,0,0};    // scrolling info
+#if defined(_IS_UNIX)
+static pthread_mutex_t spots_lock = PTHREAD_MUTEX_INITIALIZER;  // guards changing dx_spots, n_data for copyDXClusterSpots()
+#endif
 
 
 
@@ -190,16 +193,9 @@ static bool lookForDXClusterString (char *buf, uint16_t bufl, const char *needle
 static bool getDXClusterSpotLL (const char *call, LatLong &ll)
 {
         static char cty_page[] PROGMEM = "/cty/cty_wt_mod-ll.txt";
-        typedef struct {
-            char call[MAX_SPOTCALL_LEN];                // mostly prefixes, a few calls; sorted ala strcmp
-            float lat_d, lng_d;                         // +N +E degrees
-            int call_len;                               // handy strlen(call)
-        } CtyLoc;
-        static CtyLoc *cty_list;                        // malloced list
+        static CtyLoc *cty_list;                        // malloced list, indexed by mkCtyIndex()
         static int n_cty;                               // n entries
-        #define _N_RADIX ('Z' - '0' + 1)                // radix range, 
         #define _LOOKUP_DT (3600*24*1000L)              // refresh period, millis
-        static int radix[_N_RADIX];                     // table of cty_list index from first character
         static uint32_t last_lookup;                    // update occasionally
 
         // retrieve the file first time or once per _LOOKUP_DT
@@ -229,9 +225,8 @@ static bool getDXClusterSpotLL (const char *call, LatLong &ll)
                 int n_malloc = 0;
                 const int n_more = 1000;
 
-                // read lines and build tables
+                // read lines and build list
                 char line[50];
-                char prev_radix = 0;
                 uint16_t line_len;
                 CtyLoc cl;
                 while (getTCPLine (cty_client, line, sizeof(line), &line_len)) {
@@ -252,23 +247,14 @@ static bool getDXClusterSpotLL (const char *call, LatLong &ll)
                         if (!cty_list)
                             fatalError (_FX("No memory for cluster location list %d\n"), n_malloc);
                     }
-                    cl.call_len = strlen(cl.call);
                     cty_list[n_cty++] = cl;
-
-                    // update radix index when first char changes
-                    if (cl.call[0] != prev_radix) {
-                        int radix_index = cl.call[0] - '0';
-                        if (radix_index < 0 || radix_index >= _N_RADIX)
-                            fatalError (_FX("cluster radix out of range %d %d"), radix_index, _N_RADIX);
-                        radix[radix_index] = n_cty - 1;
-                        prev_radix = cl.call[0];
-                        // printf ("********* radix %c %5d %5d\n",cl.call[0],radix_index,radix[radix_index]);
-                    }
                 }
 
-                // sanity check
-                if (n_cty > 20000)
+                // sanity check then index for findCtyLoc()
+                if (n_cty > 20000) {
+                    n_cty = mkCtyIndex (cty_list, n_cty);
                     ok = true;
+                }
             }
 
           out:
@@ -291,29 +277,8 @@ static bool getDXClusterSpotLL (const char *call, LatLong &ll)
             }
         }
 
-        // start at radix then find longest cty_list call entry that starts with call.
-        const CtyLoc *candidate = NULL;
-        int radix_index = call[0] - '0';
-        if (radix_index >= 0 && radix_index < _N_RADIX) {
-            int start = radix[radix_index];
-            int len_match = 0;
-            // printf ("********* %c start %d .. ", call[0], start);
-            for (int i = start; i < n_cty; i++) {
-                const CtyLoc *cp = &cty_list[i];
-                if (cp->call[0] != call[0]) {
-                    // printf ("%d\n", i);
-                    break;
-                }
-                if (strncmp (cp->call, call, cp->call_len) == 0) {
-                    int cc_len = strlen(cp->call);
-                    if (cc_len > len_match) {
-                        len_match = cc_len;
-                        candidate = cp;
-                    }
-                }
-            }
-        } else
-            fatalError (_FX("cluster radix out of range %d %d"), radix_index, _N_RADIX);
+        // find longest cty_list call entry that starts with call.
+        const CtyLoc *candidate = findCtyLoc (cty_list, n_cty, call);
 
         if (candidate) {
             ll.lat_d = candidate->lat_d;
@@ -349,10 +314,18 @@ static void engageDXCRow (DXClusterSpot &s)
  */
 static void addDXClusterSpot (const SBox &box, DXClusterSpot &new_spot)
 {
+        // N.B. unlock before returning!
+    #if defined(_IS_UNIX)
+        pthread_mutex_lock (&spots_lock);
+    #endif
+
         // skip if looks to be same as any previous
         for (int i = 0; i < dxc_ss.n_data; i++) {
             DXClusterSpot &spot = dx_spots[i];
             if (fabsf(new_spot.kHz-spot.kHz) < 0.1F && strcmp (new_spot.dx_call, spot.dx_call) == 0) {
+            #if defined(_IS_UNIX)
+                pthread_mutex_unlock (&spots_lock);
+            #endif
                 dxcLog (_FX("DXC: %s dup\n"), new_spot.dx_call);
                 return;
             }
@@ -368,14 +341,27 @@ static void addDXClusterSpot (const SBox &box, DXClusterSpot &new_spot)
             dxc_ss.n_data = MAX_SPOTS - 1;
         } else {
             // grow dx_spots
-            dx_spots = (DXClusterSpot *) realloc (dx_spots, (dxc_ss.n_data+1) * sizeof(DXClusterSpot));
-            if (!dx_spots)
+            DXClusterSpot *new_spots = (DXClusterSpot *) realloc (dx_spots,
+                                                                (dxc_ss.n_data+1) * sizeof(DXClusterSpot));
+            if (!new_spots) {
+            #if defined(_IS_UNIX)
+                pthread_mutex_unlock (&spots_lock);
+            #endif
                 fatalError (_FX("No memory for %d spots"), dxc_ss.n_data);
+            }
+            dx_spots = new_spots;
         }
 
-        // append
+        // append, with its map position while still locked
         DXClusterSpot &list_spot = dx_spots[dxc_ss.n_data++];
         list_spot = new_spot;
+    #if defined (_SUPPORT_DXCPLOT)
+        setDXCSpotPosition (list_spot);
+    #endif
+    #if defined(_IS_UNIX)
+        pthread_mutex_unlock (&spots_lock);
+    #endif
+        markMapSymbolsStale();
 
         // printf ("***************** new: n_dxspots= %3d top_vis= %3d\n", n_dxspots, top_vis);
 
@@ -386,7 +372,6 @@ static void addDXClusterSpot (const SBox &box, DXClusterSpot &new_spot)
     #if defined (_SUPPORT_DXCPLOT)
 
         // show on map
-        setDXCSpotPosition (list_spot);
         drawDXPathOnMap (list_spot);
         drawDXCLabelOnMap (list_spot);
 
@@ -660,6 +645,11 @@ static bool connectDXCluster (const SBox &box)
 
             if (ok) {
 
+                // run loop() as packets arrive
+                #if defined(_IS_UNIX)
+                    wakeLoopOnInput (wsjtx_server.fd(), true);
+                #endif
+
                 // record and claim ok so far
                 cl_type = CT_WSJTX;
                 return (true);
@@ -676,6 +666,11 @@ static bool connectDXCluster (const SBox &box)
                 updateClocks(false);
                 dxcLog (_FX("connect ok\n"));
 
+                // run loop() as spots arrive
+                #if defined(_IS_UNIX)
+                    wakeLoopOnInput (dx_client.fd(), true);
+                #endif
+
                 // assume first question is asking for call
                 wdDelay(100);
                 const char *login = getDXClusterLogin();
@@ -751,8 +746,15 @@ static bool connectDXCluster (const SBox &box)
                 if (millis() - last_action < MAX_AGE) {
                     drawAllVisDXCSpots(box);
                 } else {
+                #if defined(_IS_UNIX)
+                    pthread_mutex_lock (&spots_lock);
+                #endif
                     dxc_ss.n_data = 0;
                     dxc_ss.top_vis = 0;
+                #if defined(_IS_UNIX)
+                    pthread_mutex_unlock (&spots_lock);
+                #endif
+                    markMapSymbolsStale();
                 }
 
                 // all ok so far
@@ -1130,8 +1132,15 @@ bool checkDXClusterTouch (const SCoord &s, const SBox &box)
             if (s.x < box.x + CLR_DX+2*CLR_R) {
                 initDXGUI(box);
                 showHostPort (box, RA8875_GREEN);
+            #if defined(_IS_UNIX)
+                pthread_mutex_lock (&spots_lock);
+            #endif
                 dxc_ss.n_data = 0;
                 dxc_ss.top_vis = 0;
+            #if defined(_IS_UNIX)
+                pthread_mutex_unlock (&spots_lock);
+            #endif
+                markMapSymbolsStale();
                 return (true);
             }
 
@@ -1168,14 +1177,47 @@ bool getDXClusterSpots (DXClusterSpot **spp, uint8_t *nspotsp)
         return (false);
 }
 
+#if defined(_IS_UNIX)
+
+/* pass back a malloced copy of the current spots list, and return whether enabled at all.
+ * unlike getDXClusterSpots() this is safe to call from other threads.
+ * N.B. caller must free *spp if we return true, even if *nspotsp is 0.
+ */
+bool copyDXClusterSpots (DXClusterSpot **spp, uint8_t *nspotsp)
+{
+        if (!useDXCluster())
+            return (false);
+
+        pthread_mutex_lock (&spots_lock);
+        uint8_t n = dxc_ss.n_data;
+        DXClusterSpot *copy = (DXClusterSpot *) malloc ((n+1) * sizeof(DXClusterSpot));
+        if (copy && n > 0)
+            memcpy (copy, dx_spots, n * sizeof(DXClusterSpot));
+        pthread_mutex_unlock (&spots_lock);
+
+        if (!copy)
+            return (false);
+        *spp = copy;
+        *nspotsp = n;
+        return (true);
+}
+
+#endif // _IS_UNIX
+
 /* update map positions of all spots, eg, because the projection has changed
  */
 void updateDXClusterSpotScreenLocations()
 {
     #if defined (_SUPPORT_DXCPLOT)
 
+        #if defined(_IS_UNIX)
+            pthread_mutex_lock (&spots_lock);
+        #endif
         for (uint8_t i = 0; i < dxc_ss.n_data; i++)
             setDXCSpotPosition (dx_spots[i]);
+        #if defined(_IS_UNIX)
+            pthread_mutex_unlock (&spots_lock);
+        #endif
 
     #endif // _SUPPORT_DXCPLOT
 }
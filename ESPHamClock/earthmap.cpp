@@ -24,6 +24,7 @@ AstroCir solar_cir;
 SCircle sun_c = {{0,0},SUN_R};                  // screen coords of sun symbol
 LatLong sun_ss_ll;                              // subsolar location
 float csslat, ssslat;                           // handy trig
+static float csslng, ssslng;                    // more handy trig
 
 // moon
 AstroCir lunar_cir;
@@ -36,6 +37,7 @@ uint8_t show_lp;                                // display long path, else short
 #define GRAYLINE_COS    (-0.208F)               // cos(90 + grayline angle), we use 12 degs
 #define GRAYLINE_POW    (0.75F)                 // cos power exponent, sqrt is too severe, 1 is too gradual
 static SCoord moremap_s;                        // drawMoreEarth() scanning location 
+static bool s2llProj (const SCoord &s, LatLong &ll);
 
 // cached grid colors
 static uint16_t GRIDC, GRIDC00;                 // main and highlighted
@@ -464,6 +466,7 @@ static void drawTropicsGrid()
 }
 
 /* draw the complete proper map grid, ESP draws incrementally as map is drawn.
+ * N.B. the Maidenhead key is not part of the grid, see drawMaidGridKey().
  * UNIX only
  */
 static void drawMapGrid()
@@ -477,7 +480,6 @@ static void drawMapGrid()
 
     case MAPGRID_MAID:
 
-        drawMaidGridKey();
         drawLLGrid (10, 20);
         break;
 
@@ -859,6 +861,592 @@ static void drawMouseLoc()
     }
 }
 
+
+/* cache of the location under each app pixel of map_b so drawing the map requires no projection trig.
+ * it only depends on the projection, center longitude and DE so initEarthMap() rebuilds it only when
+ * one of those change. the gradients plotEarth() needs come from the neighboring entries.
+ * UNIX only
+ */
+typedef struct {
+    float lat_d, lng_d;                         // location, degrees
+    float slat, clat;                           // handy sin and cos of lat
+    float slng, clng;                           // handy sin and cos of lng
+    bool ok;                                    // whether really over the globe
+} MapLLCache;
+static MapLLCache *map_llc;                     // EARTH_W x EARTH_H entries, upper left at map_b.x,y
+static bool map_llc_ok;                         // whether map_llc matches the current map
+
+/* return pointer to the map_llc entry at app screen coords x,y, else NULL if none.
+ * UNIX only
+ */
+static const MapLLCache *findMapLLCache (uint16_t x, uint16_t y)
+{
+    uint16_t dx = x - map_b.x;                  // rely on unsigned wrap to catch < map_b.x,y
+    uint16_t dy = y - map_b.y;
+    if (!map_llc_ok || dx >= EARTH_W || dy >= EARTH_H)
+        return (NULL);
+    return (&map_llc[dy*EARTH_W + dx]);
+}
+
+/* fill e with the location at app screen coords x,y using the full projection.
+ * UNIX only
+ */
+static void fillMapLL (uint16_t x, uint16_t y, MapLLCache &e)
+{
+    SCoord s = {x, y};
+    LatLong ll = {0, 0, 0, 0};                  // not all projections set ll if not over globe
+    e.ok = s2llProj (s, ll);
+    e.lat_d = ll.lat_d;
+    e.lng_d = ll.lng_d;
+    e.slat = sinf(ll.lat);
+    e.clat = cosf(ll.lat);
+    e.slng = sinf(ll.lng);
+    e.clng = cosf(ll.lng);
+}
+
+/* fill e with the location at app screen coords x,y, from map_llc if possible.
+ * return whether location is really over the globe.
+ * UNIX only
+ */
+static bool getMapLL (uint16_t x, uint16_t y, MapLLCache &e)
+{
+    const MapLLCache *cp = findMapLLCache (x, y);
+    if (cp)
+        e = *cp;
+    else
+        fillMapLL (x, y, e);
+    return (e.ok);
+}
+
+/* return fraction of daylight at the given location, 1 for full day down to 0 for full night.
+ * UNIX only
+ */
+static float mapFractDay (const MapLLCache &e)
+{
+    // find angle between subsolar point and this location
+    float cos_t = ssslat*e.slat + csslat*e.clat*(csslng*e.clng + ssslng*e.slng);
+
+    // decide day, night or twilight
+    if (!night_on || cos_t > 0) {
+        // < 90 deg: sunlit
+        return (1);
+    } else if (cos_t > GRAYLINE_COS) {
+        // blend from day to night
+        return (1 - powf(cos_t/GRAYLINE_COS, GRAYLINE_POW));
+    } else {
+        // night side
+        return (0);
+    }
+}
+
+/* draw the n app pixels of map_b starting at x0,y and going right, skipping any not over the globe.
+ * each unbroken run is handed to plotEarthRow() at once so its full res rows are blended in one pass.
+ * UNIX only
+ */
+static void drawMapRow (uint16_t x0, uint16_t y, int n)
+{
+    #define DMR_MAXN    128                     // max points given to plotEarthRow() at once
+    EarthPt pts[DMR_MAXN];
+    uint16_t run_x = x0;                        // x of pts[0]
+    int n_pts = 0;
+
+    for (uint16_t x = x0; x < x0 + n; x++) {
+
+        // find lat/lng at this screen location, end run if not over map
+        SCoord s = {x, y};
+        MapLLCache lls;
+        bool ok = overMap(s) && getMapLL (x, y, lls);
+        if (!ok || n_pts == DMR_MAXN) {
+            if (n_pts > 0)
+                tft.plotEarthRow (run_x, y, pts, n_pts);
+            n_pts = 0;
+            if (!ok)
+                continue;
+        }
+        if (n_pts == 0)
+            run_x = x;
+
+        /* even though we only draw one application point, s, plotEarth needs points r and d to
+         * interpolate to full map resolution.
+         *   s - - - r
+         *   |
+         *   d
+         */
+        MapLLCache llr, lld;
+        if (!getMapLL (x + 1, y, llr))
+            llr = lls;
+        if (!getMapLL (x, y + 1, lld))
+            lld = lls;
+
+        // find fraction of day at s, r and d so plotEarth can interpolate to each subpixel
+        EarthPt &p = pts[n_pts++];
+        p.lat0 = lls.lat_d;
+        p.lng0 = lls.lng_d;
+        p.dlatr = llr.lat_d - lls.lat_d;
+        p.dlngr = llr.lng_d - lls.lng_d;
+        p.dlatd = lld.lat_d - lls.lat_d;
+        p.dlngd = lld.lng_d - lls.lng_d;
+        p.fract_day = mapFractDay (lls);
+        p.dfractr = mapFractDay (llr) - p.fract_day;
+        p.dfractd = mapFractDay (lld) - p.fract_day;
+    }
+
+    if (n_pts > 0)
+        tft.plotEarthRow (run_x, y, pts, n_pts);
+}
+
+/* (re)build map_llc if the projection, center longitude or DE have changed since last time.
+ * N.B. caller must insure no map tiles are being drawn.
+ * UNIX only
+ */
+static void buildMapLLCache()
+{
+    // previous circumstances
+    static int prev_proj = -1;
+    static int16_t prev_clng;
+    static LatLong prev_de;
+
+    // skip if nothing relevant changed, DE only matters to the azimuthal projections
+    bool azm = map_proj == MAPP_AZIMUTHAL || map_proj == MAPP_AZIM1;
+    if (map_llc_ok && prev_proj == map_proj && prev_clng == getCenterLng()
+                && (!azm || (prev_de.lat_d == de_ll.lat_d && prev_de.lng_d == de_ll.lng_d)))
+        return;
+
+    // get memory first time
+    if (!map_llc) {
+        map_llc = (MapLLCache *) malloc (EARTH_W * EARTH_H * sizeof(MapLLCache));
+        if (!map_llc) {
+            Serial.printf (_FX("No memory for map location cache\n"));
+            return;
+        }
+    }
+
+    // fill using the full projection, cache is not valid until finished
+    map_llc_ok = false;
+    MapLLCache *cp = map_llc;
+    for (uint16_t y = map_b.y; y < map_b.y + EARTH_H; y++)
+        for (uint16_t x = map_b.x; x < map_b.x + EARTH_W; x++)
+            fillMapLL (x, y, *cp++);
+    map_llc_ok = true;
+
+    // save circumstances
+    prev_proj = map_proj;
+    prev_clng = getCenterLng();
+    prev_de = de_ll;
+}
+
+/* the map is rendered by a pool of worker threads each drawing one tile of map_b at a time while the
+ * main loop carries on. drawMoreEarth() starts each sweep then adds the overlays once all tiles are done.
+ * N.B. workers only call drawMapCoord(), which reads map state unlocked but writes the canvas under the
+ *   same lock as all other drawing, so the main thread may still draw over the map meanwhile. but
+ *   anything that changes the map geometry or the earth pixels must call stopMapSweep() first.
+ * UNIX only
+ */
+#define MAPT_W          66                      // tile width, app pixels, must divide EARTH_W
+#define MAPT_H          33                      // tile height, app pixels, must divide EARTH_H
+#define MAPT_NCOLS      (EARTH_W/MAPT_W)        // n tiles across map
+#define MAPT_N          (MAPT_NCOLS*(EARTH_H/MAPT_H))   // n tiles in whole map
+#define MAPT_MAXTHR     8                       // max worker threads
+#define MAPT_MINDT      500                     // min time between sweep starts, millis
+#define MAPT_FULLDT     60000                   // max time between full sweeps when incr_map, millis
+
+static pthread_mutex_t mapt_lock = PTHREAD_MUTEX_INITIALIZER;  // guards all following mapt_ variables
+static pthread_cond_t mapt_go = PTHREAD_COND_INITIALIZER;      // signaled when a new sweep starts
+static pthread_cond_t mapt_idle = PTHREAD_COND_INITIALIZER;    // signaled when each tile is finished
+static int mapt_next = MAPT_N;                  // next tile to draw, MAPT_N when none remain
+static int mapt_ndone;                          // n tiles finished in current sweep
+static int mapt_nbusy;                          // n workers now drawing a tile
+static int mapt_nthr;                           // n worker threads running
+static struct timeval map_sweep_tv;             // time current sweep started
+static struct timeval mapt_done_tv;             // time last tile of current sweep finished
+static bool mapt_timed;                         // set when mapt_done_tv is valid for current sweep
+
+/* time to draw all tiles of each full sweep, for each projection with and without the tiled earth maps.
+ * incremental sweeps draw too little to compare so are not counted.
+ * UNIX only
+ */
+typedef struct {
+    unsigned n;                                 // n full sweeps timed
+    uint64_t sum_us;                            // total of their times
+    uint32_t min_us;                            // fastest
+} MapSweepStat;
+static MapSweepStat map_sweep_stats[MAPP_N][2]; // [map_proj][tft.getEarthTiled()]
+
+/* with incr_map each sweep only repaints the pixels whose day fraction changed since the previous sweep,
+ * which is just those along the grayline, plus whole tiles in which something drawn directly on the canvas
+ * was not drawn again the same way since the sweep before so it gets erased. the map layers take care of
+ * themselves.
+ * a full sweep is still done now and then.
+ * map_fday[] holds the day fraction of each app pixel, 0 .. 255, alternating between sweeps.
+ * UNIX only
+ */
+bool incr_map;                                  // set to only repaint the map where it changed
+static uint8_t *map_fday[2];                    // EARTH_W x EARTH_H day fractions, previous and current
+static int map_fday_i;                          // map_fday[] index being filled by current sweep
+static bool mapt_all[MAPT_N];                   // whether to repaint each entire tile this sweep
+static bool mapt_full = true;                   // set to force next sweep to repaint everything
+static bool map_grid_stale = true;              // set when grid layer must be drawn again
+static bool map_paths_stale = true;             // set when paths layer must be drawn again
+static bool map_symbols_stale = true;           // set when symbols layer must be drawn again
+
+/* return day fraction at app pixel index i of map_b scaled to 0 .. 255
+ * UNIX only
+ */
+static uint8_t mapFDay (int i)
+{
+    return ((uint8_t) (255*mapFractDay (map_llc[i]) + 0.5F));
+}
+
+/* draw map tile t, numbered across then down from the upper left of map_b.
+ * with incr_map skip pixels whose day fraction at s, r and d are all the same as the previous sweep.
+ * UNIX only
+ */
+static void drawMapTile (int t)
+{
+    uint16_t x0 = map_b.x + (t % MAPT_NCOLS) * MAPT_W;
+    uint16_t y0 = map_b.y + (t / MAPT_NCOLS) * MAPT_H;
+
+    if (!incr_map || !map_fday[0] || !map_llc_ok) {
+        for (uint16_t y = y0; y < y0 + MAPT_H; y++)
+            drawMapRow (x0, y, MAPT_W);
+        return;
+    }
+
+    // day fraction over this tile with one more row and column for the r and d neighbors
+    uint8_t fday[MAPT_H+1][MAPT_W+1];
+    int mx0 = x0 - map_b.x;
+    int my0 = y0 - map_b.y;
+    for (int dy = 0; dy <= MAPT_H; dy++)
+        for (int dx = 0; dx <= MAPT_W; dx++)
+            if (mx0 + dx < EARTH_W && my0 + dy < EARTH_H)
+                fday[dy][dx] = mapFDay ((my0+dy)*EARTH_W + mx0+dx);
+
+    // record ours for next time and draw each run of pixels that might now look different
+    uint8_t *now_fd = map_fday[map_fday_i];
+    const uint8_t *was_fd = map_fday[!map_fday_i];
+    bool all = mapt_all[t];
+    for (int dy = 0; dy < MAPT_H; dy++) {
+        bool more_y = my0 + dy + 1 < EARTH_H;
+        int run_dx = -1;                        // start of current run, -1 if none
+        for (int dx = 0; dx < MAPT_W; dx++) {
+            bool more_x = mx0 + dx + 1 < EARTH_W;
+            int i = (my0+dy)*EARTH_W + mx0+dx;
+            now_fd[i] = fday[dy][dx];
+            bool draw = all || fday[dy][dx] != was_fd[i]
+                        || (more_x && fday[dy][dx+1] != was_fd[i+1])
+                        || (more_y && fday[dy+1][dx] != was_fd[i+EARTH_W]);
+            if (draw && run_dx < 0)
+                run_dx = dx;
+            else if (!draw && run_dx >= 0) {
+                drawMapRow (x0+run_dx, y0+dy, dx-run_dx);
+                run_dx = -1;
+            }
+        }
+        if (run_dx >= 0)
+            drawMapRow (x0+run_dx, y0+dy, MAPT_W-run_dx);
+    }
+}
+
+/* decide which tiles the coming sweep must repaint entirely.
+ * return whether the sweep will draw every pixel.
+ * N.B. call only while no tiles are being drawn.
+ * UNIX only
+ */
+static bool planMapSweep()
+{
+    // signature of drawing other than the map still showing in each tile, 0 if none
+    static uint32_t shown_sig[MAPT_N];
+    static uint32_t full_ms;
+
+    if (!incr_map)
+        return (true);
+
+    // get memory first time, never mind incr_map if none
+    if (!map_fday[0]) {
+        map_fday[0] = (uint8_t *) calloc (EARTH_W, EARTH_H);
+        map_fday[1] = (uint8_t *) calloc (EARTH_W, EARTH_H);
+        if (!map_fday[0] || !map_fday[1]) {
+            Serial.printf (_FX("No memory for incremental map\n"));
+            free (map_fday[0]);
+            free (map_fday[1]);
+            map_fday[0] = map_fday[1] = NULL;
+            return (true);
+        }
+        tft.setDrawSigGrid (map_b.x, map_b.y, MAPT_W, MAPT_H, MAPT_NCOLS, EARTH_H/MAPT_H);
+    }
+
+    // occasionally repaint everything just to be safe
+    if (timesUp (&full_ms, MAPT_FULLDT))
+        mapt_full = true;
+
+    // a tile drawn on directly since the last sweep keeps that drawing unless it replaces an
+    // earlier different one, any tile whose drawing was not repeated is repainted to clear it.
+    uint32_t sig[MAPT_N];
+    tft.getDrawSigs (sig, MAPT_N);
+    for (int t = 0; t < MAPT_N; t++) {
+        mapt_all[t] = mapt_full || (shown_sig[t] != 0 && sig[t] != shown_sig[t]);
+        shown_sig[t] = mapt_all[t] ? 0 : sig[t];
+    }
+    bool full = mapt_full;
+    mapt_full = false;
+
+    // swap day fraction history
+    map_fday_i = !map_fday_i;
+
+    return (full);
+}
+
+/* perpetual thread that draws map tiles whenever any are available.
+ * UNIX only
+ */
+static void *mapTileThread (void *unused)
+{
+    (void) unused;
+    pthread_detach (pthread_self());
+
+    pthread_mutex_lock (&mapt_lock);
+    for (;;) {
+
+        // wait for work
+        while (mapt_next >= MAPT_N)
+            pthread_cond_wait (&mapt_go, &mapt_lock);
+
+        // claim next tile and draw it without holding the lock
+        int t = mapt_next++;
+        mapt_nbusy++;
+        pthread_mutex_unlock (&mapt_lock);
+        drawMapTile (t);
+        pthread_mutex_lock (&mapt_lock);
+
+        // report
+        mapt_nbusy--;
+        if (++mapt_ndone == MAPT_N) {
+            gettimeofday (&mapt_done_tv, NULL);
+            mapt_timed = true;
+            wakeLoop();
+        }
+        pthread_cond_broadcast (&mapt_idle);
+    }
+
+    return (NULL);              // lint
+}
+
+/* start the map tile workers if not already.
+ * return whether at least one is running.
+ * UNIX only
+ */
+static bool startMapTileThreads()
+{
+    static bool tried;
+    if (!tried) {
+        tried = true;
+
+        // one per cpu is plenty
+        long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+        int nthr = ncpu < 1 ? 1 : (ncpu > MAPT_MAXTHR ? MAPT_MAXTHR : ncpu);
+        for (int i = 0; i < nthr; i++) {
+            pthread_t tid;
+            int e = pthread_create (&tid, NULL, mapTileThread, NULL);
+            if (e != 0) {
+                Serial.printf (_FX("map tile thread %d failed: %s\n"), i, strerror(e));
+                break;
+            }
+            mapt_nthr++;
+        }
+        Serial.printf (_FX("map using %d tile threads\n"), mapt_nthr);
+    }
+
+    return (mapt_nthr > 0);
+}
+
+/* begin drawing all map tiles.
+ * UNIX only
+ */
+static void startMapSweep()
+{
+    pthread_mutex_lock (&mapt_lock);
+        mapt_ndone = 0;
+        mapt_timed = false;
+        mapt_next = 0;
+        pthread_cond_broadcast (&mapt_go);
+    pthread_mutex_unlock (&mapt_lock);
+}
+
+/* return whether all tiles of the current sweep have been drawn.
+ * UNIX only
+ */
+static bool mapSweepDone()
+{
+    pthread_mutex_lock (&mapt_lock);
+        bool done = mapt_ndone >= MAPT_N;
+    pthread_mutex_unlock (&mapt_lock);
+    return (done);
+}
+
+/* abandon any remaining tiles and wait for those in progress to finish.
+ * the sweep then counts as done so drawMoreEarth() just moves on to the next one.
+ * must be called before changing anything drawMapCoord() depends upon.
+ * UNIX only
+ */
+void stopMapSweep()
+{
+    pthread_mutex_lock (&mapt_lock);
+        mapt_next = MAPT_N;
+        while (mapt_nbusy > 0)
+            pthread_cond_wait (&mapt_idle, &mapt_lock);
+        mapt_ndone = MAPT_N;
+        mapt_full = true;
+    pthread_mutex_unlock (&mapt_lock);
+}
+
+/* record the time taken to draw all tiles of a full sweep that started at map_sweep_tv and ended at tv1.
+ * UNIX only
+ */
+static void recordMapSweep (const struct timeval &tv1)
+{
+    uint32_t us = TVDELUS (map_sweep_tv, tv1);
+    MapSweepStat &ms = map_sweep_stats[map_proj][tft.getEarthTiled()];
+    if (ms.n == 0 || us < ms.min_us)
+        ms.min_us = us;
+    ms.sum_us += us;
+    ms.n++;
+}
+
+/* fill line with the full sweep times for stat i, 0 .. MAPP_N*2-1, each projection without then with the
+ * tiled earth maps. line is left empty if there are none yet.
+ * return false if i is out of range.
+ * UNIX only
+ */
+bool getMapSweepStats (int i, char line[], size_t line_len)
+{
+    if (i < 0 || i >= MAPP_N*2)
+        return (false);
+
+    MapSweepStat &ms = map_sweep_stats[i/2][i%2];
+    if (ms.n == 0)
+        line[0] = '\0';
+    else
+        snprintf (line, line_len, _FX("%-10s %-5s %4u sweeps, mean %7.1f ms, min %7.1f ms"),
+                map_projnames[i/2], (i%2) ? "tiled" : "rows", ms.n,
+                ms.sum_us/(1000.0*ms.n), ms.min_us/1000.0);
+    return (true);
+}
+
+/* things the paths and symbols layers depend on that change with time or the display rather than with
+ * data that calls markMapPathsStale() or markMapSymbolsStale().
+ * UNIX only
+ */
+typedef struct {
+    SCoord de_s, dx_s, deap_s;                  // markers, also ends of the DX path
+    SCoord sun_s, moon_s;                       // move with time
+    int8_t minute;                              // catch-all for slow changes such as santa and spot ages
+    int8_t beacon_sec10;                        // NCDXF beacons change each 10 seconds when on, else -1
+    uint8_t panes;                              // bit mask of which map spot panes are showing
+    bool dx_path;                               // whether DX path is lingering
+    bool sat;                                   // whether a satellite is defined
+    bool rss;                                   // symbols avoid the RSS banner
+    bool map_scale;                             // whether map scale is up
+} MapLayerKey;
+
+/* fill k with the current values of the MapLayerKey fields.
+ * UNIX only
+ */
+static void getMapLayerKey (MapLayerKey &k, bool dx_path)
+{
+    static const PlotChoice spot_chs[] = {
+        PLOT_CH_DXCLUSTER, PLOT_CH_PSK, PLOT_CH_POTA, PLOT_CH_SOTA, PLOT_CH_ADIF
+    };
+
+    memset (&k, 0, sizeof(k));                  // N.B. zero padding too for memcmp()
+    k.de_s = de_c.s;
+    k.dx_s = dx_c.s;
+    k.deap_s = deap_c.s;
+    k.sun_s = sun_c.s;
+    k.moon_s = moon_c.s;
+    time_t t = nowWO();
+    k.minute = minute(t);
+    k.beacon_sec10 = (brb_rotset & (1 << BRB_SHOW_BEACONS)) ? second(t)/10 : -1;
+    for (int i = 0; i < NARRAY(spot_chs); i++)
+        if (findPaneForChoice (spot_chs[i]) != PANE_NONE)
+            k.panes |= 1 << i;
+    k.dx_path = dx_path;
+    k.sat = isSatDefined();
+    k.rss = rss_on != 0;
+    k.map_scale = mapScaleIsUp();
+}
+
+/* draw everything that goes on top of a freshly drawn map.
+ * the grid, paths and symbols each go in their own map layer so none of them disturb the map beneath. each
+ * layer is only cleared and drawn again when something it shows might have changed: the grid with
+ * initEarthMap() or the RSS or map scale, the others when their data call markMapPathsStale() or
+ * markMapSymbolsStale(), when something in MapLayerKey changes, and every sweep while a satellite moves.
+ * UNIX only
+ */
+static void finishMapSweep()
+{
+    // grid changes with initEarthMap() or when the RSS or map scale come or go because it avoids them
+    static int prev_gridkey = -1;
+    int gridkey = (rss_on ? 1 : 0) | (mapScaleIsUp() ? 2 : 0);
+    if (map_grid_stale || gridkey != prev_gridkey) {
+        tft.clearLayer (MAPL_GRID);
+        tft.drawToLayer (MAPL_GRID);
+        drawMapGrid();
+        map_grid_stale = false;
+        prev_gridkey = gridkey;
+    }
+
+    // paths and symbols also change with the things in MapLayerKey and with each satellite step.
+    // N.B. call waiting4DXPath() just once, it erases the path when it times out
+    static MapLayerKey prev_key;
+    MapLayerKey key;
+    bool dx_path = waiting4DXPath();
+    getMapLayerKey (key, dx_path);
+    if (memcmp (&key, &prev_key, sizeof(key)) != 0 || key.sat) {
+        map_paths_stale = map_symbols_stale = true;
+        prev_key = key;
+    }
+
+    if (map_paths_stale) {
+        tft.clearLayer (MAPL_PATHS);
+        tft.drawToLayer (MAPL_PATHS);
+        drawSatPathAndFoot();
+        if (dx_path)
+            drawDXPath();
+        drawPSKPaths ();
+        map_paths_stale = false;
+    }
+
+    if (map_symbols_stale) {
+        tft.clearLayer (MAPL_SYMBOLS);
+        tft.drawToLayer (MAPL_SYMBOLS);
+        drawAllSymbols(true);
+        drawSatNameOnRow (0);
+        map_symbols_stale = false;
+    }
+
+    tft.drawToLayer (MAPL_NONE);
+    tft.compositeLayers();
+
+    drawMaidGridKey();
+    drawMouseLoc();
+
+    // draw now
+    tft.drawPR();
+
+    // check for map menu after each full map
+    if (mapmenu_pending) {
+        drawMapMenu();
+        mapmenu_pending = false;
+    }
+
+// define TIME_MAP_DRAW
+#if defined(TIME_MAP_DRAW)
+    struct timeval tv1;
+    gettimeofday (&tv1, NULL);
+    Serial.printf ("****** map %ld us using %d threads\n", TVDELUS (map_sweep_tv, tv1), mapt_nthr);
+#endif // TIME_MAP_DRAW
+}
+
 #else   // _IS_ESP8266
 
 /* given lat/lng and cos of angle from terminator, return earth map pixel.
@@ -992,6 +1580,8 @@ static void updateCircumstances()
     normalizeLL (sun_ss_ll);
     csslat = cosf(sun_ss_ll.lat);
     ssslat = sinf(sun_ss_ll.lat);
+    csslng = cosf(sun_ss_ll.lng);
+    ssslng = sinf(sun_ss_ll.lng);
     ll2s (sun_ss_ll, sun_c.s, SUN_R+1);
 
     getLunarCir (utc, de_ll, lunar_cir);
@@ -1304,12 +1894,51 @@ void drawMapMenu()
 
 }
 
+/* call when data drawn in the map paths layer changes so the next sweep draws that layer again.
+ * N.B. ESP draws everything with each row so has nothing to do.
+ */
+void markMapPathsStale()
+{
+    #if defined(_IS_UNIX)
+    map_paths_stale = true;
+    #endif // _IS_UNIX
+}
+
+/* call when data drawn in the map symbols layer changes so the next sweep draws that layer again.
+ * N.B. ESP draws everything with each row so has nothing to do.
+ */
+void markMapSymbolsStale()
+{
+    #if defined(_IS_UNIX)
+    map_symbols_stale = true;
+    #endif // _IS_UNIX
+}
+
 /* restart map for current projection and de_ll and dx_ll
  */
 void initEarthMap()
 {
     resetWatchdog();
 
+    #if defined(_IS_UNIX)
+    // insure no tiles are still being drawn with the previous circumstances
+    stopMapSweep();
+
+    // set up map layers first time, then start them over
+    static bool layers_set;
+    if (!layers_set) {
+        if (!tft.setMapLayerBox (map_b.x, map_b.y, map_b.w, map_b.h))
+            Serial.printf (_FX("map layers not available\n"));
+        layers_set = true;
+    }
+    tft.clearLayer (MAPL_GRID);
+    tft.clearLayer (MAPL_PATHS);
+    tft.clearLayer (MAPL_SYMBOLS);
+    map_grid_stale = true;
+    map_paths_stale = true;
+    map_symbols_stale = true;
+    #endif // _IS_UNIX
+
     // completely erase map
     fillSBox (map_b, RA8875_BLACK);
 
@@ -1335,6 +1964,9 @@ void initEarthMap()
     // update DE and DX info
     sdelat = sinf(de_ll.lat);
     cdelat = cosf(de_ll.lat);
+    #if defined(_IS_UNIX)
+    buildMapLLCache();
+    #endif // _IS_UNIX
     ll2s (de_ll, de_c.s, DE_R);
     antipode (deap_ll, de_ll);
     ll2s (deap_ll, deap_c.s, DEAP_R);
@@ -1374,6 +2006,27 @@ void drawMoreEarth()
     digitalWrite(LIFE_LED, !digitalRead(LIFE_LED));
     #endif // _IS_ESP8266
 
+    #if defined (_IS_UNIX)
+    // moremap_s.y is left at map_b.y between sweeps, else tiles are still being drawn
+    static uint32_t sweep_ms;                   // millis() when last sweep started
+    static bool sweep_full;                     // whether current sweep draws every pixel
+    if (moremap_s.y != map_b.y) {
+        if (!mapSweepDone())
+            return;
+        pthread_mutex_lock (&mapt_lock);
+            bool timed = mapt_timed;
+            struct timeval done_tv = mapt_done_tv;
+        pthread_mutex_unlock (&mapt_lock);
+        if (sweep_full && timed)
+            recordMapSweep (done_tv);
+        finishMapSweep();
+        moremap_s.y = map_b.y;
+        return;
+    }
+    if (!timesUp (&sweep_ms, MAPT_MINDT))
+        return;
+    #endif // _IS_UNIX
+
     // refresh circumstances at start of each map scan but not very first call after initEarthMap()
     if (moremap_s.y == map_b.y && moremap_s.x != 0) {
         updateCircumstances();
@@ -1381,11 +2034,11 @@ void drawMoreEarth()
             fillSBox (map_b, RA8875_BLACK);
         #endif // DEBUG_ZONES_BB
     }
-    
-    uint16_t last_x = map_b.x + EARTH_W - 1;
 
 #if defined(_IS_ESP8266)
 
+    uint16_t last_x = map_b.x + EARTH_W - 1;
+
     // freeze if showing a temporary DX-DE path
     if (waiting4DXPath())
         return;
@@ -1436,42 +2089,23 @@ void drawMoreEarth()
 
 #if defined(_IS_UNIX)
 
-    // draw next row
-    for (moremap_s.x = map_b.x; moremap_s.x <= last_x; moremap_s.x++)
-        drawMapCoord (moremap_s);               // does not draw grid
-
-    // advance row, wrap and reset and finish up at the end
-    if ((moremap_s.y += 1) >= map_b.y + EARTH_H) {
-        moremap_s.y = map_b.y;
-
-        drawMapGrid();
-        drawSatPathAndFoot();
-        if (waiting4DXPath())
-            drawDXPath();
-        drawPSKPaths ();
-        drawAllSymbols(true);
-        drawSatNameOnRow (0);
-        drawMouseLoc();
-
-        // draw now
-        tft.drawPR();
-
-        // check for map menu after each full map
-        if (mapmenu_pending) {
-            drawMapMenu();
-            mapmenu_pending = false;
+    // hand all tiles to the workers, or draw them all here if there are none
+    gettimeofday (&map_sweep_tv, NULL);
+    sweep_full = planMapSweep();
+    if (startMapTileThreads()) {
+        moremap_s.x = map_b.x;
+        moremap_s.y = map_b.y + EARTH_H;        // sweep in progress
+        startMapSweep();
+    } else {
+        for (int t = 0; t < MAPT_N; t++)
+            drawMapTile (t);
+        if (sweep_full) {
+            struct timeval tv1;
+            gettimeofday (&tv1, NULL);
+            recordMapSweep (tv1);
         }
-
-    // define TIME_MAP_DRAW
-    #if defined(TIME_MAP_DRAW)
-        static struct timeval tv0;
-        struct timeval tv1;
-        gettimeofday (&tv1, NULL);
-        if (tv0.tv_sec != 0)
-            Serial.printf ("****** map %ld us\n", TVDELUS (tv0, tv1));
-        tv0 = tv1;
-    #endif // TIME_MAP_DRAW
-
+        moremap_s.x = map_b.x;
+        finishMapSweep();
     }
 
 #endif // _IS_UNIX
@@ -1672,6 +2306,26 @@ bool s2ll (const SCoord &s, LatLong &ll)
     if (!overMap(s))
         return (false);
 
+    #if defined(_IS_UNIX)
+    // use cache if possible
+    const MapLLCache *cp = findMapLLCache (s.x, s.y);
+    if (cp) {
+        ll.lat_d = cp->lat_d;
+        ll.lng_d = cp->lng_d;
+        ll.lat = deg2rad(ll.lat_d);
+        ll.lng = deg2rad(ll.lng_d);
+        return (cp->ok);
+    }
+    #endif // _IS_UNIX
+
+    return (s2llProj (s, ll));
+}
+
+/* convert a screen coord to lat and long using the current map projection, regardless of any overlays.
+ * return whether location is really over the globe.
+ */
+static bool s2llProj (const SCoord &s, LatLong &ll)
+{
     switch ((MapProjection)map_proj) {
 
     case MAPP_AZIMUTHAL: {
@@ -1738,7 +2392,7 @@ bool s2ll (const SCoord &s, LatLong &ll)
         break;
 
     default:
-        fatalError (_FX("s2ll() bad map_proj %d"), map_proj);
+        fatalError (_FX("s2llProj() bad map_proj %d"), map_proj);
     }
 
 
@@ -1924,52 +2578,8 @@ void drawMapCoord (const SCoord &s)
     #else // !_IS_ESP8266
 
 
-        // draw one map pixel at full screen resolution. requires lat/lng gradients.
-
-        // find lat/lng at this screen location, bale if not over map
-        LatLong lls;
-        if (!s2ll(s,lls))
-            return; 
-
-        /* even though we only draw one application point, s, plotEarth needs points r and d to
-         * interpolate to full map resolution.
-         *   s - - - r
-         *   |
-         *   d
-         */
-        SCoord sr, sd;
-        LatLong llr, lld;
-        sr.x = s.x + 1;
-        sr.y = s.y;
-        if (!s2ll(sr,llr))
-            llr = lls;
-        sd.x = s.x;
-        sd.y = s.y + 1;
-        if (!s2ll(sd,lld))
-            lld = lls;
-
-        // find angle between subsolar point and any visible near this location
-        // TODO: actually different at each subpixel, this causes striping
-        float clat = cosf(lls.lat);
-        float slat = sinf(lls.lat);
-        float cos_t = ssslat*slat + csslat*clat*cosf(sun_ss_ll.lng-lls.lng);
-
-        // decide day, night or twilight
-        float fract_day;
-        if (!night_on || cos_t > 0) {
-            // < 90 deg: sunlit
-            fract_day = 1;
-        } else if (cos_t > GRAYLINE_COS) {
-            // blend from day to night
-            fract_day = 1 - powf(cos_t/GRAYLINE_COS, GRAYLINE_POW);
-        } else {
-            // night side
-            fract_day = 0;
-        }
-
-        // draw the full res map point
-        tft.plotEarth (s.x, s.y, lls.lat_d, lls.lng_d, llr.lat_d - lls.lat_d, llr.lng_d - lls.lng_d,
-                    lld.lat_d - lls.lat_d, lld.lng_d - lls.lng_d, fract_day);
+        // draw one map pixel at full screen resolution
+        drawMapRow (s.x, s.y, 1);
 
     #endif  // _IS_ESP8266
 
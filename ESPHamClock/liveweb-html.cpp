@@ -1,5 +1,6 @@
 /* this is the html that runs in a browser showing a live hamclock connection.
- * the basic idea is to start with a complete image then continuously poll for incremental changes.
+ * the basic idea is to start with a complete image then have incremental changes pushed as they
+ * happen, or with push=0 continuously poll for them.
  * this page is loaded first with all subsequent communication via a websocket.
  * ESP is far too slow reading pixels to make this practical.
  */
@@ -38,6 +39,10 @@ char live_html[] =  R"_raw_html_(
         const MOUSE_HOLD_MS = 3000;     // mouse down duration to implement hold action
         const APP_W = 800;              // app coord system width
         const nonan_chars = ['Tab', 'Enter', 'Space', 'Escape', 'Backspace'];    // supported non-alnum chars
+        const live_opts = new URLSearchParams(location.search);
+        const live_codec = live_opts.get('codec') || 'rle565';  // or png
+        const live_push = live_opts.get('push') != '0';         // 0 to poll instead of subscribing
+        const live_fps = live_opts.get('fps') || 10;            // max pushed updates per second
 
         // state
         var ws;                         // Websocket
@@ -52,6 +57,7 @@ char live_html[] =  R"_raw_html_(
         var pointerdown_y = 0;          // location of pointerdown event
         var pointermove_ms = 0;         // Date.now when pointermove event
         var fs_success = 0;             // whether setting full screen has ever succeeded
+        var push_on = 0;                // whether we have subscribed to pushed updates
         var cvs, ctx;                   // handy
 
         // define functions, onLoad follows near the bottom
@@ -61,9 +67,14 @@ char live_html[] =  R"_raw_html_(
             sendWSMsg ("get_live.png?");
         }
 
-        // request an image update
+        // request an image update, or subscribe once to have them all pushed as the screen changes
         function getUpdate() {
-            sendWSMsg ("get_live.bin?");
+            if (!live_push)
+                sendWSMsg ("get_live.bin?codec=" + live_codec);
+            else if (!push_on) {
+                sendWSMsg ("set_live_push?codec=" + live_codec + "&fps=" + live_fps);
+                push_on = 1;
+            }
         }
         
 
@@ -199,6 +210,62 @@ char live_html[] =  R"_raw_html_(
 
         }
 
+        // update given rle565 message -- see liveweb.cpp::encodeLiveDelta()
+        // return whether all went well, else caller should ask for a whole new image
+        function drawUpdate565 (data8) {
+
+            // extract 4-byte header preamble after the 2 magic bytes
+            const blok_w = data8[2];                        // block width, pixels
+            const blok_h = data8[3];                        // block height, pixels
+            const n_regn = (data8[4] << 8) | data8[5];      // n regions
+            if (n_regn == 0)
+                return (true);
+
+            // sprites are one image blok_h hi of n_regns contiguous regions each variable width
+            let n_bloks = 0;
+            for (let i = 0; i < n_regn; i++)
+                n_bloks += data8[8+3*i];
+            const img_w = n_bloks * blok_w;
+            const n_pix = img_w * blok_h;
+            const img = ctx.createImageData (img_w, blok_h);
+            const rgba = img.data;
+
+            // expand each run of RGB565 pixels into rgba, exactly as the frame buffer does
+            let ip = 6 + 3*n_regn;                          // next data8 index
+            let op = 0;                                     // next rgba index
+            while (op < 4*n_pix && ip < data8.length) {
+                const c = data8[ip++];
+                const n = (c & 0x7f) + 1;
+                for (let i = 0; i < n; i++) {
+                    const p = data8[ip] | (data8[ip+1] << 8);
+                    if (!(c & 0x80) || i == n-1)
+                        ip += 2;
+                    rgba[op++] = (p >> 8) & 0xF8;
+                    rgba[op++] = (p >> 3) & 0xFC;
+                    rgba[op++] = (p << 3) & 0xF8;
+                    rgba[op++] = 255;
+                }
+            }
+            if (op != 4*n_pix) {
+                console.log ("rle565 short: " + op/4 + " of " + n_pix);
+                return (false);
+            }
+
+            // render each region
+            let regn_x = 0;                                 // walk region x along img
+            for (let i = 0; i < n_regn; i++) {
+                const cvs_x = data8[6+3*i] * blok_w;        // ul corner x in canvas pixels
+                const cvs_y = data8[7+3*i] * blok_h;        // ul corner y in canvas pixels
+                const cvs_w = data8[8+3*i] * blok_w;        // total region width in canvas pixels
+                ctx.putImageData (img, cvs_x - regn_x, cvs_y, regn_x, 0, cvs_w, blok_h);
+                regn_x += cvs_w;                            // next region
+            }
+            if (drawing_verbose)
+                console.log ("  drawUpdate565 " + data8.byteLength + "B " + n_regn + "/" + n_bloks
+                                    + " of " + blok_w + " x " + blok_h);
+            return (true);
+        }
+
         // schedule func() soon
         var upd_tid = 0;                            // update pacing timer id
         function runSoon (func) {
@@ -351,6 +418,12 @@ char live_html[] =  R"_raw_html_(
                         }
                         // ask for updates regardless
                         runSoon (getUpdate);
+                    } else if (data8[0] == 99 && data8[1] == 92) {      // see liveweb.cpp
+                        // this is a complete rle565 update
+                        if (drawUpdate565 (data8))
+                            runSoon (getUpdate);
+                        else
+                            runSoon (getFullImage);
                     } else if (data8[0] == 99 && data8[1] == 91) {      // see liveweb.cpp
                         // this is a message whether to be in full screen mode.
                         // only succeed once in case user wants to cancel
@@ -3,7 +3,9 @@
  * we listen to liveweb_port for live.html or web socket upgrades.
  *
  * Browser displays entire HamClock frame buffer. Complete frame is sent initially then only the
- * pixels that change.
+ * pixels that change. All browsers share one screen snapshot and the encoded changes, so the cost
+ * hardly grows with more of them.
+ * Browsers either poll for changes or subscribe to have them pushed only when the screen changes.
  *
  * N.B. this server-side code must work in concert with client-side code in liveweb-html.cpp.
  *
@@ -38,21 +40,98 @@ static int live_verbose = 0;                            // more chatter if > 0
 int liveweb_port = LIVEWEB_PORT;                        // server port -- can be changed with -w
 
 
-// png format is 3 bytes per pixel
-#define LIVE_BYPPIX     3                               // bytes per pixel
+// snapshots are kept in native frame buffer format, only what is sent is converted for png or rle565
+#define LIVE_BYPPIX     BYTESPFBPIX                     // bytes per snapshot pixel
 #define LIVE_NPIX       (BUILD_H*BUILD_W)               // pixels per complete image
 #define LIVE_NBYTES     (LIVE_NPIX*LIVE_BYPPIX)         // bytes per complete image
-#define LIVE_RBYTES     (BUILD_W*LIVE_BYPPIX)           // bytes per row
+#define PNG_BYPPIX      3                               // bytes per png RGB pixel
 #define COMP_RGB        3                               // composition request code for RGB pixels
+#define LIVE_RLE_MAGIC1 99                              // first byte of an rle565 update, see liveweb-html
+#define LIVE_RLE_MAGIC2 92                              // second byte of an rle565 update
+#define LIVE_RLE_MAXRUN 128                             // max pixels in one rle565 run
+
+// get_live.bin codecs, negotiated by the browser with codec=name
+typedef enum {
+    LC_PNG,                                             // header then RGB png of changed blocks
+    LC_RLE565,                                          // one message of header and run-length RGB565
+    LC_N
+} LiveCodec;
+static const char *live_codec_names[LC_N] = {"png", "rle565"};
+
+
+// the browser image is divided into fixed sized blocks and those which have changed are coalesced into
+// regions of height one block but variable length. these are collected and sent as one image of height
+// one block preceded by a header defining the location and size of each region. the coordinates and
+// length of a region are in units of blocks, not pixels, to reduce each value's size to one byte
+// each in the header. smaller regions are more efficient but the coords must fit in 8 bit header value.
+#define BLOK_W          (BUILD_W>1600?16:8)             // pixels wide
+#define BLOK_H          8                               // pixels high
+#define BLOK_NCOLS      (BUILD_W/BLOK_W)                // blocks in each row over entire image
+#define BLOK_NROWS      (BUILD_H/BLOK_H)                // blocks in each col over entire image
+#define BLOK_NPIX       (BLOK_W*BLOK_H)                 // size of 1 block, pixels
+#define BLOK_WBYTES     (BLOK_W*LIVE_BYPPIX)            // width of 1 block, bytes
+#define MAX_REGNS       (BLOK_NCOLS*BLOK_NROWS)         // worse case number of regions
+#if BLOK_NCOLS > 255                                    // insure fits into uint8_t
+    #error too many block columns
+#endif
+#if BLOK_NROWS > 255                                    // insure fits into uint8_t
+    #error too many block rows
+#endif
+#if MAX_REGNS > 65535                                   // insure fits into uint16_t
+    #error too many live regions
+#endif
 
 
-// list of last complete scene on browser for each web socket
+/* all clients share one snapshot of the screen, live_img, numbered live_seq. each time a client asks
+ * for an update and the display has staged anything since the snapshot, a new one is taken and each
+ * block that differs is marked with the new live_seq in blk_seq. thus a client that last saw snapshot
+ * s needs just the blocks with blk_seq > s, no matter how far behind it is. encoded replies are kept
+ * in live_deltas until the next snapshot so clients that saw the same s share one encoding. senders
+ * hold a reference to the encoding while they write it so it is never copied.
+ * N.B. all guarded by live_lock
+ */
+#define LIVE_NDELTAS    8                               // max different deltas to keep per snapshot
+typedef struct {
+    uint32_t from_seq;                                  // client snapshot this delta updates
+    LiveCodec codec;                                    // how it is encoded
+    uint8_t *mem;                                       // malloced header then png, NULL if unused
+    int hdr_l, png_l;                                   // n bytes of each in mem
+    int *refs;                                          // malloced n holders of mem if shared, else NULL
+} LiveDelta;
+static uint8_t *live_img;                               // malloced current snapshot, LIVE_NBYTES
+static uint8_t *live_new;                               // malloced scratch for next snapshot
+static uint32_t live_seq;                               // snapshot number of live_img, 0 until first
+static uint32_t live_stage_gen;                         // tft.getStageGen() when live_img was read
+static uint32_t blk_seq[BLOK_NROWS][BLOK_NCOLS];        // live_seq when each block last changed
+static LiveDelta live_deltas[LIVE_NDELTAS];             // encoded deltas to live_seq
+static int live_next_delta;                             // next live_deltas[] to reuse
+static LiveDelta live_full;                             // full png of live_img if from_seq == live_seq
+static int live_nsnaps, live_nencodes, live_nreused;    // stats
+static int live_nupdates[LC_N];                         // n updates sent with each codec
+static uint64_t live_enc_us[LC_N];                      // total encoding time for each codec
+static uint64_t live_enc_bytes[LC_N];                   // total bytes sent for each codec
+static pthread_mutex_t live_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// clients that subscribe with set_live_push are sent updates by live_push_thread as the screen changes,
+// at most push_fps per second, instead of polling with get_live.bin
+#define LIVE_MAXFPS     30                              // max push rate any client may request
+#define LIVE_PUSH_IDLE  1000                            // max push thread sleep when screen is static, ms
+
+// list of each web socket client and the snapshot now on its browser
 typedef struct {
     ws_cli_conn_t *client;                              // opaque pointer unique to each connection
-    uint8_t *pixels;                                    // this client's current display image
+    uint32_t id;                                        // unique to each connection, even if client is reused
+    uint32_t seq;                                       // live_seq of the image this client is showing
+    pthread_mutex_t *send_lock;                         // malloced once per entry, keeps messages in order
+    bool push;                                          // whether client subscribed with set_live_push
+    LiveCodec codec;                                    // codec to push
+    int push_ms;                                        // min push interval, millis
+    uint32_t last_push;                                 // millis() of most recent push
 } SessionInfo;
 static SessionInfo *si_list;                            // malloced list
 static int si_n;                                        // n malloced
+static uint32_t si_next_id;                             // last SessionInfo.id assigned
 static pthread_mutex_t si_lock = PTHREAD_MUTEX_INITIALIZER;     // atomic updates
 
 #if defined(__GNUC__)
@@ -78,153 +157,314 @@ static void bye (const char *fmt, ...)
 }
 
 
-/* stbi_write_png_to_func helper to write the given array to the given ws_cli_conn_t in context.
+/* stbi_write_png_to_func helper to append the given array to the LiveDelta in context.
  */
-static void wifiSTBWrite_helper (void *context, void *data, int size)
+static void liveSTBWrite_helper (void *context, void *data, int size)
 {
-    ws_cli_conn_t *client = (ws_cli_conn_t *)context;
-    int n_sent = ws_sendframe_bin (client, (const char *) data, size);
-    if (n_sent != size)
-        Serial.printf ("LIVE: client %s: wrong png write len: %d != %d\n", ws_getaddress(client), n_sent, size);
-    if (live_verbose > 1) {
-        Serial.printf ("LIVE: sent image %d bytes\n", size);
+    LiveDelta *dp = (LiveDelta *)context;
+    dp->mem = (uint8_t *) realloc (dp->mem, dp->hdr_l + dp->png_l + size);
+    if (!dp->mem)
+        bye ("No memory for LIVE png\n");
+    memcpy (dp->mem + dp->hdr_l + dp->png_l, data, size);
+    dp->png_l += size;
+}
+
+/* send the given encoded header, if any, and png to client, each as its own frame but straight from
+ * d.mem with one write.
+ */
+static void sendLiveDelta (ws_cli_conn_t *client, const LiveDelta &d)
+{
+    struct iovec msgs[2];
+    int n_msgs = 0;
+    if (d.hdr_l > 0) {
+        msgs[n_msgs].iov_base = d.mem;
+        msgs[n_msgs].iov_len = d.hdr_l;
+        n_msgs++;
+    }
+    if (d.png_l > 0) {
+        msgs[n_msgs].iov_base = d.mem + d.hdr_l;
+        msgs[n_msgs].iov_len = d.png_l;
+        n_msgs++;
+    }
+
+    int n_sent = ws_sendframev_bin (client, msgs, n_msgs);
+    if (n_sent != d.hdr_l + d.png_l)
+        Serial.printf ("LIVE: client %s: wrong update write len: %d != %d\n", ws_getaddress(client),
+                                n_sent, d.hdr_l + d.png_l);
+
+    if (d.png_l > 0 && live_verbose > 1) {
+        Serial.printf ("LIVE: sent image %d bytes\n", d.png_l);
         if (live_verbose > 2) {
             FILE *fp = fopen ("/tmp/live.png", "w");
-            fwrite (data, size, 1, fp);
+            fwrite (d.mem + d.hdr_l, d.png_l, 1, fp);
             fclose(fp);
         }
     }
 }
 
-/* return the pixels pointer for the existing client, else NULL.
- * pixels pointer is safe to use outside si_lock and even if si_list is later realloced (and hence moves).
+/* pass back the snapshot number the given client is showing.
+ * return false and close client if it is not found.
  */
-static uint8_t *getSIPixels (ws_cli_conn_t *client)
+static bool getSISeq (ws_cli_conn_t *client, uint32_t *seqp)
 {
-    // protect list while manipulating -- N.B. unlock before returning!
+    bool found = false;
+
     pthread_mutex_lock (&si_lock);
+    for (int i = 0; i < si_n; i++) {
+        if (si_list[i].client == client) {
+            *seqp = si_list[i].seq;
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock (&si_lock);
+
+    if (!found) {
+        if (ws_close_client (client) < 0)
+            Serial.printf ("LIVE: client %s: failed to close after missing session\n", ws_getaddress(client));
+        else
+            Serial.printf ("LIVE: client %s: closed because missing session\n", ws_getaddress(client));
+    }
+
+    return (found);
+}
+
+/* return the send lock for the given client, else NULL and close client if not found.
+ * N.B. the lock stays valid even if client later closes.
+ */
+static pthread_mutex_t *getSILock (ws_cli_conn_t *client)
+{
+    pthread_mutex_t *lock = NULL;
 
-    // scan si_list for client
-    SessionInfo *found_sip = NULL;
+    pthread_mutex_lock (&si_lock);
     for (int i = 0; i < si_n; i++) {
         if (si_list[i].client == client) {
-            found_sip = &si_list[i];
+            lock = si_list[i].send_lock;
             break;
         }
     }
+    pthread_mutex_unlock (&si_lock);
 
-    // capture pixels address 
-    uint8_t *pixels = NULL;
-    if (found_sip)
-        pixels = found_sip->pixels;
-    else {
+    if (!lock) {
         if (ws_close_client (client) < 0)
-            Serial.printf ("LIVE: client %s: failed to close after missing pixels\n", ws_getaddress(client));
+            Serial.printf ("LIVE: client %s: failed to close after missing session\n", ws_getaddress(client));
         else
-            Serial.printf ("LIVE: client %s: closed because missing pixels\n", ws_getaddress(client));
+            Serial.printf ("LIVE: client %s: closed because missing session\n", ws_getaddress(client));
     }
 
-    // unlock
+    return (lock);
+}
+
+/* pass back the send lock and snapshot number of the given push subscription, either may be NULL.
+ * return false if the client has since gone away or its slot now serves another connection, in which
+ * case the subscription is just dropped and client must not be touched at all.
+ */
+static bool getSIPush (ws_cli_conn_t *client, uint32_t id, pthread_mutex_t **lockp, uint32_t *seqp)
+{
+    bool found = false;
+
+    pthread_mutex_lock (&si_lock);
+    for (int i = 0; i < si_n; i++) {
+        if (si_list[i].client == client && si_list[i].id == id && si_list[i].push) {
+            if (lockp)
+                *lockp = si_list[i].send_lock;
+            if (seqp)
+                *seqp = si_list[i].seq;
+            found = true;
+            break;
+        }
+    }
     pthread_mutex_unlock (&si_lock);
 
-    // return result
-    return (pixels);
+    return (found);
 }
 
+/* record the snapshot number the given client is now showing.
+ * if push_id is not 0 it must also still be the same connection.
+ */
+static void setSISeq (ws_cli_conn_t *client, uint32_t push_id, uint32_t seq)
+{
+    pthread_mutex_lock (&si_lock);
+    for (int i = 0; i < si_n; i++) {
+        if (si_list[i].client == client && (!push_id || si_list[i].id == push_id)) {
+            si_list[i].seq = seq;
+            break;
+        }
+    }
+    pthread_mutex_unlock (&si_lock);
+}
 
-/* send difference between client's last known screen image and the current image,
- * then store current image back in client's SessionInfo.
+/* return another reference to the given encoding, to be released with freeLiveDelta() when done.
+ * N.B. caller must hold live_lock
  */
-static void updateExistingClient (ws_cli_conn_t *client)
+static LiveDelta holdLiveDelta (LiveDelta &d)
 {
-    // curious how long these steps take
+    if (!d.refs) {
+        d.refs = (int *) malloc (sizeof(int));
+        if (!d.refs)
+            bye ("No memory for LIVE refs\n");
+        *d.refs = 1;
+    }
+    (*d.refs)++;
+    return (d);
+}
+
+/* discard the given reference to an encoding, freeing it when no one else holds it.
+ * N.B. caller must hold live_lock
+ */
+static void freeLiveDelta (LiveDelta &d)
+{
+    if (!d.refs || --(*d.refs) == 0) {
+        free (d.mem);
+        free (d.refs);
+    }
+    memset (&d, 0, sizeof(d));
+}
+
+/* take a fresh snapshot into live_img if the display has staged anything since the last one,
+ * marking each block that changed with the new live_seq.
+ * N.B. caller must hold live_lock
+ */
+static void refreshLiveSnapshot()
+{
+    // skip if nothing could have changed
+    if (live_seq > 0 && !tft.stageChangedSince (live_stage_gen, 0, 0, BUILD_W, BUILD_H))
+        return;
+
+    // curious how long this takes
     struct timeval tv0;
     gettimeofday (&tv0, NULL);
 
-    // find client's pixels
-    uint8_t *pixels = getSIPixels(client);
-    if (!pixels)
-        return;
+    // get memory first time
+    if (!live_img) {
+        live_img = (uint8_t *) malloc (LIVE_NBYTES);
+        live_new = (uint8_t *) malloc (LIVE_NBYTES);
+        if (!live_img || !live_new)
+            bye ("No memory for LIVE snapshot\n");
+    }
+
+    // read screen.
+    // get generation first so anything staged while reading is checked again next time.
+    uint32_t gen_prev = live_stage_gen;
+    live_stage_gen = tft.getStageGen();
+    if (!tft.getRegionPix (0, 0, BUILD_W, BUILD_H, (fbpix_t *)live_new))
+        bye ("getRegionPix for snapshot failed\n");
 
-    // make a copy of client's last known image
-    uint8_t *img_client = (uint8_t *) malloc (LIVE_NBYTES);
-    if (!img_client)
-        bye ("No memory for LIVE update\n");
-    memcpy (img_client, pixels, LIVE_NBYTES);
+    // mark changed blocks, all the first time
+    uint32_t seq = live_seq + 1;
+    int n_changed = 0;
+    for (int ry = 0; ry < BLOK_NROWS; ry++) {
+
+        // skip bands the display has not staged since the previous snapshot, no need to even look
+        if (live_seq > 0 && !tft.stageChangedSince (gen_prev, 0, ry*BLOK_H, BUILD_W, BLOK_H))
+            continue;
+
+        // pre-check an image band all the way across BLOK_H hi, skip entirely if no change anywhere
+        int band_start = ry*LIVE_BYPPIX*BLOK_H*BUILD_W;
+        if (live_seq > 0 && memcmp (&live_new[band_start], &live_img[band_start],
+                                                                LIVE_BYPPIX*BLOK_H*BUILD_W) == 0)
+            continue;
+
+        // something changed, check each block across this band
+        for (int rx = 0; rx < BLOK_NCOLS; rx++) {
+            int blok_start = band_start + rx*BLOK_WBYTES;
+            uint8_t *now0 = &live_new[blok_start];
+            uint8_t *pre0 = &live_img[blok_start];
+            bool blok_changed = live_seq == 0;
+            for (int rr = 0; !blok_changed && rr < BLOK_H; rr++)
+                if (memcmp (now0+rr*LIVE_BYPPIX*BUILD_W, pre0+rr*LIVE_BYPPIX*BUILD_W, BLOK_WBYTES) != 0)
+                    blok_changed = true;
+            if (blok_changed) {
+                blk_seq[ry][rx] = seq;
+                n_changed++;
+            }
+        }
+    }
 
-    // replace clients's pixels with our current screen contents
-    if (!tft.getRawPix (pixels, LIVE_NPIX))
-        bye ("getRawPix for update failed\n");
-    uint8_t *img_now = pixels;                      // better name
+    // new snapshot becomes live_img
+    uint8_t *tmp = live_img;
+    live_img = live_new;
+    live_new = tmp;
+    live_nsnaps++;
+
+    // bump seq only if anything actually changed so clients already showing this image stay current
+    if (n_changed > 0) {
+        live_seq = seq;
+        for (int i = 0; i < LIVE_NDELTAS; i++)
+            freeLiveDelta (live_deltas[i]);
+        freeLiveDelta (live_full);
+    }
 
     if (live_verbose > 1) {
         struct timeval tv1;
         gettimeofday (&tv1, NULL);
-        Serial.printf ("LIVE: client %s: copying img and reading new pixels took %ld usec\n", ws_getaddress(client),
+        Serial.printf ("LIVE: snapshot %u found %d changed blocks in %ld usec\n", live_seq, n_changed,
                                 TVDELUS (tv0,tv1));
     }
+}
+
+/* run-length encode npix RGB565 pixels into out[], which must have room for at least
+ * npix*2 + npix/LIVE_RLE_MAXRUN + 1 bytes, and return the number of bytes used.
+ * each run starts with a count byte c: if c & 0x80 the next pixel repeats (c & 0x7f) + 1 times,
+ * else c + 1 different pixels follow. each pixel is 2 bytes, LSB first.
+ */
+static int rle565 (const uint16_t *pix, int npix, uint8_t *out)
+{
+    uint8_t *op = out;
+
+    for (int i = 0; i < npix; ) {
 
-    // we only send small regions that have changed since previous.
-    // image is divided into fixed sized blocks and those which have changed are coalesced into regions
-    // of height one block but variable length. these are collected and sent as one image of height one
-    // block preceded by a header defining the location and size of each region. the coordinates and
-    // length of a region are in units of blocks, not pixels, to reduce each value's size to one byte
-    // each in the header. smaller regions are more efficient but the coords must fit in 8 bit header value.
-    #define BLOK_W      (BUILD_W>1600?16:8)             // pixels wide
-    #define BLOK_H      8                               // pixels high
-    #define BLOK_NCOLS  (BUILD_W/BLOK_W)                // blocks in each row over entire image
-    #define BLOK_NROWS  (BUILD_H/BLOK_H)                // blocks in each col over entire image
-    #define BLOK_NPIX   (BLOK_W*BLOK_H)                 // size of 1 block, pixels
-    #define BLOK_NBYTES (BLOK_NPIX*LIVE_BYPPIX)         // size of 1 block, bytes
-    #define BLOK_WBYTES (BLOK_W*LIVE_BYPPIX)            // width of 1 block, bytes
-    #define MAX_REGNS   (BLOK_NCOLS*BLOK_NROWS)         // worse case number of regions
-    #if BLOK_NCOLS > 255                                // insure fits into uint8_t
-        #error too many block columns
-    #endif
-    #if BLOK_NROWS > 255                                // insure fits into uint8_t
-        #error too many block rows
-    #endif
-    #if MAX_REGNS > 65535                               // insure fits into uint16_t
-        #error too many live regions
-    #endif
-
-    // time block creation
+        // length of run of identical pixels starting at i
+        int n_rep = 1;
+        while (i + n_rep < npix && n_rep < LIVE_RLE_MAXRUN && pix[i+n_rep] == pix[i])
+            n_rep++;
+
+        if (n_rep > 1) {
+            *op++ = 0x80 | (n_rep - 1);
+            *op++ = pix[i] & 0xff;
+            *op++ = pix[i] >> 8;
+            i += n_rep;
+        } else {
+            // collect literals until the next repeat starts
+            int n_lit = 1;
+            while (i + n_lit < npix && n_lit < LIVE_RLE_MAXRUN
+                                && !(i + n_lit + 1 < npix && pix[i+n_lit] == pix[i+n_lit+1]))
+                n_lit++;
+            *op++ = n_lit - 1;
+            for (int j = 0; j < n_lit; j++) {
+                *op++ = pix[i+j] & 0xff;
+                *op++ = pix[i+j] >> 8;
+            }
+            i += n_lit;
+        }
+    }
+
+    return (op - out);
+}
+
+/* encode into d the given codec of all blocks that changed after snapshot from_seq.
+ * N.B. caller must hold live_lock
+ */
+static void encodeLiveDelta (uint32_t from_seq, LiveCodec codec, LiveDelta &d)
+{
+    // curious how long these steps take
+    struct timeval tv0;
     gettimeofday (&tv0, NULL);
 
     // set header to location and length of each changed region.
     typedef struct {
         uint8_t x, y, l;                                // region location and length in units of blocks
     } RegnLoc;
-    RegnLoc locs[MAX_REGNS];                            // room for max number of header region entries
+    StackMalloc locs_mem(MAX_REGNS*sizeof(RegnLoc));    // room for max number of header region entries
+    RegnLoc *locs = (RegnLoc *) locs_mem.getMem();
     uint16_t n_regns = 0;                               // n regions defined so far
     int n_bloks = 0;                                    // n blocks within all regions so far
 
-    // build locs by checking each region for change across then down
+    // build locs by checking each block for change across then down
     for (int ry = 0; ry < BLOK_NROWS; ry++) {
-
-        // pre-check an image band all the way across BLOK_COLS hi, skip entirely if no change anywhere
-        int band_start = ry*LIVE_BYPPIX*BLOK_H*BUILD_W;
-        if (memcmp (&img_now[band_start], &img_client[band_start], LIVE_BYPPIX*BLOK_H*BUILD_W) == 0)
-            continue;
-
-        // something changed, scan across this band checking each block
         locs[n_regns].l = 0;                            // init n contiguous blocks that start here
         for (int rx = 0; rx < BLOK_NCOLS; rx++) {
-            int blok_start = band_start + rx*BLOK_WBYTES;
-            uint8_t *now0 = &img_now[blok_start];       // first pixel in this block of current image
-            uint8_t *pre0 = &img_client[blok_start];    // first pixel in this block of image in client
-
-            // check each row of this block for any change, start or add to region 
-            bool blok_changed = false;                  // set if any changed pixels in this block
-            for (int rr = 0; rr < BLOK_H; rr++) {
-                if (memcmp (now0+rr*LIVE_BYPPIX*BUILD_W, pre0+rr*LIVE_BYPPIX*BUILD_W, BLOK_WBYTES) != 0) {
-                    blok_changed = true;
-                    break;
-                }
-            }
-
-            // add to or start new region
-            if (blok_changed) {
+            if (blk_seq[ry][rx] > from_seq) {
                 if (locs[n_regns].l == 0) {
                     locs[n_regns].x = rx;
                     locs[n_regns].y = ry;
@@ -240,40 +480,25 @@ static void updateExistingClient (ws_cli_conn_t *client)
         }
 
         // add last region too if started
-        if (locs[n_regns].l > 0) {
+        if (locs[n_regns].l > 0)
             n_regns++;
-        }
     }
 
-    // now create one wide image containing each region as a separate sprite.
-    // remember each region must work as a separate image of size lx1 blocks.
-    uint8_t *chg_regns = (uint8_t*) malloc (n_bloks * BLOK_NBYTES);
-    uint8_t *chg0 = chg_regns;
-    for (int ry = 0; ry < BLOK_H; ry++) {
-        for (int i = 0; i < n_regns; i++) {
-            RegnLoc *rp = &locs[i];
-            uint8_t *now0 = &img_now[BUILD_W*LIVE_BYPPIX*(ry+BLOK_H*rp->y) + BLOK_WBYTES*rp->x];
-            memcpy (chg0, now0, BLOK_WBYTES*rp->l);
-            chg0 += BLOK_WBYTES*rp->l;
-        }
+    // build header: rle565 starts with 2 magic bytes, then both have block size, n regions and
+    // x,y,l of each region in units of blocks.
+    int pre_l = codec == LC_RLE565 ? 2 : 0;
+    d.from_seq = from_seq;
+    d.codec = codec;
+    d.hdr_l = pre_l+4+3*n_regns;
+    d.png_l = 0;
+    d.mem = (uint8_t *) malloc (d.hdr_l);
+    if (!d.mem)
+        bye ("No memory for LIVE header\n");
+    uint8_t *hdr = d.mem;
+    if (codec == LC_RLE565) {
+        *hdr++ = LIVE_RLE_MAGIC1;
+        *hdr++ = LIVE_RLE_MAGIC2;
     }
-    if (n_bloks != (chg0-chg_regns)/BLOK_NBYTES)        // assert
-        bye ("live regions %d != %d\n", n_bloks, (int)((chg0-chg_regns)/BLOK_NBYTES));
-
-    if (live_verbose > 1) {
-        struct timeval tv1;
-        gettimeofday (&tv1, NULL);
-        Serial.printf ("LIVE: client %s: built %d regions from %d blocks in %ld usec\n",
-                        ws_getaddress(client), n_regns, n_bloks, TVDELUS (tv0, tv1));
-    }
-
-    // time header creation and png write
-    gettimeofday (&tv0, NULL);
-
-    // build 4-byte header followed by x,y,l of each of n regions in units of blocks.
-    unsigned hdr_l = 4+3*n_regns;
-    StackMalloc hdr_mem(hdr_l);
-    uint8_t *hdr = (uint8_t *) hdr_mem.getMem();
     hdr[0] = BLOK_W;                            // block width, pixels
     hdr[1] = BLOK_H;                            // block height, pixels
     hdr[2] = n_regns >> 8;                      // n regions, MSB
@@ -286,58 +511,318 @@ static void updateExistingClient (ws_cli_conn_t *client)
             Serial.printf ("   %d,%d %dx%d\n", locs[i].x*BLOK_W, locs[i].y*BLOK_H, locs[i].l*BLOK_W, BLOK_H);
     }
 
-    // always send header
-    unsigned n_hdrsent = ws_sendframe_bin (client, (const char *) hdr, hdr_l);
-    if (n_hdrsent != hdr_l)
-        Serial.printf ("LIVE: client %s: wrong header write %u != %d\n", ws_getaddress(client), n_hdrsent, hdr_l);
+    // now create one wide image containing each region as a separate sprite.
+    // remember each region must work as a separate image of size lx1 blocks.
+    if (codec == LC_RLE565) {
+
+        // RGB565 sprites, run-length encoded right after the header in the same message
+        int n_pix = n_bloks * BLOK_NPIX;
+        StackMalloc chg_mem(n_pix*sizeof(uint16_t));
+        uint16_t *chg_regns = (uint16_t *) chg_mem.getMem();
+        uint16_t *chg0 = chg_regns;
+        for (int ry = 0; ry < BLOK_H; ry++) {
+            for (int i = 0; i < n_regns; i++) {
+                RegnLoc *rp = &locs[i];
+                uint8_t *now0 = &live_img[BUILD_W*LIVE_BYPPIX*(ry+BLOK_H*rp->y) + BLOK_WBYTES*rp->x];
+                Adafruit_RA8875::fbPixToRGB565 ((fbpix_t *)now0, BLOK_W*rp->l, chg0);
+                chg0 += BLOK_W*rp->l;
+            }
+        }
+        if (n_pix != chg0-chg_regns)                    // assert
+            bye ("live pixels %d != %d\n", n_pix, (int)(chg0-chg_regns));
 
-    // followed by one image containing one column BLOK_W wide of all changed regions
-    stbi_write_png_to_func (wifiSTBWrite_helper, client, BLOK_W*n_bloks, BLOK_H,
-                            COMP_RGB, chg_regns, BLOK_WBYTES*n_bloks);
+        d.mem = (uint8_t *) realloc (d.mem, d.hdr_l + 2*n_pix + n_pix/LIVE_RLE_MAXRUN + 1);
+        if (!d.mem)
+            bye ("No memory for LIVE rle565\n");
+        d.hdr_l += rle565 (chg_regns, n_pix, d.mem + d.hdr_l);
 
-    if (live_verbose > 1) {
-        struct timeval tv1;
-        gettimeofday (&tv1, NULL);
-        Serial.printf ("LIVE: client %s: write hdr %d bytes and update took %ld usec\n",
-                        ws_getaddress(client), hdr_l, TVDELUS (tv0,tv1));
+    } else {
+
+        // RGB sprites as a png sent as a separate message
+        uint8_t *chg_regns = (uint8_t*) malloc (n_bloks * BLOK_NPIX * PNG_BYPPIX);
+        if (!chg_regns)
+            bye ("No memory for LIVE regions\n");
+        uint8_t *chg0 = chg_regns;
+        for (int ry = 0; ry < BLOK_H; ry++) {
+            for (int i = 0; i < n_regns; i++) {
+                RegnLoc *rp = &locs[i];
+                uint8_t *now0 = &live_img[BUILD_W*LIVE_BYPPIX*(ry+BLOK_H*rp->y) + BLOK_WBYTES*rp->x];
+                Adafruit_RA8875::fbPixToRGB24 ((fbpix_t *)now0, BLOK_W*rp->l, chg0);
+                chg0 += BLOK_W*rp->l*PNG_BYPPIX;
+            }
+        }
+        if (n_bloks != (chg0-chg_regns)/(BLOK_NPIX*PNG_BYPPIX))         // assert
+            bye ("live regions %d != %d\n", n_bloks, (int)((chg0-chg_regns)/(BLOK_NPIX*PNG_BYPPIX)));
+
+        // one image containing one column BLOK_W wide of all changed regions
+        stbi_write_png_to_func (liveSTBWrite_helper, &d, BLOK_W*n_bloks, BLOK_H,
+                                COMP_RGB, chg_regns, BLOK_W*n_bloks*PNG_BYPPIX);
+        free (chg_regns);
     }
 
+    // record stats
+    struct timeval tv1;
+    gettimeofday (&tv1, NULL);
+    live_nencodes++;
+    live_enc_us[codec] += TVDELUS (tv0, tv1);
+
     if (live_verbose > 1)
-        Serial.printf ("LIVE: client %s: sent update with %d regions %d blocks\n",
-                        ws_getaddress(client), n_regns, n_bloks);
+        Serial.printf ("LIVE: encoded %s %u..%u with %d regions %d blocks, %d bytes in %ld usec\n",
+                        live_codec_names[codec], from_seq, live_seq, n_regns, n_bloks, d.hdr_l + d.png_l,
+                        TVDELUS (tv0,tv1));
+}
+
+/* send each block that changed since the client's last known screen image,
+ * then record the client as showing the current snapshot.
+ * push_id is 0 when the client asked, else the SessionInfo.id of the subscription being pushed to. a
+ * push sends nothing at all if there is nothing new, because the client is not waiting for a reply.
+ */
+static void updateExistingClient (ws_cli_conn_t *client, LiveCodec codec, uint32_t push_id)
+{
+    bool push = push_id != 0;
 
-    // finished with temps
-    free (chg_regns);
-    free (img_client);
+    // one update at a time per client -- N.B. unlock before returning!
+    pthread_mutex_t *send_lock = NULL;
+    if (push ? !getSIPush (client, push_id, &send_lock, NULL) : !(send_lock = getSILock (client)))
+        return;
+    pthread_mutex_lock (send_lock);
+
+    // find client's snapshot, checking again a subscriber did not go away while we waited
+    uint32_t from_seq;
+    if (push ? !getSIPush (client, push_id, NULL, &from_seq) : !getSISeq (client, &from_seq)) {
+        pthread_mutex_unlock (send_lock);
+        return;
+    }
+
+    // find or make the delta from there to the current snapshot and hold it while sending
+    pthread_mutex_lock (&live_lock);
+
+        refreshLiveSnapshot();
+
+        if (push && from_seq == live_seq) {
+            pthread_mutex_unlock (&live_lock);
+            pthread_mutex_unlock (send_lock);
+            return;
+        }
+
+        LiveDelta *dp = NULL;
+        for (int i = 0; !dp && i < LIVE_NDELTAS; i++)
+            if (live_deltas[i].mem && live_deltas[i].from_seq == from_seq && live_deltas[i].codec == codec)
+                dp = &live_deltas[i];
+        if (dp)
+            live_nreused++;
+        else {
+            dp = &live_deltas[live_next_delta];
+            live_next_delta = (live_next_delta + 1) % LIVE_NDELTAS;
+            freeLiveDelta (*dp);
+            encodeLiveDelta (from_seq, codec, *dp);
+        }
+
+        LiveDelta d = holdLiveDelta (*dp);
+        uint32_t seq = live_seq;
+        live_nupdates[codec]++;
+        live_enc_bytes[codec] += d.hdr_l + d.png_l;
+
+    pthread_mutex_unlock (&live_lock);
+
+    // send, always including header
+    sendLiveDelta (client, d);
+    setSISeq (client, push_id, seq);
+    pthread_mutex_lock (&live_lock);
+    freeLiveDelta (d);
+    pthread_mutex_unlock (&live_lock);
+
+    pthread_mutex_unlock (send_lock);
+
+    if (live_verbose > 1)
+        Serial.printf ("LIVE: client %s: %s %s update %u..%u\n", ws_getaddress(client),
+                                push ? "pushed" : "sent", live_codec_names[codec], from_seq, seq);
 }
 
-/* capture fresh screen image for client and send.
+/* send the current snapshot to client as a complete png.
  */
 static void sendClientPNG (ws_cli_conn_t *client)
 {
-    // get this client's current pixels array
-    uint8_t *pixels = getSIPixels(client);
-    if (!pixels)
+    // one update at a time per client -- N.B. unlock before returning!
+    pthread_mutex_t *send_lock = getSILock (client);
+    if (!send_lock)
         return;
+    pthread_mutex_lock (send_lock);
+
+    // encode fresh snapshot unless already done, and hold it while sending
+    pthread_mutex_lock (&live_lock);
+
+        refreshLiveSnapshot();
+
+        if (live_full.mem && live_full.from_seq == live_seq)
+            live_nreused++;
+        else {
+            freeLiveDelta (live_full);
+            live_full.from_seq = live_seq;
+            uint8_t *rgb24 = (uint8_t *) malloc (LIVE_NPIX*PNG_BYPPIX);
+            if (!rgb24)
+                bye ("No memory for LIVE png\n");
+            Adafruit_RA8875::fbPixToRGB24 ((fbpix_t *)live_img, LIVE_NPIX, rgb24);
+            stbi_write_png_compression_level = 2;       // faster with hardly any increase in size
+            stbi_write_png_to_func (liveSTBWrite_helper, &live_full, BUILD_W, BUILD_H, COMP_RGB,
+                                                                        rgb24, BUILD_W*PNG_BYPPIX);
+            free (rgb24);
+            live_nencodes++;
+        }
+
+        LiveDelta d = holdLiveDelta (live_full);
+        uint32_t seq = live_seq;
 
-    // fresh capture
-    if (!tft.getRawPix (pixels, LIVE_NPIX))
-        bye ("getRawPix for png failed\n");
+    pthread_mutex_unlock (&live_lock);
 
-    // convert image to and send as png
-    stbi_write_png_compression_level = 2;       // faster with hardly any increase in size
-    stbi_write_png_to_func (wifiSTBWrite_helper, client, BUILD_W, BUILD_H, COMP_RGB, pixels, LIVE_RBYTES);
+    // send
+    sendLiveDelta (client, d);
+    setSISeq (client, 0, seq);
+    pthread_mutex_lock (&live_lock);
+    freeLiveDelta (d);
+    pthread_mutex_unlock (&live_lock);
+
+    pthread_mutex_unlock (send_lock);
 
     if (live_verbose)
         Serial.printf ("LIVE: client %s: sent full PNG\n", ws_getaddress(client));
 }
 
-/* send message as to whether or not display in full screen
+/* send message as to whether or not display in full screen, in line with any other updates.
+ * push_id is as for updateExistingClient().
  */
-static void sendFullScreen(ws_cli_conn_t *client)
+static void sendFullScreen(ws_cli_conn_t *client, uint32_t push_id)
 {
+    pthread_mutex_t *send_lock = NULL;
+    if (push_id ? !getSIPush (client, push_id, &send_lock, NULL) : !(send_lock = getSILock (client)))
+        return;
+
     char fs[3] = {99, 91, getX11FullScreen()};          // see liveweb-html
-    ws_sendframe_bin (client, fs, 3);
+    pthread_mutex_lock (send_lock);
+    if (!push_id || getSIPush (client, push_id, NULL, NULL))
+        ws_sendframe_bin (client, fs, 3);
+    pthread_mutex_unlock (send_lock);
+}
+
+/* thread that pushes updates to each subscribed client forever.
+ * we sleep until the display stages something new then send each subscriber its delta, unless it
+ * was sent one sooner than its push_ms ago in which case changes coalesce until it is due.
+ * nothing at all is sent while the screen is static.
+ */
+static void *livePushThread (void *unused)
+{
+    (void) unused;
+
+    pthread_detach (pthread_self());
+
+    int wait_ms = 0;
+    uint32_t gen = tft.getStageGen();
+
+    for(;;) {
+
+        // wait for something new or a pending subscriber to become due
+        gen = tft.waitStageGen (gen, wait_ms);
+
+        // count subscribers that are due, noting how soon the others will be
+        uint32_t now = millis();
+        wait_ms = LIVE_PUSH_IDLE;
+        int n_due = 0;
+        pthread_mutex_lock (&si_lock);
+        int max_push = si_n;
+        for (int i = 0; i < si_n; i++) {
+            SessionInfo *sip = &si_list[i];
+            if (!sip->client || !sip->push)
+                continue;
+            int dt = now - sip->last_push;
+            if (dt >= sip->push_ms)
+                n_due++;
+            else if (sip->push_ms - dt < wait_ms)
+                wait_ms = sip->push_ms - dt;
+        }
+        pthread_mutex_unlock (&si_lock);
+
+        // don't bother snapshotting a frame no one will be sent
+        if (n_due == 0)
+            continue;
+
+        // bring snapshot up to date
+        pthread_mutex_lock (&live_lock);
+            refreshLiveSnapshot();
+            uint32_t seq = live_seq;
+        pthread_mutex_unlock (&live_lock);
+
+        // collect the due subscribers that have not yet been sent this snapshot
+        typedef struct {
+            ws_cli_conn_t *client;
+            uint32_t id;
+            LiveCodec codec;
+        } PushTo;
+        StackMalloc push_mem((max_push+1)*sizeof(PushTo));
+        PushTo *push_to = (PushTo *) push_mem.getMem();
+        int n_push = 0;
+        pthread_mutex_lock (&si_lock);
+        for (int i = 0; i < si_n && n_push < max_push; i++) {
+            SessionInfo *sip = &si_list[i];
+            if (!sip->client || !sip->push || sip->seq == seq)
+                continue;
+            if ((int)(now - sip->last_push) >= sip->push_ms) {
+                push_to[n_push].client = sip->client;
+                push_to[n_push].id = sip->id;
+                push_to[n_push].codec = sip->codec;
+                n_push++;
+                sip->last_push = now;
+            }
+        }
+        pthread_mutex_unlock (&si_lock);
+
+        // push each, any that closed meanwhile are found missing and skipped quietly
+        for (int i = 0; i < n_push; i++) {
+            if (liveweb_fs_ready && getX11FullScreen())
+                sendFullScreen (push_to[i].client, push_to[i].id);
+            updateExistingClient (push_to[i].client, push_to[i].codec, push_to[i].id);
+        }
+    }
+
+    return (NULL);
+}
+
+/* print shared live frame stats into line[] and return true, else false when i is past the last one.
+ * i 0 is the overall sharing, then one for each codec that has been used.
+ */
+bool getLiveWebStats (int i, char line[], size_t line_len)
+{
+    if (i < 0 || i > LC_N)
+        return (false);
+
+    line[0] = '\0';
+
+    if (i == 0) {
+
+        int n_clients = 0;
+        pthread_mutex_lock (&si_lock);
+        for (int i = 0; i < si_n; i++)
+            if (si_list[i].client)
+                n_clients++;
+        pthread_mutex_unlock (&si_lock);
+
+        pthread_mutex_lock (&live_lock);
+        if (live_nsnaps > 0)
+            snprintf (line, line_len, "%d clients %d snapshots %d encoded %d reused", n_clients,
+                                live_nsnaps, live_nencodes, live_nreused);
+        pthread_mutex_unlock (&live_lock);
+
+    } else {
+
+        LiveCodec c = (LiveCodec)(i-1);
+        pthread_mutex_lock (&live_lock);
+        int n = live_nupdates[c];
+        if (n > 0)
+            snprintf (line, line_len, "%-6s %d updates avg %lu us to encode %lu bytes", live_codec_names[c], n,
+                            (unsigned long)(live_enc_us[c]/n), (unsigned long)(live_enc_bytes[c]/n));
+        pthread_mutex_unlock (&live_lock);
+    }
+
+    return (true);
 }
 
 /* client running liveweb-html.cpp is asking for a complete screen capture as png file.
@@ -350,19 +835,86 @@ static void getLivePNG (ws_cli_conn_t *client, char args[], size_t args_len)
     sendClientPNG (client);
 }
 
+/* return the codec named by codec=name in args if we know it, else png.
+ */
+static LiveCodec crackLiveCodec (const char *args)
+{
+    const char *cp = strstr (args, "codec=");
+    if (cp) {
+        cp += 6;
+        for (int i = 0; i < LC_N; i++) {
+            size_t nl = strlen (live_codec_names[i]);
+            if (strncmp (cp, live_codec_names[i], nl) == 0 && (cp[nl] == '\0' || cp[nl] == '&'))
+                return ((LiveCodec)i);
+        }
+    }
+    return (LC_PNG);
+}
+
 /* client running liveweb-html.cpp is asking for incremental screen update.
  * we also send fullscreen if ready from setup.cpp. must send continuously because it only
  *   works a short while after a GUI interaction and we don't know when those will occur.
  */
 static void getLiveUpdate (ws_cli_conn_t *client, char args[], size_t args_len)
 {
-    (void)args;
     (void)args_len;
 
     if (liveweb_fs_ready && getX11FullScreen())
-        sendFullScreen (client);
+        sendFullScreen (client, 0);
 
-    updateExistingClient (client);
+    updateExistingClient (client, crackLiveCodec (args), 0);
+}
+
+/* client running liveweb-html.cpp is asking to be sent updates as the screen changes from now on
+ * instead of polling with get_live.bin.
+ * args may include codec=name as with get_live.bin and fps=N max updates per second.
+ */
+static void setLivePush (ws_cli_conn_t *client, char args[], size_t args_len)
+{
+    (void)args_len;
+
+    // crack args
+    LiveCodec codec = crackLiveCodec (args);
+    int fps = 10;
+    char *fp = strstr (args, "fps=");
+    if (fp)
+        fps = atoi (fp+4);
+    if (fps < 1)
+        fps = 1;
+    if (fps > LIVE_MAXFPS)
+        fps = LIVE_MAXFPS;
+
+    // protect list and started while manipulating -- N.B. unlock before returning!
+    pthread_mutex_lock (&si_lock);
+
+    // start push thread first time
+    static bool started;
+    if (!started) {
+        pthread_t tid;
+        int e = pthread_create (&tid, NULL, livePushThread, NULL);
+        if (e) {
+            pthread_mutex_unlock (&si_lock);
+            Serial.printf ("LIVE: push thread failed: %s\n", strerror(e));
+            return;                             // client will wait then reload and try again
+        }
+        started = true;
+    }
+
+    // subscribe
+    for (int i = 0; i < si_n; i++) {
+        if (si_list[i].client == client) {
+            si_list[i].push = true;
+            si_list[i].codec = codec;
+            si_list[i].push_ms = 1000/fps;
+            si_list[i].last_push = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock (&si_lock);
+
+    if (live_verbose)
+        Serial.printf ("LIVE: client %s: subscribed to %s at %d fps\n", ws_getaddress(client),
+                                live_codec_names[codec], fps);
 }
 
 /* client running liveweb-html.cpp sending us a character to act on as if typed locally.
@@ -474,6 +1026,7 @@ static void setLiveTouch (ws_cli_conn_t *client, char args[], size_t args_len)
             wifi_tt_s.x = x;
             wifi_tt_s.y = y;
             wifi_tt = h ? TT_HOLD : TT_TAP;
+            wakeLoop();
 
             if (live_verbose)
                 Serial.printf ("LIVE: set_touch %d %d %d\n", wifi_tt_s.x, wifi_tt_s.y, wifi_tt);
@@ -546,7 +1099,7 @@ static void sendLiveFavicon (FILE *sockfp)
 }
 
 /* callback when browser asks for a new websocket connection.
- * assign a fresh si_list for keeping track of the pixels for the given client.
+ * assign a fresh si_list entry for keeping track of the snapshot shown by the given client.
  */
 static void ws_onopen(ws_cli_conn_t *client)
 {
@@ -558,13 +1111,8 @@ static void ws_onopen(ws_cli_conn_t *client)
     // scan for unused entry to reuse
     SessionInfo *new_sip = NULL;
     for (int i = 0; i < si_n; i++) {
-        SessionInfo *sip = &si_list[i];
-        if (!sip->client) {
-            new_sip = sip;
-            if (new_sip->pixels) {
-                free (new_sip);
-                new_sip = NULL;
-            }
+        if (!si_list[i].client) {
+            new_sip = &si_list[i];
             break;
         }
     }
@@ -575,14 +1123,18 @@ static void ws_onopen(ws_cli_conn_t *client)
         if (!si_list)
             bye ("No memory for new live session info %d\n", si_n);
         new_sip = &si_list[si_n++];
-        memset (new_sip, 0, sizeof (*new_sip));
+        new_sip->send_lock = (pthread_mutex_t *) malloc (sizeof(pthread_mutex_t));
+        if (!new_sip->send_lock || pthread_mutex_init (new_sip->send_lock, NULL))
+            bye ("No memory for new live session lock\n");
     }
 
-    // init, including memory for pixels but don't capture until client asks for them
+    // init, snapshot 0 means client has nothing yet
     new_sip->client = client;
-    new_sip->pixels = (uint8_t *) malloc (LIVE_NBYTES);
-    if (!new_sip->pixels)
-        bye ("No memory for new live session pixels\n");
+    if (++si_next_id == 0)                              // 0 means not a push in updateExistingClient()
+        ++si_next_id;
+    new_sip->id = si_next_id;
+    new_sip->seq = 0;
+    new_sip->push = false;
 
     // ok
     pthread_mutex_unlock (&si_lock);
@@ -595,20 +1147,19 @@ static void ws_onclose (ws_cli_conn_t *client)
     Serial.printf ("LIVE: client %s: disconnected\n", ws_getaddress(client));
 
     // remove from si_list
-    for (int i = 0; i < si_n; i++) {
-        SessionInfo *sip = &si_list[i];
-        if (sip->client == client) {
-            sip->client = NULL;
-            if (sip->pixels) {
-                free (sip->pixels);
-                sip->pixels = NULL;
-            }
-            return;
+    pthread_mutex_lock (&si_lock);
+    bool found = false;
+    for (int i = 0; !found && i < si_n; i++) {
+        if (si_list[i].client == client) {
+            si_list[i].client = NULL;
+            found = true;
         }
     }
+    pthread_mutex_unlock (&si_lock);
 
-    // if get here, client was not found in si_list
-    Serial.printf ("LIVE: client %s: disappeared after closing websocket\n", ws_getaddress(client));
+    // if not found, client was not in si_list
+    if (!found)
+        Serial.printf ("LIVE: client %s: disappeared after closing websocket\n", ws_getaddress(client));
 }
 
 /* callback when browser sends us a message on a websocket
@@ -626,6 +1177,7 @@ static void ws_onmessage (ws_cli_conn_t *client, const unsigned char *msg, uint6
         {"set_touch?",    setLiveTouch},
         {"set_char?",     setLiveChar},
         {"get_live.png?", getLivePNG},
+        {"set_live_push?",setLivePush},
     };
 
     // msg as null-terminated string cmd
@@ -668,6 +1220,11 @@ static void ws_not (FILE *sockfp, const char *header)
     if (live_verbose)
         Serial.printf ("LIVE: ws_not GET %s\n", fn);
 
+    // query options are for the page itself, eg live.html?codec=png
+    char *q = strchr (fn, '?');
+    if (q)
+        *q = '\0';
+
     // dispatch according to GET file
     if (strcmp (fn, "live.html") == 0)
         sendLiveHTML (sockfp);
@@ -285,7 +285,13 @@ static void cleanFLASH (const char *title, int need_files)
 #include <errno.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sched.h>
+#if defined(_IS_LINUX)
+#include <sys/syscall.h>
+#endif
 
 
 // persistent state of open files, allows restarting
@@ -305,6 +311,9 @@ static void cleanFLASH (const char *title, int n) {}
  */
 static void invalidatePixels()
 {
+        // insure no map tiles are still using the pixels
+        stopMapSweep();
+
         // disconnect from tft thread
         tft.setEarthPix (NULL, NULL);
 
@@ -471,8 +480,9 @@ static int FSInfoNameQsort (const void *p1, const void *p2)
 
 /* download the given file of expected size and load into LittleFS.
  * client is already postioned at first byte of image.
+ * if quiet we are not on the main thread so must not draw or report progress, and failure is never fatal.
  */
-static bool downloadMapFile (WiFiClient &client, const char *file, const char *title)
+static bool downloadMapFile (WiFiClient &client, const char *file, const char *title, bool quiet)
 {
         resetWatchdog();
 
@@ -480,9 +490,12 @@ static bool downloadMapFile (WiFiClient &client, const char *file, const char *t
         bool ok = false;
 
         // alloc copy buffer
-        #define COPY_BUF_SIZE 1024                      // > BHDRSZ but beware RAM pressure
+        #if defined(_IS_UNIX)
+            #define COPY_BUF_SIZE 65536                 // > BHDRSZ, large reads go straight from socket
+        #else
+            #define COPY_BUF_SIZE 1024                  // > BHDRSZ but beware RAM pressure
+        #endif
         const uint32_t npixbytes = HC_MAP_W*HC_MAP_H*BPERBMPPIX;
-        uint32_t nbufbytes = 0;
         StackMalloc buf_mem(COPY_BUF_SIZE);
         char *copy_buf = (char *) buf_mem.getMem();
 
@@ -495,6 +508,8 @@ static bool downloadMapFile (WiFiClient &client, const char *file, const char *t
         }
         f = LittleFS.open (file, "w");
         if (!f) {
+            if (quiet)
+                return (false);
             #if defined(_IS_ESP8266)
                 // using fatalError would probably leave user stranded in what is likely a persistent err
                 mapMsg (true, 1000, _FX("%s: create failed"), title);
@@ -507,57 +522,75 @@ static bool downloadMapFile (WiFiClient &client, const char *file, const char *t
         }
 
         // read and check remote header
-        for (int i = 0; i < BHDRSZ; i++) {
-            if (!getTCPChar (client, &copy_buf[i])) {
-                Serial.printf (_FX("short header: %.*s\n"), i, copy_buf); // might be err message
+        size_t nhdr;
+        if ((nhdr = getTCPBytes (client, (uint8_t *)copy_buf, BHDRSZ)) != BHDRSZ) {
+            Serial.printf (_FX("short header: %.*s\n"), (int)nhdr, copy_buf); // might be err message
+            if (!quiet)
                 mapMsg (true, 1000, _FX("%s: header is short"), title);
-                goto out;
-            }
+            goto out;
         }
         uint32_t filesize;
         if (!bmpHdrOk (copy_buf, HC_MAP_W, HC_MAP_H, &filesize)) {
             Serial.printf (_FX("bad header: %.*s\n"), BHDRSZ, copy_buf); // might be err message
-            mapMsg (true, 1000, _FX("%s: bad header"), title);
+            if (!quiet)
+                mapMsg (true, 1000, _FX("%s: bad header"), title);
             goto out;
         }
         if (filesize != npixbytes + BHDRSZ) {
             Serial.printf (_FX("%s: wrong size %u != %u\n"), title, filesize, npixbytes);
-            mapMsg (true, 1000, _FX("%s: wrong size"), title);
+            if (!quiet)
+                mapMsg (true, 1000, _FX("%s: wrong size"), title);
             goto out;
         }
 
         // write header
         f.write (copy_buf, BHDRSZ);
-        updateClocks(false);
+        if (!quiet)
+            updateClocks(false);
 
         // copy pixels
         {   // statement block just to avoid complaint about goto bypassing t0
-            mapMsg (false, 100, _FX("%s: downloading"), title);
+            if (!quiet)
+                mapMsg (false, 100, _FX("%s: downloading"), title);
             uint32_t t0 = millis();
-            for (uint32_t nbytescopy = 0; nbytescopy < npixbytes; nbytescopy++) {
-
-                if (((nbytescopy%(npixbytes/10)) == 0) || nbytescopy == npixbytes-1)
-                    mapMsg (false, 0, _FX("%s: %3d%%"), title, 100*(nbytescopy+1)/npixbytes);
+            int prev_pct = -10;
+            for (uint32_t nbytescopy = 0; nbytescopy < npixbytes; ) {
+
+                // show progress each 10%
+                int pct = 100*nbytescopy/npixbytes;
+                if (!quiet && pct/10 != prev_pct/10) {
+                    mapMsg (false, 0, _FX("%s: %3d%%"), title, pct);
+                    prev_pct = pct;
+                }
 
-                // read more
-                if (nbufbytes < COPY_BUF_SIZE && !getTCPChar (client, &copy_buf[nbufbytes++])) {
-                    Serial.printf (_FX("%s: file is short: %u %u\n"), title, nbytescopy, npixbytes);
-                    mapMsg (true, 1000, _FX("%s: file is short"), title);
+                // read another buffer full, or whatever remains
+                uint32_t nwant = npixbytes - nbytescopy;
+                if (nwant > COPY_BUF_SIZE)
+                    nwant = COPY_BUF_SIZE;
+                uint32_t nbufbytes = getTCPBytes (client, (uint8_t *)copy_buf, nwant);
+                if (nbufbytes != nwant) {
+                    Serial.printf (_FX("%s: file is short: %u %u\n"), title, nbytescopy+nbufbytes,
+                                                npixbytes);
+                    if (!quiet)
+                        mapMsg (true, 1000, _FX("%s: file is short"), title);
                     goto out;
                 }
 
-                // write when copy_buf is full or last
-                if (nbufbytes == COPY_BUF_SIZE || nbytescopy == npixbytes-1) {
-                    resetWatchdog();
+                // write
+                resetWatchdog();
+                if (!quiet)
                     updateClocks(false);
-                    if (f.write (copy_buf, nbufbytes) != nbufbytes) {
+                if (f.write (copy_buf, nbufbytes) != nbufbytes) {
+                    if (!quiet)
                         mapMsg (true, 1000, _FX("%s: write failed"), title);
-                        goto out;
-                    }
-                    nbufbytes = 0;
+                    goto out;
                 }
+                nbytescopy += nbufbytes;
             }
-            Serial.printf (_FX("%s: %ld B/s\n"), title, 1000L*npixbytes/(millis()-t0));
+            if (!quiet)
+                mapMsg (false, 0, _FX("%s: %3d%%"), title, 100);
+            uint32_t dt = millis() - t0;
+            Serial.printf (_FX("%s: %ld B/s\n"), title, 1000L*npixbytes/(dt ? dt : 1));
         }
 
         // if get here, it worked!
@@ -685,7 +718,7 @@ static File openMapFile (bool *downloaded, const char *file, const char *title)
             cleanFLASH (title, 1);
 
             // download and open again if success
-            if (downloadMapFile (client, file, title)) {
+            if (downloadMapFile (client, file, title, false)) {
                 *downloaded = true;
                 f = LittleFS.open (file, "r");
             }
@@ -698,32 +731,158 @@ static File openMapFile (bool *downloaded, const char *file, const char *title)
         return (f);
 }
 
-/* install maps that require a fresh query and thus always a fresh download.
- * return whether ok
+#if defined(_IS_UNIX)
+
+/* query maps are kept in a cache dir named for a hash of their complete query, so returning to a band,
+ * hour, power etc seen before installs straight from disk. the least recently used are removed as
+ * needed to keep the total within MAPCACHE_MAXBYTES. UNIX only.
  */
-static bool installQueryMaps (const char *page, const char *style, const float MHz)
+#define MAPCACHE_DIR       "/mapcache"                  // within our_dir
+#define MAPCACHE_MAXBYTES  (100L*1024*1024)             // max total size of all cached maps
+#define MAPCACHE_NAMEL     (LFS_NAME_MAX+20)            // max cache file name length, w/EOS
+
+/* fill dfile and nfile with the LittleFS names of the cached day and night maps for the given query,
+ * each at least MAPCACHE_NAMEL, and insure the cache dir exists.
+ */
+static void buildCacheMapNames (const char *query, char *dfile, char *nfile)
 {
-        resetWatchdog();
+        // 64 bit FNV-1a hash of the complete query
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (const char *q = query; *q; q++)
+            h = (h ^ (uint8_t)*q) * 0x100000001b3ULL;
+
+        snprintf (dfile, MAPCACHE_NAMEL, _FX("%s/%016llx-D.bmp"), MAPCACHE_DIR, (unsigned long long)h);
+        snprintf (nfile, MAPCACHE_NAMEL, _FX("%s/%016llx-N.bmp"), MAPCACHE_DIR, (unsigned long long)h);
+
+        std::string dir = our_dir + MAPCACHE_DIR;
+        if (mkdir (dir.c_str(), 0755) == 0) {
+            if (chown (dir.c_str(), getuid(), getgid()) < 0)
+                Serial.printf (_FX("%s: chown %s\n"), dir.c_str(), strerror(errno));
+        } else if (errno != EEXIST)
+            Serial.printf (_FX("%s: mkdir %s\n"), dir.c_str(), strerror(errno));
+}
+
+/* return whether the given cache file is a complete map, and if so mark it as just used.
+ */
+static bool cachedMapOk (const char *file)
+{
+        std::string path = our_dir + file;
+        struct stat s;
+        if (stat (path.c_str(), &s) < 0)
+            return (false);
+
+        File f = LittleFS.open (file, "r");
+        if (!f)
+            return (false);
+        char hdr_buf[BHDRSZ];
+        uint32_t filesize;
+        bool ok = f.read ((uint8_t*)hdr_buf, BHDRSZ) == BHDRSZ
+                        && bmpHdrOk (hdr_buf, HC_MAP_W, HC_MAP_H, &filesize)
+                        && filesize == f.size();
+        f.close();
+
+        if (ok)
+            (void) utimes (path.c_str(), NULL);
+
+        return (ok);
+}
+
+/* qsort-style compare two FS_Info by time, newest first
+ */
+static int FSInfoNewestQsort (const void *p1, const void *p2)
+{
+        time_t t1 = ((FS_Info *)p1)->t0;
+        time_t t2 = ((FS_Info *)p2)->t0;
+        return (t1 > t2 ? -1 : t1 < t2 ? 1 : 0);
+}
+
+/* remove the least recently used cached maps until the rest fit within MAPCACHE_MAXBYTES.
+ */
+static void trimMapCache()
+{
+        std::string dir = our_dir + MAPCACHE_DIR;
+        DIR *dp = opendir (dir.c_str());
+        if (!dp) {
+            Serial.printf (_FX("%s: %s\n"), dir.c_str(), strerror(errno));
+            return;
+        }
+
+        // collect each file with its size and last use, skipping any prefetch still in progress
+        FS_Info *fs_array = NULL;
+        int n_fs = 0;
+        struct dirent *de;
+        while ((de = readdir (dp)) != NULL) {
+            struct stat s;
+            std::string path = dir + "/" + de->d_name;
+            if (de->d_name[0] == '.' || strlen (de->d_name) >= sizeof(fs_array->name)
+                                        || strstr (de->d_name, ".tmp") != NULL
+                                        || stat (path.c_str(), &s) < 0 || !S_ISREG(s.st_mode))
+                continue;
+            fs_array = (FS_Info *) realloc (fs_array, (n_fs+1)*sizeof(FS_Info));
+            if (!fs_array)
+                fatalError ("alloc map cache failed: %d", n_fs);     // no _FX if alloc failing
+            FS_Info *fip = &fs_array[n_fs++];
+            strcpy (fip->name, de->d_name);
+            fip->t0 = s.st_mtime;
+            fip->len = s.st_size;
+        }
+        closedir (dp);
+
+        // keep the most recently used that fit
+        qsort (fs_array, n_fs, sizeof(FS_Info), FSInfoNewestQsort);
+        long total = 0;
+        int n_rm = 0;
+        for (int i = 0; i < n_fs; i++) {
+            total += fs_array[i].len;
+            if (total > MAPCACHE_MAXBYTES) {
+                std::string path = dir + "/" + fs_array[i].name;
+                if (unlink (path.c_str()) == 0)
+                    n_rm++;
+                else
+                    Serial.printf (_FX("%s: %s\n"), path.c_str(), strerror(errno));
+            }
+        }
+        if (n_rm > 0)
+            Serial.printf (_FX("map cache: removed %d of %d\n"), n_rm, n_fs);
+
+        free (fs_array);
+}
+
+#endif // _IS_UNIX
 
-        // get clock time
-        time_t t = nowWO();
+#define MAPQUERY_LEN 300                                // max query length, w/EOS
+
+/* build the backend query for the given page and MHz as of time t.
+ */
+static void buildMapQuery (const char *page, const float MHz, time_t t, char *query, size_t query_len)
+{
         int yr = year(t);
         int mo = month(t);
         int hr = hour(t);
 
-        // prepare query
-        StackMalloc query_mem(300);
-        char *query = (char *) query_mem.getMem();
-        snprintf (query, query_mem.getSize(),
+        snprintf (query, query_len,
             _FX("%s?YEAR=%d&MONTH=%d&UTC=%d&TXLAT=%.3f&TXLNG=%.3f&PATH=%d&WATTS=%d&WIDTH=%d&HEIGHT=%d&MHZ=%.2f&TOA=%.1f&MODE=%d&TOA=%.1f"),
             page, yr, mo, hr, de_ll.lat_d, de_ll.lng_d, show_lp, bc_power, HC_MAP_W, HC_MAP_H,
             MHz, bc_toa, bc_modevalue, bc_toa);
+}
+
+/* install maps that require a fresh query and thus always a fresh download, unless cached on UNIX.
+ * return whether ok
+ */
+static bool installQueryMaps (const char *page, const char *style, const float MHz)
+{
+        resetWatchdog();
+
+        // prepare query for the current time
+        StackMalloc query_mem(MAPQUERY_LEN);
+        char *query = (char *) query_mem.getMem();
+        buildMapQuery (page, MHz, nowWO(), query, query_mem.getSize());
 
         Serial.printf (_FX("%s query: %s\n"), style, query);
 
         // assign a style and compose names and titles
-        char dfile[32];                 // match LFS_NAME_MAX
-        char nfile[32];
+        char dfile[LFS_NAME_MAX+20];    // room for MAPCACHE_NAMEL too
+        char nfile[LFS_NAME_MAX+20];
         char dtitle[NV_COREMAPSTYLE_LEN+10];
         char ntitle[NV_COREMAPSTYLE_LEN+10];
         buildMapNames (style, dfile, nfile, dtitle, ntitle);
@@ -732,14 +891,28 @@ static bool installQueryMaps (const char *page, const char *style, const float M
         cleanFLASH (dtitle, 2);
         invalidatePixels();
 
+    #if defined(_IS_UNIX)
+
+        // download into the cache, or just install if already there
+        buildCacheMapNames (query, dfile, nfile);
+        if (cachedMapOk (dfile) && cachedMapOk (nfile)) {
+            Serial.printf (_FX("%s: from cache %s\n"), style, dfile);
+            day_file = LittleFS.open (dfile, "r");
+            night_file = LittleFS.open (nfile, "r");
+            if (installFilePixels (dfile, nfile))
+                return (true);
+        }
+
+    #endif
+
         // download new voacap maps
         updateClocks(false);
         WiFiClient client;
         bool ok = false;
         if (wifiOk() && client.connect(backend_host, backend_port)) {
             httpHCGET (client, backend_host, query);
-            ok = httpSkipHeader (client) && downloadMapFile (client, dfile, dtitle)
-                                         && downloadMapFile (client, nfile, ntitle);
+            ok = httpSkipHeader (client) && downloadMapFile (client, dfile, dtitle, false)
+                                         && downloadMapFile (client, nfile, ntitle, false);
             client.stop();
         }
 
@@ -753,9 +926,194 @@ static bool installQueryMaps (const char *page, const char *style, const float M
         if (!ok)
             Serial.printf (_FX("%s: fail\n"), style);
 
+    #if defined(_IS_UNIX)
+        // make room for next time -- installed maps are safe even if removed because they are mmap'ed
+        trimMapCache();
+    #endif
+
         return (ok);
 }
 
+#if defined(_IS_UNIX)
+
+/* after each query map is installed, a background thread downloads into the map cache the maps that
+ * are likely to be wanted next, so those install at once instead of stalling the main loop.
+ * the queries are built here on the main thread from the current settings; the thread just fetches them
+ * one at a time, pausing between each to stay out of the way. a new prediction replaces any not yet
+ * fetched because they are probably no longer relevant. UNIX only.
+ */
+#define MAPPF_MAX       4                               // max queries per prediction
+#define MAPPF_PAUSE     2000                            // pause between fetches, millis
+static char *mappf_queries[MAPPF_MAX];                  // malloced queries waiting to be fetched
+static int mappf_n;                                     // n waiting
+static int mappf_nfetched, mappf_nhave, mappf_nfail;    // stats
+static pthread_mutex_t mappf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mappf_go = PTHREAD_COND_INITIALIZER;
+
+/* download both maps for the given query into the cache unless already there.
+ * N.B. not on main thread so no drawing. each is downloaded to a temp name then renamed so the main
+ *   thread never sees a partial file.
+ */
+static void prefetchQueryMaps (const char *query)
+{
+        char dfile[MAPCACHE_NAMEL], nfile[MAPCACHE_NAMEL];
+        buildCacheMapNames (query, dfile, nfile);
+        if (cachedMapOk (dfile) && cachedMapOk (nfile)) {
+            pthread_mutex_lock (&mappf_lock);
+            mappf_nhave++;
+            pthread_mutex_unlock (&mappf_lock);
+            return;
+        }
+
+        char dtmp[MAPCACHE_NAMEL+4], ntmp[MAPCACHE_NAMEL+4];
+        snprintf (dtmp, sizeof(dtmp), "%s.tmp", dfile);
+        snprintf (ntmp, sizeof(ntmp), "%s.tmp", nfile);
+
+        WiFiClient client;
+        bool ok = false;
+        if (client.connect(backend_host, backend_port)) {
+            httpHCGET (client, backend_host, query);
+            ok = httpSkipHeader (client, NULL, NULL, 0) && downloadMapFile (client, dtmp, dfile, true)
+                                                        && downloadMapFile (client, ntmp, nfile, true);
+            client.stop();
+        }
+        if (ok) {
+            std::string dtmp_path = our_dir + dtmp, ntmp_path = our_dir + ntmp;
+            std::string dpath = our_dir + dfile, npath = our_dir + nfile;
+            ok = rename (dtmp_path.c_str(), dpath.c_str()) == 0 && rename (ntmp_path.c_str(), npath.c_str()) == 0;
+            if (!ok)
+                Serial.printf (_FX("map prefetch: rename %s\n"), strerror(errno));
+        }
+        if (!ok) {
+            LittleFS.remove (dtmp);
+            LittleFS.remove (ntmp);
+        }
+
+        pthread_mutex_lock (&mappf_lock);
+        if (ok)
+            mappf_nfetched++;
+        else
+            mappf_nfail++;
+        pthread_mutex_unlock (&mappf_lock);
+
+        Serial.printf (_FX("map prefetch: %s %s\n"), ok ? "fetched" : "failed", query);
+}
+
+/* perpetual thread that fetches each query in mappf_queries.
+ */
+static void *mapPrefetchThread (void *unused)
+{
+        (void) unused;
+
+        pthread_detach (pthread_self());
+
+        // yield the cpu to everything else: SCHED_IDLE if available, else the lowest nice.
+        // N.B. setpriority() only applies to one thread on linux, elsewhere it would slow the whole process
+        struct sched_param sp;
+        memset (&sp, 0, sizeof(sp));
+      #if defined(SCHED_IDLE)
+        int e = pthread_setschedparam (pthread_self(), SCHED_IDLE, &sp);
+      #else
+        int e = ENOTSUP;
+      #endif
+        if (e != 0) {
+          #if defined(_IS_LINUX)
+            if (setpriority (PRIO_PROCESS, (id_t) syscall (SYS_gettid), 19) < 0)
+                Serial.printf (_FX("map prefetch: setpriority %s\n"), strerror(errno));
+          #else
+            Serial.printf (_FX("map prefetch: SCHED_IDLE %s\n"), strerror(e));
+          #endif
+        }
+
+        // N.B. httpHCGET() in prefetchQueryMaps() sends the User-Agent last built by the main thread,
+        //      see sendUserAgent(), so nothing here reads main-thread state.
+
+        for (;;) {
+
+            // wait for next query
+            pthread_mutex_lock (&mappf_lock);
+            while (mappf_n == 0)
+                pthread_cond_wait (&mappf_go, &mappf_lock);
+            char *query = mappf_queries[0];
+            memmove (mappf_queries, mappf_queries+1, (--mappf_n)*sizeof(char*));
+            pthread_mutex_unlock (&mappf_lock);
+
+            prefetchQueryMaps (query);
+            free (query);
+
+            // stay in the background
+            usleep (MAPPF_PAUSE*1000);
+        }
+
+        return (NULL);
+}
+
+/* predict which maps will be wanted after those for page and MHz: the next hour, and the neighboring
+ * bands now if band is one of PropMapBand, and have them fetched in the background.
+ */
+static void predictQueryMaps (const char *page, const float MHz, int band)
+{
+        // start thread first time
+        static bool started;
+        if (!started) {
+            started = true;
+            pthread_t tid;
+            int e = pthread_create (&tid, NULL, mapPrefetchThread, NULL);
+            if (e != 0)
+                Serial.printf (_FX("map prefetch thread failed: %s\n"), strerror(e));
+        }
+
+        // list the new predictions, most likely first
+        float pf_MHz[MAPPF_MAX];
+        time_t pf_t[MAPPF_MAX];
+        int n_q = 0;
+        time_t now = nowWO();
+        pf_MHz[n_q] = MHz;
+        pf_t[n_q++] = now + 3600;
+        if (band >= 0 && band + 1 < PROPBAND_N) {
+            pf_MHz[n_q] = propMap2MHz((PropMapBand)(band+1));
+            pf_t[n_q++] = now;
+        }
+        if (band > 0) {
+            pf_MHz[n_q] = propMap2MHz((PropMapBand)(band-1));
+            pf_t[n_q++] = now;
+        }
+
+        // build their queries
+        char *queries[MAPPF_MAX];
+        for (int i = 0; i < n_q; i++) {
+            queries[i] = (char *) malloc (MAPQUERY_LEN);
+            if (!queries[i])
+                fatalError ("alloc map prefetch failed: %d", i);        // no _FX if alloc failing
+            buildMapQuery (page, pf_MHz[i], pf_t[i], queries[i], MAPQUERY_LEN);
+        }
+
+        // replace any still waiting
+        pthread_mutex_lock (&mappf_lock);
+        for (int i = 0; i < mappf_n; i++)
+            free (mappf_queries[i]);
+        memcpy (mappf_queries, queries, n_q*sizeof(char*));
+        mappf_n = n_q;
+        pthread_cond_signal (&mappf_go);
+        pthread_mutex_unlock (&mappf_lock);
+}
+
+/* print map cache prefetch stats into line[] and return true, else false if never used.
+ */
+bool getMapPrefetchStats (char line[], size_t line_len)
+{
+        pthread_mutex_lock (&mappf_lock);
+        int nf = mappf_nfetched, nh = mappf_nhave, nx = mappf_nfail, nw = mappf_n;
+        pthread_mutex_unlock (&mappf_lock);
+
+        if (nf + nh + nx + nw == 0)
+            return (false);
+        snprintf (line, line_len, _FX("%d fetched, %d already cached, %d failed, %d waiting"), nf, nh, nx, nw);
+        return (true);
+}
+
+#endif // _IS_UNIX
+
 /* install maps for core_map that are just files maintained on the server, no update query required.
  * Download only if absent or newer on server.
  * return whether ok
@@ -810,7 +1168,12 @@ static bool installFileMaps()
 static bool installMUFMaps()
 {
         mapMsg (true, 0, _FX("Calculating %s..."), muf_style);
-        return (installQueryMaps (_FX("/fetchVOACAP-MUF.pl"), muf_style, 0));
+        bool ok = installQueryMaps (_FX("/fetchVOACAP-MUF.pl"), muf_style, 0);
+    #if defined(_IS_UNIX)
+        if (ok)
+            predictQueryMaps ("/fetchVOACAP-MUF.pl", 0, -1);
+    #endif
+        return (ok);
 }
 
 /* retrieve and install VOACAP maps for the current time and given band.
@@ -821,11 +1184,21 @@ static bool installPropMaps (void)
         char s[NV_COREMAPSTYLE_LEN];
         mapMsg (true, 0, _FX("Calculating %s %s..."), getMapStyle(s), prop_style);
         float MHz = propMap2MHz(prop_map.band);
-        if (prop_map.type == PROPTYPE_REL)
-            return (installQueryMaps (_FX("/fetchVOACAPArea.pl"), prop_style, MHz));
-        else if (prop_map.type == PROPTYPE_TOA)
-            return (installQueryMaps (_FX("/fetchVOACAP-TOA.pl"), prop_style, MHz));
-        else
+        if (prop_map.type == PROPTYPE_REL) {
+            bool ok = installQueryMaps (_FX("/fetchVOACAPArea.pl"), prop_style, MHz);
+        #if defined(_IS_UNIX)
+            if (ok)
+                predictQueryMaps ("/fetchVOACAPArea.pl", MHz, prop_map.band);
+        #endif
+            return (ok);
+        } else if (prop_map.type == PROPTYPE_TOA) {
+            bool ok = installQueryMaps (_FX("/fetchVOACAP-TOA.pl"), prop_style, MHz);
+        #if defined(_IS_UNIX)
+            if (ok)
+                predictQueryMaps ("/fetchVOACAP-TOA.pl", MHz, prop_map.band);
+        #endif
+            return (ok);
+        } else
             fatalError (_FX("unknow prop map type %d"), prop_map.type);
         return (false);
 }
@@ -201,6 +201,9 @@ static const uint8_t nv_sizes[NV_N] = {
  *******************************************************************/
 
 
+// address of each item's NV_COOKIE, set by initEEPROM()
+static uint16_t nv_addrs[NV_N];
+
 /* called to init EEPROM. ignore after first call.
  */
 static void initEEPROM()
@@ -211,6 +214,13 @@ static void initEEPROM()
         return;
     before = true;
 
+    // find where each item starts once
+    uint16_t addr = NV_BASE;
+    for (int i = 0; i < NV_N; i++) {
+        nv_addrs[i] = addr;
+        addr += 1 + nv_sizes[i];        // + room for cookie
+    }
+
     uint16_t ee_used, ee_size;
     reportEESize (ee_used, ee_size);
     if (ee_used > ee_size) {
@@ -270,11 +280,8 @@ static bool nvramStartAddr (NV_Name e, uint16_t *e_addr, uint8_t *e_len)
 {
     if (e >= NV_N)
         return(false);
-    *e_addr = NV_BASE;
-    uint8_t i;
-    for (i = 0; i < e; i++)
-        *e_addr += 1 + nv_sizes[i];     // + room for cookie
-    *e_len = nv_sizes[i];
+    *e_addr = nv_addrs[e];
+    *e_len = nv_sizes[e];
     return (true);
 }
 
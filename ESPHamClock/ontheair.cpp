@@ -371,6 +371,7 @@ static void resetONTAStorage (ONTAState *osp)
     osp->spots = NULL;
     osp->ss.n_data = 0;
     osp->ss.top_vis = 0;
+    markMapSymbolsStale();
 }
 
 /* read fresh ontheair info and draw pane in box.
@@ -471,8 +472,9 @@ bool updateOnTheAir (const SBox &box, ONTAProgram whoami)
             n_read++;
         }
 
-        // fresh screen coords
+        // fresh screen coords and map labels
         updateOnTheAirSpotScreenLocations();
+        markMapSymbolsStale();
 
         // ok, even if none found
         ok = true;
@@ -807,6 +807,13 @@ bool drawHTTPBMP (const char *hc_url, const SBox &box, uint16_t color)
         uint16_t xborder = img_w > v_b.w ? (img_w - v_b.w)/2 : 0;
         uint16_t yborder = img_h > v_b.h ? (img_h - v_b.h)/2 : 0;
 
+        // each row is read whole, including padding to bring total row length to multiple of 4
+        uint8_t extra = img_w % 4;
+        size_t row_pixbytes = 3*img_w;
+        size_t row_bytes = row_pixbytes + (extra > 0 ? 4 - extra : 0);
+        StackMalloc row_mem(row_bytes);
+        uint8_t *row = (uint8_t *) row_mem.getMem();
+
         // scan all pixels ...
         for (uint16_t img_y = 0; img_y < img_h; img_y++) {
 
@@ -814,49 +821,44 @@ bool drawHTTPBMP (const char *hc_url, const SBox &box, uint16_t color)
             resetWatchdog();
             updateClocks(false);
 
-            for (uint16_t img_x = 0; img_x < img_w; img_x++) {
-
-                char b, g, r;
-
-                // read next pixel -- note order!
-                if (!getTCPChar (client, &b) || !getTCPChar (client, &g) || !getTCPChar (client, &r)) {
-                    // allow a little loss because ESP TCP stack can fall behind while also drawing
-                    int32_t n_draw = img_y*img_w + img_x;
-                    if (n_draw > 9*n_pix/10) {
-                        // close enough
-                        Serial.printf (_FX("read error after %d pixels but good enough\n"), n_draw);
-                        ok = true;
-                        goto out;
-                    } else {
-                        Serial.printf (_FX("read error after %d pixels\n"), n_draw);
-                        plotMessage (box, color, _FX("File is short"));
-                        goto out;
-                    }
-                }
+            // read next row
+            size_t n_row = getTCPBytes (client, row, row_bytes);
+            uint16_t row_w = n_row < row_pixbytes ? n_row/3 : img_w;
+
+            for (uint16_t img_x = 0; img_x < row_w; img_x++) {
 
                 // ... but only draw if fits inside border
                 if (img_x > xborder && img_x < xborder + v_b.w - tft.SCALESZ
                             && img_y > yborder && img_y < yborder + v_b.h - tft.SCALESZ) {
 
-                    uint8_t ur = r;
-                    uint8_t ug = g;
-                    uint8_t ub = b;
+                    // note order!
+                    uint8_t ub = row[3*img_x];
+                    uint8_t ug = row[3*img_x+1];
+                    uint8_t ur = row[3*img_x+2];
                     uint16_t color16 = RGB565(ur,ug,ub);
                     tft.drawPixelRaw (v_b.x + img_x - xborder,
                                 v_b.y + v_b.h - (img_y - yborder) - 1, color16); // vertical flip
                 }
             }
 
-            // skip padding to bring total row length to multiple of 4
-            uint8_t extra = img_w % 4;
-            if (extra > 0) {
-                for (uint8_t i = 0; i < 4 - extra; i++) {
-                    if (!getTCPChar(client,&c)) {
-                        plotMessage (box, color, _FX("Row padding error"));
-                        goto out;
-                    }
+            if (row_w < img_w) {
+                // allow a little loss because ESP TCP stack can fall behind while also drawing
+                int32_t n_draw = img_y*img_w + row_w;
+                if (n_draw > 9*n_pix/10) {
+                    // close enough
+                    Serial.printf (_FX("read error after %d pixels but good enough\n"), n_draw);
+                    ok = true;
+                    goto out;
+                } else {
+                    Serial.printf (_FX("read error after %d pixels\n"), n_draw);
+                    plotMessage (box, color, _FX("File is short"));
+                    goto out;
                 }
             }
+            if (n_row < row_bytes) {
+                plotMessage (box, color, _FX("Row padding error"));
+                goto out;
+            }
         }
 
         // Serial.println (F("image complete"));
@@ -551,6 +551,10 @@ out:
         }
     }
 
+    // map paths and farthest spots follow the new reports
+    markMapPathsStale();
+    markMapSymbolsStale();
+
     drawPSKPane (box);
 
 #if defined (_IS_ESP8266)
@@ -4,6 +4,10 @@
 
 #include "HamClock.h"
 
+#if defined(_IS_UNIX)
+#include "stb_image_write.h"
+#endif
+
 
 
 // platform
@@ -29,6 +33,15 @@ int restful_port = RESTFUL_PORT;
 // captured from header Content-Length if available; handy for readings POSTs
 static long content_length;
 
+// a set_adif POST body already cracked by a RESTful worker, for setWiFiADIF() to install
+typedef struct {
+    DXClusterSpot *spots;                               // malloced list, NULL once taken by setADIFSpots()
+    int n_spots;                                        // n in spots, -1 if bad with reason in ynot[]
+    uint8_t crc;                                        // checksum of body
+    char ynot[100];                                     // reason when n_spots < 0
+} PostedADIF;
+static PostedADIF *posted_adif;                         // set only while the main thread runs such a command
+
 // handy default message strings
 static const char garbcmd[] PROGMEM = "Garbled command";
 static const char notsupp[] PROGMEM = "Not supported";
@@ -67,9 +80,15 @@ typedef enum {
 
 } DemoChoice;
 static bool runDemoChoice (DemoChoice choice, bool &slow, char msg[], size_t msg_len);
+static void sendRemoteHelp (WiFiClient &client, bool ro, char line[], size_t line_len);
+#if defined(_IS_UNIX)
+static bool getWebServerStats (char line[], size_t line_len);
+#endif
 
+#if !defined(_IS_UNIX)
 // hack around frame buffer readback weirdness that requires ignoring the very first pixel
 static bool first_pixel = true;
+#endif
 
 #if defined(__GNUC__)
 static void demoMsg (bool ok, int n, char buf[], size_t buf_len, const char *fmt, ...)
@@ -483,24 +502,14 @@ static void getStopwatchReport (char buf[], size_t bufl)
     buf[bl] = '\0';
 }
 
-/* send screen capture as bmp file
+#define CORESZ 14                               // always 14 bytes at front
+#define HDRVER 108                              // BITMAPV4HEADER, also n bytes in subheader
+#define BHDRSZ (CORESZ+HDRVER)                  // total header size
+
+/* fill buf with the BMP header for a w x h RGB565 image with nbytes of pixels.
  */
-static bool getWiFiCaptureBMP(WiFiClient &client, char *unused_line, size_t line_len)
+static void buildCaptureBMPHeader (uint8_t buf[BHDRSZ], int w, int h, uint32_t nbytes)
 {
-    (void)(unused_line);
-    (void)(line_len);
-
-    #define CORESZ 14                           // always 14 bytes at front
-    #define HDRVER 108                          // BITMAPV4HEADER, also n bytes in subheader
-    #define BHDRSZ (CORESZ+HDRVER)              // total header size
-    uint8_t buf[300];                           // any modest size ge BHDRSZ and mult of 2
-
-    resetWatchdog();
-
-    // build BMP header 
-    uint32_t npix = BUILD_W*BUILD_H;            // n pixels
-    uint32_t nbytes = npix*2;                   // n bytes of image data
-
     // 14 byte header common to all formats
     buf[0] = 'B';                               // id
     buf[1] = 'M';                               // id
@@ -511,8 +520,8 @@ static bool getWiFiCaptureBMP(WiFiClient &client, char *unused_line, size_t line
 
     // we use BITMAPV4INFOHEADER which supports RGB565
     *((uint32_t*)(buf+14)) = HDRVER;            // subheader type
-    *((uint32_t*)(buf+18)) = BUILD_W;           // width
-    *((uint32_t*)(buf+22)) = -BUILD_H;          // height, neg means starting at the top row
+    *((uint32_t*)(buf+18)) = w;                 // width
+    *((uint32_t*)(buf+22)) = -h;                // height, neg means starting at the top row
     *((uint16_t*)(buf+26)) = 1;                 // n planes
     *((uint16_t*)(buf+28)) = 16;                // bits per pixel -- 16 RGB565 
     *((uint32_t*)(buf+30)) = 3;                 // BI_BITFIELDS to indicate RGB bitmasks are present
@@ -538,15 +547,211 @@ static bool getWiFiCaptureBMP(WiFiClient &client, char *unused_line, size_t line
     *((uint32_t*)(buf+110)) = 0;                // GammaRed
     *((uint32_t*)(buf+114)) = 0;                // GammaGreen
     *((uint32_t*)(buf+118)) = 0;                // GammaBlue
+}
 
-    // send the web page header
+/* send the web page header for a capture image of the given type, and length if known.
+ */
+static void sendCaptureHeader (WiFiClient &client, const char *type, uint32_t len)
+{
     resetWatchdog();
     FWIFIPRLN (client, F("HTTP/1.0 200 OK"));
     sendUserAgent (client);
-    FWIFIPRLN (client, F("Content-Type: image/bmp"));
+    FWIFIPR (client, F("Content-Type: ")); client.println (type);
     FWIFIPRLN (client, F("Cache-Control: no-cache"));
-    FWIFIPR (client, F("Content-Length: ")); client.println (BHDRSZ+nbytes);
+    if (len > 0) {
+        FWIFIPR (client, F("Content-Length: ")); client.println (len);
+    }
     FWIFIPRLN (client, F("Connection: close\r\n"));
+}
+
+#if defined(_IS_UNIX)
+
+/* crack optional x=X&y=Y&w=W&h=H capture region from line, in screen pixels.
+ * any that are missing default to the rest of the screen.
+ * return false with excuse in line if trouble.
+ */
+static bool crackCaptureRegion (char line[], size_t line_len, int &x, int &y, int &w, int &h)
+{
+    // define all possible args
+    WebArgs wa;
+    wa.nargs = 0;
+    wa.name[wa.nargs++] = "x";
+    wa.name[wa.nargs++] = "y";
+    wa.name[wa.nargs++] = "w";
+    wa.name[wa.nargs++] = "h";
+
+    // parse
+    if (!parseWebCommand (wa, line, line_len))
+        return (false);
+
+    // crack each, with defaults
+    x = y = 0;
+    if ((wa.found[0] && !atoiOnly (wa.value[0], &x)) || (wa.found[1] && !atoiOnly (wa.value[1], &y))) {
+        strcpy (line, _FX("bad x or y"));
+        return (false);
+    }
+    w = BUILD_W - x;
+    h = BUILD_H - y;
+    if ((wa.found[2] && !atoiOnly (wa.value[2], &w)) || (wa.found[3] && !atoiOnly (wa.value[3], &h))) {
+        strcpy (line, _FX("bad w or h"));
+        return (false);
+    }
+
+    // must lie entirely on screen
+    if (x < 0 || y < 0 || w < 1 || h < 1 || x + w > BUILD_W || y + h > BUILD_H) {
+        snprintf (line, line_len, _FX("region must be within %dx%d"), BUILD_W, BUILD_H);
+        return (false);
+    }
+
+    return (true);
+}
+
+/* send the given screen region as a bmp file.
+ * pixels are read from the frame buffer a row at a time and written straight to client.
+ */
+static void sendCaptureBMP (WiFiClient &client, int x, int y, int w, int h)
+{
+    // each row is padded to a multiple of 4 bytes
+    int row_bytes = (w*2 + 3) & ~3;
+    uint32_t nbytes = row_bytes * h;
+
+    // send the web page and image headers
+    uint8_t hdr[BHDRSZ];
+    buildCaptureBMPHeader (hdr, w, h, nbytes);
+    sendCaptureHeader (client, "image/bmp", BHDRSZ + nbytes);
+    client.write (hdr, BHDRSZ);
+
+    // send the pixels a band of rows at a time
+    #define CAPT_BAND 32                        // rows per write
+    StackMalloc band_mem(row_bytes*CAPT_BAND);
+    uint8_t *band = (uint8_t *) band_mem.getMem();
+    memset (band, 0, row_bytes*CAPT_BAND);      // any padding is always 0
+    for (int r0 = 0; r0 < h; r0 += CAPT_BAND) {
+        int nr = h - r0 < CAPT_BAND ? h - r0 : CAPT_BAND;
+        for (int r = 0; r < nr; r++)
+            tft.getRegionRGB565 (x, y + r0 + r, w, 1, (uint16_t *)(band + r*row_bytes));
+        client.write (band, nr*row_bytes);
+        resetWatchdog();
+    }
+}
+
+// a png collected by captureSTBWrite_helper()
+typedef struct {
+    uint8_t *mem;                               // malloced png so far
+    int len;                                    // n bytes in mem
+    bool nomem;                                 // set if realloc failed
+} CapturePNG;
+
+/* stbi_write_png_to_func helper to append the given array to the CapturePNG in context.
+ */
+static void captureSTBWrite_helper (void *context, void *data, int size)
+{
+    CapturePNG *cp = (CapturePNG *)context;
+    uint8_t *new_mem = cp->nomem ? NULL : (uint8_t *) realloc (cp->mem, cp->len + size);
+    if (!new_mem) {
+        cp->nomem = true;
+        return;
+    }
+    memcpy (new_mem + cp->len, data, size);
+    cp->mem = new_mem;
+    cp->len += size;
+}
+
+/* send the given screen region as a png file with a Content-Length. stb builds the whole png in memory
+ * before handing any of it to captureSTBWrite_helper() so we collect it there then send it all at once.
+ * return false with excuse in line if trouble.
+ */
+static bool sendCapturePNG (WiFiClient &client, int x, int y, int w, int h, char line[], size_t line_len)
+{
+    // read the region all at once so it is consistent
+    uint8_t *rgb24 = (uint8_t *) malloc (w*h*3);
+    if (!rgb24) {
+        snprintf (line, line_len, _FX("no memory for %dx%d"), w, h);
+        return (false);
+    }
+    tft.getRegionRGB24 (x, y, w, h, rgb24);
+
+    // compress
+    CapturePNG png;
+    memset (&png, 0, sizeof(png));
+    stbi_write_png_compression_level = 2;       // faster with hardly any increase in size
+    int ok = stbi_write_png_to_func (captureSTBWrite_helper, &png, w, h, 3, rgb24, w*3);
+    free (rgb24);
+    if (!ok || png.nomem || png.len == 0) {
+        free (png.mem);
+        snprintf (line, line_len, _FX("no memory for %dx%d png"), w, h);
+        return (false);
+    }
+
+    // send
+    sendCaptureHeader (client, "image/png", png.len);
+    client.write (png.mem, png.len);
+
+    free (png.mem);
+    return (true);
+}
+
+/* send screen capture as bmp file, all or the region given by optional x,y,w,h.
+ */
+static bool getWiFiCaptureBMPRegion (WiFiClient &client, char line[], size_t line_len)
+{
+    int x, y, w, h;
+    if (!crackCaptureRegion (line, line_len, x, y, w, h))
+        return (false);
+    sendCaptureBMP (client, x, y, w, h);
+    return (true);
+}
+
+/* send screen capture as png file.
+ */
+static bool getWiFiCapturePNG (WiFiClient &client, char line[], size_t line_len)
+{
+    return (sendCapturePNG (client, 0, 0, BUILD_W, BUILD_H, line, line_len));
+}
+
+/* send screen capture as png file, all or the region given by optional x,y,w,h.
+ */
+static bool getWiFiCapturePNGRegion (WiFiClient &client, char line[], size_t line_len)
+{
+    int x, y, w, h;
+    if (!crackCaptureRegion (line, line_len, x, y, w, h))
+        return (false);
+    return (sendCapturePNG (client, x, y, w, h, line, line_len));
+}
+
+/* send screen capture as bmp file
+ */
+static bool getWiFiCaptureBMP(WiFiClient &client, char *unused_line, size_t line_len)
+{
+    (void)(unused_line);
+    (void)(line_len);
+
+    sendCaptureBMP (client, 0, 0, BUILD_W, BUILD_H);
+
+    // never fails
+    return (true);
+}
+
+#else // !_IS_UNIX
+
+/* send screen capture as bmp file
+ */
+static bool getWiFiCaptureBMP(WiFiClient &client, char *unused_line, size_t line_len)
+{
+    (void)(unused_line);
+    (void)(line_len);
+
+    uint8_t buf[300];                           // any modest size ge BHDRSZ and mult of 2
+
+    resetWatchdog();
+
+    // build BMP header 
+    uint32_t npix = BUILD_W*BUILD_H;            // n pixels
+    uint32_t nbytes = npix*2;                   // n bytes of image data
+    buildCaptureBMPHeader (buf, BUILD_W, BUILD_H, nbytes);
+
+    // send the web page header
+    sendCaptureHeader (client, "image/bmp", BHDRSZ+nbytes);
     // Serial.println(F("web header sent"));
 
     // send the image header
@@ -596,6 +801,8 @@ static bool getWiFiCaptureBMP(WiFiClient &client, char *unused_line, size_t line
     return (true);
 }
 
+#endif // _IS_UNIX
+
 /* helper to report DE or DX info which are very similar
  */
 static bool getWiFiDEDXInfo_helper (WiFiClient &client, char line[], size_t line_len, bool want_de)
@@ -856,10 +1063,15 @@ static bool getWiFiDXSpots (WiFiClient &client, char line[], size_t line_len)
     // start reply
     startPlainText (client);
 
-    // retrieve spots, if available
+    // retrieve spots, if available.
+    // N.B. UNIX uses a private copy taken under the list's lock
     DXClusterSpot *spots;
     uint8_t nspots;
+#if defined(_IS_UNIX)
+    if (!copyDXClusterSpots (&spots, &nspots)) {
+#else
     if (!getDXClusterSpots (&spots, &nspots)) {
+#endif
         strcpy (line, _FX("No dx spots"));
         return (false);
     }
@@ -867,6 +1079,10 @@ static bool getWiFiDXSpots (WiFiClient &client, char line[], size_t line_len)
     // list
     spotsHelper (client, spots, nspots, line, line_len);
 
+#if defined(_IS_UNIX)
+    free (spots);
+#endif
+
     return (true);
 
 }
@@ -1567,11 +1783,72 @@ static bool getWiFiSys (WiFiClient &client, char *unused_line, size_t line_len)
     // #endif
 #endif
 
+#if defined(_IS_UNIX)
+    // show display update rates
+    float pix_bps, wire_bps;
+    const char *disp_how = tft.getDisplayStats (&pix_bps, &wire_bps);
+    snprintf (buf, sizeof(buf), _FX("Display  %s %.1f KB/s drawn %.1f KB/s sent\n"), disp_how,
+                        pix_bps/1000, wire_bps/1000);
+    client.print (buf);
+#endif
+
+    // show background fetch performance
+    char fetch_line[100];
+    for (int i = 0; getFetchStats (i, fetch_line, sizeof(fetch_line)); i++) {
+        if (fetch_line[0]) {
+            FWIFIPR (client, F("Fetch    ")); client.println (fetch_line);
+        }
+    }
+
+#if defined(_IS_UNIX)
+    // show shared live web frame activity
+    for (int i = 0; getLiveWebStats (i, buf, sizeof(buf)); i++) {
+        if (buf[0]) {
+            FWIFIPR (client, F("LiveWeb  ")); client.println (buf);
+        }
+    }
+
+    // show concurrent RESTful server activity
+    if (getWebServerStats (buf, sizeof(buf))) {
+        FWIFIPR (client, F("RESTful  ")); client.println (buf);
+    }
+
+    // show main loop activity
+    if (getLoopStats (buf, sizeof(buf))) {
+        FWIFIPR (client, F("MainLoop ")); client.println (buf);
+    }
+
+    // show background map prefetching
+    if (getMapPrefetchStats (buf, sizeof(buf))) {
+        FWIFIPR (client, F("MapPfch  ")); client.println (buf);
+    }
+
+    // show full map sweep times
+    for (int i = 0; getMapSweepStats (i, buf, sizeof(buf)); i++) {
+        if (buf[0]) {
+            FWIFIPR (client, F("MapSweep ")); client.println (buf);
+        }
+    }
+
+    // show backend connection reuse
+    WiFiClient::getPoolStats (buf, sizeof(buf));
+    FWIFIPR (client, F("HTTPPool ")); client.println (buf);
+
+    // show backend response cache use
+    if (getHTTPCacheStats (buf, sizeof(buf))) {
+        FWIFIPR (client, F("HTTPCach ")); client.println (buf);
+    }
+#endif
+
     // show EEPROM used
     uint16_t ee_used, ee_size;
     reportEESize (ee_used, ee_size);
     snprintf (buf, sizeof(buf), _FX("EEPROM   %u used of %u bytes\n"), ee_used, ee_size);
     client.print (buf);
+#if defined(_IS_UNIX)
+    EEPROM.getStats (buf, sizeof(buf));
+    FWIFIPR (client, F("EEStore  ")); client.println (buf);
+#endif
 
     // show uptime
     uint16_t days; uint8_t hrs, mins, secs;
@@ -2434,6 +2711,52 @@ static bool setWiFiNewDX (WiFiClient &client, char line[], size_t line_len)
     return (setWiFiNewDEDX_helper (client, true, line, line_len));
 }
 
+#if defined(_IS_UNIX)
+
+/* remote command to set whether the map is drawn from tiled copies of the earth maps.
+ * compare the full sweep times for each in get_sys.txt.
+ * UNIX only
+ */
+static bool setWiFiMapTiles (WiFiClient &client, char line[], size_t line_len)
+{
+    // define all possible args
+    WebArgs wa;
+    wa.nargs = 0;
+    wa.name[wa.nargs++] = "on";
+    wa.name[wa.nargs++] = "off";
+
+    // parse
+    if (!parseWebCommand (wa, line, line_len))
+        return (false);
+
+    // engage, next sweep will be full
+    bool on;
+    if (wa.found[0] && wa.value[0] == NULL)
+        on = true;
+    else if (wa.found[1] && wa.value[1] == NULL)
+        on = false;
+    else {
+        strcpy (line, _FX("Specify just on or off"));
+        return (false);
+    }
+    stopMapSweep();
+    tft.setEarthTiled (on);
+    if (tft.getEarthTiled() != on) {
+        strcpy (line, _FX("No memory for tiled maps"));
+        return (false);
+    }
+
+    // ack with same state
+    startPlainText (client);
+    FWIFIPR (client, F("map tiles "));
+    client.println (line);
+
+    // ok
+    return (true);
+}
+
+#endif // _IS_UNIX
+
 /* set a map view color, names must match those displayed in Setup after changing all '_' to ' '
  *   setup=name&color=R,G,B" },
  */
@@ -2784,8 +3107,15 @@ static bool setWiFiADIF (WiFiClient &client, char line[], size_t line_len)
 
     if (found_file) {
 
-        // POST content immediately follows header
-        int n = readADIFWiFiClient (client, content_length, line, line_len);
+        // POST content immediately follows header, unless a worker already cracked it
+        int n;
+        if (posted_adif) {
+            n = setADIFSpots (posted_adif->spots, posted_adif->n_spots, posted_adif->crc);
+            posted_adif->spots = NULL;
+            if (n < 0)
+                snprintf (line, line_len, "%s", posted_adif->ynot);
+        } else
+            n = readADIFWiFiClient (client, content_length, line, line_len);
         if (n < 0) {
             scheduleNewADIF();
             return (false);                     // line[] already filled with error message
@@ -3760,6 +4090,11 @@ typedef struct {
 } CmdTble;
 static const CmdTble command_table[] PROGMEM = {
     { "get_capture.bmp ",   getWiFiCaptureBMP,     "get live screen shot in bmp format" },
+#if defined(_IS_UNIX)
+    { "get_capture.bmp?",   getWiFiCaptureBMPRegion, "x=X&y=Y&w=W&h=H, any missing are rest of screen" },
+    { "get_capture.png ",   getWiFiCapturePNG,     "get live screen shot in png format" },
+    { "get_capture.png?",   getWiFiCapturePNGRegion, "x=X&y=Y&w=W&h=H, any missing are rest of screen" },
+#endif // _IS_UNIX
     { "get_config.txt ",    getWiFiConfig,         "get current display settings" },
     { "get_contests.txt ",  getWiFiContests,       "get current list of contests" },
     { "get_de.txt ",        getWiFiDEInfo,         "get DE info" },
@@ -3788,6 +4123,9 @@ static const CmdTble command_table[] PROGMEM = {
     { "set_screenlock?",    setWiFiScreenLock,     "lock=on|off" },
     { "set_mapcenter?",     setWiFiMapCenter,      "lng=X" },
     { "set_mapcolor?",      setWiFiMapColor,       "setup=name&color=R,G,B" },
+#if defined(_IS_UNIX)
+    { "set_maptiles?",      setWiFiMapTiles,       "on|off" },
+#endif // _IS_UNIX
     { "set_mapview?",       setWiFiMapView,        "Style=S&Grid=G&Projection=P&RSS=on|off&Night=on|off" },
     { "set_newde?",         setWiFiNewDE,          "grid=AB12&lat=X&lng=Y&TZ=local-utc?call=AA0XYZ" },
     { "set_newdx?",         setWiFiNewDX,          "grid=AB12&lat=X&lng=Y&TZ=local-utc" },
@@ -3920,10 +4258,18 @@ static void serveRemote(WiFiClient &client, bool ro)
         return;
 
     // if get here, command was not found but client is still open to list help
+    sendRemoteHelp (client, ro, line, line_mem.getSize());
+}
+
+/* send help for all commands available in the given context to client.
+ * line is just for scratch.
+ */
+static void sendRemoteHelp (WiFiClient &client, bool ro, char line[], size_t line_len)
+{
     startPlainText(client);
 #if defined(_IS_UNIX)
     if (liveweb_port > 0) {
-        snprintf (line, line_mem.getSize(), "HamClock Live is on port %d\r\n\r\n", liveweb_port);
+        snprintf (line, line_len, "HamClock Live is on port %d\r\n\r\n", liveweb_port);
         client.print (line);
     }
 #endif
@@ -3940,7 +4286,7 @@ static void serveRemote(WiFiClient &client, bool ro)
         const int indent = 22;
         int cmd_len = strlen (ramcmd);
         client.print (ramcmd);
-        snprintf (line, line_mem.getSize(), "%*s", indent-cmd_len, "");
+        snprintf (line, line_len, "%*s", indent-cmd_len, "");
         client.print (line);
         client.println (FPSTR(ctp->help));
 
@@ -3953,8 +4299,8 @@ static void serveRemote(WiFiClient &client, bool ro)
             for (int i = 0; i < PLOT_CH_N; i++) {
                 if (plotChoiceIsAvailable ((PlotChoice)i)) {
                     if (ll == 0)
-                        ll = snprintf (line, line_mem.getSize(), "%s", indent);
-                    ll += snprintf (line+ll, line_mem.getSize()-ll, " %s", plot_names[i]);
+                        ll = snprintf (line, line_len, "%s", indent);
+                    ll += snprintf (line+ll, line_len-ll, " %s", plot_names[i]);
                     if (ll > max_w) {
                         client.println (line);
                         ll = 0;
@@ -3966,11 +4312,406 @@ static void serveRemote(WiFiClient &client, bool ro)
     }
 }
 
+#if defined(_IS_UNIX)
+
+/* concurrent RESTful service, UNIX only, enabled with -j.
+ *
+ * an accept thread hands each new connection to a bounded pool of worker threads through web_q.
+ * a worker keeps reading requests on its connection for as long as the client asks for keep-alive.
+ * commands accepted by parallelCommandOk() only read the frame buffer so they run right in the worker,
+ * in parallel with each other and with the main loop. all others are handed to the main thread through
+ * web_main and run from checkWebServer() as always, so they may freely touch the display and settings;
+ * the worker waits for them to finish.
+ */
+
+int restful_nthr;                                       // n worker threads, 0 to serve from main loop
+
+#define WEB_MAXQ        16                              // max accepted connections waiting for a worker
+#define WEB_KEEPIDLE    5000                            // max idle time on a kept connection, millis
+#define WEB_KEEPMAX     100                             // max requests on one kept connection
+
+// command a worker needs run by the main thread
+typedef struct {
+    WiFiClient *client;                                 // connection to reply on
+    char *cmd;                                          // command, starting just after the /
+    size_t max_cmd_len;                                 // room for runWebserverCommand() to use
+    long content_length;                                // captured from this request's header
+    PostedADIF *adif;                                   // set_adif body cracked by the worker, else NULL
+    bool done;                                          // set by main thread when finished
+} WebMainCmd;
+
+static pthread_mutex_t web_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t web_qcv = PTHREAD_COND_INITIALIZER;       // web_q changed
+static pthread_cond_t web_maincv = PTHREAD_COND_INITIALIZER;    // web_main changed
+static int web_q[WEB_MAXQ];                             // fifo of accepted fds waiting for a worker
+static int web_q_head, web_nq;                          // index of oldest in web_q, n in web_q
+static WebMainCmd *web_main;                            // command waiting for the main thread, if any
+
+// stats for get_sys.txt, all guarded by web_lock
+static int web_nconn;                                   // n connections accepted
+static int web_nreq;                                    // n requests served
+static int web_npar;                                    // n requests run in a worker
+static int web_nkept;                                   // n requests that reused a kept connection
+static int web_nbusy;                                   // n workers busy now
+static int web_maxq;                                    // max connections ever waiting in web_q
+
+/* return whether the given command may run in a worker thread.
+ * only the captures qualify because they read just the frame buffer, under its own lock; everything
+ * else reads state the main thread changes without locking so it must run there.
+ */
+static bool parallelCommandOk (const char *cmd)
+{
+    return (strncmp_P (cmd, PSTR("get_capture."), 12) == 0);
+}
+
+/* hand the given command to the main thread and wait until it has been run.
+ * N.B. one at a time, other workers wait their turn.
+ */
+static void runOnMainThread (WiFiClient &client, char *cmd, size_t max_cmd_len, long clen, PostedADIF *adif)
+{
+    WebMainCmd wmc;
+    wmc.client = &client;
+    wmc.cmd = cmd;
+    wmc.max_cmd_len = max_cmd_len;
+    wmc.content_length = clen;
+    wmc.adif = adif;
+    wmc.done = false;
+
+    pthread_mutex_lock (&web_lock);
+        while (web_main)
+            pthread_cond_wait (&web_maincv, &web_lock);
+        web_main = &wmc;
+        wakeLoop();
+        while (!wmc.done)
+            pthread_cond_wait (&web_maincv, &web_lock);
+    pthread_mutex_unlock (&web_lock);
+}
+
+/* called by main thread to run the command waiting in web_main, if any.
+ */
+static void runMainCommand (bool ro)
+{
+    pthread_mutex_lock (&web_lock);
+        WebMainCmd *wmc = web_main;
+    pthread_mutex_unlock (&web_lock);
+    if (!wmc)
+        return;
+
+    // run just as serveRemote() would
+    content_length = wmc->content_length;
+    posted_adif = wmc->adif;
+    bypass_pw = true;
+    if (!runWebserverCommand (*wmc->client, ro, wmc->cmd, wmc->max_cmd_len)) {
+        StackMalloc help_mem(TLE_LINEL*4);
+        sendRemoteHelp (*wmc->client, ro, (char *) help_mem.getMem(), help_mem.getSize());
+    }
+    bypass_pw = false;
+    posted_adif = NULL;
+
+    // release worker
+    pthread_mutex_lock (&web_lock);
+        wmc->done = true;
+        web_main = NULL;
+        pthread_cond_broadcast (&web_maincv);
+    pthread_mutex_unlock (&web_lock);
+}
+
+/* wait up to to_ms for client to send more.
+ * return whether there is something to read.
+ */
+static bool waitWebRequest (WiFiClient &client, int to_ms)
+{
+    uint32_t t0 = millis();
+    while (!client.available()) {
+        if (!client.connected() || timesUp (&t0, to_ms))
+            return (false);
+        delay (10);
+    }
+    return (true);
+}
+
+/* read the remainder of a request header, capturing Content-Length and whether the client wants
+ * the connection kept open, which defaults per its HTTP version.
+ * return whether the header was complete.
+ */
+static bool readWebHeader (WiFiClient &client, long *clen, bool *keep)
+{
+    char line[200];
+
+    *clen = 0;
+    do {
+        if (!getTCPLine (client, line, sizeof(line), NULL))
+            return (false);
+        if (strncasecmp (line, "Content-Length:", 15) == 0)
+            *clen = atol (line+15);
+        else if (strncasecmp (line, "Connection:", 11) == 0) {
+            if (strcasestr (line+11, "close"))
+                *keep = false;
+            else if (strcasestr (line+11, "keep-alive"))
+                *keep = true;
+        }
+    } while (line[0] != '\0');
+
+    return (true);
+}
+
+/* send the reply held in client to its socket, reframed so the connection may be kept open.
+ * all our replies begin with a header from startPlainText() or sendHTTPError() or the like that
+ * says Connection: close and gives no length, so we replace those with a Content-Length and keep-alive.
+ * return whether the connection may in fact be kept open.
+ */
+static bool sendKeptReply (WiFiClient &client)
+{
+    int n_held;
+    uint8_t *held = client.releaseWrites (&n_held);
+
+    // find end of header, if any
+    const uint8_t *body = (const uint8_t *) memmem (held, n_held, "\r\n\r\n", 4);
+    if (!body) {
+        // can't reframe so just send and close
+        client.write (held, n_held);
+        free (held);
+        return (false);
+    }
+    body += 4;
+    int n_body = n_held - (body - held);
+
+    // copy original header except for those we replace
+    char hdr[512];
+    int n_hdr = 0;
+    for (char *l = (char *)held; l < (char *)body - 2; ) {
+        char *eol = (char *) memmem (l, (char *)body - l, "\r\n", 2);
+        int ll = eol - l;
+        if (l == (char *)held && strncmp (l, "HTTP/1.0", 8) == 0)
+            n_hdr += snprintf (hdr+n_hdr, sizeof(hdr)-n_hdr, "HTTP/1.1%.*s\r\n", ll-8, l+8);
+        else if (strncasecmp (l, "Connection:", 11) && strncasecmp (l, "Content-Length:", 15))
+            n_hdr += snprintf (hdr+n_hdr, sizeof(hdr)-n_hdr, "%.*s\r\n", ll, l);
+        if (n_hdr >= (int)sizeof(hdr) - 80) {
+            // header is not one of ours
+            client.write (held, n_held);
+            free (held);
+            return (false);
+        }
+        l = eol + 2;
+    }
+    n_hdr += snprintf (hdr+n_hdr, sizeof(hdr)-n_hdr, "Content-Length: %d\r\nConnection: keep-alive\r\n\r\n",
+                                n_body);
+
+    // send
+    client.write ((uint8_t *)hdr, n_hdr);
+    client.write (body, n_body);
+    free (held);
+
+    return (client.connected());
+}
+
+/* serve one connection accepted by the concurrent server until it closes or need not be kept.
+ */
+static void serveConcurrent (int fd)
+{
+    WiFiClient client(fd);
+    StackMalloc line_mem(TLE_LINEL*4);          // accommodate longest query, probably set_sattle with %20s
+    char *line = (char *) line_mem.getMem();    // handy access to malloced buffer
+
+    for (int n_req = 0; n_req < WEB_KEEPMAX; n_req++) {
+
+        // read query, allowing a kept connection to idle a while
+        if (n_req > 0 && !waitWebRequest (client, WEB_KEEPIDLE))
+            break;
+        if (!getTCPLine (client, line, line_mem.getSize(), NULL)) {
+            if (n_req == 0)
+                sendHTTPError (client, _FX("empty RESTful query\n"));
+            break;
+        }
+
+        // first line must be the GET except set_rss and set_adif which can be POST
+        if (strncmp (line, _FX("GET /"), 5) && strncmp (line, _FX("POST /set_rss?"), 14)
+                                    && strncmp (line, _FX("POST /set_adif?"), 15)) {
+            Serial.println (line);
+            sendHTTPError (client, _FX("Method must be GET (or POST with set_rss or set_adif)\n"));
+            break;
+        }
+
+        // read header. only GETs are kept because POST handlers may read until the client closes.
+        long clen;
+        bool keep = strstr (line, " HTTP/1.1") != NULL;
+        if (!readWebHeader (client, &clen, &keep)) {
+            Serial.printf (_FX("bogus header after %s\n"), line);
+            break;
+        }
+        keep = keep && line[0] == 'G' && n_req < WEB_KEEPMAX-1;
+
+        // log sender
+        Serial.printf (_FX("Command from %s: %s\n"), client.remoteIP().toString().c_str(), line);
+        if (clen)
+            Serial.printf (_FX("Content-Length: %ld\n"), clen);
+
+        // find beginning just after first -- we aleady know there is a /
+        char *cmd_start = strchr (line,'/')+1;
+        size_t max_cmd_len = line + line_mem.getSize() - cmd_start;
+
+        // read and crack a set_adif body here so the main thread need not wait for the network
+        PostedADIF adif;
+        bool post_adif = line[0] == 'P' && strncmp_P (cmd_start, PSTR("set_adif?file "), 14) == 0;
+        if (post_adif)
+            adif.n_spots = crackADIFWiFiClient (client, clen, &adif.spots, &adif.crc, adif.ynot,
+                                                                                    sizeof(adif.ynot));
+
+        // run command here if safe, else on the main thread, holding the reply if want to keep
+        if (keep)
+            client.holdWrites();
+        bool par = parallelCommandOk (cmd_start);
+        if (par)
+            (void) runWebserverCommand (client, true, cmd_start, max_cmd_len);
+        else
+            runOnMainThread (client, cmd_start, max_cmd_len, clen, post_adif ? &adif : NULL);
+        if (post_adif)
+            free (adif.spots);                  // in case the command did not take them
+        if (keep)
+            keep = sendKeptReply (client);
+
+        pthread_mutex_lock (&web_lock);
+            web_nreq++;
+            if (par)
+                web_npar++;
+            if (n_req > 0)
+                web_nkept++;
+        pthread_mutex_unlock (&web_lock);
+
+        if (!keep)
+            break;
+    }
+
+    client.stop();
+}
+
+/* thread that serves connections from web_q forever.
+ */
+static void *webWorkerThread (void *unused)
+{
+    (void) unused;
+
+    pthread_detach (pthread_self());
+
+    for(;;) {
+
+        // wait for next connection
+        pthread_mutex_lock (&web_lock);
+            while (web_nq == 0)
+                pthread_cond_wait (&web_qcv, &web_lock);
+            int fd = web_q[web_q_head];
+            web_q_head = (web_q_head + 1) % WEB_MAXQ;
+            web_nq--;
+            web_nbusy++;
+            pthread_cond_broadcast (&web_qcv);
+        pthread_mutex_unlock (&web_lock);
+
+        serveConcurrent (fd);
+
+        pthread_mutex_lock (&web_lock);
+            web_nbusy--;
+        pthread_mutex_unlock (&web_lock);
+    }
+
+    return (NULL);
+}
+
+/* thread that accepts new RESTful connections forever and queues them for the workers.
+ * when web_q is full we stop accepting so further clients wait in the listen backlog.
+ */
+static void *webAcceptThread (void *unused)
+{
+    (void) unused;
+
+    pthread_detach (pthread_self());
+
+    for(;;) {
+
+        // wait for room
+        pthread_mutex_lock (&web_lock);
+            while (web_nq == WEB_MAXQ)
+                pthread_cond_wait (&web_qcv, &web_lock);
+        pthread_mutex_unlock (&web_lock);
+
+        // block for next connection
+        WiFiClient client = restful_server->next();
+        if (!client) {
+            delay (100);                        // avoid spinning if accept is failing
+            continue;
+        }
+        int fd = client.detachFd();             // worker owns it now
+
+        // queue for a worker
+        pthread_mutex_lock (&web_lock);
+            web_q[(web_q_head + web_nq) % WEB_MAXQ] = fd;
+            web_nq++;
+            if (web_nq > web_maxq)
+                web_maxq = web_nq;
+            web_nconn++;
+            pthread_cond_broadcast (&web_qcv);
+        pthread_mutex_unlock (&web_lock);
+    }
+
+    return (NULL);
+}
+
+/* start restful_nthr workers, or as many as we can, then the accept thread.
+ * return whether at least one worker and the accept thread started, else caller should fall back to
+ * serving from the main loop. any workers already started then just wait forever on an empty web_q.
+ */
+static bool startWebThreads()
+{
+    pthread_t tid;
+    int e;
+    for (int i = 0; i < restful_nthr; i++) {
+        e = pthread_create (&tid, NULL, webWorkerThread, NULL);
+        if (e) {
+            Serial.printf (_FX("RESTful worker thread %d failed: %s\n"), i, strerror(e));
+            if (i == 0)
+                return (false);
+            restful_nthr = i;
+            break;
+        }
+    }
+    e = pthread_create (&tid, NULL, webAcceptThread, NULL);
+    if (e) {
+        Serial.printf (_FX("RESTful accept thread failed: %s\n"), strerror(e));
+        return (false);
+    }
+    Serial.printf (_FX("RESTful server using %d concurrent threads\n"), restful_nthr);
+    return (true);
+}
+
+/* pass back a line of concurrent server stats for get_sys.txt.
+ * return whether the concurrent server is in use at all.
+ */
+static bool getWebServerStats (char line[], size_t line_len)
+{
+    if (restful_nthr <= 0)
+        return (false);
+
+    pthread_mutex_lock (&web_lock);
+        snprintf (line, line_len, _FX("%d threads %d busy conn %d req %d par %d kept %d maxq %d"),
+                    restful_nthr, web_nbusy, web_nconn, web_nreq, web_npar, web_nkept, web_maxq);
+    pthread_mutex_unlock (&web_lock);
+    return (true);
+}
+
+#endif // _IS_UNIX
+
 /* check if someone is trying to tell/ask us something.
  * N.B, all such commands bypass the password system.
  */
 void checkWebServer(bool ro)
 {
+#if defined(_IS_UNIX)
+    // concurrent workers only need us for commands that touch UI state
+    if (restful_nthr > 0) {
+        runMainCommand (ro);
+        return;
+    }
+#endif // _IS_UNIX
+
     if (restful_server) {
         WiFiClient client = restful_server->available();
         if (client) {
@@ -4008,6 +4749,19 @@ void initWebServer()
 
     tftMsg (true, 0, "RESTful API server on port %d", restful_port);
 
+    #if defined(_IS_UNIX)
+        if (restful_nthr > 0) {
+            if (startWebThreads())
+                tftMsg (true, 0, "  with %d concurrent threads", restful_nthr);
+            else
+                restful_nthr = 0;
+        }
+
+        // main loop serves connections itself unless concurrent
+        if (restful_nthr == 0)
+            wakeLoopOnInput (restful_server->fd(), true);
+    #endif
+
 }
 
 /* like readCalTouch() but also checks for remote web server touch.
@@ -30,6 +30,7 @@ static const char kp_page[] PROGMEM = "/geomag/kindex.txt";
 #define KP_NHD           7                      // N historical days
 #define KP_NPD           2                      // N predicted days
 #define KP_NV            ((KP_NHD+KP_NPD)*KP_VPD) // N total Kp values
+#define KP_NOWI          (KP_NHD*KP_VPD-1)      // index of current Kp, ie, last historic
 
 // xray info, new data posted every 10 minutes
 #define XRAY_INTERVAL   (610+randIvl(30))       // polling interval, secs
@@ -196,18 +197,23 @@ static float path_spw[BMTRX_COLS];
 static NOAASpaceWx noaa_spw;
 
 // fwd local funcs
-static bool updateDRAP(SBox &box);
-static bool updateKp(SBox &box);
-static bool updateXRay(const SBox &box);
-static bool updateSunSpots(const SBox &box);
-static bool updateSolarFlux(const SBox &box);
-static bool updateBzBt(const SBox &box);
+static bool plotDRAP (const SBox &box, bool ok, time_t t, float *a[]);
+static bool plotKp (const SBox &box, bool ok, time_t t, float *a[]);
+static bool plotXRay (const SBox &box, bool ok, time_t t, float *a[]);
+static bool plotSunSpots (const SBox &box, bool ok, time_t t, float *a[]);
+static bool plotSolarFlux (const SBox &box, bool ok, time_t t, float *a[]);
+static bool plotBzBt (const SBox &box, bool ok, time_t t, float *a[]);
 static bool updateBandConditions(const SBox &box);
 static bool updateNOAASWx(const SBox &box);
 static bool updateSolarWind(const SBox &box);
 static bool updateRSS (void);
 static uint32_t crackBE32 (uint8_t bp[]);
 
+#if defined(_IS_UNIX)
+// set only in the fetch worker threads
+static thread_local bool fetch_worker;
+#endif // _IS_UNIX
+
 /* return a random number [-n,n] intended for randomizing update intervals
  */
 static int randIvl(int n)
@@ -262,6 +268,14 @@ static time_t nextWiFiRetry (PlotChoice ch)
     return (next_try);
 }
 
+/* return interval, or WIFI_RETRY if the data just retrieved in this thread were only a stale cached copy
+ * so they are replaced as soon as the network allows.
+ */
+static int freshInterval (int interval)
+{
+    return (httpCacheStale() ? WIFI_RETRY : interval);
+}
+
 /* figure out when to next rotate the given pane.
  * rotations are spaced out to avoid swamping the server or supporting service.
  */
@@ -297,6 +311,30 @@ static time_t nextPaneUpdate (PlotPane pp, int interval)
     return (next);
 }
 
+/* updateClocks(false) unless called from a fetch worker, which must never draw.
+ */
+static void updateClocksMain()
+{
+#if defined(_IS_UNIX)
+    if (fetch_worker)
+        return;
+#endif // _IS_UNIX
+    updateClocks(false);
+}
+
+/* return whether pane pp is showing data that it keeps fresh with background fetches, so the
+ * corresponding checkXXX() need not also download them.
+ */
+static bool fetchedByPane (PlotPane pp)
+{
+#if defined(_IS_UNIX)
+    return (pp != PANE_NONE);
+#else
+    (void) pp;
+    return (false);
+#endif // _IS_UNIX
+}
+
 /* set de_ll.lat_d and de_ll.lng_d from the given ip else our public ip.
  * report status via tftMsg
  */
@@ -800,6 +838,7 @@ static char *xrayLevel (float xray, char *buf)
 
 /* retrieve latest sun spot indices and time scale in days from now.
  * return whether all ok
+ * N.B. may be called from a fetch worker
  */
 static bool retrieveSunSpots (float x[SSPOT_NV], float ssn[SSPOT_NV])
 {
@@ -807,22 +846,10 @@ static bool retrieveSunSpots (float x[SSPOT_NV], float ssn[SSPOT_NV])
     WiFiClient ss_client;
     bool ok = false;
 
-    // mark value as bad until proven otherwise
-    ssn_spw = SPW_ERR;
-
     Serial.println(ssn_page);
     resetWatchdog();
-    if (wifiOk() && ss_client.connect(backend_host, backend_port)) {
-        updateClocks(false);
-
-        // query web page
-        httpHCPGET (ss_client, backend_host, ssn_page);
-
-        // skip response header
-        if (!httpSkipHeader (ss_client)) {
-            Serial.print (F("SSN header fail\n"));
-            goto out;
-        }
+    if (httpCacheHCGET (ss_client, ssn_page)) {
+        updateClocksMain();
 
         // read lines into ssn array and build corresponding time value
         int8_t ssn_i;
@@ -831,7 +858,7 @@ static bool retrieveSunSpots (float x[SSPOT_NV], float ssn[SSPOT_NV])
             x[ssn_i] = 1-SSPOT_NV + ssn_i;
         }
 
-        updateClocks(false);
+        updateClocksMain();
         resetWatchdog();
 
         // ok if all received
@@ -839,10 +866,6 @@ static bool retrieveSunSpots (float x[SSPOT_NV], float ssn[SSPOT_NV])
 
             ok = true;
 
-            // capture latest for getSpaceWeather() and drawSpaceStats()
-            ssn_spw = ssn[SSPOT_NV-1];
-            ssn_update = myNow();
-
         } else {
 
             Serial.printf (_FX("SSN: data short %d / %d\n"), ssn_i, SSPOT_NV);
@@ -850,7 +873,6 @@ static bool retrieveSunSpots (float x[SSPOT_NV], float ssn[SSPOT_NV])
     }
 
     // clean up
-out:
     ss_client.stop();
     resetWatchdog();
     return (ok);
@@ -858,6 +880,7 @@ out:
 
 
 /* retrieve latest and predicted solar flux indices, return whether all ok.
+ * N.B. may be called from a fetch worker
  */
 static bool retrievSolarFlux (float x[SFLUX_NV], float sflux[SFLUX_NV])
 {
@@ -866,24 +889,12 @@ static bool retrievSolarFlux (float x[SFLUX_NV], float sflux[SFLUX_NV])
     WiFiClient sf_client;
     bool ok = false;
 
-    // mark value as bad until proven otherwise
-    sflux_spw = SPW_ERR;
-
     Serial.println (sf_page);
     resetWatchdog();
-    if (wifiOk() && sf_client.connect(backend_host, backend_port)) {
-        updateClocks(false);
+    if (httpCacheHCGET (sf_client, sf_page)) {
+        updateClocksMain();
         resetWatchdog();
 
-        // query web page
-        httpHCPGET (sf_client, backend_host, sf_page);
-
-        // skip response header
-        if (!httpSkipHeader (sf_client)) {
-            Serial.print (F("SFlux header fail\n"));
-            goto out;
-        }
-
         // read lines into flux array and build corresponding time value
         int8_t sflux_i;
         for (sflux_i = 0; sflux_i < SFLUX_NV && getTCPLine(sf_client, line, line_mem.getSize(), NULL);
@@ -893,13 +904,10 @@ static bool retrievSolarFlux (float x[SFLUX_NV], float sflux[SFLUX_NV])
         }
 
         // ok if found all
-        updateClocks(false);
+        updateClocksMain();
         resetWatchdog();
         if (sflux_i == SFLUX_NV) {
 
-            // capture current value for getSpaceWeather() and drawSpaceStats()
-            sflux_spw = sflux[SFLUX_NV-10];         // current value, not predictions
-            sflux_update = myNow();
             ok = true;
 
         } else {
@@ -909,7 +917,6 @@ static bool retrievSolarFlux (float x[SFLUX_NV], float sflux[SFLUX_NV])
     }
 
     // clean up
-out:
     sf_client.stop();
     resetWatchdog();
     return (ok);
@@ -925,7 +932,7 @@ static bool checkSolarFlux (void)
     PlotPane sflux_pp = findPaneForChoice (PLOT_CH_FLUX);
     time_t *next_p = sflux_pp == PANE_NONE ? &next_sflux : &next_update[sflux_pp];
 
-    if (myNow() < *next_p)
+    if (myNow() < *next_p || fetchedByPane (sflux_pp))
         return (false);
 
     StackMalloc x_mem(SFLUX_NV*sizeof(float));
@@ -936,12 +943,17 @@ static bool checkSolarFlux (void)
     bool ok = retrievSolarFlux (x, sflux);
     if (ok) {
 
+        // capture current value for getSpaceWeather() and drawSpaceStats()
+        sflux_spw = sflux[SFLUX_NV-10];                 // current value, not predictions
+        sflux_update = myNow();
+
         // schedule next
-        *next_p = myNow() + SFLUX_INTERVAL;
+        *next_p = myNow() + freshInterval (SFLUX_INTERVAL);
 
     } else {
 
         // schedule retry
+        sflux_spw = SPW_ERR;
         *next_p = nextWiFiRetry(PLOT_CH_FLUX);
     }
 
@@ -950,9 +962,10 @@ static bool checkSolarFlux (void)
 }
 
 
-/* retrieve and plot latest DRAP frequencies, return whether all ok.
+/* retrieve latest DRAP frequencies as of t_now, return whether all ok.
+ * N.B. may be called from a fetch worker
  */
-static bool retrieveDRAP (float x[DRAPDATA_NPTS], float y[DRAPDATA_NPTS])
+static bool retrieveDRAP (float x[DRAPDATA_NPTS], float y[DRAPDATA_NPTS], time_t t_now)
 {
     #define _DRAPDATA_MAXMI     (DRAPDATA_NPTS/10)                      // max allowed missing intervals
     #define _DRAP_MINGOODI      (DRAPDATA_NPTS-3600/DRAPDATA_INTERVAL)  // min index with good data
@@ -967,27 +980,12 @@ static bool retrieveDRAP (float x[DRAPDATA_NPTS], float y[DRAPDATA_NPTS])
     // want max in each interval so init y values to all 0
     memset (y, 0, DRAPDATA_NPTS*sizeof(float));
 
-    // mark data as bad until proven otherwise
-    drap_spw = SPW_ERR;
-
     Serial.println (drap_page);
     resetWatchdog();
-    if (wifiOk() && drap_client.connect(backend_host, backend_port)) {
-        updateClocks(false);
+    if (httpCacheHCGET (drap_client, drap_page)) {
+        updateClocksMain();
         resetWatchdog();
 
-        // query web page
-        httpHCPGET (drap_client, backend_host, drap_page);
-
-        // skip response header
-        if (!httpSkipHeader (drap_client)) {
-            Serial.print (F("DRAP header short\n"));
-            goto out;
-        }
-
-        // init state
-        time_t t_now = myNow();
-
         // read lines, oldest first
         int n_lines = 0;
         while (getTCPLine (drap_client, line, sizeof(line), NULL)) {
@@ -1023,7 +1021,7 @@ static bool retrieveDRAP (float x[DRAPDATA_NPTS], float y[DRAPDATA_NPTS])
         Serial.printf (_FX("DRAP: read %d lines\n"), n_lines);
 
         // look alive
-        updateClocks(false);
+        updateClocksMain();
         resetWatchdog();
 
         // check for missing data
@@ -1051,10 +1049,6 @@ static bool retrieveDRAP (float x[DRAPDATA_NPTS], float y[DRAPDATA_NPTS])
             goto out;
         }
 
-        // capture for getSpaceWeather()
-        drap_spw = y[DRAPDATA_NPTS-1];
-        drap_update = t_now;
-
         // ok!
         ok = true;
 
@@ -1080,7 +1074,7 @@ static bool checkDRAP ()
     PlotPane drap_pp = findPaneForChoice (PLOT_CH_DRAP);
     time_t *next_p = drap_pp == PANE_NONE ? &next_drap : &next_update[drap_pp];
 
-    if (myNow() < *next_p)
+    if (myNow() < *next_p || fetchedByPane (drap_pp))
         return (false);
 
     StackMalloc x_mem(DRAPDATA_NPTS*sizeof(float));
@@ -1088,15 +1082,21 @@ static bool checkDRAP ()
     float *x = (float*)x_mem.getMem();
     float *y = (float*)y_mem.getMem();
 
-    bool ok = retrieveDRAP (x, y);
+    time_t t0 = myNow();
+    bool ok = retrieveDRAP (x, y, t0);
     if (ok) {
 
+        // capture for getSpaceWeather()
+        drap_spw = y[DRAPDATA_NPTS-1];
+        drap_update = t0;
+
         // schedule next
-        *next_p = myNow() + DRAPPLOT_INTERVAL;
+        *next_p = myNow() + freshInterval (DRAPPLOT_INTERVAL);
 
     } else {
 
         // schedule retry
+        drap_spw = SPW_ERR;
         *next_p = nextWiFiRetry(PLOT_CH_DRAP);
     }
 
@@ -1105,6 +1105,7 @@ static bool checkDRAP ()
 }
 
 /* retrieve latest and predicted kp indices, return whether all ok
+ * N.B. may be called from a fetch worker
  */
 static bool retrieveKp (float kpx[KP_NV], float kp[KP_NV])
 {
@@ -1113,26 +1114,14 @@ static bool retrieveKp (float kpx[KP_NV], float kp[KP_NV])
     WiFiClient kp_client;                               // wifi client connection
     bool ok = false;                                    // set iff all ok
 
-    // mark value as bad until proven otherwise
-    kp_spw = SPW_ERR;
-
     Serial.println(kp_page);
     resetWatchdog();
-    if (wifiOk() && kp_client.connect(backend_host, backend_port)) {
-        updateClocks(false);
+    if (httpCacheHCGET (kp_client, kp_page)) {
+        updateClocksMain();
         resetWatchdog();
 
-        // query web page
-        httpHCPGET (kp_client, backend_host, kp_page);
-
-        // skip response header
-        if (!httpSkipHeader (kp_client)) {
-            Serial.print (F("Kp header short\n"));
-            goto out;
-        }
-
         // read lines into kp array and build x
-        const int now_i = KP_NHD*KP_VPD-1;              // last historic is now
+        const int now_i = KP_NOWI;
         for (kp_i = 0; kp_i < KP_NV && getTCPLine (kp_client, line, sizeof(line), NULL); kp_i++) {
             kp[kp_i] = atof(line);
             kpx[kp_i] = (kp_i-now_i)/(float)KP_VPD;
@@ -1142,10 +1131,6 @@ static bool retrieveKp (float kpx[KP_NV], float kp[KP_NV])
         // ok if all
         if (kp_i == KP_NV) {
 
-            // save current (not last!) value for getSpaceWeather()
-            kp_spw = kp[now_i];
-            kp_update = myNow();
-
             ok = true;
 
         } else {
@@ -1155,7 +1140,6 @@ static bool retrieveKp (float kpx[KP_NV], float kp[KP_NV])
     }
 
     // clean up
-out:
     kp_client.stop();
     resetWatchdog();
     return (ok);
@@ -1171,7 +1155,7 @@ static bool checkKp (void)
     PlotPane kp_pp = findPaneForChoice (PLOT_CH_KP);
     time_t *next_p = kp_pp == PANE_NONE ? &next_kp : &next_update[kp_pp];
 
-    if (myNow() < *next_p)
+    if (myNow() < *next_p || fetchedByPane (kp_pp))
         return (false);
 
     StackMalloc kpx_mem(KP_NV*sizeof(float));
@@ -1182,12 +1166,17 @@ static bool checkKp (void)
     bool ok = retrieveKp (kpx, kp);
     if (ok) {
 
+        // save current (not last!) value for getSpaceWeather()
+        kp_spw = kp[KP_NOWI];
+        kp_update = myNow();
+
         // schedule next
-        *next_p = myNow() + KP_INTERVAL;
+        *next_p = myNow() + freshInterval (KP_INTERVAL);
 
     } else {
 
         // schedule retry
+        kp_spw = SPW_ERR;
         *next_p = nextWiFiRetry(PLOT_CH_KP);
     }
 
@@ -1196,6 +1185,7 @@ static bool checkKp (void)
 }
 
 /* retrieve latest xray indices, return whether all ok
+ * N.B. may be called from a fetch worker
  */
 static bool retrieveXRay (float lxray[XRAY_NV], float sxray[XRAY_NV], float x[XRAY_NV])
 {
@@ -1205,26 +1195,13 @@ static bool retrieveXRay (float lxray[XRAY_NV], float sxray[XRAY_NV], float x[XR
     uint16_t ll;
     bool ok = false;
 
-    // mark value as bad until proven otherwise
-    xray_spw = SPW_ERR;
-
     Serial.println(xray_page);
     resetWatchdog();
-    if (wifiOk() && xray_client.connect(backend_host, backend_port)) {
-        updateClocks(false);
-
-        // query web page
-        httpHCPGET (xray_client, backend_host, xray_page);
-
-        // soak up remaining header
-        if (!httpSkipHeader (xray_client)) {
-            Serial.print (F("XRay header short\n"));
-            goto out;
-        }
+    if (httpCacheHCGET (xray_client, xray_page)) {
+        updateClocksMain();
 
         // collect content lines and extract both wavelength intensities
         xray_i = 0;
-        float raw_lxray = 0;
         while (xray_i < XRAY_NV && getTCPLine (xray_client, line, sizeof(line), &ll)) {
             // Serial.println(line);
 
@@ -1241,7 +1218,6 @@ static bool retrieveXRay (float lxray[XRAY_NV], float sxray[XRAY_NV], float x[XR
                 if (l <= 0)                             // missing values are set to -1.00e+05, also guard 0
                     l = 1e-9;
                 lxray[xray_i] = log10f(l);
-                raw_lxray = l;                          // last one will be current
 
                 // time in hours back from 0
                 x[xray_i] = (xray_i-XRAY_NV)/6.0;       // 6 entries per hour
@@ -1254,10 +1230,6 @@ static bool retrieveXRay (float lxray[XRAY_NV], float sxray[XRAY_NV], float x[XR
         // proceed iff we found all
         if (xray_i == XRAY_NV) {
 
-            // capture for getSpaceWeather() and drawSpaceStats()
-            xray_spw = raw_lxray;
-            xray_update = myNow();
-
             ok = true;
 
         } else {
@@ -1266,8 +1238,6 @@ static bool retrieveXRay (float lxray[XRAY_NV], float sxray[XRAY_NV], float x[XR
         }
     }
 
-out:
-
     xray_client.stop();
     resetWatchdog();
     return (ok);
@@ -1283,7 +1253,7 @@ static bool checkXRay (void)
     PlotPane xray_pp = findPaneForChoice (PLOT_CH_XRAY);
     time_t *next_p = xray_pp == PANE_NONE ? &next_xray : &next_update[xray_pp];
 
-    if (myNow() < *next_p)
+    if (myNow() < *next_p || fetchedByPane (xray_pp))
         return (false);
 
     StackMalloc lxray_mem(XRAY_NV*sizeof(float));
@@ -1296,12 +1266,17 @@ static bool checkXRay (void)
     bool ok = retrieveXRay (lxray, sxray, x);
     if (ok) {
 
+        // capture for getSpaceWeather() and drawSpaceStats()
+        xray_spw = powf (10.0F, lxray[XRAY_NV-1]);
+        xray_update = myNow();
+
         // schedule next
-        *next_p = myNow() + XRAY_INTERVAL;
+        *next_p = myNow() + freshInterval (XRAY_INTERVAL);
 
     } else {
 
         // schedule retry
+        xray_spw = SPW_ERR;
         *next_p = nextWiFiRetry(PLOT_CH_XRAY);
     }
 
@@ -1309,32 +1284,20 @@ static bool checkXRay (void)
     return (true);
 }
 
-/* retrieve latest bzbt indices, return whether all ok
+/* retrieve latest bzbt indices as of t0, return whether all ok
+ * N.B. may be called from a fetch worker
  */
-static bool retrieveBzBt (float bzbt_hrsold[BZBT_NV], float bz[BZBT_NV], float bt[BZBT_NV])
+static bool retrieveBzBt (float bzbt_hrsold[BZBT_NV], float bz[BZBT_NV], float bt[BZBT_NV], time_t t0)
 {
     int bzbt_i;                                     // next index to use
     WiFiClient bzbt_client;
     char line[100];
     bool ok = false;
-    time_t t0 = myNow();
-
-    // mark value as bad until proven otherwise
-    bz_spw = bt_spw = SPW_ERR;
 
     Serial.println(bzbt_page);
     resetWatchdog();
-    if (wifiOk() && bzbt_client.connect(backend_host, backend_port)) {
-        updateClocks(false);
-
-        // query web page
-        httpHCPGET (bzbt_client, backend_host, bzbt_page);
-
-        // skip over remaining header
-        if (!httpSkipHeader (bzbt_client)) {
-            Serial.print (F("BZBT: header short\n"));
-            goto out;
-        }
+    if (httpCacheHCGET (bzbt_client, bzbt_page)) {
+        updateClocksMain();
 
         // collect content lines and extract both magnetic values, oldest first (newest last :-)
         // # UNIX        Bx     By     Bz     Bt
@@ -1365,11 +1328,6 @@ static bool retrieveBzBt (float bzbt_hrsold[BZBT_NV], float bz[BZBT_NV], float b
         // proceed iff we found all and current
         if (bzbt_i == BZBT_NV && bzbt_hrsold[BZBT_NV-1] > -0.25F) {
 
-            // capture latest for getSpaceWeather() and drawSpaceStats()
-            bz_spw = bz[BZBT_NV-1];
-            bt_spw = bt[BZBT_NV-1];
-            bzbt_update = t0 + 3600*bzbt_hrsold[BZBT_NV-1];
-
             // good!
             ok = true;
 
@@ -1382,8 +1340,6 @@ static bool retrieveBzBt (float bzbt_hrsold[BZBT_NV], float bz[BZBT_NV], float b
         }
     }
 
-out:
-
     bzbt_client.stop();
     resetWatchdog();
     return (ok);
@@ -1399,7 +1355,7 @@ static bool checkBzBt(void)
     PlotPane bzbt_pp = findPaneForChoice (PLOT_CH_BZBT);
     time_t *next_p = bzbt_pp == PANE_NONE ? &next_bzbt : &next_update[bzbt_pp];
 
-    if (myNow() < *next_p)
+    if (myNow() < *next_p || fetchedByPane (bzbt_pp))
         return (false);
 
     StackMalloc old_mem(BZBT_NV*sizeof(float));
@@ -1409,15 +1365,22 @@ static bool checkBzBt(void)
     float *bz = (float *) bz_mem.getMem();
     float *bt = (float *) bt_mem.getMem();
 
-    bool ok = retrieveBzBt (old, bz, bt);
+    time_t t0 = myNow();
+    bool ok = retrieveBzBt (old, bz, bt, t0);
     if (ok) {
 
+        // capture latest for getSpaceWeather() and drawSpaceStats()
+        bz_spw = bz[BZBT_NV-1];
+        bt_spw = bt[BZBT_NV-1];
+        bzbt_update = t0 + 3600*old[BZBT_NV-1];
+
         // schedule next
-        *next_p = myNow() + BZBT_INTERVAL;
+        *next_p = myNow() + freshInterval (BZBT_INTERVAL);
 
     } else {
 
         // schedule retry
+        bz_spw = bt_spw = SPW_ERR;
         *next_p = nextWiFiRetry(PLOT_CH_BZBT);
     }
 
@@ -1813,6 +1776,351 @@ bool setPlotChoice (PlotPane pp, PlotChoice ch)
     return (true);
 }
 
+/* the space weather panes that download a few arrays of values and plot them.
+ * on UNIX a small pool of worker threads downloads and parses each into arrays owned by its FetchJob,
+ * then updateWiFi() plots the result on the main thread once it is ready, so a slow backend no longer
+ * stalls the map sweep or touch handling. a fetch still running after its deadline is reported as a
+ * failure and its result discarded whenever it does finish. failures are retried with exponential backoff.
+ * ESP8266 just fetches and plots inline.
+ */
+#define FETCH_NA        3                       // max arrays per source
+#define FETCH_NTHR      3                       // n worker threads, UNIX only
+#define FETCH_MAXRETRY  600                     // longest retry backoff, secs
+
+typedef enum {
+    FJS_IDLE,                                   // nothing in progress
+    FJS_QUEUED,                                 // waiting for a worker
+    FJS_BUSY,                                   // worker is fetching
+    FJS_READY,                                  // result is waiting to be plotted
+} FetchJobState;
+
+typedef struct {
+    // fixed info
+    PlotChoice ch;                              // pane choice
+    int na, nv;                                 // na arrays each of nv floats
+    int deadline;                               // max secs allowed for one fetch
+    bool (*fetch)(float *a[], time_t t);        // download into a[] as of t, N.B. no drawing!
+    bool (*plot)(const SBox &box, bool ok, time_t t, float *a[]); // plot a[] or show error
+
+    // current fetch, guarded by fetch_lock on UNIX
+    FetchJobState state;                        // progress
+    bool abandoned;                             // set if deadline passed
+    bool ok;                                    // fetch result when FJS_READY
+    bool stale;                                 // result was only a stale cached copy
+    float *a[FETCH_NA];                         // result arrays, UNIX only
+    time_t t_start;                             // myNow() when queued
+    uint32_t ms_start;                          // millis() when queued
+
+    // stats
+    int n_ok, n_fail, n_late;                   // n successes, failures and deadlines missed
+    int n_failrun;                              // n consecutive failures, for backoff
+    uint32_t ms_sum, ms_max;                    // total and longest successful fetch, millis
+} FetchJob;
+
+static bool fetchDRAP (float *a[], time_t t) { return (retrieveDRAP (a[0], a[1], t)); }
+static bool fetchKp (float *a[], time_t t) { (void)t; return (retrieveKp (a[0], a[1])); }
+static bool fetchXRay (float *a[], time_t t) { (void)t; return (retrieveXRay (a[0], a[1], a[2])); }
+static bool fetchSunSpots (float *a[], time_t t) { (void)t; return (retrieveSunSpots (a[0], a[1])); }
+static bool fetchSolarFlux (float *a[], time_t t) { (void)t; return (retrievSolarFlux (a[0], a[1])); }
+static bool fetchBzBt (float *a[], time_t t) { return (retrieveBzBt (a[0], a[1], a[2], t)); }
+
+static FetchJob fetch_jobs[] = {
+    { PLOT_CH_DRAP, 2, DRAPDATA_NPTS, 30, fetchDRAP,      plotDRAP },
+    { PLOT_CH_KP,   2, KP_NV,         20, fetchKp,        plotKp },
+    { PLOT_CH_XRAY, 3, XRAY_NV,       30, fetchXRay,      plotXRay },
+    { PLOT_CH_SSN,  2, SSPOT_NV,      20, fetchSunSpots,  plotSunSpots },
+    { PLOT_CH_FLUX, 2, SFLUX_NV,      20, fetchSolarFlux, plotSolarFlux },
+    { PLOT_CH_BZBT, 3, BZBT_NV,       30, fetchBzBt,      plotBzBt },
+};
+#define N_FETCH_JOBS NARRAY(fetch_jobs)
+
+/* return the FetchJob for the given plot choice, else NULL.
+ */
+static FetchJob *findFetchJob (PlotChoice ch)
+{
+    for (unsigned i = 0; i < N_FETCH_JOBS; i++)
+        if (fetch_jobs[i].ch == ch)
+            return (&fetch_jobs[i]);
+    return (NULL);
+}
+
+/* return refresh interval for the given fetched pane choice.
+ */
+static int fetchInterval (PlotChoice ch)
+{
+    switch (ch) {
+    case PLOT_CH_DRAP: return (DRAPPLOT_INTERVAL);
+    case PLOT_CH_KP:   return (KP_INTERVAL);
+    case PLOT_CH_XRAY: return (XRAY_INTERVAL);
+    case PLOT_CH_SSN:  return (SSPOT_INTERVAL);
+    case PLOT_CH_FLUX: return (SFLUX_INTERVAL);
+    case PLOT_CH_BZBT: return (BZBT_INTERVAL);
+    default: fatalError (_FX("fetchInterval() %d"), (int)ch);
+    }
+    return (0);                 // lint
+}
+
+/* record the outcome of one fetch of fj taking dt millis.
+ * N.B. on UNIX caller must hold fetch_lock
+ */
+static void noteFetch (FetchJob *fj, bool ok, uint32_t dt)
+{
+    if (ok) {
+        fj->n_ok++;
+        fj->n_failrun = 0;
+        fj->ms_sum += dt;
+        if (dt > fj->ms_max)
+            fj->ms_max = dt;
+    } else {
+        fj->n_fail++;
+        fj->n_failrun++;
+    }
+    Serial.printf (_FX("Fetch %s %s in %u ms\n"), plot_names[fj->ch], ok ? "ok" : "failed", dt);
+}
+
+/* return time of next attempt for fj after a failure, doubling WIFI_RETRY with each one in a row.
+ */
+static time_t nextFetchRetry (FetchJob *fj)
+{
+    int dt = WIFI_RETRY;
+    for (int i = 1; i < fj->n_failrun && dt < FETCH_MAXRETRY; i++)
+        dt *= 2;
+    if (dt > FETCH_MAXRETRY)
+        dt = FETCH_MAXRETRY;
+    Serial.printf (_FX("Next %s retry in %d sec after %d failures\n"), plot_names[fj->ch], dt,
+                                                fj->n_failrun);
+    return (myNow() + dt);
+}
+
+/* plot the outcome of fj in pane pp and schedule its next update accordingly.
+ */
+static void finishFetchPane (PlotPane pp, FetchJob *fj, bool ok, float *a[])
+{
+    if ((*fj->plot) (plot_b[pp], ok, fj->t_start, a))
+        next_update[pp] = nextPaneUpdate (pp, fj->stale ? WIFI_RETRY : fetchInterval (fj->ch));
+    else
+        next_update[pp] = nextFetchRetry (fj);
+}
+
+/* fetch and plot fj in pane pp right now.
+ */
+static void fetchPaneNow (PlotPane pp, FetchJob *fj)
+{
+    StackMalloc a_mem(fj->na*fj->nv*sizeof(float));
+    float *a[FETCH_NA];
+    for (int i = 0; i < fj->na; i++)
+        a[i] = (float *) a_mem.getMem() + i*fj->nv;
+
+    fj->t_start = myNow();
+    fj->ms_start = millis();
+    bool ok = (*fj->fetch) (a, fj->t_start);
+    fj->stale = ok && httpCacheStale();
+    noteFetch (fj, ok, millis() - fj->ms_start);
+    finishFetchPane (pp, fj, ok, a);
+}
+
+#if defined(_IS_UNIX)
+
+static pthread_mutex_t fetch_lock = PTHREAD_MUTEX_INITIALIZER;  // guards state of all fetch_jobs
+static pthread_cond_t fetch_go = PTHREAD_COND_INITIALIZER;      // signaled when a job is queued
+static int fetch_nthr;                          // n worker threads running
+
+/* return the job that has been queued longest, else NULL.
+ * N.B. caller must hold fetch_lock
+ * UNIX only
+ */
+static FetchJob *nextQueuedFetch()
+{
+    FetchJob *oldest = NULL;
+    for (unsigned i = 0; i < N_FETCH_JOBS; i++) {
+        FetchJob *fj = &fetch_jobs[i];
+        if (fj->state == FJS_QUEUED && (!oldest || (int32_t)(fj->ms_start - oldest->ms_start) < 0))
+            oldest = fj;
+    }
+    return (oldest);
+}
+
+/* perpetual thread that runs queued fetches.
+ * UNIX only
+ */
+static void *fetchThread (void *unused)
+{
+    (void) unused;
+    pthread_detach (pthread_self());
+    fetch_worker = true;
+
+    pthread_mutex_lock (&fetch_lock);
+    for (;;) {
+
+        // wait for work
+        FetchJob *fj;
+        while ((fj = nextQueuedFetch()) == NULL)
+            pthread_cond_wait (&fetch_go, &fetch_lock);
+
+        // claim it and fetch without holding the lock
+        fj->state = FJS_BUSY;
+        time_t t = fj->t_start;
+        pthread_mutex_unlock (&fetch_lock);
+        uint32_t ms0 = millis();
+        bool ok = (*fj->fetch) (fj->a, t);
+        bool stale = ok && httpCacheStale();
+        uint32_t dt = millis() - ms0;
+        pthread_mutex_lock (&fetch_lock);
+
+        // hand back unless it took too long
+        if (fj->abandoned) {
+            Serial.printf (_FX("Fetch %s discarded after %u ms\n"), plot_names[fj->ch], dt);
+            fj->state = FJS_IDLE;
+        } else {
+            noteFetch (fj, ok, dt);
+            fj->ok = ok;
+            fj->stale = stale;
+            fj->state = FJS_READY;
+        }
+    }
+
+    return (NULL);              // lint
+}
+
+/* start the fetch workers if not already.
+ * return whether at least one is running.
+ * UNIX only
+ */
+static bool startFetchThreads()
+{
+    static bool tried;
+    if (!tried) {
+        tried = true;
+        for (int i = 0; i < FETCH_NTHR; i++) {
+            pthread_t tid;
+            int e = pthread_create (&tid, NULL, fetchThread, NULL);
+            if (e != 0) {
+                Serial.printf (_FX("fetch thread %d failed: %s\n"), i, strerror(e));
+                break;
+            }
+            fetch_nthr++;
+        }
+        Serial.printf (_FX("using %d fetch threads\n"), fetch_nthr);
+    }
+
+    return (fetch_nthr > 0);
+}
+
+/* discard any results that are no longer shown in any pane.
+ * UNIX only
+ */
+static void reapFetchJobs()
+{
+    pthread_mutex_lock (&fetch_lock);
+        for (unsigned i = 0; i < N_FETCH_JOBS; i++) {
+            FetchJob *fj = &fetch_jobs[i];
+            if (fj->state == FJS_READY && findPaneForChoice (fj->ch) == PANE_NONE)
+                fj->state = FJS_IDLE;
+        }
+    pthread_mutex_unlock (&fetch_lock);
+}
+
+#endif // _IS_UNIX
+
+/* update pane pp whose current choice is in fetch_jobs[].
+ * on UNIX start a background fetch when due and plot it when ready, else fetch and plot inline.
+ */
+static void updateFetchPane (PlotPane pp, time_t t0)
+{
+    FetchJob *fj = findFetchJob (plot_ch[pp]);
+    if (!fj)
+        fatalError (_FX("updateFetchPane() %d"), (int)plot_ch[pp]);
+
+#if defined(_IS_UNIX)
+
+    // inline if no workers
+    if (!startFetchThreads()) {
+        if (t0 >= next_update[pp])
+            fetchPaneNow (pp, fj);
+        return;
+    }
+
+    pthread_mutex_lock (&fetch_lock);
+
+    switch (fj->state) {
+
+    case FJS_IDLE:
+        // start when due
+        if (t0 >= next_update[pp]) {
+            if (!fj->a[0]) {
+                fj->a[0] = (float *) malloc (fj->na*fj->nv*sizeof(float));
+                if (!fj->a[0])
+                    fatalError (_FX("No memory for %s"), plot_names[fj->ch]);
+                for (int i = 1; i < fj->na; i++)
+                    fj->a[i] = fj->a[0] + i*fj->nv;
+            }
+            fj->t_start = myNow();
+            fj->ms_start = millis();
+            fj->abandoned = false;
+            fj->state = FJS_QUEUED;
+            pthread_cond_signal (&fetch_go);
+        }
+        break;
+
+    case FJS_QUEUED:            // fallthru
+    case FJS_BUSY:
+        // give up if too long, a worker that is still busy finishes later and finds fj abandoned
+        if (!fj->abandoned && millis() - fj->ms_start > 1000U*fj->deadline) {
+            fj->abandoned = true;
+            fj->n_late++;
+            fj->n_failrun++;
+            if (fj->state == FJS_QUEUED)
+                fj->state = FJS_IDLE;
+            Serial.printf (_FX("Fetch %s missed %d sec deadline\n"), plot_names[fj->ch], fj->deadline);
+            pthread_mutex_unlock (&fetch_lock);
+            if (t0 >= next_update[pp]) {
+                // N.B. plot does not look at a[] when !ok
+                (*fj->plot) (plot_b[pp], false, fj->t_start, fj->a);
+                next_update[pp] = nextFetchRetry (fj);
+            }
+            return;
+        }
+        break;
+
+    case FJS_READY:
+        // plot unless pane is busy showing something else for a while, such as DE weather
+        if (t0 >= next_update[pp]) {
+            fj->state = FJS_IDLE;
+            bool ok = fj->ok;
+            pthread_mutex_unlock (&fetch_lock);
+            finishFetchPane (pp, fj, ok, fj->a);
+            return;
+        }
+        break;
+    }
+
+    pthread_mutex_unlock (&fetch_lock);
+
+#else
+
+    if (t0 >= next_update[pp])
+        fetchPaneNow (pp, fj);
+
+#endif // _IS_UNIX
+}
+
+/* print stats for each fetch source that has been used into line[] and return true, else false
+ * when i is past the last one.
+ */
+bool getFetchStats (int i, char line[], size_t line_len)
+{
+    if (i < 0 || i >= (int)N_FETCH_JOBS)
+        return (false);
+
+    FetchJob *fj = &fetch_jobs[i];
+    if (fj->n_ok + fj->n_fail + fj->n_late == 0)
+        line[0] = '\0';
+    else
+        snprintf (line, line_len, _FX("%s ok %d fail %d late %d ms avg %u max %u"), plot_names[fj->ch],
+                    fj->n_ok, fj->n_fail, fj->n_late, fj->n_ok ? fj->ms_sum/fj->n_ok : 0, fj->ms_max);
+    return (true);
+}
+
 /* check if it is time to update any info via wifi.
  * proceed even if no wifi to allow subsystems to update.
  */
@@ -1873,21 +2181,11 @@ void updateWiFi(void)
             break;
 
         case PLOT_CH_FLUX:
-            if (t0 >= next_update[pp]) {
-                if (updateSolarFlux(box))
-                    next_update[pp] = nextPaneUpdate (pp, SFLUX_INTERVAL);
-                else
-                    next_update[pp] = nextWiFiRetry(ch);
-            }
+            updateFetchPane (pp, t0);
             break;
 
         case PLOT_CH_KP:
-            if (t0 >= next_update[pp]) {
-                if (updateKp(box))
-                    next_update[pp] = nextPaneUpdate (pp, KP_INTERVAL);
-                else
-                    next_update[pp] = nextWiFiRetry(ch);
-            }
+            updateFetchPane (pp, t0);
             break;
 
         case PLOT_CH_MOON:
@@ -1901,28 +2199,18 @@ void updateWiFi(void)
         case PLOT_CH_NOAASWX:
             if (t0 >= next_update[pp]) {
                 if (updateNOAASWx(box))
-                    next_update[pp] = nextPaneUpdate (pp, NOAASWX_INTERVAL);
+                    next_update[pp] = nextPaneUpdate (pp, freshInterval (NOAASWX_INTERVAL));
                 else
                     next_update[pp] = nextWiFiRetry(ch);
             }
             break;
 
         case PLOT_CH_SSN:
-            if (t0 >= next_update[pp]) {
-                if (updateSunSpots(box))
-                    next_update[pp] = nextPaneUpdate (pp, SSPOT_INTERVAL);
-                else
-                    next_update[pp] = nextWiFiRetry(ch);
-            }
+            updateFetchPane (pp, t0);
             break;
 
         case PLOT_CH_XRAY:
-            if (t0 >= next_update[pp]) {
-                if (updateXRay(box))
-                    next_update[pp] = nextPaneUpdate (pp, XRAY_INTERVAL);
-                else
-                    next_update[pp] = nextWiFiRetry(ch);
-            }
+            updateFetchPane (pp, t0);
             break;
 
         case PLOT_CH_GIMBAL:
@@ -1958,19 +2246,14 @@ void updateWiFi(void)
         case PLOT_CH_SOLWIND:
             if (t0 >= next_update[pp]) {
                 if (updateSolarWind(box))
-                    next_update[pp] = nextPaneUpdate (pp, SWIND_INTERVAL);
+                    next_update[pp] = nextPaneUpdate (pp, freshInterval (SWIND_INTERVAL));
                 else
                     next_update[pp] = nextWiFiRetry(ch);
             }
             break;
 
         case PLOT_CH_DRAP:
-            if (t0 >= next_update[pp]) {
-                if (updateDRAP(box))
-                    next_update[pp] = nextPaneUpdate (pp, DRAPPLOT_INTERVAL);
-                else
-                    next_update[pp] = nextWiFiRetry(ch);
-            }
+            updateFetchPane (pp, t0);
             break;
 
         case PLOT_CH_COUNTDOWN:
@@ -1996,12 +2279,7 @@ void updateWiFi(void)
             break;
 
         case PLOT_CH_BZBT:
-            if (t0 >= next_update[pp]) { 
-                if (updateBzBt(box))
-                    next_update[pp] = nextPaneUpdate (pp, BZBT_INTERVAL);
-                else
-                    next_update[pp] = nextWiFiRetry(ch);
-            }
+            updateFetchPane (pp, t0);
             break;
 
         case PLOT_CH_POTA:
@@ -2038,6 +2316,11 @@ void updateWiFi(void)
             showRotatingBorder ();
     }
 
+#if defined(_IS_UNIX)
+    // forget background fetches no longer wanted
+    reapFetchJobs();
+#endif // _IS_UNIX
+
     // freshen ADIF memory usage
     checkADIF();
 
@@ -2198,12 +2481,12 @@ time_t getNTPUTC(const char **server)
     return (unix_s);
 }
 
-/* read next char from client.
- * return whether another character was in fact available.
+/* wait for client to have more data ready to read.
+ * return false if it disconnects or nothing arrives within 10 seconds.
  */
-bool getTCPChar (WiFiClient &client, char *cp)
+static bool waitTCPData (WiFiClient &client)
 {
-    // wait for char, avoid calling millis() if more data are already ready
+    // avoid calling millis() if more data are already ready
     if (!client.available()) {
         uint32_t t0 = millis();
         while (!client.available()) {
@@ -2222,6 +2505,17 @@ bool getTCPChar (WiFiClient &client, char *cp)
             resetWatchdog();
         }
     }
+    return (true);
+}
+
+/* read next char from client.
+ * return whether another character was in fact available.
+ */
+bool getTCPChar (WiFiClient &client, char *cp)
+{
+    // wait for char
+    if (!waitTCPData (client))
+        return (false);
 
     // read, which offers yet another way to indicate failure
     int c = client.read();
@@ -2235,14 +2529,44 @@ bool getTCPChar (WiFiClient &client, char *cp)
     return (true);
 }
 
-/* send User-Agent to client
+/* read n bytes from client into buf, using bulk reads rather than one getTCPChar() at a time.
+ * return count actually read, which will be less than n only if the client disconnects or times out.
  */
-void sendUserAgent (WiFiClient &client)
+size_t getTCPBytes (WiFiClient &client, uint8_t *buf, size_t n)
 {
-    StackMalloc ua_mem(300);
-    char *ua = (char *) ua_mem.getMem();
-    size_t ual = ua_mem.getSize();
+    size_t n_read = 0;
+    while (n_read < n) {
+        if (!waitTCPData (client))
+            break;
+        int nr = client.read (buf + n_read, n - n_read);
+        if (nr < 0) {
+            Serial.print (F("bad getTCPBytes read\n"));
+            break;
+        }
+        n_read += nr;
+    }
+    return (n_read);
+}
+
+#if defined(_IS_UNIX)
+// the User-Agent most recently built by the main thread, for sendUserAgent() in other threads
+static char ua_cache[300];                                      // same size as in sendUserAgent()
+static pthread_mutex_t ua_lock = PTHREAD_MUTEX_INITIALIZER;     // guards ua_cache
+#endif // _IS_UNIX
+
+/* fill ua with the short User-Agent, which any thread may build.
+ */
+static void buildShortUserAgent (char *ua, size_t ual)
+{
+    snprintf (ua, ual, _FX("User-Agent: %s/%s (id %u up %lld) crc %d\r\n"),
+        platform, hc_version, ESP.getChipId(), (long long)getUptime(NULL,NULL,NULL,NULL), flash_crc_ok);
+}
 
+/* fill ua with the User-Agent describing our settings, if allowed.
+ * N.B. main thread only, this reads a great deal of state without locking
+ */
+static void buildUserAgent (char *ua, size_t ual)
+{
     if (logUsageOk()) {
 
         // display mode: 0=X11 1=fb0 2=X11full 3=X11+live 4=X11full+live 5=noX
@@ -2410,29 +2734,80 @@ void sendUserAgent (WiFiClient &client)
             path, spots,
             call_fg, call_bg, !clockTimeOk());  // default clock 0 == ok
     } else {
-        snprintf (ua, ual, _FX("User-Agent: %s/%s (id %u up %lld) crc %d\r\n"),
-            platform, hc_version, ESP.getChipId(), (long long)getUptime(NULL,NULL,NULL,NULL), flash_crc_ok);
+        buildShortUserAgent (ua, ual);
     }
+}
+
+/* send User-Agent to client.
+ * on UNIX only the main thread builds it, other threads send the one it built last, if any.
+ */
+void sendUserAgent (WiFiClient &client)
+{
+    StackMalloc ua_mem(300);
+    char *ua = (char *) ua_mem.getMem();
+    size_t ual = ua_mem.getSize();
+
+#if defined(_IS_UNIX)
+    if (onMainThread()) {
+        buildUserAgent (ua, ual);
+        pthread_mutex_lock (&ua_lock);
+            strcpy (ua_cache, ua);
+        pthread_mutex_unlock (&ua_lock);
+    } else {
+        pthread_mutex_lock (&ua_lock);
+            strcpy (ua, ua_cache);
+        pthread_mutex_unlock (&ua_lock);
+        if (!ua[0])
+            buildShortUserAgent (ua, ual);
+    }
+#else
+    buildUserAgent (ua, ual);
+#endif // _IS_UNIX
 
     // send
     client.print(ua);
-
 }
 
-/* issue an HTTP Get for an arbitary page
+/* issue an HTTP Get for an arbitary page, adding xhdrs unless NULL, each line ending with \r\n
  */
-void httpGET (WiFiClient &client, const char *server, const char *page)
+void httpGET (WiFiClient &client, const char *server, const char *page, const char *xhdrs)
 {
     resetWatchdog();
 
+#if defined(_IS_UNIX)
+    // persistent so the next connect() to server can reuse this connection once the response is read.
+    // send as one write else Nagle would hold back all but the first piece on a reused connection.
+    client.holdWrites();
+    FWIFIPR (client, F("GET ")); client.print(page); FWIFIPRLN (client, F(" HTTP/1.1"));
+    FWIFIPR (client, F("Host: ")); client.println (server);
+    sendUserAgent (client);
+    if (xhdrs)
+        client.print (xhdrs);
+    FWIFIPRLN (client, F("Connection: keep-alive\r\n"));
+    int n_req;
+    uint8_t *req = client.releaseWrites (&n_req);
+    client.write (req, n_req);
+    free (req);
+    client.httpKeepAlive();
+#else
     FWIFIPR (client, F("GET ")); client.print(page); FWIFIPRLN (client, F(" HTTP/1.0"));
     FWIFIPR (client, F("Host: ")); client.println (server);
     sendUserAgent (client);
+    if (xhdrs)
+        client.print (xhdrs);
     FWIFIPRLN (client, F("Connection: close\r\n"));
+#endif
 
     resetWatchdog();
 }
 
+/* issue an HTTP Get for an arbitary page
+ */
+void httpGET (WiFiClient &client, const char *server, const char *page)
+{
+    httpGET (client, server, page, NULL);
+}
+
 /* issue an HTTP Get to a /ham/HamClock page named in ram
  */
 void httpHCGET (WiFiClient &client, const char *server, const char *hc_page)
@@ -2481,27 +2856,35 @@ bool httpSkipHeader (WiFiClient &client, const char *header, char *value, int va
 }
 
 /* same but when we don't care about any header field;
- * so we pick up Remote_Addr for postDiags()
+ * so we pick up Remote_Addr for postDiags(), but only on the main thread which owns remote_addr.
  */
 bool httpSkipHeader (WiFiClient &client)
 {
+#if defined(_IS_UNIX)
+    if (!onMainThread())
+        return (httpSkipHeader (client, NULL, NULL, 0));
+#endif // _IS_UNIX
+
     return (httpSkipHeader (client, _FX("Remote_Addr: "), remote_addr, sizeof(remote_addr)));
 }
 
-/* retrieve and plot latest and predicted DRAP indices, return whether all ok
+/* plot the given DRAP data in box, else an error message if !ok.
+ * a[0] is hours ago, a[1] is max MHz as of time t.
+ * return ok.
  */
-static bool updateDRAP (SBox &box)
+static bool plotDRAP (const SBox &box, bool ok, time_t t, float *a[])
 {
-    StackMalloc x_mem(DRAPDATA_NPTS*sizeof(float));
-    StackMalloc y_mem(DRAPDATA_NPTS*sizeof(float));
-    float *x = (float*)x_mem.getMem();
-    float *y = (float*)y_mem.getMem();
+    float *x = a[0];
+    float *y = a[1];
 
-    bool ok = retrieveDRAP (x, y);
     if (ok) {
         updateClocks(false);
         resetWatchdog();
 
+        // capture for getSpaceWeather()
+        drap_spw = y[DRAPDATA_NPTS-1];
+        drap_update = t;
+
         // plot
         plotXY (box, x, y, DRAPDATA_NPTS, _FX("Hours"), _FX("DRAP, max MHz"), DRAPPLOT_COLOR,
                                                             0, 0, y[DRAPDATA_NPTS-1]);
@@ -2511,6 +2894,7 @@ static bool updateDRAP (SBox &box)
             drawSpaceStats(RA8875_BLACK);
 
     } else {
+        drap_spw = SPW_ERR;
         plotMessage (box, DRAPPLOT_COLOR, _FX("DRAP connection failed"));
     }
 
@@ -2519,21 +2903,24 @@ static bool updateDRAP (SBox &box)
     return (ok);
 }
 
-/* retrieve and plot latest and predicted kp indices, return whether all ok
+/* plot the given latest and predicted kp indices in box, else an error message if !ok.
+ * a[0] is days ago, a[1] is Kp.
+ * return ok.
  */
-static bool updateKp(SBox &box)
+static bool plotKp (const SBox &box, bool ok, time_t t, float *a[])
 {
     // data are provided every 3 hours == 8/day. collect 7 days of history + 2 days of predictions
-    StackMalloc kpx_mem(KP_NV*sizeof(float));
-    StackMalloc kp_mem(KP_NV*sizeof(float));
-    float *kpx = (float*)kpx_mem.getMem();              // days ago
-    float *kp = (float*)kp_mem.getMem();                // kp collection
+    float *kpx = a[0];
+    float *kp = a[1];
 
-    bool ok = retrieveKp (kpx, kp);
     if (ok) {
         updateClocks(false);
         resetWatchdog();
 
+        // save current (not last!) value for getSpaceWeather()
+        kp_spw = kp[KP_NOWI];
+        kp_update = t;
+
         // plot
         plotXY (box, kpx, kp, KP_NV, _FX("Days"), _FX("Planetary Kp"), KP_COLOR, 0, 9, kp_spw);
 
@@ -2542,6 +2929,7 @@ static bool updateKp(SBox &box)
             drawSpaceStats(RA8875_BLACK);
 
     } else {
+        kp_spw = SPW_ERR;
         plotMessage (box, KP_COLOR, _FX("Kp connection failed"));
     }
 
@@ -2550,22 +2938,24 @@ static bool updateKp(SBox &box)
     return (ok);
 }
 
-/* retrieve and plot latest xray indices, return whether all ok
+/* plot the given xray indices in box, else an error message if !ok.
+ * a[0] is log long wavelength, a[1] log short wavelength, a[2] hours ago.
+ * return ok.
  */
-static bool updateXRay(const SBox &box)
+static bool plotXRay (const SBox &box, bool ok, time_t t, float *a[])
 {
-    StackMalloc lxray_mem(XRAY_NV*sizeof(float));
-    StackMalloc sxray_mem(XRAY_NV*sizeof(float));
-    StackMalloc x_mem(XRAY_NV*sizeof(float));
-    float *lxray = (float *) lxray_mem.getMem();        // long wavelength values
-    float *sxray = (float *) sxray_mem.getMem();        // short wavelength values
-    float *x = (float *) x_mem.getMem();                // x coords of plot
+    float *lxray = a[0];                                // long wavelength values
+    float *sxray = a[1];                                // short wavelength values
+    float *x = a[2];                                    // x coords of plot
 
-    bool ok = retrieveXRay (lxray, sxray, x);
     if (ok) {
         updateClocks(false);
         resetWatchdog();
 
+        // capture for getSpaceWeather() and drawSpaceStats()
+        xray_spw = powf (10.0F, lxray[XRAY_NV-1]);
+        xray_update = t;
+
         // overlay short over long with fixed y axis
         char level_str[10];
         plotXYstr (box, x, lxray, XRAY_NV, _FX("Hours"), _FX("GOES 16 X-Ray"), XRAY_LCOLOR,
@@ -2578,6 +2968,7 @@ static bool updateXRay(const SBox &box)
             drawSpaceStats(RA8875_BLACK);
 
     } else {
+        xray_spw = SPW_ERR;
         plotMessage (box, XRAY_LCOLOR, _FX("X-Ray connection failed"));
     }
 
@@ -2586,22 +2977,23 @@ static bool updateXRay(const SBox &box)
     return (ok);
 }
 
-/* retrieve and plot fresh sun spot indices
+/* plot the given sun spot indices in box, else an error message if !ok.
+ * a[0] is days ago, a[1] is SSN.
+ * return ok.
  */
-static bool updateSunSpots (const SBox &box)
+static bool plotSunSpots (const SBox &box, bool ok, time_t t, float *a[])
 {
-    StackMalloc x_ssn((SSPOT_NV)*sizeof(float));
-    StackMalloc x_x((SSPOT_NV)*sizeof(float));
-    float *ssn = (float*)x_ssn.getMem();
-    float *x = (float*)x_x.getMem();
+    float *x = a[0];
+    float *ssn = a[1];
 
-    // get and plot if ok, else show err message
-    resetWatchdog();
-    bool ok = retrieveSunSpots (x, ssn);
     if (ok) {
         updateClocks(false);
         resetWatchdog();
 
+        // capture latest for getSpaceWeather() and drawSpaceStats()
+        ssn_spw = ssn[SSPOT_NV-1];
+        ssn_update = t;
+
         // plot, showing value as traditional whole number
         char label[20];
         snprintf (label, sizeof(label), "%.0f", ssn[SSPOT_NV-1]);
@@ -2612,6 +3004,7 @@ static bool updateSunSpots (const SBox &box)
             drawSpaceStats(RA8875_BLACK);
 
     } else {
+        ssn_spw = SPW_ERR;
         plotMessage (box, SSPOT_COLOR, _FX("SSN connection failed"));
     }
 
@@ -2620,21 +3013,23 @@ static bool updateSunSpots (const SBox &box)
     return (ok);
 }
 
-/* retrieve and plot latest and predicted solar flux indices, return whether all ok.
+/* plot the given latest and predicted solar flux indices in box, else an error message if !ok.
+ * a[0] is days ago, a[1] is flux.
+ * return ok.
  */
-static bool updateSolarFlux(const SBox &box)
+static bool plotSolarFlux (const SBox &box, bool ok, time_t t, float *a[])
 {
-    StackMalloc x_mem(SFLUX_NV*sizeof(float));
-    StackMalloc sflux_mem(SFLUX_NV*sizeof(float));
-    float *x = (float *) x_mem.getMem();
-    float *sflux = (float *) sflux_mem.getMem();
+    float *x = a[0];
+    float *sflux = a[1];
 
-    // get flux and plot if ok
-    bool ok = retrievSolarFlux(x, sflux);
     if (ok) {
         updateClocks(false);
         resetWatchdog();
 
+        // capture current value for getSpaceWeather() and drawSpaceStats()
+        sflux_spw = sflux[SFLUX_NV-10];                 // current value, not predictions
+        sflux_update = t;
+
         // plot
         plotXY (box, x, sflux, SFLUX_NV, _FX("Days"), _FX("10.7 cm Solar flux"),
                                                 SFLUX_COLOR, 0, 0, sflux[SFLUX_NV-10]);
@@ -2644,6 +3039,7 @@ static bool updateSolarFlux(const SBox &box)
             drawSpaceStats(RA8875_BLACK);
 
     } else {
+        sflux_spw = SPW_ERR;
         plotMessage (box, SFLUX_COLOR, _FX("Flux connection failed"));
     }
 
@@ -2673,19 +3069,10 @@ static bool updateSolarWind(const SBox &box)
 
     Serial.println (swind_page);
     resetWatchdog();
-    if (wifiOk() && swind_client.connect(backend_host, backend_port)) {
+    if (httpCacheHCGET (swind_client, swind_page)) {
         updateClocks(false);
         resetWatchdog();
 
-        // query web page
-        httpHCPGET (swind_client, backend_host, swind_page);
-
-        // skip response header
-        if (!httpSkipHeader (swind_client)) {
-            plotMessage (box, SWIND_COLOR, _FX("Wind header short"));
-            goto out;
-        }
-
         // read lines into wind array and build corresponding x/y values
         time_t t0 = myNow();
         time_t start_t = t0 - SOLWINDP;
@@ -2750,22 +3137,25 @@ out:
     return (ok);
 }
 
-/* retrieve and plot latest BZBT indices, return whether all ok
+/* plot the given BZBT indices in box, else an error message if !ok.
+ * a[0] is hours old as of time t, a[1] is Bz, a[2] is Bt.
+ * return ok.
  */
-static bool updateBzBt (const SBox &box)
+static bool plotBzBt (const SBox &box, bool ok, time_t t, float *a[])
 {
-    StackMalloc hrsold_mem(BZBT_NV*sizeof(float));
-    StackMalloc bz_mem(BZBT_NV*sizeof(float));
-    StackMalloc bt_mem(BZBT_NV*sizeof(float));
-    float *hrsold = (float *) hrsold_mem.getMem();      // hours old
-    float *bz = (float *) bz_mem.getMem();              // Bz
-    float *bt = (float *) bt_mem.getMem();              // Bt
+    float *hrsold = a[0];                               // hours old
+    float *bz = a[1];                                   // Bz
+    float *bt = a[2];                                   // Bt
 
-    bool ok = retrieveBzBt (hrsold, bz, bt);
     if (ok) {
         updateClocks(false);
         resetWatchdog();
 
+        // capture latest for getSpaceWeather() and drawSpaceStats()
+        bz_spw = bz[BZBT_NV-1];
+        bt_spw = bt[BZBT_NV-1];
+        bzbt_update = t + 3600*hrsold[BZBT_NV-1];
+
         // find first within 25 hours thence min/max over both
         float min_bzbt = 1e10, max_bzbt = -1e10;
         int f25 = -1;
@@ -2793,6 +3183,7 @@ static bool updateBzBt (const SBox &box)
 
     } else {
 
+        bz_spw = bt_spw = SPW_ERR;
         plotMessage (box, BZBT_BZCOLOR, _FX("BzBt update error"));
     }
 
@@ -2941,44 +3332,35 @@ static bool updateNOAASWx(const SBox &box)
     // read scales
     Serial.println(noaaswx_page);
     resetWatchdog();
-    if (wifiOk() && noaaswx_client.connect(backend_host, backend_port)) {
+    if (httpCacheHCGET (noaaswx_client, noaaswx_page)) {
 
         resetWatchdog();
         updateClocks(false);
 
-        // fetch page
-        httpHCPGET (noaaswx_client, backend_host, noaaswx_page);
-
-        // skip header then read the data lines
-        if (httpSkipHeader (noaaswx_client)) {
+        // read the data lines
+        for (int i = 0; i < N_NOAASW_C; i++) {
 
-            for (int i = 0; i < N_NOAASW_C; i++) {
-
-                // read next line
-                if (!getTCPLine (noaaswx_client, line, sizeof(line), NULL)) {
-                    plotMessage (box, RA8875_RED, _FX("NOAASW missing data"));
-                    goto out;
-                }
-                // Serial.printf (_FX("NOAA: %d %s\n"), i, line);
+            // read next line
+            if (!getTCPLine (noaaswx_client, line, sizeof(line), NULL)) {
+                plotMessage (box, RA8875_RED, _FX("NOAASW missing data"));
+                goto out;
+            }
+            // Serial.printf (_FX("NOAA: %d %s\n"), i, line);
 
-                // parse
-                // sprintf (line, _FX("%c 1 2 3 4"), 'A'+i);  // test line
-                if (sscanf (line, _FX("%c %d %d %d %d"), &noaa_spw.cat[i], &noaa_spw.val[i][0],
-                                &noaa_spw.val[i][1], &noaa_spw.val[i][2], &noaa_spw.val[i][3]) != 5) {
-                    plotMessage (box, RA8875_RED, line);
-                    goto out;
-                }
+            // parse
+            // sprintf (line, _FX("%c 1 2 3 4"), 'A'+i);  // test line
+            if (sscanf (line, _FX("%c %d %d %d %d"), &noaa_spw.cat[i], &noaa_spw.val[i][0],
+                            &noaa_spw.val[i][1], &noaa_spw.val[i][2], &noaa_spw.val[i][3]) != 5) {
+                plotMessage (box, RA8875_RED, line);
+                goto out;
             }
+        }
 
-            // all ok: mark for getSpaceWeather() and display
-            noaa_update = myNow();
-            plotNOAASWx (box, noaa_spw);
-            ok = true;
+        // all ok: mark for getSpaceWeather() and display
+        noaa_update = myNow();
+        plotNOAASWx (box, noaa_spw);
+        ok = true;
 
-        } else {
-            plotMessage (box, RA8875_RED, _FX("NOAASW header short"));
-            goto out;
-        }
     } else
         plotMessage (box, RA8875_RED, _FX("NOAASW connection failed"));
 
@@ -3024,20 +3406,11 @@ static bool updateRSS ()
         
         Serial.println(rss_page);
         resetWatchdog();
-        if (wifiOk() && rss_client.connect(backend_host, backend_port)) {
+        if (httpCacheHCGET (rss_client, rss_page)) {
 
             resetWatchdog();
             updateClocks(false);
 
-            // fetch feed page
-            httpHCPGET (rss_client, backend_host, rss_page);
-
-            // skip response header
-            if (!httpSkipHeader (rss_client)) {
-                Serial.println (F("RSS header short"));
-                goto out;
-            }
-
             // get up to RSS_MAXN more rss_titles[]
             for (n_rss_titles = 0; n_rss_titles < RSS_MAXN; n_rss_titles++) {
                 if (!getTCPLine (rss_client, line, line_mem.getSize(), NULL))
@@ -3151,6 +3524,34 @@ bool getTCPLine (WiFiClient &client, char line[], uint16_t line_len, uint16_t *l
 
     // read until find \n or time out.
     uint16_t i = 0;
+
+#if defined(_IS_UNIX)
+
+    // copy whole runs from the client's buffer at once
+    while (true) {
+        if (!waitTCPData (client))
+            return (false);
+        bool eol;
+        int nr = client.readUntil ('\n', line+i, line_len-i, &eol);
+        if (nr < 0)
+            return (false);
+
+        // discard any \r from the new portion
+        char *np = &line[i];
+        for (int j = 0; j < nr; j++)
+            if (np[j] != '\r')
+                line[i++] = np[j];
+
+        if (eol) {
+            line[i] = '\0';
+            if (ll)
+                *ll = i;
+            return (true);
+        }
+    }
+
+#else
+
     while (true) {
         char c;
         if (!getTCPChar (client, &c))
@@ -3166,6 +3567,8 @@ bool getTCPLine (WiFiClient &client, char line[], uint16_t line_len, uint16_t *l
         } else if (i < line_len)
             line[i++] = c;
     }
+
+#endif // _IS_UNIX
 }
 
 /* convert an array of 4 big-endian network-order bytes into a uint32_t
@@ -3213,6 +3616,12 @@ bool wifiOk()
     if (WiFi.status() == WL_CONNECTED)
         return (true);
 
+#if defined(_IS_UNIX)
+    // leave reconnecting to the main thread
+    if (fetch_worker)
+        return (false);
+#endif // _IS_UNIX
+
     // retry occasionally
     static uint32_t last_wifi;
     if (timesUp (&last_wifi, WIFI_RETRY*1000)) {
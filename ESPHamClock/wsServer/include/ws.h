@@ -33,6 +33,15 @@ extern "C" {
 	#include <stdbool.h>
 	#include <stdint.h>
 	#include <inttypes.h>
+	#ifndef _WIN32
+	#include <sys/uio.h>
+	#else
+	struct iovec
+	{
+		void *iov_base;
+		size_t iov_len;
+	};
+	#endif
 
 	/**
 	 * @name Global configurations
@@ -263,6 +272,9 @@ extern "C" {
 		ws_cli_conn_t *cli, const char *msg, uint64_t size, int type);
 	extern int ws_sendframe_txt(ws_cli_conn_t *cli, const char *msg);
 	extern int ws_sendframe_bin(ws_cli_conn_t *cli, const char *msg, uint64_t size);
+	extern int ws_sendframev(
+		ws_cli_conn_t *cli, const struct iovec *msgs, int n_msgs, int type);
+	extern int ws_sendframev_bin(ws_cli_conn_t *cli, const struct iovec *msgs, int n_msgs);
 	extern int ws_get_state(ws_cli_conn_t *cli);
 	extern int ws_close_client(ws_cli_conn_t *cli);
 	extern int ws_socket(struct ws_events *evs, uint16_t port, int thread_loop,
@@ -32,6 +32,7 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <limits.h>
 #else
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -285,6 +286,90 @@ static ssize_t send_all(
 	return (ret);
 }
 
+/**
+ * @brief Send all of the given buffers @p iov on the socket of
+ * @p client, in order, with as few system calls as possible.
+ *
+ * @param client Target client.
+ * @param iov Buffers to be sent, modified as they are consumed.
+ * @param iovcnt Number of buffers.
+ * @param flags Send flags.
+ *
+ * @return If success (i.e: all buffers were sent), returns
+ * the amount of bytes sent. Otherwise, -1.
+ */
+static ssize_t send_allv(
+	ws_cli_conn_t *client, struct iovec *iov, int iovcnt, int flags)
+{
+	ssize_t ret;
+	ssize_t r;
+
+	ret = 0;
+
+	/* Sanity check. */
+	if (!CLIENT_VALID(client))
+		return (-1);
+
+#ifdef _WIN32
+	/* No scatter-gather, just send each in turn. */
+	for (int i = 0; i < iovcnt; i++)
+	{
+		r = send_all(client, iov[i].iov_base, iov[i].iov_len, flags);
+		if (r == -1)
+			return (-1);
+		ret += r;
+	}
+#else
+	struct msghdr mh;
+
+	/* clang-format off */
+	pthread_mutex_lock(&client->mtx_snd);
+		while (iovcnt > 0)
+		{
+			/* Skip any empty or finished buffers. */
+			if (iov->iov_len == 0)
+			{
+				iov++;
+				iovcnt--;
+				continue;
+			}
+
+			memset(&mh, 0, sizeof(mh));
+			mh.msg_iov    = iov;
+			mh.msg_iovlen = iovcnt > IOV_MAX ? IOV_MAX : iovcnt;
+			r = sendmsg(client->client_sock, &mh, flags);
+			if (r == -1)
+			{
+				pthread_mutex_unlock(&client->mtx_snd);
+				return (-1);
+			}
+			ret += r;
+
+			/* Advance past whatever was sent. */
+			while (r > 0)
+			{
+				if ((size_t)r >= iov->iov_len)
+				{
+					r -= iov->iov_len;
+					iov->iov_len = 0;
+					iov++;
+					iovcnt--;
+				}
+				else
+				{
+					iov->iov_base = (char *)iov->iov_base + r;
+					iov->iov_len -= r;
+					r = 0;
+				}
+			}
+		}
+	pthread_mutex_unlock(&client->mtx_snd);
+	/* clang-format on */
+#endif
+
+	return (ret);
+}
+
 /**
  * @brief Close client connection (no close handshake, this should
  * be done earlier), set appropriate state and destroy mutexes.
@@ -448,42 +533,24 @@ char *ws_getaddress(ws_cli_conn_t *client)
 }
 
 /**
- * @brief Creates and send an WebSocket frame with some payload data.
- *
- * This routine is intended to be used to create a websocket frame for
- * a given type e sending to the client. For higher level routines,
- * please check @ref ws_sendframe_txt and @ref ws_sendframe_bin.
+ * @brief Fills @p frame with the WebSocket frame header for a payload
+ * of @p length bytes of the given @p type.
  *
- * @param client Target to be send. If NULL, broadcast the message.
- * @param msg    Message to be send.
- * @param size   Binary message size.
+ * @param frame  Target buffer, at least 10 bytes.
+ * @param length Payload length.
  * @param type   Frame type.
  *
- * @return Returns the number of msg bytes written, -1 if error.
- *
- * @note If @p size is -1, it is assumed that a text frame is being sent,
- * otherwise, a binary frame. In the later case, the @p size is used.
+ * @return Returns the number of header bytes used.
  */
-int ws_sendframe(ws_cli_conn_t *client, const char *msg, uint64_t size, int type)
+static int make_frame_header(unsigned char *frame, uint64_t length, int type)
 {
-	unsigned char *response; /* Response data.     */
-	unsigned char frame[10]; /* Frame.             */
-	uint8_t idx_first_rData; /* Index data.        */
-	uint64_t length;         /* Message length.    */
-	int idx_response;        /* Index response.    */
-	ssize_t output;          /* Bytes sent.        */
-	ssize_t send_ret;        /* Ret send function  */
-	uint64_t i;              /* Loop index.        */
-	ws_cli_conn_t *cli;      /* Client.            */
-
 	frame[0] = (WS_FIN | type);
-	length = (uint64_t)size;
 
 	/* Split the size between octets. */
 	if (length <= 125)
 	{
 		frame[1] = length & 0x7F;
-		idx_first_rData = 2;
+		return (2);
 	}
 
 	/* Size between 126 and 65535 bytes. */
@@ -492,49 +559,80 @@ int ws_sendframe(ws_cli_conn_t *client, const char *msg, uint64_t size, int type
 		frame[1] = 126;
 		frame[2] = (length >> 8) & 255;
 		frame[3] = length & 255;
-		idx_first_rData = 4;
+		return (4);
 	}
 
 	/* More than 65535 bytes. */
-	else
-	{
-		frame[1] = 127;
-		frame[2] = (unsigned char)((length >> 56) & 255);
-		frame[3] = (unsigned char)((length >> 48) & 255);
-		frame[4] = (unsigned char)((length >> 40) & 255);
-		frame[5] = (unsigned char)((length >> 32) & 255);
-		frame[6] = (unsigned char)((length >> 24) & 255);
-		frame[7] = (unsigned char)((length >> 16) & 255);
-		frame[8] = (unsigned char)((length >> 8) & 255);
-		frame[9] = (unsigned char)(length & 255);
-		idx_first_rData = 10;
-	}
+	frame[1] = 127;
+	frame[2] = (unsigned char)((length >> 56) & 255);
+	frame[3] = (unsigned char)((length >> 48) & 255);
+	frame[4] = (unsigned char)((length >> 40) & 255);
+	frame[5] = (unsigned char)((length >> 32) & 255);
+	frame[6] = (unsigned char)((length >> 24) & 255);
+	frame[7] = (unsigned char)((length >> 16) & 255);
+	frame[8] = (unsigned char)((length >> 8) & 255);
+	frame[9] = (unsigned char)(length & 255);
+	return (10);
+}
 
-	/* Add frame bytes. */
-	idx_response = 0;
-	response = (unsigned char *) malloc(sizeof(unsigned char) * (idx_first_rData + length + 1));
-	if (!response)
-		return (-1);
+/**
+ * @brief Sends each of the given payloads as its own WebSocket frame,
+ * all in one scatter-gather write straight from the caller's buffers.
+ *
+ * This is handy to send several messages back to back, with no copies
+ * and no chance of another sender slipping in between.
+ *
+ * @param client Target to be send. If NULL, broadcast the messages.
+ * @param msgs   Payload of each frame.
+ * @param n_msgs Number of frames.
+ * @param type   Frame type of each.
+ *
+ * @return Returns the number of payload bytes written, -1 if error.
+ */
+int ws_sendframev(ws_cli_conn_t *client, const struct iovec *msgs, int n_msgs, int type)
+{
+	unsigned char *frames;   /* Frame headers.     */
+	struct iovec *iov;       /* Headers, payloads. */
+	struct iovec *iov_send;  /* Copy consumed.     */
+	uint64_t n_payload;      /* Payload total.     */
+	ssize_t n_total;         /* Total to send.     */
+	ssize_t output;          /* Bytes sent.        */
+	int i;                   /* Loop index.        */
+	ws_cli_conn_t *cli;      /* Client.            */
 
-	for (i = 0; i < idx_first_rData; i++)
+	if (n_msgs <= 0)
+		return (0);
+
+	frames = (unsigned char *) malloc(10 * n_msgs);
+	iov = (struct iovec *) malloc(2 * 2 * n_msgs * sizeof(struct iovec));
+	if (!frames || !iov)
 	{
-		response[i] = frame[i];
-		idx_response++;
+		free(frames);
+		free(iov);
+		return (-1);
 	}
+	iov_send = iov + 2 * n_msgs;
 
-	/* Add data bytes. */
-	for (i = 0; i < length; i++)
+	/* Interleave each header with its payload. */
+	n_payload = 0;
+	n_total = 0;
+	for (i = 0; i < n_msgs; i++)
 	{
-		response[idx_response] = msg[i];
-		idx_response++;
+		iov[2*i].iov_base = frames + 10*i;
+		iov[2*i].iov_len = make_frame_header(frames + 10*i, msgs[i].iov_len, type);
+		iov[2*i+1] = msgs[i];
+		n_payload += msgs[i].iov_len;
+		n_total += iov[2*i].iov_len + msgs[i].iov_len;
 	}
 
-	response[idx_response] = '\0';
-
 	/* Send to the client if there is one. */
 	output = 0;
 	if (client)
-		output = SEND(client, response, idx_response);
+	{
+		memcpy(iov_send, iov, 2 * n_msgs * sizeof(struct iovec));
+		if (send_allv(client, iov_send, 2 * n_msgs, MSG_NOSIGNAL) != n_total)
+			output = -1;
+	}
 
 	/* If no client specified, broadcast to everyone. */
 	if (!client)
@@ -546,9 +644,8 @@ int ws_sendframe(ws_cli_conn_t *client, const char *msg, uint64_t size, int type
 			cli = &client_socks[i];
 			if ((cli->client_sock > -1) && get_client_state(cli) == WS_STATE_OPEN)
 			{
-				if ((send_ret = SEND(cli, response, idx_response)) != -1)
-					output += send_ret;
-				else
+				memcpy(iov_send, iov, 2 * n_msgs * sizeof(struct iovec));
+				if (send_allv(cli, iov_send, 2 * n_msgs, MSG_NOSIGNAL) != n_total)
 				{
 					output = -1;
 					break;
@@ -558,8 +655,34 @@ int ws_sendframe(ws_cli_conn_t *client, const char *msg, uint64_t size, int type
 		pthread_mutex_unlock(&mutex);
 	}
 
-	free(response);
-	return ((int)(output - idx_first_rData));
+	free(iov);
+	free(frames);
+	return (output < 0 ? -1 : (int)n_payload);
+}
+
+/**
+ * @brief Creates and send an WebSocket frame with some payload data.
+ *
+ * This routine is intended to be used to create a websocket frame for
+ * a given type e sending to the client. For higher level routines,
+ * please check @ref ws_sendframe_txt and @ref ws_sendframe_bin.
+ *
+ * @param client Target to be send. If NULL, broadcast the message.
+ * @param msg    Message to be send.
+ * @param size   Binary message size.
+ * @param type   Frame type.
+ *
+ * @return Returns the number of msg bytes written, -1 if error.
+ *
+ * @note The header and @p msg are written together without copying @p msg.
+ */
+int ws_sendframe(ws_cli_conn_t *client, const char *msg, uint64_t size, int type)
+{
+	struct iovec iov;
+
+	iov.iov_base = (void *)msg;
+	iov.iov_len = size;
+	return ws_sendframev(client, &iov, 1, type);
 }
 
 /**
@@ -707,6 +830,21 @@ int ws_sendframe_bin(ws_cli_conn_t *client, const char *msg, uint64_t size)
 	return ws_sendframe(client, msg, size, WS_FR_OP_BIN);
 }
 
+/**
+ * @brief Sends each of the given payloads as its own WebSocket binary
+ * frame, all in one scatter-gather write.
+ *
+ * @param client Target to be send. If NULL, broadcast the messages.
+ * @param msgs   Payload of each frame.
+ * @param n_msgs Number of frames.
+ *
+ * @return Returns the number of payload bytes written, -1 if error.
+ */
+int ws_sendframev_bin(ws_cli_conn_t *client, const struct iovec *msgs, int n_msgs)
+{
+	return ws_sendframev(client, msgs, n_msgs, WS_FR_OP_BIN);
+}
+
 /**
  * @brief For a given @p client, gets the current state for
  * the connection, or -1 if invalid.